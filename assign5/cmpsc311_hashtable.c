@@ -0,0 +1,361 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : cmpsc311_hashtable.c
+//  Description   : This is a generic hashtable implementation used for
+//                  data structure storage and access.
+//
+//  Author   : Patrick McDaniel
+//  Created  : Sat Sep  6 08:56:10 EDT 2014
+//
+
+// System include files
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include <cmpsc311_hashtable.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+//
+// Defines
+
+#define HT_MAX_BITS 24
+#define HT_UNIT_TEST_ITERATIONS 10000
+#define HT_UNIT_TEST_KEYS 512
+
+//
+// Local functions
+static unsigned long hashIndex( HTable *ht, HtIndexValue idx );
+static HtEntryData * findEntryInHashTable( HTable *ht, HtIndexValue idx );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initHashTable
+// Description  : This function initializes the hash table to a width of
+//                2^(bits) width
+//
+// Inputs       : ht - the hash table to initialize
+//                bits - the number of bits in the hash value
+// Outputs      : 0 if successful, -1 if failure
+
+int initHashTable( HTable *ht, uint16_t bits ) {
+
+	// Sanity check the table width
+	if ( (bits == 0) || (bits > HT_MAX_BITS) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad hash table width [%u bits]", bits );
+		return( -1 );
+	}
+
+	// Allocate the table buckets, all initially empty
+	ht->htTableSize = bits;
+	ht->elements = 0;
+	ht->hasHTable = calloc( (size_t)1 << bits, sizeof(HtEntryData *) );
+	if ( ht->hasHTable == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Hash table allocation failed [%u bits]", bits );
+		return( -1 );
+	}
+
+	// Return successfully
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cleanupHashTable
+// Description  : Cleanup the hash table (note: does not free the blocks)
+//
+// Inputs       : ht - the hash table to cleanup
+// Outputs      : 0 if successful, -1 if failure
+
+int cleanupHashTable( HTable *ht ) {
+
+	// Local variables
+	unsigned long i;
+	HtEntryData *entry, *next;
+
+	// Nothing to do if never initialized
+	if ( ht->hasHTable == NULL ) {
+		return( 0 );
+	}
+
+	// Walk each of the chains, freeing the entries
+	for ( i=0; i<((unsigned long)1<<ht->htTableSize); i++ ) {
+		entry = ht->hasHTable[i];
+		while ( entry != NULL ) {
+			next = entry->next;
+			free( entry );
+			entry = next;
+		}
+	}
+
+	// Free the table itself, return successfully
+	free( ht->hasHTable );
+	ht->hasHTable = NULL;
+	ht->elements = 0;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : insertValueInHashTable
+// Description  : Insert a value into the hashtable of value idx, block size blk
+//
+// Inputs       : ht - the hash table to insert into
+//                idx - the index value of the item
+//                blk - the data block to store
+// Outputs      : 0 if successful, -1 if failure (including duplicate)
+
+int insertValueInHashTable( HTable *ht, HtIndexValue idx, void *blk ) {
+
+	// Local variables
+	unsigned long bucket;
+	HtEntryData *entry;
+
+	// Check for a duplicate entry
+	if ( findEntryInHashTable(ht, idx) != NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Hash table insert of existing index [%lu]", idx );
+		return( -1 );
+	}
+
+	// Create the new entry
+	if ( (entry = malloc(sizeof(HtEntryData))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Hash table entry allocation failed [%lu]", idx );
+		return( -1 );
+	}
+	entry->cookie = HT_COOKIE_VALUE;
+	entry->index = idx;
+	entry->block = blk;
+
+	// Push it onto the front of the chain
+	bucket = hashIndex( ht, idx );
+	entry->prev = NULL;
+	entry->next = ht->hasHTable[bucket];
+	if ( entry->next != NULL ) {
+		entry->next->prev = entry;
+	}
+	ht->hasHTable[bucket] = entry;
+	ht->elements ++;
+
+	// Return successfully
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findValueInHashTable
+// Description  : Find a block for a particular index value in the table
+//
+// Inputs       : ht - the hash table to search
+//                idx - the index value to look for
+// Outputs      : the block if found, NULL otherwise
+
+void * findValueInHashTable( HTable *ht, HtIndexValue idx ) {
+
+	// Find the entry, return the block
+	HtEntryData *entry = findEntryInHashTable( ht, idx );
+	return( (entry == NULL) ? NULL : entry->block );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : deleteValueFromHashTable
+// Description  : Delete a value from the hashtable of value idx, return it
+//
+// Inputs       : ht - the hash table to delete from
+//                idx - the index value to remove
+// Outputs      : the block removed, NULL if not found
+
+void * deleteValueFromHashTable( HTable *ht, HtIndexValue idx ) {
+
+	// Local variables
+	HtEntryData *entry;
+	void *blk;
+
+	// Find the entry to remove
+	if ( (entry = findEntryInHashTable(ht, idx)) == NULL ) {
+		return( NULL );
+	}
+
+	// Unlink it from the chain
+	if ( entry->prev != NULL ) {
+		entry->prev->next = entry->next;
+	} else {
+		ht->hasHTable[hashIndex(ht, idx)] = entry->next;
+	}
+	if ( entry->next != NULL ) {
+		entry->next->prev = entry->prev;
+	}
+	ht->elements --;
+
+	// Free the entry, return the block
+	blk = entry->block;
+	entry->cookie = 0;
+	free( entry );
+	return( blk );
+}
+
+//
+// Iterator Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initHashTableIterator
+// Description  : Initialize the iterator
+//
+// Inputs       : ht - the hash table to iterate over
+//                it - the iterator to initialize
+// Outputs      : 0 if successful, -1 if failure
+
+int initHashTableIterator( HTable *ht, HtIterator *it ) {
+
+	// Start before the first bucket
+	it->table = ht;
+	it->idx = 0;
+	it->ptr = NULL;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : iterateHashTable
+// Description  : Iterate through the hash table, returns the next value in
+//                the table (note: values must not be deleted while iterating)
+//
+// Inputs       : it - the iterator
+// Outputs      : the next value, NULL if no more values
+
+void * iterateHashTable( HtIterator *it ) {
+
+	// Local variables
+	unsigned long buckets = (unsigned long)1 << it->table->htTableSize;
+
+	// Move along the current chain if we can
+	if ( it->ptr != NULL ) {
+		it->ptr = it->ptr->next;
+		if ( it->ptr == NULL ) {
+			it->idx ++;
+		}
+	}
+
+	// Otherwise find the next non-empty bucket
+	while ( (it->ptr == NULL) && (it->idx < buckets) ) {
+		it->ptr = it->table->hasHTable[it->idx];
+		if ( it->ptr == NULL ) {
+			it->idx ++;
+		}
+	}
+
+	// Return the value (or NULL if done)
+	return( (it->ptr == NULL) ? NULL : it->ptr->block );
+}
+
+//
+// Unit Testing
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashTableUnitTest
+// Description  : Perform a test of the hash table functionality
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int hashTableUnitTest( void ) {
+
+	// Local variables
+	HTable ht;
+	HtIterator it;
+	uintptr_t mirror[HT_UNIT_TEST_KEYS];
+	uint32_t count, elements = 0;
+	void *blk;
+	int i, key;
+
+	// Setup the table and the mirror values
+	memset( mirror, 0x0, sizeof(mirror) );
+	if ( initHashTable(&ht, 6) ) {
+		logMessage( LOG_ERROR_LEVEL, "HT_UNIT_TEST : init failed." );
+		return( -1 );
+	}
+
+	// Do a bunch of random insert/find/delete operations
+	for ( i=0; i<HT_UNIT_TEST_ITERATIONS; i++ ) {
+		key = getRandomValue( 1, HT_UNIT_TEST_KEYS-1 );
+		blk = findValueInHashTable( &ht, key );
+		if ( (uintptr_t)blk != mirror[key] ) {
+			logMessage( LOG_ERROR_LEVEL, "HT_UNIT_TEST : find mismatch [%d]", key );
+			return( -1 );
+		}
+
+		if ( mirror[key] == 0 ) {
+			mirror[key] = (uintptr_t)getRandomValue( 1, 0xffff );
+			if ( insertValueInHashTable(&ht, key, (void *)mirror[key]) ) {
+				logMessage( LOG_ERROR_LEVEL, "HT_UNIT_TEST : insert failed [%d]", key );
+				return( -1 );
+			}
+			elements ++;
+		} else {
+			if ( (uintptr_t)deleteValueFromHashTable(&ht, key) != mirror[key] ) {
+				logMessage( LOG_ERROR_LEVEL, "HT_UNIT_TEST : delete failed [%d]", key );
+				return( -1 );
+			}
+			mirror[key] = 0;
+			elements --;
+		}
+	}
+
+	// Now make sure the iterator walks each of the elements once
+	count = 0;
+	initHashTableIterator( &ht, &it );
+	while ( iterateHashTable(&it) != NULL ) {
+		count ++;
+	}
+	if ( (count != elements) || (ht.elements != elements) ) {
+		logMessage( LOG_ERROR_LEVEL, "HT_UNIT_TEST : iterator count mismatch [%u!=%u]", count, elements );
+		return( -1 );
+	}
+
+	// Cleanup, log and return successfully
+	cleanupHashTable( &ht );
+	logMessage( LOG_INFO_LEVEL, "Hash table unit test successful." );
+	return( 0 );
+}
+
+//
+// Local Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashIndex
+// Description  : Compute the bucket for an index value (multiplicative hash)
+//
+// Inputs       : ht - the hash table
+//                idx - the index value
+// Outputs      : the bucket number
+
+static unsigned long hashIndex( HTable *ht, HtIndexValue idx ) {
+	return( (unsigned long)(((uint64_t)idx * 0x9e3779b97f4a7c15ULL) >> (64 - ht->htTableSize)) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : findEntryInHashTable
+// Description  : Find the chain entry for a particular index value
+//
+// Inputs       : ht - the hash table
+//                idx - the index value
+// Outputs      : the entry if found, NULL otherwise
+
+static HtEntryData * findEntryInHashTable( HTable *ht, HtIndexValue idx ) {
+
+	// Walk the chain looking for the index
+	HtEntryData *entry = ht->hasHTable[hashIndex(ht, idx)];
+	while ( (entry != NULL) && (entry->index != idx) ) {
+		CMPSC_ASSERT1( entry->cookie == HT_COOKIE_VALUE, "Hash table corruption [%lu]", idx );
+		entry = entry->next;
+	}
+	return( entry );
+}
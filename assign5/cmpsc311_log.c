@@ -5,6 +5,18 @@
 //                  library.  It provides access enable log events,
 //                  whose levels are registered by the calling programs.
 //
+//                  The asynchronous log is a ring of slots, each with a
+//                  sequence number saying whose turn it is: the callers
+//                  claim the next slot (a compare-and-swap of the tail),
+//                  format the entry into it and mark it full, the writer
+//                  takes the full slots in order (writev) and marks them
+//                  free for the next time round the ring.  Locks and
+//                  condition variables are only taken to sleep/wake, when
+//                  the ring is empty (the writer) or full (the callers).
+//                  The writer is only woken for half a ring of entries (or
+//                  a flush), otherwise it wakes every CMPSC311_LOG_INTERVAL
+//                  msecs, so callers do not pay for a wakeup an entry.
+//
 //  Author   : Patrick McDaniel
 //  Created  : Sat Sep 14 10:19:45 EDT 2013
 //
@@ -19,6 +31,10 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include <stdint.h>
 
 // Project Include Files
 #include <cmpsc311_log.h>
@@ -33,9 +49,56 @@ int fileHandle = -1;				// This is the filehandle that we are using to write.
 int echoHandle = -1;				// This is descriptor to echo the content with
 int errored = 0;					// Is the log permanently errored?
 
+// This is a slot of the asynchronous log ring
+typedef struct {
+	unsigned long seq;                 // The position it is free for (full for, less one)
+	int           len;                 // The length of the entry
+	char          entry[MAX_LOG_MESSAGE_SIZE]; // The entry
+} LogSlot;
+
+// The asynchronous log (see above)
+static LogSlot *logRing = NULL;            // The ring (kept once made)
+static unsigned long logTail = 0;          // The next position to claim (callers)
+static unsigned long logHead = 0;          // The next position to write (writer)
+static unsigned long logWritten = 0;       // The positions written, for flushLog
+static unsigned long logDropped = 0;       // The entries dropped
+static int asyncLog = 0;                   // Flag indicating the log is asynchronous
+static int asyncPolicy = CMPSC311_LOG_BLOCK; // What the callers do when the ring is full
+static int asyncUsers = 0;                 // The callers in the ring
+static int writerSleeping = 0;             // Flag indicating the writer waits for an entry
+static int callersWaiting = 0;             // The callers waiting for a free slot
+static int flushersWaiting = 0;            // The callers waiting in flushLog
+static pthread_t logWriter;                // The writer
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logReady = PTHREAD_COND_INITIALIZER;   // An entry is full (or stopping)
+static pthread_cond_t logSpace = PTHREAD_COND_INITIALIZER;   // A slot is free
+static pthread_cond_t logFlushed = PTHREAD_COND_INITIALIZER; // Entries were written
+
+// The time stamp of the entries (the thread's last, remade each second)
+static __thread time_t logStampTime = (time_t)-1;
+static __thread char logStamp[32];
+
 // Functional prototypes
 int openLog( void );
 int closeLog( void );
+static int formatLogEntry( char *tbuf, unsigned long lvl, const char *fmt, va_list args );
+static int queueLogEntry( unsigned long lvl, const char *fmt, va_list args );
+static void *writeAsyncLog( void *arg );
+static int writeLogBatch( void );
+static int writeAllLog( int fd, struct iovec *iov, int cnt );
+static void wakeLogWriter( void );
+static void stopAsyncLogAtExit( void );
+static void *logTestThread( void *arg );
+static void *logTestReader( void *arg );
+static int logTestCheck( int exact, unsigned long *total );
+
+// The unit test (see logUnitTest)
+#define LOG_UNIT_TEST_FILE "cmpsc311_log_test.log"
+#define LOG_UNIT_TEST_THREADS 4
+#define LOG_UNIT_TEST_ENTRIES 4000
+static int logTestFd = -1;      // What the test reads back (file or pipe)
+static char *logTestBuf = NULL; // What was read back
+static size_t logTestLen = 0;   // The bytes read back
 
 //
 // Functions
@@ -105,6 +168,9 @@ void setEchoDescriptor( int eh ) {
 
 int initializeLogWithFilename( const char *logname ) {
 
+	// Write out the asynchronous log (a new log is synchronous)
+	stopAsyncLog();
+
 	// Setup library global variables
     logLevel = DEFAULT_LOG_LEVEL;
     fileHandle = -1;
@@ -133,6 +199,9 @@ int initializeLogWithFilename( const char *logname ) {
 
 int initializeLogWithFilehandle( int out ) {
 
+	// Write out the asynchronous log (a new log is synchronous)
+	stopAsyncLog();
+
 	// Setup library global variables
     logLevel = DEFAULT_LOG_LEVEL;
     fileHandle = out;
@@ -218,9 +287,8 @@ int logMessage( unsigned long lvl, const char *fmt, ...) {
 int vlogMessage( unsigned long lvl, const char *fmt, va_list args ) {
 
 	// Local variables
-    char msg[MAX_LOG_MESSAGE_SIZE], tbuf[MAX_LOG_MESSAGE_SIZE];
-    int first = 1, ret, writelen, i;
-    time_t tm;
+    char tbuf[MAX_LOG_MESSAGE_SIZE];
+    int ret, writelen;
 
 	// Bail out if not read, open file if necessary
     if ( !levelEnabled(lvl) ) {
@@ -237,47 +305,17 @@ int vlogMessage( unsigned long lvl, const char *fmt, va_list args ) {
     	return( errored );
     }
 
-    // Add header with descriptor names
-    time(&tm);
-    strncpy(tbuf, ctime((const time_t *)&tm), MAX_LOG_MESSAGE_SIZE);
-    tbuf[strlen(tbuf)-1] = 0x0;
-    strncat(tbuf, " [", MAX_LOG_MESSAGE_SIZE);
-    for ( i=0; i<MAX_LOG_LEVEL; i++ ) {
-        if ( levelEnabled((1<<i)&lvl) ) {
-
-        	// Comma separate the levels if necessary
-            if ( !first ) {
-            	strncat(tbuf, ",", MAX_LOG_MESSAGE_SIZE);
-            } else {
-            	first = 0;
-            }
-
-            // Add the level descriptor
-            if ( descriptors[i] == NULL ) {
-            	strncat(tbuf, "*BAD LEVEL*", MAX_LOG_MESSAGE_SIZE);
-            } else {
-                strncat(tbuf, descriptors[i], MAX_LOG_MESSAGE_SIZE);
-            }
-          }
-    }
-    strncat(tbuf, "] ", MAX_LOG_MESSAGE_SIZE);
-
-    // Setup the "printf" like message, get write len
-	vsnprintf( msg, MAX_LOG_MESSAGE_SIZE, fmt, args );
-    strncat(tbuf, msg, MAX_LOG_MESSAGE_SIZE);
-    writelen = strlen(tbuf);
-
-    // Check if we need to CR/LF the line
-    if ( tbuf[writelen-1] != '\n' ) {
-    	strncat(tbuf, "\n", MAX_LOG_MESSAGE_SIZE);
-        writelen = strlen(tbuf);
+    // Queue the entry if the log is asynchronous
+    if ( (ret = queueLogEntry(lvl, fmt, args)) != -1 ) {
+    	return( ret );
     }
 
     // Echo, then Write the entry to the log and return
+    writelen = formatLogEntry( tbuf, lvl, fmt, args );
     if (echoHandle != -1 ) {
     	ret = write( echoHandle, tbuf, writelen );
     }
-    if ( (ret=write(fileHandle, tbuf, strlen(tbuf))) != writelen ) {
+    if ( (ret=write(fileHandle, tbuf, writelen)) != writelen ) {
     	fprintf( stderr, "Error writing to log : %s [%s] (%d)", tbuf, logFilename, ret );
     }
     return( ret );
@@ -304,12 +342,138 @@ int logAssert( int expr, const char *file, int line, const char *fmt, ...) {
 	va_start(args, fmt);
 	int ret = vlogMessage( LOG_ERROR_LEVEL, fmt, args );
     va_end(args);
+    flushLog();
     assert( 0 );
 
     // Return the log return (UNREACHABLE)
     return( ret );
 }
 
+//
+// Asynchronous logging functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : startAsyncLog
+// Description  : Write the log on a thread of its own (flushed at exit)
+//
+// Inputs       : policy - what callers do when the ring is full,
+//                         CMPSC311_LOG_BLOCK or CMPSC311_LOG_DROP
+// Outputs      : 0 if successful, -1 if failure
+
+int startAsyncLog( int policy ) {
+
+	// Local variables
+	static int registered = 0;
+	int i;
+
+	// Already started, just change the policy
+	asyncPolicy = policy;
+	if ( __atomic_load_n(&asyncLog, __ATOMIC_SEQ_CST) ) {
+		return( 0 );
+	}
+
+	// Open the log, make the ring (the first time) with every slot free
+	if ( fileHandle == -1 ) {
+		openLog();
+	}
+	if ( errored ) {
+		return( -1 );
+	}
+	if ( (logRing == NULL) && ((logRing = malloc(sizeof(LogSlot)*CMPSC311_LOG_RING_SIZE)) == NULL) ) {
+		return( -1 );
+	}
+	for ( i=0; i<CMPSC311_LOG_RING_SIZE; i++ ) {
+		logRing[i].seq = i;
+	}
+	logTail = logHead = logWritten = logDropped = 0;
+
+	// Start the writer (writing out what got queued if it cannot be)
+	__atomic_store_n( &asyncLog, 1, __ATOMIC_SEQ_CST );
+	if ( pthread_create(&logWriter, NULL, writeAsyncLog, NULL) ) {
+		__atomic_store_n( &asyncLog, 0, __ATOMIC_SEQ_CST );
+		while ( __atomic_load_n(&asyncUsers, __ATOMIC_SEQ_CST) ) {
+			writeLogBatch();
+			sched_yield();
+		}
+		while ( writeLogBatch() > 0 );
+		fprintf( stderr, "Error starting log writer [%s]", logFilename );
+		return( -1 );
+	}
+	if ( ! registered ) {
+		atexit( stopAsyncLogAtExit );
+		registered = 1;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stopAsyncLog
+// Description  : Write out the entries queued and go back to writing on the
+//                caller
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int stopAsyncLog( void ) {
+
+	// Local variables
+	unsigned long dropped;
+
+	// The writer writes all there is, once no caller is in the ring
+	if ( !__atomic_exchange_n(&asyncLog, 0, __ATOMIC_SEQ_CST) ) {
+		return( 0 );
+	}
+	wakeLogWriter();
+	pthread_join( logWriter, NULL );
+
+	// Say if entries were lost
+	if ( (dropped = droppedLogMessages()) > 0 ) {
+		logMessage( LOG_WARNING_LEVEL, "%lu log entries dropped (the log fell behind)", dropped );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flushLog
+// Description  : Wait for the entries logged so far to be written
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int flushLog( void ) {
+
+	// Local variables
+	unsigned long target = __atomic_load_n( &logTail, __ATOMIC_SEQ_CST );
+
+	if ( !__atomic_load_n(&asyncLog, __ATOMIC_SEQ_CST) ) {
+		return( 0 );
+	}
+	wakeLogWriter();
+	pthread_mutex_lock( &logLock );
+	__atomic_add_fetch( &flushersWaiting, 1, __ATOMIC_SEQ_CST );
+	while ( __atomic_load_n(&logWritten, __ATOMIC_SEQ_CST) < target ) {
+		pthread_cond_wait( &logFlushed, &logLock );
+	}
+	__atomic_sub_fetch( &flushersWaiting, 1, __ATOMIC_SEQ_CST );
+	pthread_mutex_unlock( &logLock );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : droppedLogMessages
+// Description  : The entries dropped since the asynchronous log was started
+//
+// Inputs       : none
+// Outputs      : the number of entries dropped
+
+unsigned long droppedLogMessages( void ) {
+	return( __atomic_load_n(&logDropped, __ATOMIC_SEQ_CST) );
+}
+
 //
 // Private Interfaces
 
@@ -365,4 +529,479 @@ int closeLog( void ) {
     return( 0 );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : formatLogEntry
+// Description  : Format an entry: the time, the level descriptors, the
+//                message, ending the line (truncated to fit)
+//
+// Inputs       : tbuf - the buffer (MAX_LOG_MESSAGE_SIZE bytes)
+//                lvl - the levels logged on
+//                fmt - format (etc)
+//                args - the list of arguments for log message
+// Outputs      : the length of the entry
+
+static int formatLogEntry( char *tbuf, unsigned long lvl, const char *fmt, va_list args ) {
+
+	// Local variables
+	int first = 1, len, i;
+	time_t tm;
+
+	// Add header with the time (remade once a second) and descriptor names
+	time( &tm );
+	if ( tm != logStampTime ) {
+		ctime_r( &tm, logStamp );
+		logStamp[strlen(logStamp)-1] = 0x0;
+		logStampTime = tm;
+	}
+	len = snprintf( tbuf, MAX_LOG_MESSAGE_SIZE, "%s [", logStamp );
+	for ( i=0; i<MAX_LOG_LEVEL; i++ ) {
+		if ( levelEnabled((1<<i)&lvl) ) {
+
+			// Comma separate the levels if necessary, add the level descriptor
+			len += snprintf( &tbuf[len], MAX_LOG_MESSAGE_SIZE-len, "%s%s", first ? "" : ",",
+					(descriptors[i] == NULL) ? "*BAD LEVEL*" : descriptors[i] );
+			len = (len < MAX_LOG_MESSAGE_SIZE) ? len : MAX_LOG_MESSAGE_SIZE-1;
+			first = 0;
+		}
+	}
+	len += snprintf( &tbuf[len], MAX_LOG_MESSAGE_SIZE-len, "] " );
+	len = (len < MAX_LOG_MESSAGE_SIZE) ? len : MAX_LOG_MESSAGE_SIZE-1;
+
+	// Setup the "printf" like message
+	len += vsnprintf( &tbuf[len], MAX_LOG_MESSAGE_SIZE-len, fmt, args );
+	len = (len < MAX_LOG_MESSAGE_SIZE) ? len : MAX_LOG_MESSAGE_SIZE-1;
+
+	// Check if we need to CR/LF the line (over the last character if full)
+	if ( tbuf[len-1] != '\n' ) {
+		len = (len < MAX_LOG_MESSAGE_SIZE-1) ? len : MAX_LOG_MESSAGE_SIZE-2;
+		tbuf[len++] = '\n';
+		tbuf[len] = 0x0;
+	}
+	return( len );
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queueLogEntry
+// Description  : Queue an entry on the asynchronous log: claim the next
+//                slot (waiting for it, or dropping the entry, if the ring is
+//                full), format the entry into it and mark it full
+//
+// Inputs       : lvl - the levels logged on
+//                fmt - format (etc)
+//                args - the list of arguments for log message
+// Outputs      : the length of the entry (0 if dropped), -1 if the log is
+//                not asynchronous
+
+static int queueLogEntry( unsigned long lvl, const char *fmt, va_list args ) {
+
+	// Local variables
+	LogSlot *slot;
+	unsigned long pos;
+	long diff;
+	int len = -1;
+
+	// Enter the ring, if the log is asynchronous (the writer waits for
+	// callers in the ring before stopping)
+	__atomic_add_fetch( &asyncUsers, 1, __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n(&asyncLog, __ATOMIC_SEQ_CST) ) {
+
+		// Claim the slot at the tail, if it is free for this time round
+		pos = __atomic_load_n( &logTail, __ATOMIC_RELAXED );
+		for (;;) {
+			slot = &logRing[pos & (CMPSC311_LOG_RING_SIZE-1)];
+			diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) - pos);
+			if ( diff == 0 ) {
+				if ( __atomic_compare_exchange_n(&logTail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) {
+					break;
+				}
+			} else if ( diff > 0 ) {
+				pos = __atomic_load_n( &logTail, __ATOMIC_RELAXED );
+			} else if ( asyncPolicy == CMPSC311_LOG_DROP ) {
+				__atomic_add_fetch( &logDropped, 1, __ATOMIC_RELAXED );
+				slot = NULL;
+				break;
+			} else {
+
+				// Full, wait for the writer to free the slot
+				pthread_mutex_lock( &logLock );
+				__atomic_add_fetch( &callersWaiting, 1, __ATOMIC_SEQ_CST );
+				while ( (long)(__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) - pos) < 0 ) {
+					pthread_cond_wait( &logSpace, &logLock );
+				}
+				__atomic_sub_fetch( &callersWaiting, 1, __ATOMIC_SEQ_CST );
+				pthread_mutex_unlock( &logLock );
+				pos = __atomic_load_n( &logTail, __ATOMIC_RELAXED );
+			}
+		}
+
+		// Format the entry into it, mark it full (waking the writer if half
+		// the ring waits)
+		len = 0;
+		if ( slot != NULL ) {
+			len = slot->len = formatLogEntry( slot->entry, lvl, fmt, args );
+			__atomic_store_n( &slot->seq, pos+1, __ATOMIC_SEQ_CST );
+			if ( __atomic_load_n(&writerSleeping, __ATOMIC_SEQ_CST) &&
+				 (pos+1-__atomic_load_n(&logWritten, __ATOMIC_SEQ_CST) >= CMPSC311_LOG_RING_SIZE/2) ) {
+				wakeLogWriter();
+			}
+		}
+	}
+
+	// Leave the ring (the last out of a stopping log wakes the writer)
+	if ( (__atomic_sub_fetch(&asyncUsers, 1, __ATOMIC_SEQ_CST) == 0) &&
+		 !__atomic_load_n(&asyncLog, __ATOMIC_SEQ_CST) ) {
+		wakeLogWriter();
+	}
+	return( len );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeAsyncLog
+// Description  : The writer of the asynchronous log: write the full slots
+//                as they come, until stopped (and the ring is empty)
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+static void *writeAsyncLog( void *arg ) {
+
+	// Local variables
+	struct timespec wake;
+	int stopping, ready;
+
+	for (;;) {
+
+		// Write what there is
+		if ( writeLogBatch() > 0 ) {
+			continue;
+		}
+
+		// Nothing, wait for an entry (done if stopping, and no caller left)
+		pthread_mutex_lock( &logLock );
+		__atomic_store_n( &writerSleeping, 1, __ATOMIC_SEQ_CST );
+		stopping = !__atomic_load_n(&asyncLog, __ATOMIC_SEQ_CST) && !__atomic_load_n(&asyncUsers, __ATOMIC_SEQ_CST);
+		ready = (__atomic_load_n(&logRing[logHead & (CMPSC311_LOG_RING_SIZE-1)].seq, __ATOMIC_SEQ_CST) == logHead+1);
+		if ( !ready && !stopping ) {
+			clock_gettime( CLOCK_REALTIME, &wake );
+			wake.tv_nsec += CMPSC311_LOG_INTERVAL*1000000L;
+			wake.tv_sec += wake.tv_nsec/1000000000L;
+			wake.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait( &logReady, &logLock, &wake );
+		}
+		__atomic_store_n( &writerSleeping, 0, __ATOMIC_SEQ_CST );
+		pthread_mutex_unlock( &logLock );
+		if ( !ready && stopping ) {
+			return( NULL );
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeLogBatch
+// Description  : Write the full slots at the head of the ring (in one
+//                writev), then free them and wake the callers waiting
+//
+// Inputs       : none
+// Outputs      : the number of entries written
+
+static int writeLogBatch( void ) {
+
+	// Local variables
+	struct iovec iov[CMPSC311_LOG_BATCH_SIZE];
+	LogSlot *slot;
+	int cnt, i;
+
+	// Gather the full slots, in order
+	for ( cnt=0; cnt<CMPSC311_LOG_BATCH_SIZE; cnt++ ) {
+		slot = &logRing[(logHead+cnt) & (CMPSC311_LOG_RING_SIZE-1)];
+		if ( __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != logHead+cnt+1 ) {
+			break;
+		}
+		iov[cnt].iov_base = slot->entry;
+		iov[cnt].iov_len = slot->len;
+	}
+	if ( cnt == 0 ) {
+		return( 0 );
+	}
+
+	// Echo, then Write the entries to the log
+	if ( echoHandle != -1 ) {
+		writeAllLog( echoHandle, iov, cnt );
+	}
+	if ( writeAllLog(fileHandle, iov, cnt) ) {
+		fprintf( stderr, "Error writing to log : %d entries [%s] (%s)", cnt, logFilename, strerror(errno) );
+	}
+
+	// Free the slots for the next time round the ring
+	for ( i=0; i<cnt; i++ ) {
+		__atomic_store_n( &logRing[(logHead+i) & (CMPSC311_LOG_RING_SIZE-1)].seq,
+				logHead+i+CMPSC311_LOG_RING_SIZE, __ATOMIC_SEQ_CST );
+	}
+	logHead += cnt;
+	__atomic_store_n( &logWritten, logHead, __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n(&callersWaiting, __ATOMIC_SEQ_CST) || __atomic_load_n(&flushersWaiting, __ATOMIC_SEQ_CST) ) {
+		pthread_mutex_lock( &logLock );
+		pthread_cond_broadcast( &logSpace );
+		pthread_cond_broadcast( &logFlushed );
+		pthread_mutex_unlock( &logLock );
+	}
+	return( cnt );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeAllLog
+// Description  : Write all of a batch of entries (writev may come up short)
+//
+// Inputs       : fd - the file handle
+//                iov - the entries
+//                cnt - the number of entries
+// Outputs      : 0 if successful, -1 if failure
+
+static int writeAllLog( int fd, struct iovec *iov, int cnt ) {
+
+	// Local variables
+	struct iovec vec[CMPSC311_LOG_BATCH_SIZE];
+	ssize_t n;
+	int first = 0;
+
+	memcpy( vec, iov, sizeof(struct iovec)*cnt );
+	while ( first < cnt ) {
+		if ( (n = writev(fd, &vec[first], cnt-first)) == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			return( -1 );
+		}
+		while ( (first < cnt) && ((size_t)n >= vec[first].iov_len) ) {
+			n -= vec[first++].iov_len;
+		}
+		if ( first < cnt ) {
+			vec[first].iov_base = (char *)vec[first].iov_base + n;
+			vec[first].iov_len -= n;
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wakeLogWriter
+// Description  : Wake the writer (if it waits for an entry)
+//
+// Inputs       : none
+// Outputs      : none
+
+static void wakeLogWriter( void ) {
+	pthread_mutex_lock( &logLock );
+	pthread_cond_signal( &logReady );
+	pthread_mutex_unlock( &logLock );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stopAsyncLogAtExit
+// Description  : Write out the asynchronous log at exit (see atexit)
+//
+// Inputs       : none
+// Outputs      : none
+
+static void stopAsyncLogAtExit( void ) {
+	stopAsyncLog();
+	return;
+}
+
+//
+// Unit Testing
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : logUnitTest
+// Description  : Log from threads through the asynchronous log into a file,
+//                waiting when the ring is full, and check each thread's
+//                entries are all there in order.  Then log into a pipe that
+//                is not read (so the writer falls behind), dropping, and
+//                check the entries written and dropped add up.  The log is
+//                put back as it was.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int logUnitTest( void ) {
+
+	// Local variables
+	pthread_t threads[LOG_UNIT_TEST_THREADS], reader;
+	unsigned long saveLevel = logLevel, total = 0, dropped = 0;
+	int saveFile = fileHandle, saveEcho = echoHandle, savePolicy = asyncPolicy;
+	int wasAsync = __atomic_load_n( &asyncLog, __ATOMIC_SEQ_CST );
+	int pfd[2] = { -1, -1 }, ret = 0, mode, t;
+
+	// Log the test entries only to the test (the log written out first)
+	stopAsyncLog();
+	if ( fileHandle == -1 ) {
+		openLog();
+		saveFile = fileHandle;
+	}
+	logLevel |= LOG_OUTPUT_LEVEL;
+	echoHandle = -1;
+
+	// Waiting into a file, then dropping into a pipe
+	for ( mode=CMPSC311_LOG_BLOCK; (ret == 0) && (mode<=CMPSC311_LOG_DROP); mode++ ) {
+		if ( mode == CMPSC311_LOG_BLOCK ) {
+			logTestFd = open( LOG_UNIT_TEST_FILE, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR );
+			fileHandle = logTestFd;
+		} else if ( pipe(pfd) == 0 ) {
+#ifdef F_SETPIPE_SZ
+			fcntl( pfd[1], F_SETPIPE_SZ, 4096 );
+#endif
+			logTestFd = pfd[0];
+			fileHandle = pfd[1];
+		}
+		if ( (fileHandle == -1) || startAsyncLog(mode) ) {
+			fileHandle = saveFile;
+			ret = -1;
+			break;
+		}
+
+		// Log from the threads
+		for ( t=0; t<LOG_UNIT_TEST_THREADS; t++ ) {
+			pthread_create( &threads[t], NULL, logTestThread, (void *)(intptr_t)t );
+		}
+		for ( t=0; t<LOG_UNIT_TEST_THREADS; t++ ) {
+			pthread_join( threads[t], NULL );
+		}
+
+		// Read back what was written (the pipe read while the rest is)
+		logTestLen = 0;
+		if ( mode == CMPSC311_LOG_BLOCK ) {
+			flushLog();
+			dropped = droppedLogMessages();
+			stopAsyncLog();
+			lseek( logTestFd, 0, SEEK_SET );
+			logTestReader( NULL );
+			close( logTestFd );
+			unlink( LOG_UNIT_TEST_FILE );
+		} else {
+			dropped = droppedLogMessages();
+			pthread_create( &reader, NULL, logTestReader, NULL );
+			stopAsyncLog();
+			close( pfd[1] );
+			pthread_join( reader, NULL );
+			close( pfd[0] );
+		}
+		fileHandle = saveFile;
+
+		// Check it
+		if ( logTestCheck(mode == CMPSC311_LOG_BLOCK, &total) ||
+			 (total+dropped != LOG_UNIT_TEST_THREADS*LOG_UNIT_TEST_ENTRIES) ||
+			 ((mode == CMPSC311_LOG_BLOCK) ? (dropped != 0) : (dropped == 0)) ) {
+			logLevel = saveLevel;
+			logMessage( LOG_ERROR_LEVEL, "Log unit test: %s, %lu entries written, %lu dropped",
+					(mode == CMPSC311_LOG_BLOCK) ? "waiting" : "dropping", total, dropped );
+			ret = -1;
+		}
+	}
+
+	// Put the log back, log and return
+	free( logTestBuf );
+	logTestBuf = NULL;
+	logLevel = saveLevel;
+	echoHandle = saveEcho;
+	if ( wasAsync && startAsyncLog(savePolicy) ) {
+		ret = -1;
+	}
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "Log unit test completed successfully (%lu of %d entries dropped).", dropped,
+				LOG_UNIT_TEST_THREADS*LOG_UNIT_TEST_ENTRIES );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : logTestThread
+// Description  : Log the entries of a thread of the unit test
+//
+// Inputs       : arg - the number of the thread
+// Outputs      : NULL
+
+static void *logTestThread( void *arg ) {
+
+	// Local variables
+	int t = (int)(intptr_t)arg, i;
+
+	for ( i=0; i<LOG_UNIT_TEST_ENTRIES; i++ ) {
+		logMessage( LOG_OUTPUT_LEVEL, "LOGTEST %d %d", t, i );
+	}
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : logTestReader
+// Description  : Read what the unit test logged (to the end of the file)
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+static void *logTestReader( void *arg ) {
+
+	// Local variables
+	size_t size = 0;
+	ssize_t n;
+
+	do {
+		if ( size - logTestLen < MAX_LOG_MESSAGE_SIZE ) {
+			size = (size == 0) ? 1<<20 : size*2;
+			if ( (logTestBuf = realloc(logTestBuf, size)) == NULL ) {
+				logTestLen = 0;
+				return( NULL );
+			}
+		}
+		if ( (n = read(logTestFd, &logTestBuf[logTestLen], size-logTestLen)) > 0 ) {
+			logTestLen += n;
+		}
+	} while ( (n > 0) || ((n == -1) && (errno == EINTR)) );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : logTestCheck
+// Description  : Check the entries the unit test read back: each thread's
+//                in order (and all of them if none were dropped)
+//
+// Inputs       : exact - flag indicating none were dropped
+//                total - the number of entries found (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+static int logTestCheck( int exact, unsigned long *total ) {
+
+	// Local variables
+	int next[LOG_UNIT_TEST_THREADS], t, i;
+	char *line, *end, *entry;
+
+	memset( next, 0x0, sizeof(next) );
+	*total = 0;
+	for ( line=logTestBuf; (line != NULL) && (line < logTestBuf+logTestLen); line=end+1 ) {
+		if ( (end = memchr(line, '\n', logTestBuf+logTestLen-line)) == NULL ) {
+			return( -1 );
+		}
+		*end = 0x0;
+		if ( (entry = strstr(line, "] LOGTEST ")) == NULL ) {
+			continue;
+		}
+		if ( (sscanf(entry, "] LOGTEST %d %d", &t, &i) != 2) || (t < 0) || (t >= LOG_UNIT_TEST_THREADS) ||
+			 (exact ? (i != next[t]) : (i < next[t])) ) {
+			return( -1 );
+		}
+		next[t] = i+1;
+		(*total) ++;
+	}
+	return( 0 );
+}
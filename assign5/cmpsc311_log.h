@@ -13,6 +13,11 @@
 //         given a level which is checked at run-time.  If the log level is
 //         enabled, then the entry it written to the log, and not otherwise.
 //
+//         Once the asynchronous log is started, entries are formatted into a
+//         ring of slots and written (in batches) by a thread of the log's
+//         own, rather than by the caller.  When the ring is full the caller
+//         waits, or the entry is dropped (and counted), by the policy given.
+//
 //  Author   : Patrick McDaniel
 //  Created  : Sat Sep 14 10:19:45 EDT 2013
 //
@@ -41,6 +46,13 @@
 #define MAX_LOG_MESSAGE_SIZE	1024
 #define CMPSC311_LOG_STDOUT 1
 #define CMPSC311_LOG_STDERR 2
+#define CMPSC311_LOG_RING_SIZE 1024 // The entries the asynchronous log holds (a power of 2)
+#define CMPSC311_LOG_BATCH_SIZE 64  // The most entries written at once
+#define CMPSC311_LOG_INTERVAL 10    // The longest the writer sleeps with entries to write (msecs)
+
+// The policies of the asynchronous log when its ring is full
+#define CMPSC311_LOG_BLOCK 0 // Wait for the entries before to be written
+#define CMPSC311_LOG_DROP 1  // Drop the entry (counted, see droppedLogMessages)
 
 //
 // Interface
@@ -69,6 +81,23 @@ int initializeLogWithFilename( const char *logname );
 int initializeLogWithFilehandle( int out );
 	// Create a log with a fixed file handle
 
+//
+// Asynchronous logging interfaces
+
+int startAsyncLog( int policy );
+	// Write the log on a thread of its own (flushed at exit), the policy
+	// when it falls behind CMPSC311_LOG_BLOCK or CMPSC311_LOG_DROP
+
+int stopAsyncLog( void );
+	// Write out the entries queued and go back to writing on the caller
+	// (also done when the log is initialized again)
+
+int flushLog( void );
+	// Wait for the entries logged so far to be written
+
+unsigned long droppedLogMessages( void );
+	// The entries dropped since the asynchronous log was started
+
 //
 // Logging functions
 
@@ -88,4 +117,11 @@ int vlogMessage( unsigned long lvl, const char *fmt, va_list args );
 int logAssert( int expr, const char *file,  int line, const char *fmt, ...);
 	// Log a "printf"-style message where ASSERT fails
 
+//
+// Unit Testing
+
+int logUnitTest( void );
+	// Log from threads through the asynchronous log (waiting, then
+	// dropping) and check what was written
+
 #endif
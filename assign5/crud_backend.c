@@ -0,0 +1,272 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_backend.c
+//  Description    : This is the implementation of the backend dispatch for
+//                   the CRUD filesystem.  The in-process backends run the
+//                   requests directly against a (single partition) object
+//                   store, the same one crud_server uses, so the only
+//                   difference from the network backend is the network.
+//                   Threads share that store under a lock, while on the
+//                   network each thread is a client with its own connection.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+// Project includes
+#include <crud_backend.h>
+#include <crud_capture.h>
+#include <crud_codec.h>
+#include <crud_hist.h>
+#include <crud_network.h>
+#include <crud_store.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+//
+// Local functions
+
+CrudResponse crud_store_operation( CrudRequest op, void *buf, uint64_t *objver );
+
+//
+// Global data
+
+// The backends (indexed by CRUD_BACKEND_TYPES)
+CrudBackend crud_backends[CRUD_BACKEND_MAXVAL] = {
+	{ "network", crud_client_versioned, 0, 0 },
+	{ "memory",  crud_store_operation,  0, 0 },
+	{ "file",    crud_store_operation,  0, 0 },
+};
+
+CRUD_BACKEND_TYPES crud_backend_selected = CRUD_BACKEND_NETWORK; // Used from the next mount
+CRUD_BACKEND_TYPES crud_backend_mounted = CRUD_BACKEND_NETWORK;  // Used now
+char      crud_backend_image[CRUD_BACKEND_MAX_PATH] = CRUD_STORE_FILENAME; // The file backend image
+CrudStore crud_backend_store;     // The store of the in-process backends
+int       crud_backend_setup = 0; // Flag indicating the store is setup
+pthread_mutex_t crud_backend_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the store
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_select
+// Description  : Select the backend used from the next mount on.  The
+//                specification is the backend name, optionally followed by
+//                the image file for the file backend (e.g., file:test.crd).
+//
+// Inputs       : spec - the backend specification
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_backend_select( const char *spec ) {
+
+	// Local variables
+	const char *sep = strchr( spec, ':' );
+	size_t len = (sep == NULL) ? strlen(spec) : (size_t)(sep-spec);
+	int i;
+
+	// Find the backend by name
+	for ( i=0; i<CRUD_BACKEND_MAXVAL; i++ ) {
+		if ( (strlen(crud_backends[i].name) == len) && (strncmp(crud_backends[i].name, spec, len) == 0) ) {
+			break;
+		}
+	}
+	if ( i == CRUD_BACKEND_MAXVAL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD backend: unknown backend [%s]", spec );
+		return( -1 );
+	}
+
+	// Only the file backend takes an image name
+	if ( sep != NULL ) {
+		if ( (i != CRUD_BACKEND_FILE) || (sep[1] == 0x0) || (strlen(sep+1) >= CRUD_BACKEND_MAX_PATH) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD backend: bad backend specification [%s]", spec );
+			return( -1 );
+		}
+		strcpy( crud_backend_image, sep+1 );
+	}
+
+	// Log, return successfully
+	crud_backend_selected = i;
+	logMessage( LOG_INFO_LEVEL, "CRUD backend: selected %s backend%s%s", crud_backends[i].name,
+			(i == CRUD_BACKEND_FILE) ? ", image " : "", (i == CRUD_BACKEND_FILE) ? crud_backend_image : "" );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_operation
+// Description  : Execute a request on the backend of the mounted filesystem,
+//                an INIT mounts the selected backend.
+//
+// Inputs       : op - the request
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_backend_operation( CrudRequest op, void *buf ) {
+
+	// Local variables
+	uint64_t objver = 0;
+
+	// Execute without a version
+	return( crud_backend_versioned(op, buf, &objver) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_versioned
+// Description  : Execute a request carrying an object version on the backend
+//                of the mounted filesystem (e.g., a CRUD_IF_VERSION UPDATE).
+//                The network backend only has versions if the server agreed
+//                to them, otherwise the version returned is 0.
+//
+// Inputs       : op - the request
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+//                objver - the object version of the request (the response's
+//                         on return)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_backend_versioned( CrudRequest op, void *buf, uint64_t *objver ) {
+
+	// Local variables
+	CrudBackend *backend;
+	CrudResponse res;
+	struct timeval start, end;
+	uint64_t sent = 0, version = 0;
+
+	// Mounting picks up the selected backend
+	if ( crud_codec_req(op) == CRUD_INIT ) {
+		crud_backend_mounted = crud_backend_selected;
+	}
+	backend = &crud_backends[crud_backend_mounted];
+
+	// Execute the request, keeping the time spent (and capturing it)
+	if ( crud_capture_enabled ) {
+		sent = crud_hist_now();
+		version = *objver;
+	}
+	gettimeofday( &start, NULL );
+	res = backend->operation( op, buf, objver );
+	gettimeofday( &end, NULL );
+	__sync_fetch_and_add( &backend->requests, 1 );
+	__sync_fetch_and_add( &backend->usecs, compareTimes(&start, &end) );
+	if ( crud_capture_enabled ) {
+		crud_capture_record( op, res, buf, version, *objver, sent, crud_hist_now() );
+	}
+	return( res );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_attach
+// Description  : Join the mounted filesystem from another thread (e.g., a
+//                worker of crud_sim).  The thread INITs a session of its
+//                own, on the network over a connection of its own.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_backend_attach( void ) {
+
+	// Local variables
+	CrudResponse res;
+
+	res = crud_backend_operation( crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL );
+	if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD backend %s: attach failed", crud_backends[crud_backend_mounted].name );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_detach
+// Description  : Leave the mounted filesystem from a thread that attached
+//                (the filesystem stays mounted by the others).
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_backend_detach( void ) {
+
+	// Local variables
+	CrudResponse res;
+
+	res = crud_backend_operation( crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL );
+	if ( crud_backend_mounted == CRUD_BACKEND_NETWORK ) {
+		crud_client_disconnect();
+	}
+	if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD backend %s: detach failed", crud_backends[crud_backend_mounted].name );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_backend_report
+// Description  : Log the requests executed by (and time spent in) each
+//                backend that has been used.
+//
+// Inputs       : none
+// Outputs      : none
+
+void crud_backend_report( void ) {
+
+	// Local variables
+	int i;
+
+	for ( i=0; i<CRUD_BACKEND_MAXVAL; i++ ) {
+		if ( crud_backends[i].requests > 0 ) {
+			logMessage( LOG_OUTPUT_LEVEL, "CRUD backend %s: %lu requests, %lu usecs (%.2f usecs/request)",
+					crud_backends[i].name, crud_backends[i].requests, crud_backends[i].usecs,
+					(double)crud_backends[i].usecs/crud_backends[i].requests );
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_operation
+// Description  : Execute a request on the store of the in-process backends.
+//                The image is attached at each INIT, so the memory backend
+//                starts empty and the file backend from the image.
+//
+// Inputs       : op - the request
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+//                objver - the object version of the request (the response's
+//                         on return)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_store_operation( CrudRequest op, void *buf, uint64_t *objver ) {
+
+	// Local variables
+	CrudResponse res;
+
+	// The store is not thread safe, one request at a time
+	pthread_mutex_lock( &crud_backend_lock );
+
+	// Setup the store the first time through
+	if ( !crud_backend_setup ) {
+		crud_store_setup( &crud_backend_store, 1 );
+		crud_backend_setup = 1;
+	}
+
+	// Attach the image (if any) before the store is initialized
+	if ( (crud_codec_req(op) == CRUD_INIT) && (!crud_backend_store.initialized) ) {
+		crud_store_file( &crud_backend_store,
+				(crud_backend_mounted == CRUD_BACKEND_FILE) ? crud_backend_image : NULL );
+	}
+	res = crud_store_versioned( &crud_backend_store,
+			crud_store_owner(&crud_backend_store, op, 0), op, buf, objver );
+	pthread_mutex_unlock( &crud_backend_lock );
+	return( res );
+}
@@ -0,0 +1,71 @@
+#ifndef CRUD_BACKEND_INCLUDED
+#define CRUD_BACKEND_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_backend.h
+//  Description   : This is the interface to the backends the CRUD filesystem
+//                  (crud_file_io.c) sends its object requests to: the
+//                  crud_server over the network, an object store in this
+//                  process kept only in memory, or one saved to a local image
+//                  file.  The backend is chosen when the filesystem is
+//                  mounted (on the INIT request), so that the cost of the
+//                  filesystem layer can be measured with and without the
+//                  network.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines
+#define CRUD_BACKEND_MAX_PATH 256
+
+//
+// Type definitions
+
+// These are the backends
+typedef enum {
+	CRUD_BACKEND_NETWORK = 0, // The crud_server (see crud_client.c)
+	CRUD_BACKEND_MEMORY  = 1, // A store in this process, discarded on close
+	CRUD_BACKEND_FILE    = 2, // A store in this process, saved to a file on close
+	CRUD_BACKEND_MAXVAL  = 3, // The maximum value
+} CRUD_BACKEND_TYPES;
+
+// This is a backend
+typedef struct {
+	const char   *name;  // The name of the backend
+	CrudResponse (*operation)( CrudRequest op, void *buf, uint64_t *objver ); // Executes a request
+	uint64_t      requests; // The requests executed
+	uint64_t      usecs;    // The time spent executing them (microseconds)
+} CrudBackend;
+
+//
+// Backend interface
+
+int crud_backend_select( const char *spec );
+	// Select the backend used from the next mount on ("network", "memory",
+	// or "file[:<image>]")
+
+CrudResponse crud_backend_operation( CrudRequest op, void *buf );
+	// Execute a request on the backend of the mounted filesystem
+
+CrudResponse crud_backend_versioned( CrudRequest op, void *buf, uint64_t *objver );
+	// Execute a request carrying an object version (in and out, 0 if the
+	// backend does not have versions)
+
+int crud_backend_attach( void );
+	// Join the mounted filesystem from another thread (a session of its own)
+
+int crud_backend_detach( void );
+	// Leave the mounted filesystem from a thread that attached
+
+void crud_backend_report( void );
+	// Log the requests executed by (and the time spent in) each backend
+
+#endif
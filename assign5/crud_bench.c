@@ -0,0 +1,1039 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_bench.c
+//  Description   : This is the microbenchmark suite for the CRUD stack.  Each
+//                  benchmark runs an operation in a loop: the loop is first
+//                  grown until it takes long enough to time (which warms it
+//                  up), run a few more times to warm up, then timed over a
+//                  number of repetitions.  The time per operation of the
+//                  repetitions is summarized (mean, standard deviation,
+//                  min, median, max), logged, and written as CSV or JSON so
+//                  runs can be compared for regressions.
+//
+//   Author : Patrick McDaniel
+//   Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+// Project Includes
+#include <crud_driver.h>
+#include <crud_codec.h>
+#include <crud_crc.h>
+#include <crud_network.h>
+#include <crud_file_io.h>
+#include <crud_backend.h>
+#include <crud_hist.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_BENCH_MAX_REPS 1000
+#define CRUD_BENCH_MAX_ITERS (1ULL << 32)
+#define CRUD_BENCH_FILE "bench.dat"
+#define CRUD_BENCH_IMAGE "crud_bench.crd"
+#define CRUD_ARGUMENTS "hvl:a:p:b:r:w:t:f:o:"
+#define USAGE \
+	"USAGE: crud_bench [-h] [-v] [-l <logfile>] [-a <ip addr>] [-p <port>] [-b <backend>] [-r <reps>] [-w <warmups>]\n" \
+	"                  [-t <msecs>] [-f <filter>] [-o <file>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -a - IP address of server to connect to.\n" \
+	"    -p - port number of server to connect to.\n" \
+	"    -b - send the requests to <backend>: memory (a store in this process,\n" \
+	"         default), file[:<image>] or network (the server)\n" \
+	"    -r - time each benchmark over <reps> repetitions (default 10)\n" \
+	"    -w - run each benchmark <warmups> more times before timing it, once\n" \
+	"         its loop is long enough (default 2)\n" \
+	"    -t - make each repetition at least <msecs> long (default 20)\n" \
+	"    -f - only run the benchmarks whose names contain <filter>\n" \
+	"    -o - write the results to <file>, as JSON if it ends in .json (with\n" \
+	"         the time of each repetition), CSV if not\n" \
+	"\n"
+
+//
+// Type definitions
+
+// This is a benchmark
+typedef struct CrudBenchCase {
+	const char *name;   // The name of the benchmark
+	uint32_t    size;   // The bytes each operation moves (0 if none)
+	int       (*setup)( struct CrudBenchCase *bc );                 // Get ready (NULL if nothing to do)
+	int       (*run)( struct CrudBenchCase *bc, uint64_t iters );   // Run the operation iters times
+	int       (*teardown)( struct CrudBenchCase *bc );              // Clean up (NULL if nothing to do)
+} CrudBenchCase;
+
+// This is what a benchmark measured
+typedef struct {
+	CrudBenchCase *bench;  // The benchmark
+	char           label[32]; // The name (and size) of the benchmark
+	uint64_t       iters;  // The operations in each repetition
+	uint32_t       reps;   // The number of repetitions
+	double        *nsecs;  // The time per operation of each repetition
+	double         mean;   // The mean time per operation
+	double         stddev; // The standard deviation of the time per operation
+	double         median; // The median time per operation
+	double         min;    // The least time per operation
+	double         max;    // The most time per operation
+} CrudBenchResult;
+
+//
+// Functional Prototypes
+
+int bench_measure( CrudBenchCase *bc, uint32_t reps, uint32_t warmups, uint64_t target, CrudBenchResult *res );
+int bench_report( CrudBenchResult *results, int count, char *ofile, const char *backend );
+int bench_compare( const void *a, const void *b );
+int bench_log( void );
+int bench_filesystem( CrudBenchCase *bc );
+int bench_empty( CrudBenchCase *bc );
+int bench_filled( CrudBenchCase *bc );
+int bench_full( CrudBenchCase *bc );
+int bench_unmount( CrudBenchCase *bc );
+int bench_image( CrudBenchCase *bc );
+int bench_release( CrudBenchCase *bc );
+int bench_log_on( CrudBenchCase *bc );
+int bench_log_off( CrudBenchCase *bc );
+int bench_log_async( CrudBenchCase *bc );
+int bench_construct( CrudBenchCase *bc, uint64_t iters );
+int bench_deconstruct( CrudBenchCase *bc, uint64_t iters );
+int bench_codec( CrudBenchCase *bc, uint64_t iters );
+int bench_pack( CrudBenchCase *bc, uint64_t iters );
+int bench_message( CrudBenchCase *bc, uint64_t iters );
+int bench_crc( CrudBenchCase *bc, uint64_t iters );
+int bench_random( CrudBenchCase *bc, uint64_t iters );
+int bench_swap( CrudBenchCase *bc, uint64_t iters );
+int bench_open( CrudBenchCase *bc, uint64_t iters );
+int bench_seek( CrudBenchCase *bc, uint64_t iters );
+int bench_mount( CrudBenchCase *bc, uint64_t iters );
+int bench_read_seq( CrudBenchCase *bc, uint64_t iters );
+int bench_read_random( CrudBenchCase *bc, uint64_t iters );
+int bench_write_seq( CrudBenchCase *bc, uint64_t iters );
+int bench_write_random( CrudBenchCase *bc, uint64_t iters );
+
+//
+// Global data
+
+// A benchmark for each of the sizes of a read or write (16B to 1MB)
+#define CRUD_BENCH_SIZES(name, setup, run) \
+	{ name, 16, setup, run, bench_unmount }, \
+	{ name, 256, setup, run, bench_unmount }, \
+	{ name, 4096, setup, run, bench_unmount }, \
+	{ name, 65536, setup, run, bench_unmount }, \
+	{ name, CRUD_MAX_OBJECT_SIZE, setup, run, bench_unmount }
+
+// The benchmarks, in the order they are run
+CrudBenchCase crud_bench_cases[] = {
+	{ "header-construct",   0, NULL, bench_construct, NULL },
+	{ "header-deconstruct", 0, NULL, bench_deconstruct, NULL },
+	{ "header-codec",       0, NULL, bench_codec, NULL },
+	{ "header-pack-v2",     0, NULL, bench_pack, NULL },
+	{ "log-disabled",       0, bench_log_off, bench_message, NULL },
+	{ "log-enabled",        0, bench_log_on, bench_message, bench_log_off },
+	{ "log-async",          0, bench_log_async, bench_message, bench_log_off },
+	{ "util-crc32c",     4096, NULL, bench_crc, NULL },
+	{ "util-random",        0, NULL, bench_random, NULL },
+	{ "util-htonll64",      0, NULL, bench_swap, NULL },
+	{ "open-full",          0, bench_full, bench_open, bench_unmount },
+	{ "seek",               0, bench_filled, bench_seek, bench_unmount },
+	{ "mount-full",         0, bench_image, bench_mount, bench_release },
+	CRUD_BENCH_SIZES( "read-seq", bench_filled, bench_read_seq ),
+	CRUD_BENCH_SIZES( "read-random", bench_filled, bench_read_random ),
+	CRUD_BENCH_SIZES( "write-seq", bench_empty, bench_write_seq ),
+	CRUD_BENCH_SIZES( "write-random", bench_filled, bench_write_random ),
+};
+
+// The state the benchmarks share
+char *bench_backend = "memory";     // The backend selected
+char *bench_logfile = NULL;         // The log file (NULL for stderr)
+int bench_verbose = 0;              // Flag indicating verbose output
+unsigned long bench_level = 0;      // The level the log benchmarks log at
+int bench_null = -1;                // The log of the enabled log benchmark (/dev/null)
+volatile uint64_t bench_sink = 0;   // Where results go, so they are not optimized away
+unsigned char *bench_buf = NULL;    // The bytes read and written (CRUD_MAX_OBJECT_SIZE)
+char bench_name[CRUD_MAX_PATH_LENGTH]; // The name of the file opened (open-full)
+int16_t bench_fh = -1;              // The file read and written
+int32_t bench_length = 0;           // Its length
+int32_t bench_position = 0;         // The position in it
+unsigned int bench_seed = 311;      // The seed of the random positions
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the CRUD microbenchmarks
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, count = 0, cases = sizeof(crud_bench_cases)/sizeof(crud_bench_cases[0]), i, ret = 0;
+	uint32_t reps = 10, warmups = 2, msecs = 20;
+	char *filter = NULL, *ofile = NULL;
+	CrudBenchResult *results;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CRUD_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			bench_verbose = 1;
+			break;
+
+		case 'l': // Set the log filename
+			bench_logfile = optarg;
+			break;
+
+		case 'a': // Get the IP address
+			if (inet_addr(optarg) == INADDR_NONE) {
+				fprintf( stderr, "Bad IP address [%s]\n", optarg );
+				return( -1 );
+			}
+			crud_network_address = (unsigned char *)strdup(optarg);
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &crud_network_port) != 1 ) {
+				fprintf( stderr, "Bad port number [%s]\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'b': // Select the backend
+			bench_backend = optarg;
+			break;
+
+		case 'r': // Set the repetitions
+			if ( (sscanf(optarg, "%u", &reps) != 1) || (reps < 1) || (reps > CRUD_BENCH_MAX_REPS) ) {
+				fprintf( stderr, "Bad number of repetitions [%s]\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'w': // Set the warmups
+			if ( sscanf(optarg, "%u", &warmups) != 1 ) {
+				fprintf( stderr, "Bad number of warmups [%s]\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 't': // Set the time of a repetition
+			if ( (sscanf(optarg, "%u", &msecs) != 1) || (msecs < 1) ) {
+				fprintf( stderr, "Bad repetition time [%s]\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'f': // Filter the benchmarks
+			filter = optarg;
+			break;
+
+		case 'o': // Write the results to a file
+			ofile = optarg;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log, the backend and the buffer
+	bench_log();
+	if ( crud_backend_select(bench_backend) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad backend [%s]", bench_backend );
+		return( -1 );
+	}
+	if ( ((bench_buf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL) ||
+		 ((results = calloc(cases, sizeof(CrudBenchResult))) == NULL) ) {
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_MAX_OBJECT_SIZE; i++ ) {
+		bench_buf[i] = 'a' + i%26;
+	}
+
+	// Run the benchmarks, then report them
+	for ( i=0; (i < cases) && (ret == 0); i++ ) {
+		if ( crud_bench_cases[i].size > 0 ) {
+			snprintf( results[count].label, sizeof(results[count].label), "%s-%u", crud_bench_cases[i].name,
+					crud_bench_cases[i].size );
+		} else {
+			snprintf( results[count].label, sizeof(results[count].label), "%s", crud_bench_cases[i].name );
+		}
+		if ( (filter != NULL) && (strstr(results[count].label, filter) == NULL) ) {
+			continue;
+		}
+		if ( (ret = bench_measure(&crud_bench_cases[i], reps, warmups, (uint64_t)msecs*1000000, &results[count])) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD benchmark %s failed.", results[count].label );
+		}
+		count ++;
+	}
+	if ( ret == 0 ) {
+		ret = bench_report( results, count, ofile, bench_backend );
+	}
+
+	// Cleanup and return
+	for ( i=0; i<count; i++ ) {
+		free( results[i].nsecs );
+	}
+	free( results );
+	free( bench_buf );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD benchmarks completed successfully.\n\n" );
+	}
+	return( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_measure
+// Description  : Run a benchmark: double its loop until it takes the target
+//                time, warm it up, then time the repetitions and summarize
+//                the time per operation.
+//
+// Inputs       : bc - the benchmark
+//                reps - the number of repetitions timed
+//                warmups - the number of repetitions run first
+//                target - the least time a repetition takes (nsecs)
+//                res - what was measured (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_measure( CrudBenchCase *bc, uint32_t reps, uint32_t warmups, uint64_t target, CrudBenchResult *res ) {
+
+	// Local variables
+	uint64_t iters, start, elapsed = 0, rep;
+	double *sorted, dev = 0.0;
+	int ret = 0;
+
+	// Get ready, find how long the loop has to be
+	res->bench = bc;
+	res->reps = reps;
+	if ( (res->nsecs = calloc(reps, sizeof(double))) == NULL ) {
+		return( -1 );
+	}
+	if ( (bc->setup != NULL) && bc->setup(bc) ) {
+		return( -1 );
+	}
+	for ( iters=1; (ret == 0) && (iters < CRUD_BENCH_MAX_ITERS); iters*=2 ) {
+		start = crud_hist_now();
+		ret = bc->run( bc, iters );
+		if ( (elapsed = crud_hist_now()-start) >= target ) {
+			break;
+		}
+	}
+	iters = (elapsed > 0) ? (uint64_t)ceil((double)iters*target/elapsed) : iters;
+	res->iters = (iters < 1) ? 1 : iters;
+
+	// Warm up, then time the repetitions
+	for ( rep=0; (rep < warmups) && (ret == 0); rep++ ) {
+		ret = bc->run( bc, res->iters );
+	}
+	for ( rep=0; (rep < reps) && (ret == 0); rep++ ) {
+		start = crud_hist_now();
+		ret = bc->run( bc, res->iters );
+		res->nsecs[rep] = (double)(crud_hist_now()-start)/res->iters;
+	}
+	if ( (bc->teardown != NULL) && bc->teardown(bc) ) {
+		ret = -1;
+	}
+	if ( ret ) {
+		return( -1 );
+	}
+
+	// Summarize the time per operation
+	if ( (sorted = malloc(sizeof(double)*reps)) == NULL ) {
+		return( -1 );
+	}
+	memcpy( sorted, res->nsecs, sizeof(double)*reps );
+	qsort( sorted, reps, sizeof(double), bench_compare );
+	res->min = sorted[0];
+	res->max = sorted[reps-1];
+	res->median = (reps%2) ? sorted[reps/2] : (sorted[reps/2-1]+sorted[reps/2])/2.0;
+	for ( rep=0, res->mean=0.0; rep<reps; rep++ ) {
+		res->mean += res->nsecs[rep]/reps;
+	}
+	for ( rep=0; rep<reps; rep++ ) {
+		dev += (res->nsecs[rep]-res->mean)*(res->nsecs[rep]-res->mean);
+	}
+	res->stddev = (reps > 1) ? sqrt(dev/(reps-1)) : 0.0;
+	free( sorted );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_report
+// Description  : Log the results (nsecs per operation, and operations and
+//                MB per second at the median), and write them to a file if
+//                asked to: JSON (with each repetition) if the name ends in
+//                .json, CSV otherwise.
+//
+// Inputs       : results - the results
+//                count - the number of results
+//                ofile - the file to write them to (NULL if none)
+//                backend - the backend they were run against
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_report( CrudBenchResult *results, int count, char *ofile, const char *backend ) {
+
+	// Local variables
+	CrudBenchResult *res;
+	double ops, mbs;
+	int json = 0, i;
+	uint32_t rep;
+	size_t len;
+	FILE *fh = NULL;
+
+	// Open the file, JSON or CSV
+	if ( ofile != NULL ) {
+		if ( (fh = fopen(ofile, "w")) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure opening the results file [%s], error: %s.\n",
+				ofile, strerror(errno) );
+			return( -1 );
+		}
+		len = strlen( ofile );
+		json = ((len >= 5) && (strcmp(&ofile[len-5], ".json") == 0));
+		if ( json ) {
+			fprintf( fh, "{\n  \"backend\": \"%s\",\n  \"benchmarks\": [", backend );
+		} else {
+			fprintf( fh, "benchmark,bytes,iterations,reps,mean_nsecs,stddev_nsecs,min_nsecs,median_nsecs,max_nsecs,"
+					"ops_per_sec,mb_per_sec\n" );
+		}
+	}
+
+	// Log (and write) each benchmark
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_BENCH : %s backend, nsecs per operation", backend );
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_BENCH : %-26s %10s %12s %10s %12s %12s %12s %12s %10s",
+			"benchmark", "iters", "mean", "stddev", "min", "median", "max", "ops/sec", "MB/sec" );
+	for ( i=0; i<count; i++ ) {
+		res = &results[i];
+		ops = 1e9/res->median;
+		mbs = ops*res->bench->size/1e6;
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_BENCH : %-26s %10lu %12.1f %10.1f %12.1f %12.1f %12.1f %12.1f %10.1f",
+				res->label, res->iters, res->mean, res->stddev, res->min, res->median, res->max, ops, mbs );
+		if ( (fh != NULL) && json ) {
+			fprintf( fh, "%s\n    {\"benchmark\": \"%s\", \"bytes\": %u, \"iterations\": %lu, \"mean_nsecs\": %.3f, "
+					"\"stddev_nsecs\": %.3f, \"min_nsecs\": %.3f, \"median_nsecs\": %.3f, \"max_nsecs\": %.3f, "
+					"\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f,\n      \"reps_nsecs\": [", (i == 0) ? "" : ",",
+					res->label, res->bench->size, res->iters, res->mean, res->stddev, res->min, res->median,
+					res->max, ops, mbs );
+			for ( rep=0; rep<res->reps; rep++ ) {
+				fprintf( fh, "%s%.3f", (rep == 0) ? "" : ", ", res->nsecs[rep] );
+			}
+			fprintf( fh, "]}" );
+		} else if ( fh != NULL ) {
+			fprintf( fh, "%s,%u,%lu,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.3f\n", res->label, res->bench->size,
+					res->iters, res->reps, res->mean, res->stddev, res->min, res->median, res->max, ops, mbs );
+		}
+	}
+
+	// Finish off the file
+	if ( fh != NULL ) {
+		if ( json ) {
+			fprintf( fh, "\n  ]\n}\n" );
+		}
+		if ( fclose(fh) ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure writing the results file [%s], error: %s.\n",
+				ofile, strerror(errno) );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_compare
+// Description  : Order two times (for qsort)
+//
+// Inputs       : a, b - the times
+// Outputs      : <0, 0, >0 as a is below, the same as, above b
+
+int bench_compare( const void *a, const void *b ) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return( (x > y) - (x < y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_log
+// Description  : Setup the log (to the log file, or stderr)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_log( void ) {
+	if ( bench_logfile != NULL ) {
+		initializeLogWithFilename( bench_logfile );
+	} else {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+	if ( bench_verbose ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+	}
+	return( 0 );
+}
+
+//
+// Setup and teardown
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_filesystem
+// Description  : Format and mount the filesystem
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_filesystem( CrudBenchCase *bc ) {
+	if ( crud_format() || crud_mount() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD benchmark: format/mount failed" );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_empty
+// Description  : Start on an empty filesystem with an empty file open
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_empty( CrudBenchCase *bc ) {
+	if ( bench_filesystem(bc) || ((bench_fh = crud_open(CRUD_BENCH_FILE)) == -1) ) {
+		return( -1 );
+	}
+	bench_length = 0;
+	bench_position = 0;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_filled
+// Description  : Start on an empty filesystem with a file of the largest
+//                size open (at the start)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_filled( CrudBenchCase *bc ) {
+	if ( bench_empty(bc) || (crud_write(bench_fh, bench_buf, CRUD_MAX_OBJECT_SIZE) != CRUD_MAX_OBJECT_SIZE) ||
+		 crud_seek(bench_fh, 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD benchmark: fill failed" );
+		return( -1 );
+	}
+	bench_length = CRUD_MAX_OBJECT_SIZE;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_full
+// Description  : Start on a filesystem with all of its files made (the file
+//                allocation table full)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_full( CrudBenchCase *bc ) {
+
+	// Local variables
+	int16_t fh;
+	int i;
+
+	if ( bench_filesystem(bc) ) {
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		snprintf( bench_name, sizeof(bench_name), "bench%04d.dat", i );
+		if ( ((fh = crud_open(bench_name)) == -1) || crud_close(fh) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD benchmark: cannot make file %d", i );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_unmount
+// Description  : Unmount the filesystem
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_unmount( CrudBenchCase *bc ) {
+	bench_fh = -1;
+	return( crud_unmount() ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_log_on
+// Description  : Send the log to /dev/null, with a level of its own enabled
+//                (so the messages are formatted and written)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_log_on( CrudBenchCase *bc ) {
+
+	if ( (bench_null = open("/dev/null", O_WRONLY)) == -1 ) {
+		return( -1 );
+	}
+	initializeLogWithFilehandle( bench_null );
+	bench_level = registerLogLevel( "BENCH", 1 );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_log_off
+// Description  : Put the log back, logging at a level of its own that is
+//                not enabled (so the messages are dropped)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_log_off( CrudBenchCase *bc ) {
+	bench_log();
+	bench_level = registerLogLevel( "BENCH", 0 );
+	if ( bench_null != -1 ) {
+		close( bench_null );
+		bench_null = -1;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_log_async
+// Description  : Send the log to /dev/null as bench_log_on does, written on
+//                the log's own thread (the caller waiting when it falls
+//                behind, so every message is still written)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_log_async( CrudBenchCase *bc ) {
+	if ( bench_log_on(bc) ) {
+		return( -1 );
+	}
+	return( startAsyncLog(CMPSC311_LOG_BLOCK) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_image
+// Description  : Start on a filesystem with a full file allocation table that
+//                outlives an unmount.  The memory backend starts empty at
+//                each mount, so it is swapped for a file backend image.
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_image( CrudBenchCase *bc ) {
+	if ( (strcmp(bench_backend, "memory") == 0) && crud_backend_select("file:" CRUD_BENCH_IMAGE) ) {
+		return( -1 );
+	}
+	return( bench_full(bc) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_release
+// Description  : Unmount the filesystem, putting back the backend selected
+//                (and removing the image bench_image made)
+//
+// Inputs       : bc - the benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_release( CrudBenchCase *bc ) {
+
+	// Local variables
+	int ret = bench_unmount( bc );
+
+	if ( strcmp(bench_backend, "memory") == 0 ) {
+		unlink( CRUD_BENCH_IMAGE );
+		ret |= crud_backend_select( bench_backend );
+	}
+	return( ret ? -1 : 0 );
+}
+
+//
+// Benchmarks
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_construct
+// Description  : Build request headers (construct_crud_request)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_construct( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		bench_sink += construct_crud_request( i, CRUD_READ, i & CRUD_MAX_OBJECT_SIZE, 0, 0 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_deconstruct
+// Description  : Take response headers apart (deconstruct_crud_request)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_deconstruct( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint8_t flags, res;
+	CrudOID oid;
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		deconstruct_crud_request( (i << 32) | (i & 0xfffff), &oid, &req, &length, &flags, &res );
+		bench_sink += oid + length;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_codec
+// Description  : Build a header and take it apart again with the inline
+//                codec (crud_codec.h), as the client does
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_codec( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	CrudRequest req;
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		req = crud_codec_encode( i, CRUD_UPDATE, i & CRUD_MAX_OBJECT_SIZE, 0, 0 );
+		bench_sink += crud_codec_oid(req) + crud_codec_length(req) + crud_codec_result(req);
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_pack
+// Description  : Put a header in the version 2 wire format (with the object
+//                version) and take it out again
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_pack( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	CrudHeader hdr, out;
+	uint64_t wire[4], i;
+
+	memset( &hdr, 0x0, sizeof(hdr) );
+	hdr.req = CRUD_READ;
+	for ( i=0; i<iters; i++ ) {
+		hdr.oid = i;
+		hdr.length = i;
+		hdr.objver = i;
+		pack_crud_header( &hdr, CRUD_PROTOCOL_V2|CRUD_PROTOCOL_VERSIONS, wire );
+		unpack_crud_header( wire, CRUD_PROTOCOL_V2|CRUD_PROTOCOL_VERSIONS, &out );
+		bench_sink += out.oid + out.objver;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_message
+// Description  : Log a message (at the level of the benchmark)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_message( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		logMessage( bench_level, "CRUD_SIM : Writing %d bytes at position %d from file [%s]", (int)i, 0, CRUD_BENCH_FILE );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_crc
+// Description  : Checksum a payload (CRC32C)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_crc( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		bench_sink += crud_crc32c( 0, bench_buf, bc->size );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_random
+// Description  : Get a random value (getRandomValue)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_random( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		bench_sink += getRandomValue( 0, 1000 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_swap
+// Description  : Put a value in network byte order (htonll64)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_swap( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		bench_sink += htonll64( i );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_open
+// Description  : Open (and close) the last file of a full file allocation
+//                table
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_open( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	int16_t fh;
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( ((fh = crud_open(bench_name)) == -1) || crud_close(fh) ) {
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_seek
+// Description  : Seek in the file
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_seek( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( crud_seek(bench_fh, i % bench_length) ) {
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_mount
+// Description  : Unmount and mount again a filesystem with a full file
+//                allocation table
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_mount( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( crud_unmount() || crud_mount() ) {
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_read_seq
+// Description  : Read the file in order, going back to the start when the
+//                next read would pass the end
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_read_seq( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( bench_position+(int32_t)bc->size > bench_length ) {
+			if ( crud_seek(bench_fh, 0) ) {
+				return( -1 );
+			}
+			bench_position = 0;
+		}
+		if ( crud_read(bench_fh, bench_buf, bc->size) != (int32_t)bc->size ) {
+			return( -1 );
+		}
+		bench_position += bc->size;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_read_random
+// Description  : Read from random places in the file
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_read_random( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( crud_seek(bench_fh, rand_r(&bench_seed) % (bench_length-bc->size+1)) ||
+			 (crud_read(bench_fh, bench_buf, bc->size) != (int32_t)bc->size) ) {
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_write_seq
+// Description  : Write the file in order (growing it), going back to the
+//                start when the next write would pass the largest object
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_write_seq( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( bench_position+bc->size > CRUD_MAX_OBJECT_SIZE ) {
+			if ( crud_seek(bench_fh, 0) ) {
+				return( -1 );
+			}
+			bench_position = 0;
+		}
+		if ( crud_write(bench_fh, bench_buf, bc->size) != (int32_t)bc->size ) {
+			return( -1 );
+		}
+		bench_position += bc->size;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_write_random
+// Description  : Write to random places in the file (it does not grow)
+//
+// Inputs       : bc - the benchmark
+//                iters - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_write_random( CrudBenchCase *bc, uint64_t iters ) {
+
+	// Local variables
+	uint64_t i;
+
+	for ( i=0; i<iters; i++ ) {
+		if ( crud_seek(bench_fh, rand_r(&bench_seed) % (bench_length-bc->size+1)) ||
+			 (crud_write(bench_fh, bench_buf, bc->size) != (int32_t)bc->size) ) {
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
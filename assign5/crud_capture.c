@@ -0,0 +1,835 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_capture.c
+//  Description    : This is the implementation of the request capture (see
+//                   crud_capture.h).  Recording a request only copies it
+//                   into the buffer (under a lock); the buffer is written
+//                   out by the request that fills it.  A replay maps the
+//                   capture, and the OIDs the objects get in the replay
+//                   stand in for the ones they had in the capture.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+
+// Project includes
+#include <crud_capture.h>
+#include <crud_backend.h>
+#include <crud_codec.h>
+#include <crud_crc.h>
+#include <crud_hist.h>
+#include <cmpsc311_hashtable.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_CAPTURE_MAX_PATH 256
+#define CRUD_CAPTURE_OBJECT_BITS 12 // Width of the replay's object table
+#define CRUD_CAPTURE_UNIT_TEST_FILE "crud_capture_test.cap"
+#define CRUD_CAPTURE_UNIT_TEST_OBJECTS 16
+#define CRUD_CAPTURE_UNIT_TEST_REQUESTS (CRUD_CAPTURE_BUFFER+1000) // More than a buffer
+#define CRUD_CAPTURE_UNIT_TEST_SIZE 4096
+
+//
+// Type definitions
+
+// This is an object of a replay
+typedef struct {
+	CrudOID  oid;     // The OID of the object in the replay
+	uint64_t version; // The last version of the object the replay saw
+} CrudCaptureObject;
+
+// This is a capture being replayed
+typedef struct {
+	CrudCaptureRecord        *records; // The records (in the mapped capture)
+	uint64_t                  count;   // The number of records
+	int                       timed;   // Flag indicating the requests are sent when they were captured
+	uint64_t                  start;   // When the replay started (crud_hist_now)
+	struct CrudCaptureWorker *workers; // The replay threads (one for each thread captured)
+	uint32_t                  threads; // The number of them
+	HTable                    objects; // The objects (CrudCaptureObject by captured OID)
+	pthread_mutex_t           lock;    // Serializes the objects
+} CrudCaptureReplay;
+
+// This is a thread of a replay, sending the requests of a captured thread
+typedef struct CrudCaptureWorker {
+	CrudCaptureReplay *replay;   // The replay
+	uint32_t           thread;   // The thread captured
+	pthread_t          handle;   // The thread replaying it
+	uint64_t          *order;    // Its records (indexes, in the order sent)
+	uint64_t           count;    // The number of them
+	uint64_t           done;     // The number of them answered so far
+	int                ret;      // The result of the replay
+	uint64_t           requests; // The requests sent
+	uint64_t           differ;   // The requests whose result differs from the capture
+	CrudHistogram      captured[CRUD_MAXVAL]; // The captured latencies (by request type)
+	CrudHistogram      replayed[CRUD_MAXVAL]; // The replayed latencies (by request type)
+} CrudCaptureWorker;
+
+//
+// Global data
+
+int crud_capture_enabled = 0; // Flag indicating requests are being captured
+static int crud_capture_fd = -1;                  // The capture file (-1 if none)
+static char crud_capture_name[CRUD_CAPTURE_MAX_PATH]; // The name of the capture file
+static uint32_t crud_capture_flags = 0;           // The capture flags
+static uint64_t crud_capture_started = 0;         // When the capture started (crud_hist_now)
+static CrudCaptureRecord *crud_capture_buffer = NULL; // The records not yet written
+static uint32_t crud_capture_used = 0;            // The records in the buffer
+static uint64_t crud_capture_records = 0;         // The records captured
+static uint32_t crud_capture_threads = 0;         // The threads numbered so far
+static uint32_t crud_capture_generation = 0;      // The capture the thread numbers belong to
+static int crud_capture_exiting = 0;              // Flag indicating the capture is stopped at exit
+static pthread_mutex_t crud_capture_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes the capture
+static __thread uint32_t crud_capture_thread = 0; // The number of this thread
+static __thread uint32_t crud_capture_numbered = 0; // The capture it was numbered in (0 if none)
+
+//
+// Local functions
+
+static int crud_capture_spec( const char *spec, const char *option, char *path );
+static int crud_capture_flush( void );
+static void crud_capture_exit( void );
+static int crud_capture_run( const char *path, int timed, uint64_t *differ );
+static void *crud_capture_worker( void *arg );
+static void crud_capture_wait( CrudCaptureWorker *worker, CrudCaptureRecord *rec );
+static void crud_capture_report( CrudCaptureReplay *replay, CrudCaptureWorker *workers, uint32_t threads,
+		const char *path, uint64_t nsecs );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_start
+// Description  : Start capturing the requests to a file (the header is
+//                written now, the records as the buffer fills)
+//
+// Inputs       : spec - the capture file, optionally followed by :crc
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_capture_start( const char *spec ) {
+
+	// Local variables
+	CrudCaptureHeader hdr;
+	struct timespec ts;
+	char path[CRUD_CAPTURE_MAX_PATH];
+	int fd, crc;
+
+	// Open the file and write the header
+	if ( (crc = crud_capture_spec(spec, "crc", path)) == -1 ) {
+		return( -1 );
+	}
+	if ( (fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure creating [%s], error: %s.", path, strerror(errno) );
+		return( -1 );
+	}
+	clock_gettime( CLOCK_REALTIME, &ts );
+	memset( &hdr, 0x0, sizeof(hdr) );
+	memcpy( hdr.magic, CRUD_CAPTURE_MAGIC, sizeof(hdr.magic) );
+	hdr.order = CRUD_CAPTURE_ORDER;
+	hdr.flags = crc ? CRUD_CAPTURE_CHECKSUMS : 0;
+	hdr.started = (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+	if ( write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure writing [%s], error: %s.", path, strerror(errno) );
+		close( fd );
+		return( -1 );
+	}
+
+	// Start capturing (stopping any capture already going)
+	crud_capture_stop();
+	pthread_mutex_lock( &crud_capture_lock );
+	if ( (crud_capture_buffer == NULL) &&
+		 ((crud_capture_buffer = malloc(sizeof(CrudCaptureRecord)*CRUD_CAPTURE_BUFFER)) == NULL) ) {
+		pthread_mutex_unlock( &crud_capture_lock );
+		close( fd );
+		return( -1 );
+	}
+	if ( ! crud_capture_exiting ) {
+		atexit( crud_capture_exit );
+		crud_capture_exiting = 1;
+	}
+	strncpy( crud_capture_name, path, sizeof(crud_capture_name) );
+	crud_capture_fd = fd;
+	crud_capture_flags = hdr.flags;
+	crud_capture_used = 0;
+	crud_capture_records = 0;
+	crud_capture_threads = 0;
+	crud_capture_generation ++;
+	crud_capture_started = crud_hist_now();
+	crud_capture_enabled = 1;
+	pthread_mutex_unlock( &crud_capture_lock );
+	logMessage( LOG_INFO_LEVEL, "CRUD capture: capturing requests to [%s]%s", path, crc ? " (checksummed)" : "" );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_record
+// Description  : Record a request, writing out the buffer if this fills it
+//
+// Inputs       : op - the request
+//                res - the response (-1 if the request failed)
+//                buf - the payload (CREATE/UPDATE sent, READ received)
+//                objver - the object version sent
+//                resver - the object version returned
+//                start - when the request was sent (crud_hist_now)
+//                end - when the response came back (crud_hist_now)
+// Outputs      : none
+
+void crud_capture_record( CrudRequest op, CrudResponse res, void *buf, uint64_t objver, uint64_t resver,
+		uint64_t start, uint64_t end ) {
+
+	// Local variables
+	CrudCaptureRecord rec;
+
+	// Fill in the record (the checksum outside of the lock)
+	memset( &rec, 0x0, sizeof(rec) );
+	rec.start = (start > crud_capture_started) ? start-crud_capture_started : 0;
+	rec.request = op;
+	rec.response = res;
+	rec.objver = objver;
+	rec.resver = resver;
+	rec.nsecs = (end-start > UINT32_MAX) ? UINT32_MAX : end-start;
+	if ( (crud_codec_req(op) == CRUD_CREATE) || (crud_codec_req(op) == CRUD_UPDATE) ) {
+		rec.sent = crud_codec_length( op );
+	} else if ( (crud_codec_req(op) == CRUD_READ) && (res != (CrudResponse)-1) && !crud_codec_result(res) ) {
+		rec.received = crud_codec_length( res );
+	}
+	if ( (crud_capture_flags & CRUD_CAPTURE_CHECKSUMS) && (buf != NULL) && (rec.sent+rec.received > 0) ) {
+		rec.crc = crud_crc32c( 0, buf, rec.sent+rec.received );
+	}
+
+	// Add it to the buffer (numbering the thread the first time through)
+	pthread_mutex_lock( &crud_capture_lock );
+	if ( crud_capture_fd != -1 ) {
+		if ( crud_capture_numbered != crud_capture_generation ) {
+			crud_capture_thread = crud_capture_threads ++;
+			crud_capture_numbered = crud_capture_generation;
+		}
+		rec.thread = crud_capture_thread;
+		crud_capture_buffer[crud_capture_used++] = rec;
+		crud_capture_records ++;
+		if ( crud_capture_used == CRUD_CAPTURE_BUFFER ) {
+			crud_capture_flush();
+		}
+	}
+	pthread_mutex_unlock( &crud_capture_lock );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_stop
+// Description  : Write out the records buffered and stop capturing
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_capture_stop( void ) {
+
+	// Local variables
+	int ret = 0;
+
+	pthread_mutex_lock( &crud_capture_lock );
+	if ( crud_capture_fd != -1 ) {
+		ret = crud_capture_flush();
+		if ( crud_capture_fd != -1 ) {
+			close( crud_capture_fd );
+			crud_capture_fd = -1;
+			logMessage( LOG_INFO_LEVEL, "CRUD capture: %lu requests from %u threads captured to [%s]",
+					crud_capture_records, crud_capture_threads, crud_capture_name );
+		}
+	}
+	crud_capture_enabled = 0;
+	pthread_mutex_unlock( &crud_capture_lock );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_replay
+// Description  : Replay a capture against the selected backend
+//
+// Inputs       : spec - the capture file, optionally followed by :timed
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_capture_replay( const char *spec ) {
+
+	// Local variables
+	char path[CRUD_CAPTURE_MAX_PATH];
+	uint64_t differ;
+	int timed;
+
+	if ( (timed = crud_capture_spec(spec, "timed", path)) == -1 ) {
+		return( -1 );
+	}
+	return( crud_capture_run(path, timed, &differ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_spec
+// Description  : Split the file name from an option that may follow it
+//
+// Inputs       : spec - the spec (<file>[:<option>])
+//                option - the option
+//                path - the file name (returned, CRUD_CAPTURE_MAX_PATH)
+// Outputs      : 1 if the option is given, 0 if not, -1 if failure
+
+static int crud_capture_spec( const char *spec, const char *option, char *path ) {
+
+	// Local variables
+	const char *colon = strrchr( spec, ':' );
+	size_t len = strlen( spec );
+
+	if ( (colon != NULL) && (strcmp(colon+1, option) == 0) ) {
+		len = colon-spec;
+	}
+	if ( (len == 0) || (len >= CRUD_CAPTURE_MAX_PATH) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: bad capture file [%s]", spec );
+		return( -1 );
+	}
+	memcpy( path, spec, len );
+	path[len] = 0x0;
+	return( len < strlen(spec) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_flush
+// Description  : Write out the records buffered (the lock is held), the
+//                capture stops if they cannot be
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_capture_flush( void ) {
+
+	// Local variables
+	ssize_t len = sizeof(CrudCaptureRecord)*crud_capture_used;
+
+	if ( (len > 0) && (write(crud_capture_fd, crud_capture_buffer, len) != len) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure writing [%s], error: %s, capture stopped.",
+				crud_capture_name, strerror(errno) );
+		close( crud_capture_fd );
+		crud_capture_fd = -1;
+		crud_capture_enabled = 0;
+		return( -1 );
+	}
+	crud_capture_used = 0;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_exit
+// Description  : Stop capturing as the process exits (so the last records
+//                are written)
+//
+// Inputs       : none
+// Outputs      : none
+
+static void crud_capture_exit( void ) {
+	crud_capture_stop();
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_run
+// Description  : Replay a capture: map it, start a thread for each thread
+//                captured (the requests of each are sent in order, on a
+//                session of their own), then report the latencies against
+//                the captured ones.
+//
+// Inputs       : path - the capture file
+//                timed - flag indicating the requests are sent when they
+//                        were captured
+//                differ - the requests whose result differs (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_capture_run( const char *path, int timed, uint64_t *differ ) {
+
+	// Local variables
+	CrudCaptureReplay replay;
+	CrudCaptureWorker *workers;
+	CrudCaptureHeader *hdr;
+	CrudCaptureObject *obj;
+	HtIterator it;
+	struct stat st;
+	uint32_t threads = 0, started = 0, i;
+	uint64_t rec, start, *order = NULL, offset;
+	char *map;
+	int fd, ret = 0;
+
+	// Open and map the capture, check the header
+	if ( ((fd = open(path, O_RDONLY)) == -1) || (fstat(fd, &st) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure opening [%s], error: %s.", path, strerror(errno) );
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		return( -1 );
+	}
+	if ( (st.st_size < (off_t)sizeof(CrudCaptureHeader)) ||
+		 ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure mapping [%s]", path );
+		close( fd );
+		return( -1 );
+	}
+	close( fd );
+	hdr = (CrudCaptureHeader *)map;
+	if ( memcmp(hdr->magic, CRUD_CAPTURE_MAGIC, sizeof(hdr->magic)) || (hdr->order != CRUD_CAPTURE_ORDER) ||
+		 ((st.st_size-sizeof(CrudCaptureHeader)) % sizeof(CrudCaptureRecord)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: [%s] is not a capture (or has the wrong byte order)", path );
+		munmap( map, st.st_size );
+		return( -1 );
+	}
+	memset( &replay, 0x0, sizeof(replay) );
+	replay.records = (CrudCaptureRecord *)(map + sizeof(CrudCaptureHeader));
+	replay.count = (st.st_size-sizeof(CrudCaptureHeader)) / sizeof(CrudCaptureRecord);
+	replay.timed = timed;
+	madvise( map, st.st_size, MADV_SEQUENTIAL );
+
+	// Find the threads captured
+	for ( rec=0; rec<replay.count; rec++ ) {
+		threads = (replay.records[rec].thread >= threads) ? replay.records[rec].thread+1 : threads;
+	}
+	if ( threads > CRUD_CAPTURE_MAX_THREADS ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD capture: too many threads captured [%u]", threads );
+		munmap( map, st.st_size );
+		return( -1 );
+	}
+	workers = calloc( threads ? threads : 1, sizeof(CrudCaptureWorker) );
+	if ( (workers == NULL) || ((order = malloc(sizeof(uint64_t)*(replay.count ? replay.count : 1))) == NULL) ) {
+		free( workers );
+		munmap( map, st.st_size );
+		return( -1 );
+	}
+
+	// Give each its records, in order
+	for ( rec=0; rec<replay.count; rec++ ) {
+		workers[replay.records[rec].thread].count ++;
+	}
+	for ( i=0, offset=0; i<threads; i++ ) {
+		workers[i].replay = &replay;
+		workers[i].thread = i;
+		workers[i].order = &order[offset];
+		offset += workers[i].count;
+		workers[i].count = 0;
+	}
+	for ( rec=0; rec<replay.count; rec++ ) {
+		workers[replay.records[rec].thread].order[workers[replay.records[rec].thread].count++] = rec;
+	}
+	replay.workers = workers;
+	replay.threads = threads;
+	initHashTable( &replay.objects, CRUD_CAPTURE_OBJECT_BITS );
+	pthread_mutex_init( &replay.lock, NULL );
+
+	// Replay each thread on a thread of its own (the only one on this one),
+	// timed sleeps are not stretched by the timer slack
+	if ( timed ) {
+		prctl( PR_SET_TIMERSLACK, 1 );
+	}
+	start = replay.start = crud_hist_now();
+	for ( started=0; (threads > 1) && (started < threads); started++ ) {
+		if ( pthread_create(&workers[started].handle, NULL, crud_capture_worker, &workers[started]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD capture: failure starting replay thread %u", started );
+			ret = -1;
+			break;
+		}
+	}
+	if ( threads == 1 ) {
+		crud_capture_worker( &workers[0] );
+	}
+	for ( i=0, *differ=0; i<threads; i++ ) {
+		if ( (threads > 1) && (i < started) ) {
+			pthread_join( workers[i].handle, NULL );
+		}
+		ret |= workers[i].ret;
+		*differ += workers[i].differ;
+	}
+	if ( ret == 0 ) {
+		crud_capture_report( &replay, workers, threads, path, crud_hist_now()-start );
+	}
+
+	// Cleanup and return
+	initHashTableIterator( &replay.objects, &it );
+	while ( (obj = iterateHashTable(&it)) != NULL ) {
+		free( obj );
+	}
+	cleanupHashTable( &replay.objects );
+	pthread_mutex_destroy( &replay.lock );
+	free( workers );
+	free( order );
+	munmap( map, st.st_size );
+	return( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_worker
+// Description  : Send the requests of a captured thread, the objects named
+//                by the OIDs they get in the replay (and the versions they
+//                have in it), the payloads made up.  A request is not sent
+//                before the requests of the other threads that were
+//                answered before it was sent in the capture.
+//
+// Inputs       : arg - the replay thread (CrudCaptureWorker)
+// Outputs      : NULL
+
+static void *crud_capture_worker( void *arg ) {
+
+	// Local variables
+	CrudCaptureWorker *worker = arg;
+	CrudCaptureReplay *replay = worker->replay;
+	CrudCaptureRecord *rec;
+	CrudCaptureObject *obj;
+	CRUD_REQUEST_TYPES req;
+	CrudResponse res;
+	CrudOID oid;
+	struct timespec ts;
+	unsigned char *buf = NULL, *nbuf;
+	uint64_t i, k, objver, when, sent;
+	uint32_t len, size = 0, j;
+
+	for ( j=0; j<CRUD_MAXVAL; j++ ) {
+		crud_hist_init( &worker->captured[j] );
+		crud_hist_init( &worker->replayed[j] );
+	}
+	for ( k=0; k<worker->count; k++, __atomic_store_n(&worker->done, k, __ATOMIC_RELEASE) ) {
+		i = worker->order[k];
+		rec = &replay->records[i];
+
+		// Make the buffer big enough (with a pattern to send)
+		req = crud_codec_req( rec->request );
+		len = crud_codec_length( rec->request );
+		if ( req >= CRUD_MAXVAL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD capture: bad request in record %lu", i );
+			worker->ret = -1;
+			break;
+		}
+		if ( len > size ) {
+			if ( (nbuf = realloc(buf, len)) == NULL ) {
+				worker->ret = -1;
+				break;
+			}
+			buf = nbuf;
+			for ( j=size; j<len; j++ ) {
+				buf[j] = 'a' + j%26;
+			}
+			size = len;
+		}
+
+		// Name the object as the replay knows it
+		oid = crud_codec_oid( rec->request );
+		objver = rec->objver;
+		pthread_mutex_lock( &replay->lock );
+		if ( (obj = findValueInHashTable(&replay->objects, oid)) != NULL ) {
+			oid = obj->oid;
+			objver = objver ? obj->version : 0;
+		}
+		pthread_mutex_unlock( &replay->lock );
+
+		// Send it (when it was captured if timed)
+		crud_capture_wait( worker, rec );
+		if ( replay->timed ) {
+			when = replay->start + rec->start;
+			if ( crud_hist_now() < when ) {
+				ts.tv_sec = when/1000000000;
+				ts.tv_nsec = when%1000000000;
+				while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR );
+			}
+			sent = when;
+		} else {
+			sent = crud_hist_now();
+		}
+		res = crud_backend_versioned( crud_codec_encode(oid, req, len, crud_codec_flags(rec->request), 0),
+				buf, &objver );
+		crud_hist_record( &worker->replayed[req], crud_hist_now()-sent );
+		crud_hist_record( &worker->captured[req], rec->nsecs );
+		worker->requests ++;
+		if ( (res == (CrudResponse)-1) && (rec->response != (CrudResponse)-1) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD capture: replay of record %lu failed", i );
+			worker->ret = -1;
+			break;
+		}
+		if ( crud_codec_result(res) != crud_codec_result(rec->response) ) {
+			worker->differ ++;
+		}
+		if ( crud_codec_result(res) || crud_codec_result(rec->response) ) {
+			continue;
+		}
+
+		// Keep track of the objects made, changed and deleted
+		pthread_mutex_lock( &replay->lock );
+		oid = crud_codec_oid( rec->response );
+		obj = findValueInHashTable( &replay->objects, oid );
+		if ( req == CRUD_DELETE ) {
+			if ( obj != NULL ) {
+				deleteValueFromHashTable( &replay->objects, oid );
+				free( obj );
+			}
+		} else if ( (req == CRUD_CREATE) && (obj == NULL) ) {
+			if ( (obj = malloc(sizeof(CrudCaptureObject))) != NULL ) {
+				obj->oid = crud_codec_oid( res );
+				obj->version = objver;
+				insertValueInHashTable( &replay->objects, oid, obj );
+			}
+		} else if ( obj != NULL ) {
+			obj->oid = (req == CRUD_CREATE) ? crud_codec_oid(res) : obj->oid;
+			obj->version = objver;
+		}
+		pthread_mutex_unlock( &replay->lock );
+	}
+
+	// The other threads need not wait for what is not sent
+	__atomic_store_n( &worker->done, worker->count, __ATOMIC_RELEASE );
+	free( buf );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_wait
+// Description  : Wait until the other threads of a replay sent the requests
+//                that were answered before a request was sent in the
+//                capture (those of a thread are the first of its records,
+//                as each thread sent one request at a time)
+//
+// Inputs       : worker - the replay thread
+//                rec - the request it sends next
+// Outputs      : none
+
+static void crud_capture_wait( CrudCaptureWorker *worker, CrudCaptureRecord *rec ) {
+
+	// Local variables
+	CrudCaptureReplay *replay = worker->replay;
+	CrudCaptureWorker *other;
+	CrudCaptureRecord *prev;
+	uint64_t lo, hi, mid;
+	uint32_t i;
+
+	for ( i=0; i<replay->threads; i++ ) {
+		other = &replay->workers[i];
+		if ( other == worker ) {
+			continue;
+		}
+
+		// Count the records answered before this one was sent
+		lo = 0;
+		hi = other->count;
+		while ( lo < hi ) {
+			mid = (lo+hi)/2;
+			prev = &replay->records[other->order[mid]];
+			if ( prev->start+prev->nsecs <= rec->start ) {
+				lo = mid+1;
+			} else {
+				hi = mid;
+			}
+		}
+		while ( __atomic_load_n(&other->done, __ATOMIC_ACQUIRE) < lo ) {
+			sched_yield();
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_report
+// Description  : Log the replay, and the latencies of each request type as
+//                captured and as replayed
+//
+// Inputs       : replay - the replay
+//                workers - the replay threads
+//                threads - the number of them
+//                path - the capture file
+//                nsecs - how long the replay took
+// Outputs      : none
+
+static void crud_capture_report( CrudCaptureReplay *replay, CrudCaptureWorker *workers, uint32_t threads,
+		const char *path, uint64_t nsecs ) {
+
+	// Local variables
+	CrudHistogram *captured, *replayed;
+	uint64_t requests = 0, differ = 0, span = 0, rec;
+	uint32_t i, j;
+
+	// Merge the threads (the first holds the totals)
+	for ( i=0; i<threads; i++ ) {
+		requests += workers[i].requests;
+		differ += workers[i].differ;
+		for ( j=0; (i > 0) && (j<CRUD_MAXVAL); j++ ) {
+			crud_hist_merge( &workers[0].captured[j], &workers[i].captured[j] );
+			crud_hist_merge( &workers[0].replayed[j], &workers[i].replayed[j] );
+		}
+	}
+	for ( rec=0; rec<replay->count; rec++ ) {
+		span = (replay->records[rec].start+replay->records[rec].nsecs > span) ?
+				replay->records[rec].start+replay->records[rec].nsecs : span;
+	}
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_CAPTURE : replayed %lu requests of [%s] on %u threads%s in %.3f secs "
+			"(%.1f requests/sec, captured in %.3f secs), %lu results differ", requests, path, threads,
+			replay->timed ? " (timed)" : "", nsecs/1e9, (nsecs > 0) ? requests*1e9/nsecs : 0.0, span/1e9, differ );
+	if ( threads == 0 ) {
+		return;
+	}
+
+	// Then each request type
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_CAPTURE : %-10s %9s %12s %12s %12s %12s %12s %12s", "request", "count",
+			"cap mean", "cap p50", "cap p99", "mean", "p50", "p99" );
+	for ( j=0; j<CRUD_MAXVAL; j++ ) {
+		captured = &workers[0].captured[j];
+		replayed = &workers[0].replayed[j];
+		if ( replayed->count > 0 ) {
+			logMessage( LOG_OUTPUT_LEVEL, "CRUD_CAPTURE : %-10s %9lu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f",
+					CRUD_REQUEST_TYPE_LABLES[j], replayed->count, crud_hist_mean(captured)/1000.0,
+					crud_hist_percentile(captured, 50.0)/1000.0, crud_hist_percentile(captured, 99.0)/1000.0,
+					crud_hist_mean(replayed)/1000.0, crud_hist_percentile(replayed, 50.0)/1000.0,
+					crud_hist_percentile(replayed, 99.0)/1000.0 );
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_capture_unit_test
+// Description  : Capture (checksummed) requests sent straight to the backend,
+//                more than fill the buffer, and check each record against
+//                the request sent.  Then replay the capture, as fast as it
+//                goes and timed, and check the results are the same.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_capture_unit_test( void ) {
+
+	// Local variables
+	CrudRequest *ops;
+	CrudResponse res;
+	CrudOID oids[CRUD_CAPTURE_UNIT_TEST_OBJECTS];
+	CrudCaptureHeader *hdr;
+	CrudCaptureRecord *rec;
+	unsigned char *buf;
+	struct stat st;
+	uint64_t i, count = 0, differ, last = 0;
+	uint32_t crc, len, obj;
+	char *map = MAP_FAILED;
+	int fd, ret = -1;
+
+	// Capture the requests
+	ops = malloc( sizeof(CrudRequest)*(CRUD_CAPTURE_UNIT_TEST_REQUESTS+CRUD_CAPTURE_UNIT_TEST_OBJECTS+4) );
+	buf = malloc( CRUD_CAPTURE_UNIT_TEST_SIZE );
+	if ( (ops == NULL) || (buf == NULL) || crud_capture_start(CRUD_CAPTURE_UNIT_TEST_FILE ":crc") ) {
+		free( ops );
+		free( buf );
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_CAPTURE_UNIT_TEST_SIZE; i++ ) {
+		buf[i] = 'A' + i%26;
+	}
+	crc = crud_crc32c( 0, buf, CRUD_CAPTURE_UNIT_TEST_SIZE );
+	ops[count++] = crud_codec_encode( 0, CRUD_INIT, 0, 0, 0 );
+	ops[count++] = crud_codec_encode( 0, CRUD_FORMAT, 0, 0, 0 );
+	for ( i=0; i<count; i++ ) {
+		if ( (res = crud_backend_operation(ops[i], NULL)) == (CrudResponse)-1 || crud_codec_result(res) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : setup failed" );
+			crud_capture_stop();
+			free( ops );
+			free( buf );
+			return( -1 );
+		}
+	}
+	for ( obj=0; obj<CRUD_CAPTURE_UNIT_TEST_OBJECTS; obj++ ) {
+		ops[count] = crud_codec_encode( 0, CRUD_CREATE, CRUD_CAPTURE_UNIT_TEST_SIZE, 0, 0 );
+		res = crud_backend_operation( ops[count++], buf );
+		oids[obj] = crud_codec_oid( res );
+	}
+	for ( i=0; i<CRUD_CAPTURE_UNIT_TEST_REQUESTS; i++ ) {
+		obj = getRandomValue( 0, CRUD_CAPTURE_UNIT_TEST_OBJECTS-1 );
+		ops[count] = crud_codec_encode( oids[obj], (i%4) ? CRUD_READ : CRUD_UPDATE, CRUD_CAPTURE_UNIT_TEST_SIZE, 0, 0 );
+		res = crud_backend_operation( ops[count++], buf );
+		if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : request %lu failed", i );
+			crud_capture_stop();
+			free( ops );
+			free( buf );
+			return( -1 );
+		}
+	}
+	ops[count] = crud_codec_encode( oids[0], CRUD_DELETE, 0, 0, 0 );
+	crud_backend_operation( ops[count++], NULL );
+	ops[count] = crud_codec_encode( 0, CRUD_CLOSE, 0, 0, 0 );
+	crud_backend_operation( ops[count++], NULL );
+	crud_capture_stop();
+
+	// Check the records against the requests
+	if ( ((fd = open(CRUD_CAPTURE_UNIT_TEST_FILE, O_RDONLY)) != -1) && (fstat(fd, &st) == 0) &&
+		 (st.st_size == (off_t)(sizeof(CrudCaptureHeader)+count*sizeof(CrudCaptureRecord))) ) {
+		map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	}
+	if ( fd != -1 ) {
+		close( fd );
+	}
+	if ( map == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : capture missing or the wrong size" );
+		unlink( CRUD_CAPTURE_UNIT_TEST_FILE );
+		free( ops );
+		free( buf );
+		return( -1 );
+	}
+	hdr = (CrudCaptureHeader *)map;
+	rec = (CrudCaptureRecord *)(map + sizeof(CrudCaptureHeader));
+	if ( memcmp(hdr->magic, CRUD_CAPTURE_MAGIC, sizeof(hdr->magic)) || (hdr->flags != CRUD_CAPTURE_CHECKSUMS) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : bad capture header" );
+		i = 0;
+	} else {
+		for ( i=0; i<count; i++, rec++ ) {
+			len = ((crud_codec_req(ops[i]) == CRUD_CREATE) || (crud_codec_req(ops[i]) == CRUD_UPDATE) ||
+					(crud_codec_req(ops[i]) == CRUD_READ)) ? CRUD_CAPTURE_UNIT_TEST_SIZE : 0;
+			if ( (rec->request != ops[i]) || (rec->thread != 0) || (rec->start < last) ||
+				 (rec->sent+rec->received != len) || (rec->crc != (len ? crc : 0)) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : bad record %lu [%s, %u/%u bytes, crc %x]", i,
+						CRUD_REQUEST_TYPE_LABLES[crud_codec_req(rec->request)], rec->sent, rec->received, rec->crc );
+				break;
+			}
+			last = rec->start;
+		}
+	}
+	munmap( map, st.st_size );
+
+	// Replay it both ways, the results should be the same
+	if ( i == count ) {
+		if ( crud_capture_run(CRUD_CAPTURE_UNIT_TEST_FILE, 0, &differ) || differ ||
+			 crud_capture_run(CRUD_CAPTURE_UNIT_TEST_FILE, 1, &differ) || differ ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_CAPTURE_UNIT_TEST : replay failed (or differs)" );
+		} else {
+			ret = 0;
+		}
+	}
+
+	// Cleanup, log and return
+	unlink( CRUD_CAPTURE_UNIT_TEST_FILE );
+	free( ops );
+	free( buf );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD capture unit test completed successfully." );
+	}
+	return( ret );
+}
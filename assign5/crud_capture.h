@@ -0,0 +1,91 @@
+#ifndef CRUD_CAPTURE_INCLUDED
+#define CRUD_CAPTURE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_capture.h
+//  Description   : This is the interface to the request capture.  Once
+//                  started, every request the filesystem sends to its
+//                  backend (see crud_backend_versioned) is recorded with the
+//                  response, when it was sent and how long it took, the
+//                  payload sizes and (optionally) a checksum of the payload.
+//                  The records are buffered and written to the capture file
+//                  a buffer at a time.  A capture can then be replayed
+//                  straight against a backend (the server), without the
+//                  filesystem, to benchmark it in isolation.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines
+#define CRUD_CAPTURE_MAGIC "CRUDCAP1"  // The first bytes of a capture
+#define CRUD_CAPTURE_ORDER 0x01020304  // Written as is, to detect the byte order
+#define CRUD_CAPTURE_BUFFER 4096       // The records buffered before they are written
+#define CRUD_CAPTURE_MAX_THREADS 64    // The most threads a capture can hold
+#define CRUD_CAPTURE_CHECKSUMS 0x1     // Flag indicating the payloads are checksummed
+
+//
+// Type definitions
+
+// This is the header of a capture (host byte order, see order)
+typedef struct {
+	char     magic[8]; // CRUD_CAPTURE_MAGIC (not terminated)
+	uint32_t order;    // CRUD_CAPTURE_ORDER
+	uint32_t flags;    // The capture flags (CRUD_CAPTURE_CHECKSUMS)
+	uint64_t started;  // When the capture started (nsecs since the epoch)
+} CrudCaptureHeader;
+
+// This is a record of a capture, a request and its response
+typedef struct {
+	uint64_t start;    // When the request was sent (nsecs after the capture started)
+	uint64_t request;  // The request (CrudRequest)
+	uint64_t response; // The response (CrudResponse, all ones if it failed)
+	uint64_t objver;   // The object version sent
+	uint64_t resver;   // The object version returned
+	uint32_t nsecs;    // How long the request took (nsecs, at most UINT32_MAX)
+	uint32_t thread;   // The thread that sent it (numbered as they first send)
+	uint32_t sent;     // The payload bytes sent (CREATE/UPDATE)
+	uint32_t received; // The payload bytes received (READ)
+	uint32_t crc;      // The CRC32C of the payload (0 if not checksummed)
+	uint32_t unused;   // Unused (0)
+} CrudCaptureRecord;
+
+//
+// Global data
+
+extern int crud_capture_enabled; // Flag indicating requests are being captured
+
+//
+// Capture interface
+
+int crud_capture_start( const char *spec );
+	// Start capturing the requests to a file ("<file>[:crc]", checksumming
+	// the payloads if crc is given)
+
+void crud_capture_record( CrudRequest op, CrudResponse res, void *buf, uint64_t objver, uint64_t resver,
+		uint64_t start, uint64_t end );
+	// Record a request (start and end on the crud_hist_now clock)
+
+int crud_capture_stop( void );
+	// Write out the records buffered and stop capturing (also done at exit)
+
+int crud_capture_replay( const char *spec );
+	// Replay a capture against the selected backend ("<file>[:timed]", each
+	// request sent when it was captured if timed is given, as soon as the
+	// one before is done if not), a thread for each thread captured
+
+//
+// Unit Testing
+
+int crud_capture_unit_test( void );
+	// Capture requests to the memory backend, check the records and replay
+	// them
+
+#endif
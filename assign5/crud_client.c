@@ -2,6 +2,18 @@
 //
 //  File          : crud_client.c
 //  Description   : This is the client side of the CRUD communication protocol.
+//                  Version 2 of the protocol is asked for at INIT, and once
+//                  the server agrees the requests go out in the version 2
+//                  format (see crud_driver.h).  crud_client_stream gives
+//                  access to large objects a chunk at a time.  Payload
+//                  checksums are asked for at INIT too (-k), and so are read
+//                  leases (-L), which let the client keep the objects it
+//                  reads and writes until the server says they changed
+//                  (each invalidation is acknowledged, the change is not
+//                  answered until it is).
+//                  Leasing clients ask for object versions as well, so a
+//                  copy whose lease ran out is revalidated with a
+//                  conditional READ rather than read again.
 //
 //   Author       : John Stockwell
 //  Last Modified : Wed Dec 10 12:49 EDT 2014
@@ -11,27 +23,123 @@
 
 // Project Include Files
 #include <crud_network.h>
+#include <crud_codec.h>
+#include <crud_crc.h>
+#include <cmpsc311_hashtable.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 
-// Global variables
-int            crud_network_shutdown = 0; // Flag indicating shutdown
+// Global variables (the connection and the cache belong to the thread, so
+// each thread of a process is a client of its own to the server)
+volatile sig_atomic_t crud_network_shutdown = 0; // Flag indicating shutdown
 unsigned char *crud_network_address = NULL; // Address of CRUD server 
 unsigned short crud_network_port = 0; // Port of CRUD server
-struct         sockaddr_in v4; // IPV4 address
-int            socket_fd = 0; // Socket file descriptor
-int            connected = 0; // Connected flag
-int64_t        length = 0; // Number of bytes to send or read
+__thread struct sockaddr_in v4; // IPV4 address
+__thread int   socket_fd = 0; // Socket file descriptor
+__thread int   connected = 0; // Connected flag
+int            crud_network_protocol = CRUD_PROTOCOL_V2; // Version to ask for at INIT
+__thread int   version = CRUD_PROTOCOL_V1; // Version agreed on with the server
+int            crud_network_checksums = 0; // Ask for payload checksums at INIT
+__thread int   checksums = 0; // Payload checksums agreed on with the server
+int            crud_network_leases = 0; // Ask for read leases at INIT
+__thread int   leases = 0; // Read leases agreed on with the server
+int            crud_network_versions = 0; // Ask for object versions at INIT
+__thread int   versions = 0; // Object versions agreed on with the server
+__thread unsigned char *chunkBuf = NULL; // Buffer for streamed chunks
+__thread HTable cache; // The objects held under a lease (by OID)
+__thread int   cacheReady = 0; // Cache set up flag
+__thread uint64_t cacheBytes = 0; // Bytes of objects in the cache
+__thread uint64_t cacheHits = 0, cacheMisses = 0, cacheInvalidations = 0, cacheRevalidations = 0; // Cache counters
+
+// Defines
+#define CRUD_CLIENT_TEST_SIZE (8*1024*1024) // Size of the unit test object
+#define CRUD_CLIENT_CACHE_SIZE (64*1024*1024) // Most bytes of objects cached
+#define CRUD_CLIENT_CACHE_BITS 12 // Width of the cache hash table
+#define CRUD_CLIENT_INVALIDATE_WAIT 1000000 // Longest wait for an invalidation (usecs)
+#define CRUD_CLIENT_CHILD_POLL 10 // How often waitChild looks at the child (msecs)
+#define CRUD_CLIENT_CAS_CLIENTS 4 // Clients adding to the counter in casUnitTest
+#define CRUD_CLIENT_CAS_ADDS 200 // Additions made by each of them
+#define CRUD_BENCH_OBJECTS 64 // Objects shared by the benchmark clients
+#define CRUD_BENCH_OBJECT_SIZE 4096 // Size of each benchmark object
+#define CRUD_BENCH_OPERATIONS 20000 // Operations run by each benchmark client
+#define CRUD_BENCH_UPDATE_RATE 20 // One benchmark operation in this many updates
+
+// Type for an object in the cache
+typedef struct
+{
+	CrudOID oid; // The object
+	uint32_t length; // The size of the object
+	uint64_t expires; // When the lease runs out (usecs, see leaseNow)
+	uint64_t version; // The object version (0 if not agreed on)
+	unsigned char data[]; // The contents
+} CacheEntry;
+
+// Type for copying a streamed payload to/from a buffer
+typedef struct
+{
+	unsigned char *buf; // The buffer
+	uint64_t size; // The size of the buffer
+	int out; // Flag indicating the payload goes out to the server
+} CopyStream;
+
+// Type for the streams of the unit test
+typedef struct
+{
+	uint64_t seed; // The pattern of the object
+	uint64_t checked; // The bytes checked so far
+} PatternStream;
+
+// Type for what the benchmark clients share (mapped across the processes)
+typedef struct
+{
+	CrudOID oid[CRUD_BENCH_OBJECTS]; // The objects
+	uint64_t committed[CRUD_BENCH_OBJECTS]; // The last value the server took for each
+	uint64_t reads, updates, hits, invalidations, revalidations; // Totals over the clients
+	uint64_t stale; // Reads older than a value taken before they started
+	uint64_t failed; // Clients that failed (or read something wrong)
+} BenchShared;
 
 // Functions
-int64_t getRequest(CrudRequest res);
 int     establishConnection();
-int64_t receive(CrudRequest req, void *buf);
-int64_t send1(CrudRequest req, void *buf);
+int64_t receive(CrudRequest req, void *buf, uint64_t *objver);
+int64_t send1(CrudRequest req, void *buf, uint64_t objver);
+CrudResponse operation2(CrudRequest op, void *buf, uint64_t *objver);
+int     copyChunk(void *arg, void *chunk, uint32_t len, uint64_t offset);
+uint32_t initOptions();
+void    agreeOptions(uint32_t options);
+int     patternChunk(void *arg, void *chunk, uint32_t len, uint64_t offset);
+int     checkChunk(void *arg, void *chunk, uint32_t len, uint64_t offset);
+int     readBytes(void *buf, uint64_t len);
+int     writeBytes(void *buf, uint64_t len);
+int     readResponse(uint64_t *wire);
+int     headerFormat();
+int     drainInvalidations();
+int     acknowledgeInvalidation(CrudOID oid);
+pid_t   waitChild(pid_t pid, int *status);
+uint64_t leaseNow();
+CacheEntry *cachedObject(CrudOID oid);
+void    cacheObject(CrudOID oid, uint32_t len, void *buf, uint64_t expires, uint64_t objver);
+void    dropCached(CrudOID oid);
+void    dropCache();
+void    keepObject(CrudRequest op, CrudResponse res, void *buf, uint64_t sent, uint64_t objver);
+void    resetConnection();
+int     benchClient(BenchShared *shared, int me, int clients);
+int     leaseUnitTest();
+int     casUnitTest();
+void    benchObject(unsigned char *buf, uint64_t value);
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -48,10 +156,29 @@ int64_t send1(CrudRequest req, void *buf);
 // Outputs      : the response structure encoded as needed
 
 CrudResponse crud_client_operation(CrudRequest op, void *buf) 
+{
+	uint64_t objver = 0;
+
+	return crud_client_versioned(op, buf, &objver);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : crud_client_versioned
+//// Description  : The client operation, carrying an object version to and
+////		    from the server (e.g., for a CRUD_IF_VERSION UPDATE).  The
+////		    version is only sent and returned once the server agreed on
+////		    object versions, otherwise it comes back 0.
+////
+//// Inputs       : op - the request opcode for the command
+////		    buf - the block to be read/written from (READ/WRITE)
+////		    objver - the object version to send (the response's on return)
+//// Outputs      : the response structure encoded as needed
+CrudResponse crud_client_versioned(CrudRequest op, void *buf, uint64_t *objver)
 {
 
 	/* Some debug output.
-	 * switch(getRequest(op))
+	 * switch(crud_codec_req(op))
 	{
 		case CRUD_INIT:
 			logMessage(LOG_INFO_LEVEL, "----------------------------------------");
@@ -84,36 +211,1278 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf)
 	};*/
 
 	CrudResponse res = 0;
-	res = send1(op, buf);
+	CacheEntry *entry;
+	uint64_t sent = 0;
+
+	// Reads of objects we hold a lease on don't go to the server (once the
+	// invalidations already sent to us are seen to), a copy whose lease ran
+	// out is only sent again if it changed (it is in buf if not)
+	if(leases)
+	{
+		if(drainInvalidations())
+			return -1;
+		if(crud_codec_req(op) == CRUD_READ && !crud_codec_flags(op))
+		{
+			entry = cachedObject(crud_codec_oid(op));
+			if(entry != NULL && entry->length <= crud_codec_length(op))
+			{
+				memcpy(buf, entry->data, entry->length);
+				if(leaseNow() < entry->expires)
+				{
+					cacheHits++;
+					*objver = entry->version;
+					return crud_codec_encode(entry->oid, CRUD_READ, entry->length, 0, 0);
+				}
+				op = crud_codec_encode(entry->oid, CRUD_READ, crud_codec_length(op), CRUD_IF_CHANGED, 0);
+				*objver = entry->version;
+			}
+			else
+				cacheMisses++;
+		}
+		sent = leaseNow();
+	}
+
+	// Once version 2 is agreed on everything goes that way
+	if(version >= CRUD_PROTOCOL_V2)
+	{
+		res = operation2(op, buf, objver);
+		if(leases && res != -1)
+		{
+			keepObject(op, res, buf, sent, *objver);
+			res &= ~((CrudResponse)CRUD_IF_CHANGED << CRUD_CODEC_FLAGS_SHIFT);
+		}
+		return res;
+	}
+
+	// Ask for version 2 (and checksums) in the length of the INIT
+	if(crud_codec_req(op) == CRUD_INIT)
+		op = crud_codec_set_length(op, initOptions());
+
+	res = send1(op, buf, *objver);
 	if(res < 0)
 	{
 		logMessage(LOG_ERROR_LEVEL, "crud_client_operation : send failed");
 		return -1;
 	}
 	
-	res = receive(op, buf);
+	res = receive(op, buf, objver);
 	if(res < 0)
 	{
 		logMessage(LOG_ERROR_LEVEL, "crud_client_operation : receive failed");
 		return -1;
 	}
 
+	// The INIT response length is what the server agreed on (0 is version 1)
+	if(crud_codec_req(res) == CRUD_INIT && !crud_codec_result(res))
+	{
+		agreeOptions(crud_codec_length(res));
+		res = crud_codec_set_length(res, 0);
+	}
+
+	if(leases)
+	{
+		keepObject(op, res, buf, sent, *objver);
+		res &= ~((CrudResponse)CRUD_IF_CHANGED << CRUD_CODEC_FLAGS_SHIFT);
+	}
+
 	return res;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : keepObject
+//// Description  : Updates the cache after a request: what we read or wrote
+////		    is kept (the server granted a lease on it from when the
+////		    request was sent), a copy found unchanged just gets the
+////		    new lease, what we deleted (or lost an update race on) is
+////		    dropped, and INIT, FORMAT and CLOSE start over.
+////
+//// Inputs       : op - the request
+////		    res - the response
+////		    buf - the object contents (CREATE/READ/UPDATE)
+////		    sent - when the request was sent (see leaseNow)
+////		    objver - the object version in the response
+//// Outputs      : Nothing
+void keepObject(CrudRequest op, CrudResponse res, void *buf, uint64_t sent, uint64_t objver)
+{
+	CacheEntry *entry;
+
+	if(crud_codec_result(res))
+	{
+		if(crud_codec_req(op) == CRUD_UPDATE && (crud_codec_flags(res) & CRUD_IF_VERSION))
+			dropCached(crud_codec_oid(op));
+		return;
+	}
+
+	switch(crud_codec_req(op))
+	{
+		case CRUD_CREATE:
+		case CRUD_READ:
+		case CRUD_UPDATE:
+			if(crud_codec_flags(op) & CRUD_PRIORITY_OBJECT)
+				break;
+			if(crud_codec_flags(op) & CRUD_IF_CHANGED)
+			{
+				if(!(crud_codec_flags(res) & CRUD_IF_CHANGED))
+					cacheMisses++;
+				else
+				{
+					cacheRevalidations++;
+					entry = cachedObject(crud_codec_oid(res));
+					if(entry != NULL && entry->version == objver)
+					{
+						entry->expires = sent+CRUD_LEASE_TIME;
+						break;
+					}
+				}
+			}
+			cacheObject(crud_codec_oid(res), (crud_codec_req(op) == CRUD_READ) ? crud_codec_length(res) :
+					crud_codec_length(op), buf, sent+CRUD_LEASE_TIME, objver);
+			break;
+		case CRUD_DELETE:
+			dropCached(crud_codec_oid(op));
+			break;
+		case CRUD_CLOSE:
+			logMessage(LOG_INFO_LEVEL, "crud_client : cache %lu hits, %lu revalidated, %lu misses, %lu invalidations",
+					cacheHits, cacheRevalidations, cacheMisses, cacheInvalidations);
+			dropCache();
+			break;
+		case CRUD_INIT:
+		case CRUD_FORMAT:
+			dropCache();
+			break;
+		default:
+			break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : crud_client_stream
+//// Description  : Sends a version 2 request, with the payload streamed a
+////		    chunk at a time.  For CREATE/UPDATE fn fills each chunk
+////		    before it is sent, for READ fn is given each chunk as it
+////		    arrives (hdr->length is the most that will be taken).
+////
+//// Inputs       : hdr - the request (replaced by the response)
+////		    fn - the function producing/consuming the chunks
+////		    arg - passed to fn
+//// Outputs      : 0 if successful, -1 if unsuccessful (or the response failed)
+int crud_client_stream(CrudHeader *hdr, CrudStreamFunction fn, void *arg)
+{
+	uint64_t wire[4], offset = 0, limit = hdr->length;
+	uint32_t chunk = 0, prefix, crc = 0, trailer;
+	struct iovec iov[2];
+	ssize_t n;
+	int failed = 0;
+
+	if(!connected || version < CRUD_PROTOCOL_V2)
+	{
+		logMessage(LOG_ERROR_LEVEL, "crud_client_stream : version 2 not agreed on with server");
+		return -1;
+	}
+	if(chunkBuf == NULL && (chunkBuf = malloc(CRUD_MAX_CHUNK_SIZE)) == NULL)
+		return -1;
+
+	// Send the header, then the payload (if any)
+	pack_crud_header(hdr, headerFormat(), wire);
+	if(writeBytes(wire, size_crud_header(headerFormat())))
+		return -1;
+
+	if(hdr->req == CRUD_CREATE || hdr->req == CRUD_UPDATE)
+	{
+		while(offset < hdr->length)
+		{
+			chunk = (hdr->length-offset > CRUD_CHUNK_SIZE) ? CRUD_CHUNK_SIZE : hdr->length-offset;
+			if(fn(arg, chunkBuf, chunk, offset))
+			{
+				// The server is still owed the payload, send it anyway
+				memset(chunkBuf, 0x0, chunk);
+				failed = 1;
+			}
+			if(checksums)
+				crc = crud_crc32c(crc, chunkBuf, chunk);
+			prefix = htonl(chunk);
+			iov[0].iov_base = &prefix;
+			iov[0].iov_len = CRUD_NET_CHUNK_HEADER_SIZE;
+			iov[1].iov_base = chunkBuf;
+			iov[1].iov_len = chunk;
+
+			// Prefix and chunk go out in one write, a short one is finished by hand
+			n = writev(socket_fd, iov, 2);
+			if(n < 0)
+			{
+				logMessage(LOG_ERROR_LEVEL, "crud_client_stream : failed write to server");
+				return -1;
+			}
+			if(n < CRUD_NET_CHUNK_HEADER_SIZE)
+			{
+				if(writeBytes((char *)&prefix+n, CRUD_NET_CHUNK_HEADER_SIZE-n) || writeBytes(chunkBuf, chunk))
+					return -1;
+			}
+			else if(n < CRUD_NET_CHUNK_HEADER_SIZE+chunk)
+			{
+				if(writeBytes(chunkBuf+(n-CRUD_NET_CHUNK_HEADER_SIZE), CRUD_NET_CHUNK_HEADER_SIZE+chunk-n))
+					return -1;
+			}
+			offset += chunk;
+		}
+
+		// The checksum follows the last chunk
+		trailer = htonl(crc);
+		if(checksums && hdr->length > 0 && writeBytes(&trailer, CRUD_TRAILER_SIZE))
+			return -1;
+	}
+
+	// Get the response, then the payload a chunk at a time (none if the
+	// object was not sent because it had not changed)
+	if(readResponse(wire))
+		return -1;
+	unpack_crud_header(wire, headerFormat(), hdr);
+	if(hdr->req == CRUD_INIT && !hdr->res)
+		agreeOptions(hdr->length);
+
+	// Our own changes make the cached copy stale (the caller may keep the new one)
+	if(leases && (hdr->req == CRUD_UPDATE || hdr->req == CRUD_DELETE))
+		dropCached(hdr->oid);
+	else if(leases && (hdr->req == CRUD_FORMAT || hdr->req == CRUD_CLOSE))
+		dropCache();
+
+	if(hdr->req == CRUD_READ && !hdr->res && !(hdr->flags & CRUD_IF_CHANGED))
+	{
+		for(offset = 0; offset < hdr->length; offset += chunk)
+		{
+			if(readBytes(&prefix, CRUD_NET_CHUNK_HEADER_SIZE))
+				return -1;
+			chunk = ntohl(prefix);
+			if(chunk == 0 || chunk > CRUD_MAX_CHUNK_SIZE || chunk > hdr->length-offset)
+			{
+				logMessage(LOG_ERROR_LEVEL, "crud_client_stream : bad chunk from server [%u]", chunk);
+				return -1;
+			}
+			if(readBytes(chunkBuf, chunk))
+				return -1;
+			if(checksums)
+				crc = crud_crc32c(crc, chunkBuf, chunk);
+
+			// Keep draining the payload after the consumer is done
+			if(!failed && (offset+chunk > limit || fn(arg, chunkBuf, chunk, offset)))
+				failed = 1;
+		}
+
+		// Check the payload against the trailer
+		if(checksums && hdr->length > 0)
+		{
+			if(readBytes(&trailer, CRUD_TRAILER_SIZE))
+				return -1;
+			if(ntohl(trailer) != crc)
+			{
+				logMessage(LOG_ERROR_LEVEL, "crud_client_stream : payload checksum mismatch on object %lu", hdr->oid);
+				failed = 1;
+			}
+		}
+	}
+
+	return (failed || hdr->res) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : operation2
+//// Description  : Sends a version 1 request over a version 2 connection
+////
+//// Inputs       : op - A standard 64bit crud request
+////		    buf - the block to be read/written from (READ/WRITE)
+////		    objver - the object version to send (the response's on return)
+//// Outputs      : Returns a standard 64bit response value or -1 if it fails
+CrudResponse operation2(CrudRequest op, void *buf, uint64_t *objver)
+{
+	uint64_t wire[1];
+	CrudHeader hdr;
+	CopyStream copy;
+
+	// Pull the request apart, INIT asks to stay on version 2
+	wire[0] = crud_codec_swap(op);
+	unpack_crud_header(wire, CRUD_PROTOCOL_V1, &hdr);
+	hdr.objver = *objver;
+	if(hdr.req == CRUD_INIT)
+		hdr.length = initOptions();
+
+	copy.buf = buf;
+	copy.size = hdr.length;
+	copy.out = (hdr.req == CRUD_CREATE || hdr.req == CRUD_UPDATE);
+	if(crud_client_stream(&hdr, copyChunk, &copy) && !hdr.res)
+	{
+		logMessage(LOG_ERROR_LEVEL, "crud_client_operation : version 2 request failed");
+		return -1;
+	}
+
+	// Put the response back in the version 1 format
+	if(hdr.req == CRUD_INIT)
+		hdr.length = 0;
+	*objver = hdr.objver;
+	pack_crud_header(&hdr, CRUD_PROTOCOL_V1, wire);
+	return crud_codec_swap(wire[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : copyChunk
+//// Description  : Stream function copying the chunks to/from a buffer
+////
+//// Inputs       : arg - the CopyStream
+////		    chunk - the chunk
+////		    len - the length of the chunk
+////		    offset - where the chunk goes in the payload
+//// Outputs      : 0 if successful, -1 if the chunk does not fit
+int copyChunk(void *arg, void *chunk, uint32_t len, uint64_t offset)
+{
+	CopyStream *copy = arg;
+
+	if(offset+len > copy->size)
+		return -1;
+
+	// Payloads going out come from the buffer, coming in go to it
+	if(copy->out)
+		memcpy(chunk, copy->buf+offset, len);
+	else
+		memcpy(copy->buf+offset, chunk, len);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : initOptions
+//// Description  : Works out the length to send in an INIT, the version asked
+////		    for plus the options (plain version 1 sends 0)
+////
+//// Inputs       : Nothing (uses the -n, -k, -L and -V settings, leases come
+////		    with object versions)
+//// Outputs      : The INIT length
+uint32_t initOptions()
+{
+	uint32_t options = (crud_network_protocol >= CRUD_PROTOCOL_V2) ? CRUD_PROTOCOL_V2 : CRUD_PROTOCOL_V1;
+
+	if(crud_network_checksums)
+		options |= CRUD_PROTOCOL_CRC32C;
+	if(crud_network_leases)
+		options |= CRUD_PROTOCOL_LEASES|CRUD_PROTOCOL_VERSIONS;
+	if(crud_network_versions)
+		options |= CRUD_PROTOCOL_VERSIONS;
+	if(options == CRUD_PROTOCOL_V1)
+		options = 0;
+
+	return options;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : agreeOptions
+//// Description  : Switches to what the server agreed on in its INIT response
+////
+//// Inputs       : options - the INIT response length
+//// Outputs      : Nothing
+void agreeOptions(uint32_t options)
+{
+	if((options & CRUD_PROTOCOL_VERSION_MASK) >= CRUD_PROTOCOL_V2)
+		version = CRUD_PROTOCOL_V2;
+	checksums = ((options & CRUD_PROTOCOL_CRC32C) != 0);
+	leases = ((options & CRUD_PROTOCOL_LEASES) != 0);
+	versions = ((options & CRUD_PROTOCOL_VERSIONS) != 0);
+	logMessage(LOG_INFO_LEVEL, "crud_client : server agreed on protocol version %d%s%s%s", version,
+			checksums ? ", payload checksums" : "", leases ? ", read leases" : "", versions ? ", object versions" : "");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : headerFormat
+//// Description  : The format of the headers on the connection (see
+////		    size_crud_header)
+////
+//// Inputs       : Nothing
+//// Outputs      : The version, plus CRUD_PROTOCOL_VERSIONS if agreed on
+int headerFormat()
+{
+	return version | (versions ? CRUD_PROTOCOL_VERSIONS : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : readBytes
+//// Description  : Reads exactly len bytes from the server
+////
+//// Inputs       : buf - where the bytes go
+////		    len - the number of bytes
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int readBytes(void *buf, uint64_t len)
+{
+	ssize_t n;
+
+	while(len > 0)
+	{
+		n = read(socket_fd, buf, len);
+		if(n <= 0)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crud_client.readBytes() : failed read from server");
+			return -1;
+		}
+		buf = (char *)buf+n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : writeBytes
+//// Description  : Writes exactly len bytes to the server
+////
+//// Inputs       : buf - the bytes
+////		    len - the number of bytes
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int writeBytes(void *buf, uint64_t len)
+{
+	ssize_t n;
+
+	while(len > 0)
+	{
+		n = write(socket_fd, buf, len);
+		if(n <= 0)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crud_client.writeBytes() : failed write to server");
+			return -1;
+		}
+		buf = (char *)buf+n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : readResponse
+//// Description  : Reads the header of the response from the server, dealing
+////		    with any invalidations that come ahead of it
+////
+//// Inputs       : wire - where the header goes (network order, in the
+////		    format of the connection, see headerFormat)
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int readResponse(uint64_t *wire)
+{
+	CrudHeader hdr;
+
+	while(1)
+	{
+		if(readBytes(wire, size_crud_header(headerFormat())))
+			return -1;
+		unpack_crud_header(wire, headerFormat(), &hdr);
+		if(hdr.req != CRUD_INVALIDATE)
+			return 0;
+		if(acknowledgeInvalidation(hdr.oid))
+			return -1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : drainInvalidations
+//// Description  : Deals with the invalidations the server has sent while no
+////		    request was outstanding (anything waiting on the socket
+////		    is one, so a partial header is finished blocking)
+////
+//// Inputs       : Nothing
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int drainInvalidations()
+{
+	uint64_t wire[4];
+	unsigned char peek;
+	CrudHeader hdr;
+
+	while(connected && recv(socket_fd, &peek, 1, MSG_PEEK|MSG_DONTWAIT) == 1)
+	{
+		if(readBytes(wire, size_crud_header(headerFormat())))
+			return -1;
+		unpack_crud_header(wire, headerFormat(), &hdr);
+		if(hdr.req != CRUD_INVALIDATE)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crud_client : unexpected %s from server", 
+					(hdr.req < CRUD_MAXVAL) ? CRUD_REQUEST_TYPE_LABLES[hdr.req] : "BAD");
+			return -1;
+		}
+		if(acknowledgeInvalidation(hdr.oid))
+			return -1;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : acknowledgeInvalidation
+//// Description  : Drops an object the server says changed, then tells the
+////		    server it is gone (by sending the invalidation back), so
+////		    the client that changed it can be answered
+////
+//// Inputs       : oid - the object
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int acknowledgeInvalidation(CrudOID oid)
+{
+	uint64_t wire[4];
+	CrudHeader hdr;
+
+	dropCached(oid);
+	cacheInvalidations++;
+
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.req = CRUD_INVALIDATE;
+	hdr.oid = oid;
+	pack_crud_header(&hdr, headerFormat(), wire);
+	return writeBytes(wire, size_crud_header(headerFormat()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : waitChild
+//// Description  : Waits for a child process like waitpid, answering the
+////		    invalidations sent to us meanwhile (a change the child
+////		    makes to an object we hold waits on our acknowledgement)
+////
+//// Inputs       : pid - the child (-1 for any)
+////		    status - where the exit status goes
+//// Outputs      : The child that exited, -1 if unsuccessful
+pid_t waitChild(pid_t pid, int *status)
+{
+	struct pollfd pfd;
+	pid_t done;
+
+	while((done = waitpid(pid, status, WNOHANG)) == 0)
+	{
+		if(!leases || !connected)
+		{
+			done = waitpid(pid, status, 0);
+			break;
+		}
+		pfd.fd = socket_fd;
+		pfd.events = POLLIN;
+		poll(&pfd, 1, CRUD_CLIENT_CHILD_POLL);
+		if(drainInvalidations())
+			return -1;
+	}
+
+	return done;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : leaseNow
+//// Description  : The current time for timing leases (the monotonic clock)
+////
+//// Inputs       : Nothing
+//// Outputs      : The time in usecs
+uint64_t leaseNow()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : cachedObject
+//// Description  : Finds an object in the cache, if its lease has not run out
+////		    (or it has, but we have its version to revalidate it)
+////
+//// Inputs       : oid - the object
+//// Outputs      : The cache entry, NULL if none
+CacheEntry *cachedObject(CrudOID oid)
+{
+	CacheEntry *entry;
+
+	if(!cacheReady || (entry = findValueInHashTable(&cache, oid)) == NULL)
+		return NULL;
+	if(!versions && leaseNow() >= entry->expires)
+	{
+		dropCached(oid);
+		return NULL;
+	}
+
+	return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : cacheObject
+//// Description  : Puts a copy of an object in the cache (replacing any we
+////		    had), starting over when the cache is full
+////
+//// Inputs       : oid - the object
+////		    len - the size of the object
+////		    buf - the contents
+////		    expires - when the lease runs out
+////		    objver - the object version
+//// Outputs      : Nothing
+void cacheObject(CrudOID oid, uint32_t len, void *buf, uint64_t expires, uint64_t objver)
+{
+	CacheEntry *entry;
+
+	dropCached(oid);
+	if(len > CRUD_CLIENT_CACHE_SIZE)
+		return;
+	if(cacheBytes+len > CRUD_CLIENT_CACHE_SIZE)
+		dropCache();
+	if(!cacheReady)
+	{
+		if(initHashTable(&cache, CRUD_CLIENT_CACHE_BITS))
+			return;
+		cacheReady = 1;
+	}
+	if((entry = malloc(sizeof(CacheEntry)+len)) == NULL)
+		return;
+
+	entry->oid = oid;
+	entry->length = len;
+	entry->expires = expires;
+	entry->version = objver;
+	memcpy(entry->data, buf, len);
+	if(insertValueInHashTable(&cache, oid, entry))
+	{
+		free(entry);
+		return;
+	}
+	cacheBytes += len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : dropCached
+//// Description  : Drops an object from the cache (if it is there)
+////
+//// Inputs       : oid - the object
+//// Outputs      : Nothing
+void dropCached(CrudOID oid)
+{
+	CacheEntry *entry;
+
+	if(cacheReady && (entry = deleteValueFromHashTable(&cache, oid)) != NULL)
+	{
+		cacheBytes -= entry->length;
+		free(entry);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : dropCache
+//// Description  : Drops everything in the cache
+////
+//// Inputs       : Nothing
+//// Outputs      : Nothing
+void dropCache()
+{
+	HtIterator it;
+	CacheEntry *entry;
+
+	if(!cacheReady)
+		return;
+	initHashTableIterator(&cache, &it);
+	while((entry = iterateHashTable(&it)) != NULL)
+		free(entry);
+	cleanupHashTable(&cache);
+	cacheReady = 0;
+	cacheBytes = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : crudClientUnitTest
+//// Description  : Checks the cache is told of another client's change (if
+////		    leases were agreed on) and that conditional updates lose
+////		    nothing (if object versions were), then streams a large object
+////		    through the server (create, read, update, read, delete) if
+////		    version 2 was agreed on, checking every chunk read back.
+////		    Run after crudIOUnitTest, which makes the connection.
+////
+//// Inputs       : Nothing
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int crudClientUnitTest(void)
+{
+	CrudHeader hdr;
+	PatternStream pattern;
+	CrudOID oid;
+	uint64_t wire[4];
+	uint32_t prefix, trailer;
+	unsigned char bytes[16];
+	int pass;
+
+	if(leases && leaseUnitTest())
+		return -1;
+	if(versions && casUnitTest())
+		return -1;
+
+	if(!connected || version < CRUD_PROTOCOL_V2)
+	{
+		logMessage(LOG_INFO_LEVEL, "crudClientUnitTest : version 2 not in use, skipping");
+		return 0;
+	}
+
+	// Mount
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.req = CRUD_INIT;
+	hdr.length = initOptions();
+	if(crud_client_stream(&hdr, NULL, NULL))
+	{
+		logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : INIT failed");
+		return -1;
+	}
+
+	// Create the object, then update it with another pattern
+	for(pass = 0; pass < 2; pass++)
+	{
+		memset(&hdr, 0x0, sizeof(hdr));
+		hdr.req = (pass == 0) ? CRUD_CREATE : CRUD_UPDATE;
+		hdr.oid = (pass == 0) ? 0 : oid;
+		hdr.length = CRUD_CLIENT_TEST_SIZE;
+		pattern.seed = pass+1;
+		pattern.checked = 0;
+		if(crud_client_stream(&hdr, patternChunk, &pattern))
+		{
+			logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : %s failed", (pass == 0) ? "CREATE" : "UPDATE");
+			return -1;
+		}
+		oid = hdr.oid;
+
+		// Read it back, checking every chunk
+		memset(&hdr, 0x0, sizeof(hdr));
+		hdr.req = CRUD_READ;
+		hdr.oid = oid;
+		hdr.length = CRUD_CLIENT_TEST_SIZE;
+		pattern.checked = 0;
+		if(crud_client_stream(&hdr, checkChunk, &pattern) || hdr.length != CRUD_CLIENT_TEST_SIZE ||
+				pattern.checked != CRUD_CLIENT_TEST_SIZE)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : READ of object %u failed", oid);
+			return -1;
+		}
+		logMessage(LOG_INFO_LEVEL, "crudClientUnitTest : streamed %u bytes through object %u", CRUD_CLIENT_TEST_SIZE, oid);
+	}
+
+	// A payload that does not match its checksum has to be refused
+	if(checksums)
+	{
+		memset(&hdr, 0x0, sizeof(hdr));
+		hdr.req = CRUD_CREATE;
+		hdr.length = sizeof(bytes);
+		memset(bytes, 0xa5, sizeof(bytes));
+		pack_crud_header(&hdr, headerFormat(), wire);
+		prefix = htonl(sizeof(bytes));
+		trailer = htonl(crud_crc32c(0, bytes, sizeof(bytes)) ^ 0x1);
+		if(writeBytes(wire, size_crud_header(headerFormat())) || writeBytes(&prefix, CRUD_NET_CHUNK_HEADER_SIZE) ||
+				writeBytes(bytes, sizeof(bytes)) || writeBytes(&trailer, CRUD_TRAILER_SIZE) ||
+				readResponse(wire))
+			return -1;
+		unpack_crud_header(wire, headerFormat(), &hdr);
+		if(!hdr.res)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : CREATE with a bad checksum was accepted");
+			return -1;
+		}
+		logMessage(LOG_INFO_LEVEL, "crudClientUnitTest : CREATE with a bad checksum refused");
+	}
+
+	// Delete the object and unmount
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.req = CRUD_DELETE;
+	hdr.oid = oid;
+	if(crud_client_stream(&hdr, NULL, NULL))
+	{
+		logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : DELETE of object %u failed", oid);
+		return -1;
+	}
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.req = CRUD_CLOSE;
+	if(crud_client_stream(&hdr, NULL, NULL))
+	{
+		logMessage(LOG_ERROR_LEVEL, "crudClientUnitTest : CLOSE failed");
+		return -1;
+	}
+
+	logMessage(LOG_INFO_LEVEL, "crudClientUnitTest : completed successfully");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : leaseUnitTest
+//// Description  : Creates an object (which we then hold a lease on), has
+////		    another client (a child process) update it, then checks
+////		    the update is only answered once the invalidation has
+////		    arrived (and been acknowledged) and the next read gets it.
+////		    With object versions, a copy whose lease has run out is
+////		    then revalidated (as is, and with its version made stale).
+////
+//// Inputs       : Nothing
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int leaseUnitTest()
+{
+	unsigned char buf[CRUD_BENCH_OBJECT_SIZE], expect[CRUD_BENCH_OBJECT_SIZE];
+	CrudResponse res;
+	CacheEntry *entry;
+	CrudOID oid;
+	uint64_t start, revalidated;
+	int status, pass;
+	pid_t pid;
+
+	res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	benchObject(buf, 1);
+	if(!crud_codec_result(res))
+		res = crud_client_operation(crud_codec_encode(0, CRUD_CREATE, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+	if(crud_codec_result(res) || !leases || cachedObject(crud_codec_oid(res)) == NULL)
+	{
+		logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : CREATE failed (or not cached)");
+		return -1;
+	}
+	oid = crud_codec_oid(res);
+
+	// The other client updates it
+	pid = fork();
+	if(pid == 0)
+	{
+		resetConnection();
+		benchObject(buf, 2);
+		res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+		if(!crud_codec_result(res))
+			res = crud_client_operation(crud_codec_encode(oid, CRUD_UPDATE, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+		if(!crud_codec_result(res))
+			res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+		_exit(crud_codec_result(res) ? 1 : 0);
+	}
+	start = leaseNow();
+	if(pid < 0 || waitChild(pid, &status) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : UPDATE by the other client failed");
+		return -1;
+	}
+
+	// We dropped our copy before it was answered (well before the lease ran
+	// out), then read the update
+	if(cachedObject(oid) != NULL || leaseNow()-start >= CRUD_CLIENT_INVALIDATE_WAIT)
+	{
+		logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : UPDATE of object %u answered without the invalidation", oid);
+		return -1;
+	}
+	res = crud_client_operation(crud_codec_encode(oid, CRUD_READ, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+	benchObject(expect, 2);
+	if(crud_codec_result(res) || memcmp(buf, expect, CRUD_BENCH_OBJECT_SIZE))
+	{
+		logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : READ of object %u did not get the update", oid);
+		return -1;
+	}
+	logMessage(LOG_INFO_LEVEL, "leaseUnitTest : object %u invalidated after %lu usecs", oid, leaseNow()-start);
+
+	// Run the lease out, the copy is good without being sent again, unless
+	// the version we have is not the object's
+	for(pass = 0; versions && pass < 2; pass++)
+	{
+		entry = cachedObject(oid);
+		if(entry == NULL)
+		{
+			logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : object %u not cached", oid);
+			return -1;
+		}
+		entry->expires = 0;
+		entry->version -= pass;
+		revalidated = cacheRevalidations;
+		memset(buf, 0x0, CRUD_BENCH_OBJECT_SIZE);
+		res = crud_client_operation(crud_codec_encode(oid, CRUD_READ, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+		entry = cachedObject(oid);
+		if(crud_codec_result(res) || crud_codec_flags(res) || crud_codec_length(res) != CRUD_BENCH_OBJECT_SIZE ||
+				memcmp(buf, expect, CRUD_BENCH_OBJECT_SIZE) || cacheRevalidations != revalidated+(pass == 0) ||
+				entry == NULL || leaseNow() >= entry->expires)
+		{
+			logMessage(LOG_ERROR_LEVEL, "leaseUnitTest : revalidation of object %u failed", oid);
+			return -1;
+		}
+	}
+	if(versions)
+		logMessage(LOG_INFO_LEVEL, "leaseUnitTest : object %u revalidated", oid);
+
+	// Clean up
+	crud_client_operation(crud_codec_encode(oid, CRUD_DELETE, 0, 0, 0), NULL);
+	res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+	return crud_codec_result(res) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : casUnitTest
+//// Description  : Has a few clients (child processes) add to a counter in a
+////		    shared object at the same time, each addition a READ and
+////		    a CRUD_IF_VERSION UPDATE of the version read (again if
+////		    another client got there first), then checks that none of
+////		    the additions were lost.
+////
+//// Inputs       : Nothing
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int casUnitTest()
+{
+	pid_t pids[CRUD_CLIENT_CAS_CLIENTS];
+	uint64_t counter = 0, objver;
+	CrudResponse res;
+	CrudOID oid;
+	int child, i, status, failed = 0;
+
+	res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	if(!crud_codec_result(res))
+		res = crud_client_operation(crud_codec_encode(0, CRUD_CREATE, sizeof(counter), 0, 0), &counter);
+	if(crud_codec_result(res))
+	{
+		logMessage(LOG_ERROR_LEVEL, "casUnitTest : CREATE failed");
+		return -1;
+	}
+	oid = crud_codec_oid(res);
+
+	// The clients add to the counter, retrying the ones that lose a race
+	for(child = 0; child < CRUD_CLIENT_CAS_CLIENTS; child++)
+	{
+		pids[child] = fork();
+		if(pids[child] == 0)
+		{
+			resetConnection();
+			res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+			for(i = 0; i < CRUD_CLIENT_CAS_ADDS && !crud_codec_result(res); i++)
+			{
+				do
+				{
+					objver = 0;
+					res = crud_client_versioned(crud_codec_encode(oid, CRUD_READ, sizeof(counter), 0, 0), &counter, &objver);
+					if(crud_codec_result(res))
+						break;
+					counter++;
+					res = crud_client_versioned(crud_codec_encode(oid, CRUD_UPDATE, sizeof(counter), CRUD_IF_VERSION, 0),
+							&counter, &objver);
+				}while(res != (CrudResponse)-1 && crud_codec_result(res) && (crud_codec_flags(res) & CRUD_IF_VERSION));
+			}
+			if(!crud_codec_result(res))
+				res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+			_exit(crud_codec_result(res) ? 1 : 0);
+		}
+		if(pids[child] < 0)
+			failed = 1;
+	}
+	for(child = 0; child < CRUD_CLIENT_CAS_CLIENTS; child++)
+		if(pids[child] > 0 && (waitChild(pids[child], &status) != pids[child] || !WIFEXITED(status) ||
+				WEXITSTATUS(status) != 0))
+			failed = 1;
+	if(failed)
+	{
+		logMessage(LOG_ERROR_LEVEL, "casUnitTest : a client failed");
+		return -1;
+	}
+
+	// Every addition has to be there (in the server's copy, not ours)
+	dropCached(oid);
+	res = crud_client_operation(crud_codec_encode(oid, CRUD_READ, sizeof(counter), 0, 0), &counter);
+	if(crud_codec_result(res) || counter != CRUD_CLIENT_CAS_CLIENTS*CRUD_CLIENT_CAS_ADDS)
+	{
+		logMessage(LOG_ERROR_LEVEL, "casUnitTest : counter is %lu, expected %d", counter,
+				CRUD_CLIENT_CAS_CLIENTS*CRUD_CLIENT_CAS_ADDS);
+		return -1;
+	}
+	logMessage(LOG_INFO_LEVEL, "casUnitTest : %d clients made %lu additions without losing any",
+			CRUD_CLIENT_CAS_CLIENTS, counter);
+
+	// Clean up
+	crud_client_operation(crud_codec_encode(oid, CRUD_DELETE, 0, 0, 0), NULL);
+	res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+	return crud_codec_result(res) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : crudClientBenchmark
+//// Description  : Runs a number of clients (processes, each with its own
+////		    connection) against a set of shared objects at the same
+////		    time, mostly reading them.  Each object is updated by one
+////		    client only, with a value that goes up every time, so a
+////		    read can be checked against the values taken before it
+////		    started.  Run with and without -L to see what the cache
+////		    saves.
+////
+//// Inputs       : clients - the number of clients
+//// Outputs      : 0 if successful, -1 if unsuccessful
+int crudClientBenchmark(int clients)
+{
+	BenchShared *shared;
+	unsigned char buf[CRUD_BENCH_OBJECT_SIZE];
+	CrudResponse res;
+	uint64_t start, elapsed;
+	int i, status, failed = 0;
+	pid_t pid;
+
+	if(clients < 1 || clients > CRUD_BENCH_OBJECTS)
+	{
+		logMessage(LOG_ERROR_LEVEL, "crudClientBenchmark : 1 to %d clients", CRUD_BENCH_OBJECTS);
+		return -1;
+	}
+	shared = mmap(NULL, sizeof(BenchShared), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+		return -1;
+	memset(shared, 0x0, sizeof(BenchShared));
+
+	// Mount and create the objects (we stay mounted while the clients run)
+	res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	if(crud_codec_result(res))
+	{
+		logMessage(LOG_ERROR_LEVEL, "crudClientBenchmark : INIT failed");
+		return -1;
+	}
+	for(i = 0; i < CRUD_BENCH_OBJECTS; i++)
+	{
+		benchObject(buf, 0);
+		res = crud_client_operation(crud_codec_encode(0, CRUD_CREATE, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+		if(crud_codec_result(res))
+		{
+			logMessage(LOG_ERROR_LEVEL, "crudClientBenchmark : CREATE failed");
+			return -1;
+		}
+		shared->oid[i] = crud_codec_oid(res);
+	}
+
+	// Start the clients, wait for them all
+	start = leaseNow();
+	for(i = 0; i < clients; i++)
+	{
+		pid = fork();
+		if(pid < 0)
+		{
+			logMessage(LOG_ERROR_LEVEL, "crudClientBenchmark : fork failed");
+			clients = i;
+			failed = 1;
+			break;
+		}
+		if(pid == 0)
+		{
+			resetConnection();
+			if(benchClient(shared, i, clients))
+				__sync_fetch_and_add(&shared->failed, 1);
+			_exit(0);
+		}
+	}
+	for(i = 0; i < clients; i++)
+		if(waitChild(-1, &status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = 1;
+	elapsed = leaseNow()-start;
+
+	logMessage(LOG_OUTPUT_LEVEL, "crudClientBenchmark : %d clients, %lu reads, %lu updates in %.3f secs (%.0f ops/sec)%s",
+			clients, shared->reads, shared->updates, elapsed/1000000.0,
+			(shared->reads+shared->updates)*1000000.0/(elapsed ? elapsed : 1), leases ? " with read leases" : "");
+	logMessage(LOG_OUTPUT_LEVEL, "crudClientBenchmark : %lu cache hits (%.1f%% of reads), %lu revalidations, %lu invalidations, %lu stale reads, %lu clients failed",
+			shared->hits, shared->reads ? shared->hits*100.0/shared->reads : 0.0, shared->revalidations,
+			shared->invalidations, shared->stale, shared->failed);
+	failed = failed || shared->failed;
+
+	// Delete the objects and unmount
+	for(i = 0; i < CRUD_BENCH_OBJECTS; i++)
+		crud_client_operation(crud_codec_encode(shared->oid[i], CRUD_DELETE, 0, 0, 0), NULL);
+	res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+	munmap(shared, sizeof(BenchShared));
+
+	return (failed || crud_codec_result(res)) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : benchClient
+//// Description  : One client of the benchmark: mounts on its own connection
+////		    and reads random objects, now and then updating one of
+////		    its own (those numbered me, me+clients, ...)
+////
+//// Inputs       : shared - what the clients share
+////		    me - the number of the client
+////		    clients - the number of clients
+//// Outputs      : 0 if successful, -1 if unsuccessful (or a read was wrong)
+int benchClient(BenchShared *shared, int me, int clients)
+{
+	unsigned char buf[CRUD_BENCH_OBJECT_SIZE], expect[CRUD_BENCH_OBJECT_SIZE];
+	uint64_t last[CRUD_BENCH_OBJECTS], value, before, reads = 0, updates = 0, stale = 0;
+	unsigned int seed = getpid();
+	CrudResponse res;
+	int op, i, mine = (CRUD_BENCH_OBJECTS-me+clients-1)/clients;
+
+	memset(last, 0x0, sizeof(last));
+	res = crud_client_operation(crud_codec_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	if(crud_codec_result(res))
+		return -1;
+
+	for(op = 0; op < CRUD_BENCH_OPERATIONS; op++)
+	{
+		// Update one of ours with the next value
+		if(rand_r(&seed)%CRUD_BENCH_UPDATE_RATE == 0)
+		{
+			i = me + clients*(rand_r(&seed)%mine);
+			value = shared->committed[i]+1;
+			benchObject(buf, value);
+			res = crud_client_operation(crud_codec_encode(shared->oid[i], CRUD_UPDATE, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+			if(crud_codec_result(res))
+				return -1;
+			__sync_synchronize();
+			shared->committed[i] = value;
+			updates++;
+			continue;
+		}
+
+		// Read any of them, it has to be whole and no older than before
+		i = rand_r(&seed)%CRUD_BENCH_OBJECTS;
+		before = shared->committed[i];
+		__sync_synchronize();
+		res = crud_client_operation(crud_codec_encode(shared->oid[i], CRUD_READ, CRUD_BENCH_OBJECT_SIZE, 0, 0), buf);
+		if(crud_codec_result(res) || crud_codec_length(res) != CRUD_BENCH_OBJECT_SIZE)
+			return -1;
+		memcpy(&value, buf, sizeof(value));
+		benchObject(expect, value);
+		if(memcmp(buf, expect, CRUD_BENCH_OBJECT_SIZE) || value < last[i])
+		{
+			logMessage(LOG_ERROR_LEVEL, "benchClient : object %u read wrong (value %lu after %lu)", shared->oid[i], value, last[i]);
+			return -1;
+		}
+		if(value < before)
+			stale++;
+		last[i] = value;
+		reads++;
+	}
+
+	__sync_fetch_and_add(&shared->reads, reads);
+	__sync_fetch_and_add(&shared->updates, updates);
+	__sync_fetch_and_add(&shared->stale, stale);
+	__sync_fetch_and_add(&shared->hits, cacheHits);
+	__sync_fetch_and_add(&shared->invalidations, cacheInvalidations);
+	__sync_fetch_and_add(&shared->revalidations, cacheRevalidations);
+	res = crud_client_operation(crud_codec_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+	return crud_codec_result(res) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : benchObject
+//// Description  : Fills in the contents of a benchmark object for a value
+////
+//// Inputs       : buf - the object contents
+////		    value - the value (the first 8 bytes, the rest follow it)
+//// Outputs      : Nothing
+void benchObject(unsigned char *buf, uint64_t value)
+{
+	memcpy(buf, &value, sizeof(value));
+	memset(buf+sizeof(value), (unsigned char)(value*7+1), CRUD_BENCH_OBJECT_SIZE-sizeof(value));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : crud_client_disconnect
+//// Description  : Closes the connection of this thread (after its CLOSE), so
+////		    a thread that is done with the server leaves nothing behind
+////
+//// Inputs       : Nothing
+//// Outputs      : Nothing
+void crud_client_disconnect()
+{
+	resetConnection();
+	free(chunkBuf);
+	chunkBuf = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : resetConnection
+//// Description  : Forgets the connection (and cache) of the parent in a new
+////		    process, the next request connects again
+////
+//// Inputs       : Nothing
+//// Outputs      : Nothing
+void resetConnection()
+{
+	if(connected)
+		close(socket_fd);
+	connected = 0;
+	version = CRUD_PROTOCOL_V1;
+	checksums = 0;
+	leases = 0;
+	versions = 0;
+	dropCache();
+	cacheHits = cacheMisses = cacheInvalidations = cacheRevalidations = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : patternChunk
+//// Description  : Stream function filling the chunks with the test pattern
+////
+//// Inputs       : arg - the PatternStream
+////		    chunk - the chunk
+////		    len - the length of the chunk
+////		    offset - where the chunk goes in the payload
+//// Outputs      : 0
+int patternChunk(void *arg, void *chunk, uint32_t len, uint64_t offset)
+{
+	PatternStream *pattern = arg;
+	unsigned char *bytes = chunk;
+	uint32_t i;
+
+	for(i = 0; i < len; i++)
+		bytes[i] = (unsigned char)((offset+i)*pattern->seed + ((offset+i)>>16));
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Function     : checkChunk
+//// Description  : Stream function checking the chunks against the test pattern
+////
+//// Inputs       : arg - the PatternStream
+////		    chunk - the chunk
+////		    len - the length of the chunk
+////		    offset - where the chunk goes in the payload
+//// Outputs      : 0 if the chunk matches, -1 if not
+int checkChunk(void *arg, void *chunk, uint32_t len, uint64_t offset)
+{
+	PatternStream *pattern = arg;
+	unsigned char *bytes = chunk;
+	uint32_t i;
+
+	if(offset != pattern->checked)
+		return -1;
+	for(i = 0; i < len; i++)
+	{
+		if(bytes[i] != (unsigned char)((offset+i)*pattern->seed + ((offset+i)>>16)))
+		{
+			logMessage(LOG_ERROR_LEVEL, "checkChunk : mismatch at byte %lu", offset+i);
+			return -1;
+		}
+	}
+	pattern->checked += len;
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////
 //// Function     : establishConnection
 //// Description  : Just connects to the server and updates the connected flag
 ////
 //// Inputs       : Nothing
+//// 		    (uses the -a/-p address and port if they were given)
 ////
 //// Outputs      : 0 if successful, -1 if unsuccessful
 int establishConnection()
 {
+	int optval = 1;
 
-	inet_aton(CRUD_DEFAULT_IP,  &(v4.sin_addr));
-	v4.sin_port = htons(CRUD_DEFAULT_PORT);
+	if(crud_network_address != NULL)
+		inet_aton((char *)crud_network_address, &(v4.sin_addr));
+	else
+		inet_aton(CRUD_DEFAULT_IP,  &(v4.sin_addr));
+	v4.sin_port = htons((crud_network_port != 0) ? crud_network_port : CRUD_DEFAULT_PORT);
 	v4.sin_family = AF_INET;
 
 	socket_fd = socket(PF_INET, SOCK_STREAM, 0);
@@ -121,6 +1490,9 @@ int establishConnection()
 	if( connect(socket_fd, (const struct sockaddr *) &(v4),  sizeof(v4)) == -1)
 		return -1;
 
+	// Header and payload go out as separate writes, don't let Nagle hold them
+	setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
 	connected = 1;
 
 	return 0;
@@ -135,7 +1507,7 @@ int establishConnection()
 //// Inputs       : req - A standard 64bit crud request
 ////		    buf - A void pointer we'll be passing data into
 //// Outputs      : Returns a standard 64bit response value or -1 if it fails
-int64_t receive(CrudRequest req, void *buf)
+int64_t receive(CrudRequest req, void *buf, uint64_t *objver)
 {
 
 	if(!connected)
@@ -145,21 +1517,27 @@ int64_t receive(CrudRequest req, void *buf)
 	}
 
 	CrudResponse res = req;
-	res = htonll64(res);
-	int n = read( socket_fd, &res, sizeof(res));
+	CrudHeader hdr;
+	uint64_t wire[2];
+	int n = 0;
 	int tmpLength = 0;
+	void *start = buf;
+	uint32_t trailer;
 
-	if( n != sizeof(res) )
+	if( readResponse(wire) )
 	{
 		logMessage(LOG_ERROR_LEVEL, "crud_client.c : failed read from server");
 		return -1;
 	}
 
-	res = ntohll64(res);
+	res = crud_codec_swap(wire[0]);
+	unpack_crud_header(wire, headerFormat(), &hdr);
+	*objver = hdr.objver;
 	
-	if(getRequest(res) == CRUD_READ)
+	// An object that has not changed is not sent
+	if(crud_codec_req(res) == CRUD_READ && !(crud_codec_flags(res) & CRUD_IF_CHANGED))
 	{
-		tmpLength = length;
+		tmpLength = crud_codec_length(res);
 		do{
 
 			n = read( socket_fd, buf, tmpLength );
@@ -174,6 +1552,18 @@ int64_t receive(CrudRequest req, void *buf)
 			buf+=n;
 
 		}while(  n>0 );
+
+		// Check the payload against the trailer
+		if(checksums && crud_codec_length(res) > 0 && !crud_codec_result(res))
+		{
+			if(readBytes(&trailer, CRUD_TRAILER_SIZE))
+				return -1;
+			if(ntohl(trailer) != crud_crc32c(0, start, crud_codec_length(res)))
+			{
+				logMessage(LOG_ERROR_LEVEL, "crud_client.receive() : payload checksum mismatch on object %u", crud_codec_oid(res));
+				res |= 0x1;
+			}
+		}
 		
 	}
 
@@ -189,33 +1579,47 @@ int64_t receive(CrudRequest req, void *buf)
 //// Inputs       : req - A standard 64bit crud request
 ////		    buf - A void pointer we'll be passing data into
 //// Outputs      : Returns a standard 64bit response value or -1 if it fails
-int64_t send1(CrudRequest req, void *buf)
+int64_t send1(CrudRequest req, void *buf, uint64_t objver)
 {
 
 	if(!connected)
 		if(establishConnection())
 			return -1;
 
-	CrudRequest tmpReq = htonll64(req);
+	CrudRequest tmpReq = req;
+	int64_t length = crud_codec_length(req);
+	uint64_t wire[2] = { crud_codec_swap(req), crud_codec_swap(objver) };
+	uint32_t trailer;
+	struct iovec iov[2];
+	int iovcnt = 1;
 
-	int n = write( socket_fd, &tmpReq, sizeof(tmpReq) );
+	// The object version (if agreed on) follows the request
+	int n = write( socket_fd, wire, size_crud_header(headerFormat()) );
 
-	if( n != sizeof(tmpReq) )
+	if( n != size_crud_header(headerFormat()) )
 	{
 		logMessage(LOG_ERROR_LEVEL, "crud_client.send() : failed write to server");
 		return -1;
 	}
 
-	tmpReq = ntohll64(tmpReq);
-
 	//logMessage(LOG_INFO_LEVEL, "crud_client.send() : sent %d bytes", n);
 
-	if(getRequest(req) == CRUD_CREATE || getRequest(req) == CRUD_UPDATE)
+	if(crud_codec_req(req) == CRUD_CREATE || crud_codec_req(req) == CRUD_UPDATE)
 	{
-		n = write( socket_fd, buf, length );
+		// The checksum (if any) goes out with the payload
+		iov[0].iov_base = buf;
+		iov[0].iov_len = length;
+		if(checksums && length > 0)
+		{
+			trailer = htonl(crud_crc32c(0, buf, length));
+			iov[1].iov_base = &trailer;
+			iov[1].iov_len = CRUD_TRAILER_SIZE;
+			iovcnt = 2;
+		}
+		n = writev( socket_fd, iov, iovcnt );
 		//logMessage(LOG_INFO_LEVEL, "crud_client.send() : sent  %d bytes", n);
 
-		if( n != length )
+		if( n != length + ((iovcnt == 2) ? CRUD_TRAILER_SIZE : 0) )
 		{
 			logMessage(LOG_ERROR_LEVEL, "crud_client.send() : failed write to server");
 			return -1;
@@ -226,22 +1630,3 @@ int64_t send1(CrudRequest req, void *buf)
 	return tmpReq;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-////
-//// Function     : getRequest
-//// Description  : Sets the global variable for length, and returns the 
-////		    value of the request
-//// Inputs       : req - A standard 64bit crud request
-////
-//// Outputs      : Returns a 64bit value for the request
-int64_t getRequest(CrudRequest req)
-{
-	// Length
-	req>>=4;
-	
-	length = (int64_t)(16777215 & req);
-	req>>=24;
-	
-	return (int64_t)(15 & req);
-}
-
@@ -0,0 +1,221 @@
+#ifndef CRUD_CODEC_INCLUDED
+#define CRUD_CODEC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_codec.h
+//  Description   : This is the codec for the 64-bit CRUD request/response
+//                  header (see crud_driver.h for the layout).  Everything is
+//                  inline and branch free so the compiler can fold it into the
+//                  callers; the layout is checked at compile time.  The batch
+//                  forms encode/decode arrays of headers straight to/from the
+//                  wire (network byte order), the byte swap using SSE2/SSSE3
+//                  when the target has them.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines (the fields, low bit first)
+#define CRUD_CODEC_RES_SHIFT     0
+#define CRUD_CODEC_RES_BITS      1
+#define CRUD_CODEC_FLAGS_SHIFT   (CRUD_CODEC_RES_SHIFT+CRUD_CODEC_RES_BITS)
+#define CRUD_CODEC_FLAGS_BITS    3
+#define CRUD_CODEC_LENGTH_SHIFT  (CRUD_CODEC_FLAGS_SHIFT+CRUD_CODEC_FLAGS_BITS)
+#define CRUD_CODEC_LENGTH_BITS   24
+#define CRUD_CODEC_REQ_SHIFT     (CRUD_CODEC_LENGTH_SHIFT+CRUD_CODEC_LENGTH_BITS)
+#define CRUD_CODEC_REQ_BITS      4
+#define CRUD_CODEC_OID_SHIFT     (CRUD_CODEC_REQ_SHIFT+CRUD_CODEC_REQ_BITS)
+#define CRUD_CODEC_OID_BITS      32
+#define CRUD_CODEC_MASK(bits)    ((((uint64_t)1) << (bits)) - 1)
+
+// Check the layout against the types and limits that depend on it
+_Static_assert( sizeof(CrudRequest) == 8, "CRUD header is not 64 bits" );
+_Static_assert( CRUD_CODEC_OID_SHIFT+CRUD_CODEC_OID_BITS == 64, "CRUD header fields do not fill 64 bits" );
+_Static_assert( sizeof(CrudOID)*8 == CRUD_CODEC_OID_BITS, "CRUD OID does not match the OID field" );
+_Static_assert( CRUD_MAXVAL <= CRUD_CODEC_MASK(CRUD_CODEC_REQ_BITS)+1, "CRUD request types overflow the field" );
+_Static_assert( CRUD_FLAGMAX <= CRUD_CODEC_MASK(CRUD_CODEC_FLAGS_BITS)+1, "CRUD flags overflow the field" );
+_Static_assert( CRUD_MAX_OBJECT_SIZE <= CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS), "CRUD object size overflows the field" );
+_Static_assert( (CRUD_PROTOCOL_VERSION_MASK|CRUD_PROTOCOL_CRC32C|CRUD_PROTOCOL_LEASES|CRUD_PROTOCOL_VERSIONS) <= CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS),
+		"CRUD protocol version/options overflow the field" );
+
+//
+// Single header functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_encode
+// Description  : Encode the header fields (each masked to its width)
+//
+// Inputs       : oid - the object ID
+//                req - the request type
+//                length - the length field
+//                flags - the flags
+//                res - the result bit
+// Outputs      : the encoded header (host byte order)
+
+static inline CrudRequest crud_codec_encode( uint32_t oid, uint32_t req, uint32_t length,
+		uint32_t flags, uint32_t res ) {
+	return( (((uint64_t)oid) << CRUD_CODEC_OID_SHIFT) |
+			((req & CRUD_CODEC_MASK(CRUD_CODEC_REQ_BITS)) << CRUD_CODEC_REQ_SHIFT) |
+			((length & CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS)) << CRUD_CODEC_LENGTH_SHIFT) |
+			((flags & CRUD_CODEC_MASK(CRUD_CODEC_FLAGS_BITS)) << CRUD_CODEC_FLAGS_SHIFT) |
+			((res & CRUD_CODEC_MASK(CRUD_CODEC_RES_BITS)) << CRUD_CODEC_RES_SHIFT) );
+}
+
+// The field accessors (host byte order)
+static inline CrudOID crud_codec_oid( CrudRequest hdr ) {
+	return( (CrudOID)(hdr >> CRUD_CODEC_OID_SHIFT) );
+}
+static inline CRUD_REQUEST_TYPES crud_codec_req( CrudRequest hdr ) {
+	return( (CRUD_REQUEST_TYPES)((hdr >> CRUD_CODEC_REQ_SHIFT) & CRUD_CODEC_MASK(CRUD_CODEC_REQ_BITS)) );
+}
+static inline uint32_t crud_codec_length( CrudRequest hdr ) {
+	return( (uint32_t)((hdr >> CRUD_CODEC_LENGTH_SHIFT) & CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS)) );
+}
+static inline uint8_t crud_codec_flags( CrudRequest hdr ) {
+	return( (uint8_t)((hdr >> CRUD_CODEC_FLAGS_SHIFT) & CRUD_CODEC_MASK(CRUD_CODEC_FLAGS_BITS)) );
+}
+static inline uint8_t crud_codec_result( CrudRequest hdr ) {
+	return( (uint8_t)((hdr >> CRUD_CODEC_RES_SHIFT) & CRUD_CODEC_MASK(CRUD_CODEC_RES_BITS)) );
+}
+
+// Replace the length field (e.g., to clear the INIT version)
+static inline CrudRequest crud_codec_set_length( CrudRequest hdr, uint32_t length ) {
+	return( (hdr & ~(CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS) << CRUD_CODEC_LENGTH_SHIFT)) |
+			((length & CRUD_CODEC_MASK(CRUD_CODEC_LENGTH_BITS)) << CRUD_CODEC_LENGTH_SHIFT) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_swap
+// Description  : Convert a 64-bit value between host and network byte order
+//                (the byte order is known at compile time, unlike htonll64)
+//
+// Inputs       : val - the value
+// Outputs      : the converted value
+
+static inline uint64_t crud_codec_swap( uint64_t val ) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	return( val );
+#else
+	return( __builtin_bswap64(val) );
+#endif
+}
+
+//
+// Batch functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_swap_batch
+// Description  : Convert an array of 64-bit values between host and network
+//                byte order in place, two at a time with SSE2/SSSE3
+//
+// Inputs       : vals - the values
+//                count - the number of values
+// Outputs      : none
+
+static inline void crud_codec_swap_batch( uint64_t *vals, size_t count ) {
+
+	// Local variables
+	size_t i = 0;
+
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_BIG_ENDIAN__)
+#if defined(__SSSE3__)
+	// Reverse the bytes of each 64-bit lane with one shuffle
+	const __m128i rev = _mm_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7 );
+	for ( ; i+2 <= count; i+=2 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)&vals[i] );
+		_mm_storeu_si128( (__m128i *)&vals[i], _mm_shuffle_epi8(v, rev) );
+	}
+#elif defined(__SSE2__)
+	// Swap the bytes of each 16-bit word, then reverse the words of each lane
+	for ( ; i+2 <= count; i+=2 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)&vals[i] );
+		v = _mm_or_si128( _mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8) );
+		v = _mm_shufflelo_epi16( v, _MM_SHUFFLE(0, 1, 2, 3) );
+		v = _mm_shufflehi_epi16( v, _MM_SHUFFLE(0, 1, 2, 3) );
+		_mm_storeu_si128( (__m128i *)&vals[i], v );
+	}
+#endif
+	for ( ; i<count; i++ ) {
+		vals[i] = crud_codec_swap( vals[i] );
+	}
+#else
+	(void)vals; (void)count; (void)i;
+#endif
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_encode_batch
+// Description  : Encode an array of headers into version 1 wire words
+//                (network byte order, OIDs/lengths masked to the fields)
+//
+// Inputs       : hdrs - the headers
+//                wire - the words to fill
+//                count - the number of headers
+// Outputs      : none
+
+static inline void crud_codec_encode_batch( const CrudHeader *hdrs, uint64_t *wire, size_t count ) {
+
+	// Local variables
+	size_t i;
+
+	// Pack everything, then swap the whole array at once
+	for ( i=0; i<count; i++ ) {
+		wire[i] = crud_codec_encode( (uint32_t)hdrs[i].oid, hdrs[i].req, (uint32_t)hdrs[i].length,
+				hdrs[i].flags, hdrs[i].res );
+	}
+	crud_codec_swap_batch( wire, count );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_decode_batch
+// Description  : Decode an array of version 1 wire words into headers
+//
+// Inputs       : wire - the words (network byte order, left unchanged)
+//                hdrs - the headers to fill
+//                count - the number of words
+// Outputs      : none
+
+static inline void crud_codec_decode_batch( const uint64_t *wire, CrudHeader *hdrs, size_t count ) {
+
+	// Local variables
+	CrudRequest word;
+	size_t i;
+
+	for ( i=0; i<count; i++ ) {
+		word = crud_codec_swap( wire[i] );
+		hdrs[i].oid = crud_codec_oid( word );
+		hdrs[i].req = crud_codec_req( word );
+		hdrs[i].length = crud_codec_length( word );
+		hdrs[i].flags = crud_codec_flags( word );
+		hdrs[i].res = crud_codec_result( word );
+	}
+	return;
+}
+
+//
+// Unit Testing
+
+int crud_codec_unit_test( void );
+	// Check the codec against a reference encoding (crud_util.c)
+
+#endif
@@ -0,0 +1,443 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_crc.c
+//  Description    : This is the implementation of the CRC32C checksum for the
+//                   CRUD payloads.  The hardware version runs three crc32
+//                   streams over adjacent blocks (the instruction has a
+//                   latency of three cycles) and joins them with tables that
+//                   shift a CRC over a block of zeros.  The software version
+//                   is slicing-by-8.  The tables are built once, on first use.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Project includes
+#include <crud_crc.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_CRC_POLY 0x82f63b78   // The CRC32C polynomial (reflected)
+#define CRUD_CRC_LONG 8192         // The block of each hardware stream (long buffers)
+#define CRUD_CRC_SHORT 256         // The block of each hardware stream (short buffers)
+#define CRUD_CRC_TEST_SIZE 0x100000 // The size of the unit test buffer
+#define CRUD_CRC_TEST_ITERATIONS 1000
+
+//
+// Global data
+
+uint32_t crud_crc_table[8][256];     // The slicing-by-8 tables
+uint32_t crud_crc_long[4][256];      // Shift a CRC over CRUD_CRC_LONG zeros
+uint32_t crud_crc_short[4][256];     // Shift a CRC over CRUD_CRC_SHORT zeros
+int      crud_crc_hw = 0;            // Flag indicating the hardware is used
+pthread_once_t crud_crc_once = PTHREAD_ONCE_INIT; // Builds the tables once
+
+//
+// Local functions
+
+void crud_crc_setup( void );
+uint32_t crud_crc32c_sw( uint32_t crc, const void *buf, size_t len );
+uint32_t crud_crc32c_hw( uint32_t crc, const void *buf, size_t len );
+uint32_t crud_crc32c_bitwise( uint32_t crc, const void *buf, size_t len );
+uint32_t crud_crc_times( const uint32_t *mat, uint32_t vec );
+void crud_crc_zeros( uint32_t zeros[][256], size_t len );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc32c
+// Description  : Extend the CRC32C of the bytes before buf over buf (so a
+//                payload can be checksummed a chunk at a time).
+//
+// Inputs       : crc - the CRC so far (0 to start)
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the CRC including buf
+
+uint32_t crud_crc32c( uint32_t crc, const void *buf, size_t len ) {
+	pthread_once( &crud_crc_once, crud_crc_setup );
+	return( crud_crc_hw ? crud_crc32c_hw(crc, buf, len) : crud_crc32c_sw(crc, buf, len) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_hardware
+// Description  : Is the hardware (SSE4.2) implementation in use?
+//
+// Inputs       : none
+// Outputs      : 1 if hardware, 0 if software
+
+int crud_crc_hardware( void ) {
+	pthread_once( &crud_crc_once, crud_crc_setup );
+	return( crud_crc_hw );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_setup
+// Description  : Build the tables, see if the processor has SSE4.2
+//
+// Inputs       : none
+// Outputs      : none
+
+void crud_crc_setup( void ) {
+
+	// Local variables
+	uint32_t crc;
+	int i, j;
+
+	// The first table is the classic byte table, each next one is a byte further
+	for ( i=0; i<256; i++ ) {
+		crc = i;
+		for ( j=0; j<8; j++ ) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRUD_CRC_POLY : crc >> 1;
+		}
+		crud_crc_table[0][i] = crc;
+	}
+	for ( i=0; i<256; i++ ) {
+		for ( j=1; j<8; j++ ) {
+			crud_crc_table[j][i] = (crud_crc_table[j-1][i] >> 8) ^ crud_crc_table[0][crud_crc_table[j-1][i] & 0xff];
+		}
+	}
+
+	// The shift tables joining the hardware streams
+	crud_crc_zeros( crud_crc_long, CRUD_CRC_LONG );
+	crud_crc_zeros( crud_crc_short, CRUD_CRC_SHORT );
+
+#if defined(__x86_64__)
+	crud_crc_hw = (__builtin_cpu_supports( "sse4.2" ) != 0);
+#endif
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc32c_sw
+// Description  : Slicing-by-8 CRC32C (eight bytes per step, little endian)
+//
+// Inputs       : crc - the CRC so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the CRC including buf
+
+uint32_t crud_crc32c_sw( uint32_t crc, const void *buf, size_t len ) {
+
+	// Local variables
+	const unsigned char *next = buf;
+	uint64_t word;
+
+	// Bytes up to an 8 byte boundary, then 8 at a time, then the rest
+	crc = ~crc;
+	while ( (len > 0) && ((uintptr_t)next & 7) ) {
+		crc = (crc >> 8) ^ crud_crc_table[0][(crc ^ *next++) & 0xff];
+		len --;
+	}
+	while ( len >= 8 ) {
+		memcpy( &word, next, sizeof(word) );
+		word ^= crc;
+		crc = crud_crc_table[7][word & 0xff] ^
+			  crud_crc_table[6][(word >> 8) & 0xff] ^
+			  crud_crc_table[5][(word >> 16) & 0xff] ^
+			  crud_crc_table[4][(word >> 24) & 0xff] ^
+			  crud_crc_table[3][(word >> 32) & 0xff] ^
+			  crud_crc_table[2][(word >> 40) & 0xff] ^
+			  crud_crc_table[1][(word >> 48) & 0xff] ^
+			  crud_crc_table[0][word >> 56];
+		next += 8;
+		len -= 8;
+	}
+	while ( len > 0 ) {
+		crc = (crc >> 8) ^ crud_crc_table[0][(crc ^ *next++) & 0xff];
+		len --;
+	}
+	return( ~crc );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_shift
+// Description  : Shift a CRC over a block of zeros (using the table for the
+//                block size)
+//
+// Inputs       : zeros - the shift table
+//                crc - the CRC
+// Outputs      : the shifted CRC
+
+static inline uint32_t crud_crc_shift( uint32_t zeros[][256], uint32_t crc ) {
+	return( zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+			zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24] );
+}
+
+#if defined(__x86_64__)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc32c_hw
+// Description  : CRC32C with the SSE4.2 crc32 instruction, three streams at
+//                a time over long buffers
+//
+// Inputs       : crc - the CRC so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the CRC including buf
+
+__attribute__((target("sse4.2")))
+uint32_t crud_crc32c_hw( uint32_t crc, const void *buf, size_t len ) {
+
+	// Local variables
+	const unsigned char *next = buf, *end;
+	uint64_t crc0, crc1, crc2, word0, word1, word2;
+
+	// Bytes up to an 8 byte boundary
+	crc0 = (uint32_t)~crc;
+	while ( (len > 0) && ((uintptr_t)next & 7) ) {
+		crc0 = _mm_crc32_u8( (uint32_t)crc0, *next++ );
+		len --;
+	}
+
+	// Three long blocks at a time, then three short blocks at a time
+	while ( len >= CRUD_CRC_LONG*3 ) {
+		crc1 = crc2 = 0;
+		end = next + CRUD_CRC_LONG;
+		do {
+			memcpy( &word0, next, 8 );
+			memcpy( &word1, next+CRUD_CRC_LONG, 8 );
+			memcpy( &word2, next+CRUD_CRC_LONG*2, 8 );
+			crc0 = _mm_crc32_u64( crc0, word0 );
+			crc1 = _mm_crc32_u64( crc1, word1 );
+			crc2 = _mm_crc32_u64( crc2, word2 );
+			next += 8;
+		} while ( next < end );
+		crc0 = crud_crc_shift( crud_crc_long, (uint32_t)crc0 ) ^ crc1;
+		crc0 = crud_crc_shift( crud_crc_long, (uint32_t)crc0 ) ^ crc2;
+		next += CRUD_CRC_LONG*2;
+		len -= CRUD_CRC_LONG*3;
+	}
+	while ( len >= CRUD_CRC_SHORT*3 ) {
+		crc1 = crc2 = 0;
+		end = next + CRUD_CRC_SHORT;
+		do {
+			memcpy( &word0, next, 8 );
+			memcpy( &word1, next+CRUD_CRC_SHORT, 8 );
+			memcpy( &word2, next+CRUD_CRC_SHORT*2, 8 );
+			crc0 = _mm_crc32_u64( crc0, word0 );
+			crc1 = _mm_crc32_u64( crc1, word1 );
+			crc2 = _mm_crc32_u64( crc2, word2 );
+			next += 8;
+		} while ( next < end );
+		crc0 = crud_crc_shift( crud_crc_short, (uint32_t)crc0 ) ^ crc1;
+		crc0 = crud_crc_shift( crud_crc_short, (uint32_t)crc0 ) ^ crc2;
+		next += CRUD_CRC_SHORT*2;
+		len -= CRUD_CRC_SHORT*3;
+	}
+
+	// Whatever is left, 8 bytes then 1 byte at a time
+	while ( len >= 8 ) {
+		memcpy( &word0, next, 8 );
+		crc0 = _mm_crc32_u64( crc0, word0 );
+		next += 8;
+		len -= 8;
+	}
+	while ( len > 0 ) {
+		crc0 = _mm_crc32_u8( (uint32_t)crc0, *next++ );
+		len --;
+	}
+	return( ~(uint32_t)crc0 );
+}
+
+#else
+
+// No crc32 instruction, never selected
+uint32_t crud_crc32c_hw( uint32_t crc, const void *buf, size_t len ) {
+	return( crud_crc32c_sw(crc, buf, len) );
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_times
+// Description  : Multiply a vector by a 32x32 matrix over GF(2)
+//
+// Inputs       : mat - the matrix (a column per bit)
+//                vec - the vector
+// Outputs      : the product
+
+uint32_t crud_crc_times( const uint32_t *mat, uint32_t vec ) {
+
+	// Local variables
+	uint32_t sum = 0;
+
+	while ( vec ) {
+		if ( vec & 1 ) {
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat ++;
+	}
+	return( sum );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_zeros
+// Description  : Build the tables that shift a CRC over len zero bytes
+//                (the operator is squared up from a single zero bit)
+//
+// Inputs       : zeros - the tables to fill
+//                len - the number of zero bytes (a power of two)
+// Outputs      : none
+
+void crud_crc_zeros( uint32_t zeros[][256], size_t len ) {
+
+	// Local variables
+	uint32_t even[32], odd[32], *op, row = 1;
+	int n;
+
+	// The operator for one zero bit, then two, then four
+	odd[0] = CRUD_CRC_POLY;
+	for ( n=1; n<32; n++ ) {
+		odd[n] = row;
+		row <<= 1;
+	}
+	for ( n=0; n<32; n++ ) {
+		even[n] = crud_crc_times( odd, odd[n] );
+	}
+	for ( n=0; n<32; n++ ) {
+		odd[n] = crud_crc_times( even, even[n] );
+	}
+
+	// Square up to the 8*len bits (starting from the four above)
+	op = odd;
+	while ( len > 0 ) {
+		if ( op == odd ) {
+			for ( n=0; n<32; n++ ) {
+				even[n] = crud_crc_times( odd, odd[n] );
+			}
+			op = even;
+		} else {
+			for ( n=0; n<32; n++ ) {
+				odd[n] = crud_crc_times( even, even[n] );
+			}
+			op = odd;
+		}
+		len >>= 1;
+	}
+
+	// Table the operator a byte of the CRC at a time
+	for ( n=0; n<256; n++ ) {
+		zeros[0][n] = crud_crc_times( op, n );
+		zeros[1][n] = crud_crc_times( op, n << 8 );
+		zeros[2][n] = crud_crc_times( op, n << 16 );
+		zeros[3][n] = crud_crc_times( op, (uint32_t)n << 24 );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc32c_bitwise
+// Description  : CRC32C a bit at a time (the reference for the unit test)
+//
+// Inputs       : crc - the CRC so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the CRC including buf
+
+uint32_t crud_crc32c_bitwise( uint32_t crc, const void *buf, size_t len ) {
+
+	// Local variables
+	const unsigned char *next = buf;
+	int k;
+
+	crc = ~crc;
+	while ( len-- > 0 ) {
+		crc ^= *next++;
+		for ( k=0; k<8; k++ ) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRUD_CRC_POLY : crc >> 1;
+		}
+	}
+	return( ~crc );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_crc_unit_test
+// Description  : Check the implementations against the known CRC32C of
+//                "123456789", a bitwise reference and each other (random
+//                lengths, alignments and splits), then time them on 1MB.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_crc_unit_test( void ) {
+
+	// Local variables
+	unsigned char *buf;
+	uint32_t i, off, len, split, ref, sw, hw;
+	struct timeval start, end;
+	long sw_usecs, hw_usecs;
+
+	// The check value from the CRC32C definition
+	pthread_once( &crud_crc_once, crud_crc_setup );
+	if ( (crud_crc32c_sw(0, "123456789", 9) != 0xe3069283) ||
+		 (crud_crc32c(0, "123456789", 9) != 0xe3069283) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD crc unit test: bad check value" );
+		return( -1 );
+	}
+
+	// Random buffers, lengths and offsets (the long ones cover both block sizes)
+	if ( (buf = malloc(CRUD_CRC_TEST_SIZE+8)) == NULL ) {
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_CRC_TEST_SIZE+8; i++ ) {
+		buf[i] = (unsigned char)getRandomValue( 0, 255 );
+	}
+	for ( i=0; i<CRUD_CRC_TEST_ITERATIONS; i++ ) {
+		off = getRandomValue( 0, 7 );
+		len = (i % 10 == 0) ? getRandomValue(0, CRUD_CRC_TEST_SIZE) : getRandomValue(0, CRUD_CRC_LONG*4);
+		split = getRandomValue( 0, len );
+		ref = crud_crc32c_bitwise( 0, buf+off, len );
+		sw = crud_crc32c_sw( crud_crc32c_sw(0, buf+off, split), buf+off+split, len-split );
+		hw = crud_crc32c( crud_crc32c(0, buf+off, split), buf+off+split, len-split );
+		if ( (sw != ref) || (hw != ref) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD crc unit test: mismatch [len=%u, off=%u, split=%u, %08x/%08x/%08x]",
+					len, off, split, ref, sw, hw );
+			free( buf );
+			return( -1 );
+		}
+	}
+
+	// Time 1MB each way
+	gettimeofday( &start, NULL );
+	for ( i=0; i<100; i++ ) {
+		sw = crud_crc32c_sw( sw, buf, CRUD_CRC_TEST_SIZE );
+	}
+	gettimeofday( &end, NULL );
+	sw_usecs = compareTimes( &start, &end );
+	gettimeofday( &start, NULL );
+	for ( i=0; i<100; i++ ) {
+		hw = crud_crc32c( hw, buf, CRUD_CRC_TEST_SIZE );
+	}
+	gettimeofday( &end, NULL );
+	hw_usecs = compareTimes( &start, &end );
+	free( buf );
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD crc 1MB: software %.1f usecs, %s %.1f usecs",
+			sw_usecs/100.0, crud_crc_hw ? "hardware" : "software", hw_usecs/100.0 );
+	logMessage( LOG_INFO_LEVEL, "CRUD crc unit test completed successfully." );
+	return( 0 );
+}
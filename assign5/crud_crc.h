@@ -0,0 +1,35 @@
+#ifndef CRUD_CRC_INCLUDED
+#define CRUD_CRC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_crc.h
+//  Description   : This is the interface to the CRC32C (Castagnoli) checksum
+//                  used on the object payloads sent over the network.  The
+//                  SSE4.2 crc32 instruction is used when the processor has
+//                  it, a slicing-by-8 table implementation otherwise.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// CRC interface
+
+uint32_t crud_crc32c( uint32_t crc, const void *buf, size_t len );
+	// Extend the CRC32C of the bytes before buf (0 to start) over buf
+
+int crud_crc_hardware( void );
+	// Is the hardware (SSE4.2) implementation in use?
+
+//
+// Unit Testing
+
+int crud_crc_unit_test( void );
+	// Check the implementations against each other and a known value
+
+#endif
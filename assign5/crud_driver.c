@@ -0,0 +1,1712 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_driver.c
+//  Description    : This is the implementation of the in-memory object store
+//                   behind the CRUD bus interface.  Objects are kept in a hash
+//                   table keyed by OID, and the whole store is written to (and
+//                   read back from) a disk file on close (and init), unless
+//                   the store keeps them in a log (see crud_log.h).  The
+//                   store may be split into partitions by OID (see
+//                   crud_store.h), crud_bus_request uses a single partition.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Sat Sep  6 08:24:25 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// Project includes
+#include <crud_driver.h>
+#include <crud_codec.h>
+#include <crud_store.h>
+#include <cmpsc311_hashtable.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_UNIT_TEST_OBJECTS 64
+#define CRUD_UNIT_TEST_ITERATIONS 10000
+#define CRUD_UNIT_TEST_MAX_SIZE 4096
+#define CRUD_UNIT_TEST_PARTITIONS 3
+#define CRUD_IMAGE_MAGIC 0x474d4943 // "CIMG"
+#define CRUD_IMAGE_VERSION 1
+#define CRUD_IMAGE_PAGE 4096
+#define CRUD_IMAGE_ROUND(x) ((((uint64_t)(x))+CRUD_IMAGE_PAGE-1) & ~((uint64_t)CRUD_IMAGE_PAGE-1))
+#define CRUD_IMAGE_REWRITE 0x100000 // Images smaller than this are never rewritten
+
+//
+// Type definitions
+
+// This is the header in the first page of a store image, which is followed
+// by the (page aligned) object slots, then the directory of the objects
+typedef struct {
+	uint32_t  magic;     // The image magic number
+	uint32_t  version;   // The image format version
+	CrudOID   next_oid;  // The next OID to hand out
+	uint32_t  elements;  // The number of entries in the directory
+	uint64_t  directory; // The offset of the directory
+	uint64_t  end;       // The end of the image (new slots go here)
+} CrudImageHeader;
+
+// This is the directory entry for each object of a store image
+typedef struct {
+	CrudOID   oid;      // The object identifier
+	uint32_t  length;   // The length of the object
+	uint32_t  capacity; // The size of the object's slot
+	uint8_t   flags;    // The object flags
+	uint64_t  offset;   // The offset of the object's slot
+} CrudImageEntry;
+
+//
+// Global data
+
+CrudStore crud_driver_store;           // The store behind crud_bus_request
+int       crud_driver_store_setup = 0; // Flag indicating the store is setup
+
+//
+// Local functions
+
+CrudResponse initialize_crud( CrudStore *stores );
+CrudResponse format_crud( CrudStore *stores );
+CrudResponse create_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf, uint64_t *version );
+CrudResponse read_crud_object( CrudStore *store, CrudOID oid, uint32_t *length, uint8_t flags, void *buf, uint64_t *version );
+CrudResponse update_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf, uint64_t *version );
+CrudResponse delete_crud_object( CrudStore *store, CrudOID oid, uint8_t flags );
+CrudResponse shutdown_crud( CrudStore *stores );
+CrudObject * find_crud_object( CrudStore *store, CrudOID oid, uint8_t flags );
+CrudObject * new_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf );
+void free_crud_object( CrudStore *store, CrudObject *obj );
+void clear_crud_objects( CrudStore *store );
+CrudSlab * crud_object_slab( CrudStore *store, uint8_t flags );
+uint64_t next_crud_version( CrudStore *store, uint8_t flags );
+CrudObject ** list_crud_objects( CrudStore *stores, uint32_t *count );
+int save_crud_image( CrudStore *stores, char *fname, CrudObject **objs, uint32_t count );
+int save_crud_changes( CrudStore *stores, CrudObject **objs, uint32_t count );
+int sync_crud_directory( char *fname );
+CrudOID first_crud_oid( CrudStore *store, CrudOID from );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_bus_request
+// Description  : This is the interface to the CRUD interfaces, it decodes the
+//                request and executes it against the object store.
+//
+// Inputs       : request - the request (64 bits, see crud_driver.h)
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_bus_request( CrudRequest request, void *buf ) {
+
+	// Setup the (single partition) store the first time through
+	if ( !crud_driver_store_setup ) {
+		crud_store_setup( &crud_driver_store, 1 );
+		crud_driver_store_setup = 1;
+	}
+	return( crud_store_request(&crud_driver_store,
+			crud_store_owner(&crud_driver_store, request, 0), request, buf) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_save_store
+// Description  : Write the contents of the CRUD store to disk file.
+//
+// Inputs       : fname - the file to write the store to
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_save_store( char *fname ) {
+	return( crud_store_save(&crud_driver_store, fname) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_load_store
+// Description  : Read the contents of the storage device from a disk file.
+//
+// Inputs       : fname - the file to read the store from
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_load_store( char *fname ) {
+	return( crud_store_load(&crud_driver_store, fname) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_setup
+// Description  : Setup (but do not initialize) a store of some number of
+//                partitions
+//
+// Inputs       : stores - the array of partitions
+//                partitions - the number of partitions
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_store_setup( CrudStore *stores, uint32_t partitions ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Each partition knows where it sits in the store
+	memset( stores, 0x0, sizeof(CrudStore)*partitions );
+	for ( i=0; i<partitions; i++ ) {
+		stores[i].partition = i;
+		stores[i].partitions = partitions;
+		stores[i].version = first_crud_version();
+		stores[i].priority_version = first_crud_version();
+		crud_slab_init( &stores[i].slab );
+		crud_slab_init( &stores[i].priority_slab );
+	}
+	stores->fname = CRUD_STORE_FILENAME;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_persist
+// Description  : Keep the objects of all partitions in a (setup) log instead
+//                of memory.  The log is opened on INIT and closed on CLOSE.
+//
+// Inputs       : stores - the array of partitions
+//                log - the log
+// Outputs      : none
+
+void crud_store_persist( CrudStore *stores, CrudLog *log ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Every partition uses the same log
+	for ( i=0; i<stores->partitions; i++ ) {
+		stores[i].log = log;
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_file
+// Description  : Set the image the (in memory) store is loaded from on INIT
+//                and saved to on CLOSE.  A store without one starts empty and
+//                is discarded on CLOSE.
+//
+// Inputs       : stores - the array of partitions
+//                fname - the image file (NULL if none)
+// Outputs      : none
+
+void crud_store_file( CrudStore *stores, char *fname ) {
+	stores->fname = fname;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_owner
+// Description  : Which partition executes a request.  INIT, FORMAT and CLOSE
+//                touch all of the partitions, new objects are created in the
+//                caller's partition (so a CREATE never moves), and everything
+//                else goes to the partition the OID belongs to.
+//
+// Inputs       : stores - the array of partitions
+//                request - the request
+//                local - the partition of the caller
+// Outputs      : the partition number (CRUD_STORE_ALL_PARTITIONS if all)
+
+uint32_t crud_store_owner( CrudStore *stores, CrudRequest request, uint32_t local ) {
+
+	// Local variables
+	CRUD_REQUEST_TYPES req = crud_codec_req( request );
+
+	// Work out who owns the request
+	if ( (req == CRUD_INIT) || (req == CRUD_FORMAT) || (req == CRUD_CLOSE) ) {
+		return( CRUD_STORE_ALL_PARTITIONS );
+	}
+	if ( crud_codec_flags(request) & CRUD_PRIORITY_OBJECT ) {
+		return( 0 );
+	}
+	if ( req == CRUD_CREATE ) {
+		return( local % stores->partitions );
+	}
+	return( crud_codec_oid(request) % stores->partitions );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_request
+// Description  : Execute a (version 1) request on the owning partition (or
+//                all of them).  The caller must have exclusive access to the
+//                partitions the request touches.
+//
+// Inputs       : stores - the array of partitions
+//                owner - the owning partition (see crud_store_owner)
+//                request - the request (64 bits, see crud_driver.h)
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_store_request( CrudStore *stores, uint32_t owner, CrudRequest request, void *buf ) {
+
+	// Local variables
+	uint64_t version = 0;
+
+	// Execute without a version
+	return( crud_store_versioned(stores, owner, request, buf, &version) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_versioned
+// Description  : Execute a (version 1) request carrying an object version
+//                (see crud_store_request).
+//
+// Inputs       : stores - the array of partitions
+//                owner - the owning partition (see crud_store_owner)
+//                request - the request (64 bits, see crud_driver.h)
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+//                version - the object version of the request (the
+//                          response's on return)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_store_versioned( CrudStore *stores, uint32_t owner, CrudRequest request, void *buf, uint64_t *version ) {
+
+	// Local variables
+	CrudHeader cmd;
+	CrudOID oid;
+	uint32_t length;
+
+	// Pull apart the request, version 1 objects keep the version 1 limit
+	deconstruct_crud_request( request, &oid, &cmd.req, &length, &cmd.flags, &cmd.res );
+	cmd.oid = oid;
+	cmd.length = length;
+	cmd.objver = *version;
+	*version = 0;
+	if ( ((cmd.req == CRUD_CREATE) || (cmd.req == CRUD_UPDATE)) && (length > CRUD_MAX_OBJECT_SIZE) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: object too large [%u]", length );
+		return( construct_crud_request(oid, cmd.req, length, cmd.flags, 1) );
+	}
+
+	// Execute, then put the response back together
+	crud_store_execute( stores, owner, &cmd, buf );
+	*version = cmd.objver;
+	return( construct_crud_request((CrudOID)cmd.oid, cmd.req, (uint32_t)cmd.length, cmd.flags, cmd.res) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_execute
+// Description  : Execute a request (of any protocol version) on the owning
+//                partition (or all of them), replacing it with the response.
+//                The caller must have exclusive access to the partitions the
+//                request touches (a request on the priority object only
+//                touches the priority object).
+//
+// Inputs       : stores - the array of partitions
+//                owner - the owning partition (see crud_store_owner)
+//                cmd - the request (the response on return)
+//                buf - the buffer for object contents (CREATE/READ/UPDATE)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_store_execute( CrudStore *stores, uint32_t owner, CrudHeader *cmd, void *buf ) {
+
+	// Local variables
+	CrudStore *store = (owner == CRUD_STORE_ALL_PARTITIONS) ? stores : &stores[owner];
+	CrudResponse response;
+	CrudOID oid = (CrudOID)cmd->oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length, rlength;
+	uint64_t version = ((cmd->req == CRUD_READ) || (cmd->req == CRUD_UPDATE)) ? cmd->objver : 0;
+	uint8_t flags, res;
+
+	// Log the request
+	logMessage( LOG_INFO_LEVEL, "Received CRUD request: %s, len=%llu, oid=%llu, flgs=%d",
+			(cmd->req < CRUD_MAXVAL) ? CRUD_REQUEST_TYPE_LABLES[cmd->req] : "BAD",
+			(unsigned long long)cmd->length, (unsigned long long)cmd->oid, cmd->flags );
+
+	// Everything but INIT requires an initialized store, and the object has
+	// to be one the store can hold (failed READs are empty)
+	length = (cmd->length > CRUD_MAX_V2_OBJECT_SIZE) ? CRUD_MAX_V2_OBJECT_SIZE : (uint32_t)cmd->length;
+	if ( (cmd->req != CRUD_INIT) && (!store->initialized) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: request on uninitialized store (%u)", cmd->req );
+		cmd->length = (cmd->req == CRUD_READ) ? 0 : cmd->length;
+		cmd->res = 1;
+		return( -1 );
+	}
+	if ( (cmd->oid != oid) ||
+		 (((cmd->req == CRUD_CREATE) || (cmd->req == CRUD_UPDATE)) && (cmd->length > length)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: object out of range [OID %llu, length %llu]",
+				(unsigned long long)cmd->oid, (unsigned long long)cmd->length );
+		cmd->length = (cmd->req == CRUD_READ) ? 0 : cmd->length;
+		cmd->res = 1;
+		return( -1 );
+	}
+
+	// Dispatch on the request type
+	switch ( cmd->req ) {
+
+	case CRUD_INIT:
+		response = initialize_crud( stores );
+		break;
+
+	case CRUD_FORMAT:
+		response = format_crud( stores );
+		break;
+
+	case CRUD_CREATE:
+		response = create_crud_object( store, oid, length, cmd->flags, buf, &version );
+		break;
+
+	case CRUD_READ:
+		response = read_crud_object( store, oid, &length, cmd->flags, buf, &version );
+		break;
+
+	case CRUD_UPDATE:
+		response = update_crud_object( store, oid, length, cmd->flags, buf, &version );
+		break;
+
+	case CRUD_DELETE:
+		response = delete_crud_object( store, oid, cmd->flags );
+		break;
+
+	case CRUD_CLOSE:
+		response = shutdown_crud( stores );
+		break;
+
+	default:
+		// Unknown request, fail
+		logMessage( LOG_ERROR_LEVEL, "CRUD Driver Error: unkown request type (%u)", cmd->req );
+		cmd->res = 1;
+		return( -1 );
+	}
+
+	// The response carries the OID, result and object version (the current
+	// one for a conflicting CRUD_IF_VERSION update), the length is the
+	// object's for a READ (which may not fit the response word, and keeps
+	// CRUD_IF_CHANGED only if unchanged) and echoed otherwise
+	deconstruct_crud_request( response, &oid, &req, &rlength, &flags, &res );
+	cmd->oid = oid;
+	cmd->res = res;
+	cmd->objver = (res && !(flags & CRUD_IF_VERSION)) ? 0 : version;
+	if ( cmd->req == CRUD_READ ) {
+		cmd->length = res ? 0 : length;
+		cmd->flags = flags;
+	} else if ( cmd->req == CRUD_UPDATE ) {
+		cmd->flags = flags;
+	} else if ( cmd->req != CRUD_CREATE ) {
+		cmd->length = rlength;
+	}
+	return( res ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_save
+// Description  : Write the contents of all partitions of the store to a disk
+//                image.  Saving to the image the store was loaded from only
+//                writes the objects that changed, unless most of the image
+//                is dead space (then it is rewritten like any other).
+//
+// Inputs       : stores - the array of partitions
+//                fname - the file to write the store to
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_store_save( CrudStore *stores, char *fname ) {
+
+	// Local variables
+	CrudImage *image = &stores->image;
+	CrudObject **objs;
+	uint64_t used = 0;
+	uint32_t count, i;
+	int ret;
+
+	// Gather the objects from the partitions
+	logMessage( LOG_INFO_LEVEL, "Storing the CRUD store contents to [%s] ...", fname );
+	if ( (objs = list_crud_objects(stores, &count)) == NULL ) {
+		return( -1 );
+	}
+
+	// Work out how much of the loaded image is still in use
+	for ( i=0; i<count; i++ ) {
+		used += (objs[i]->slot != 0) ? objs[i]->capacity : 0;
+	}
+	if ( (image->base != NULL) && (!strcmp(image->fname, fname)) &&
+		 ((image->end < CRUD_IMAGE_REWRITE) || (used*2 >= image->end)) ) {
+		ret = save_crud_changes( stores, objs, count );
+	} else {
+		ret = save_crud_image( stores, fname, objs, count );
+	}
+	free( objs );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_load
+// Description  : Map a disk image into the partitions of the store (each
+//                object goes to the partition that owns its OID).  Only the
+//                directory is read, the objects point into the mapped image
+//                and are paged in as they are used.  The mapping is private,
+//                so changes to the objects never touch the file (see
+//                save_crud_changes).
+//
+// Inputs       : stores - the array of partitions
+//                fname - the file to read the store from
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_store_load( CrudStore *stores, char *fname ) {
+
+	// Local variables
+	CrudImage *image = &stores->image;
+	CrudImageHeader *hdr;
+	CrudImageEntry *dir;
+	CrudStore *store;
+	CrudObject *obj;
+	struct stat st;
+	uint32_t i;
+	int fh;
+
+	// Check to see if the store exists, no store is fine
+	logMessage( LOG_INFO_LEVEL, "Loading the disk array contents ..." );
+	if ( stat(fname, &st) == -1 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD repository file [%s] does not exist, not loading", fname );
+		return( 0 );
+	}
+	if ( (strlen(fname) >= CRUD_STORE_MAX_PATH) || (st.st_size < CRUD_IMAGE_PAGE) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad CRUD store image [%s]", fname );
+		return( -1 );
+	}
+
+	// Map the image (so it is released with the objects from here on)
+	if ( (fh = open(fname, O_RDWR)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening CRUD data for read [%s], error=[%s]",
+				fname, strerror(errno) );
+		return( -1 );
+	}
+	hdr = mmap( NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fh, 0 );
+	if ( hdr == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure mapping CRUD data [%s], error=[%s]",
+				fname, strerror(errno) );
+		close( fh );
+		return( -1 );
+	}
+	strncpy( image->fname, fname, CRUD_STORE_MAX_PATH-1 );
+	image->fd = fh;
+	image->base = (char *)hdr;
+	image->size = st.st_size;
+	image->end = hdr->end;
+
+	// Check the header, then set the next OIDs
+	if ( (hdr->magic != CRUD_IMAGE_MAGIC) || (hdr->version != CRUD_IMAGE_VERSION) ||
+		 (hdr->directory+(uint64_t)hdr->elements*sizeof(CrudImageEntry) > image->size) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad CRUD store image header [%s]", fname );
+		return( -1 );
+	}
+	for ( i=0; i<stores->partitions; i++ ) {
+		stores[i].next_oid = first_crud_oid( &stores[i], hdr->next_oid );
+	}
+
+	// Add an object for each directory entry
+	dir = (CrudImageEntry *)(image->base+hdr->directory);
+	for ( i=0; i<hdr->elements; i++ ) {
+
+		// Check the entry, then point a new object at its slot
+		if ( (dir[i].length > dir[i].capacity) || (dir[i].length > CRUD_MAX_V2_OBJECT_SIZE) ||
+			 (dir[i].offset+dir[i].capacity > image->size) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad CRUD store image entry [%s, OID %u]", fname, dir[i].oid );
+			return( -1 );
+		}
+		store = (dir[i].flags & CRUD_PRIORITY_OBJECT) ? stores : &stores[dir[i].oid % stores->partitions];
+		if ( (obj = crud_slab_alloc(crud_object_slab(store, dir[i].flags), sizeof(CrudObject))) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: object allocation failed [OID %u]", dir[i].oid );
+			return( -1 );
+		}
+		memset( obj, 0x0, sizeof(CrudObject) );
+		obj->oid = dir[i].oid;
+		obj->length = dir[i].length;
+		obj->flags = dir[i].flags;
+		obj->mapped = 1;
+		obj->capacity = dir[i].capacity;
+		obj->slot = dir[i].offset;
+		obj->version = next_crud_version( store, obj->flags );
+		obj->data = image->base+dir[i].offset;
+
+		// Place the object in the partition that owns it
+		if ( obj->flags & CRUD_PRIORITY_OBJECT ) {
+			free_crud_object( store, store->priority );
+			store->priority = obj;
+		} else {
+			if ( insertValueInHashTable(&store->objects, obj->oid, obj) ) {
+				logMessage( LOG_ERROR_LEVEL, "Inserting new object that already exists [OID=%d]", obj->oid );
+				free_crud_object( store, obj );
+				return( -1 );
+			}
+			if ( obj->oid >= store->next_oid ) {
+				store->next_oid = first_crud_oid( store, obj->oid+1 );
+			}
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD: new object [OID %u], length %d bytes", obj->oid, obj->length );
+	}
+
+	// Log and return successfully
+	logMessage( LOG_INFO_LEVEL, "Loaded the disk array contents successfully." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_store_report
+// Description  : Log the memory (or log) use of each partition of the store
+//
+// Inputs       : stores - the array of partitions
+// Outputs      : none
+
+void crud_store_report( CrudStore *stores ) {
+
+	// Local variables
+	char name[32];
+	uint32_t i;
+
+	// The partitions share the log
+	if ( stores->log != NULL ) {
+		crud_log_report( stores->log );
+		return;
+	}
+
+	// Report each partition's allocator
+	for ( i=0; i<stores->partitions; i++ ) {
+		snprintf( name, sizeof(name), "partition %u", i );
+		crud_slab_report( &stores[i].slab, name );
+	}
+	crud_slab_report( &stores->priority_slab, "priority object" );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_unit_test
+// Description  : This is a function used to test the CRUD interfaces and code.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_unit_test( void ) {
+
+	// Local variables
+	CrudStore parts[CRUD_UNIT_TEST_PARTITIONS];
+	CrudOID oid, ooid, oids[CRUD_UNIT_TEST_OBJECTS];
+	CRUD_REQUEST_TYPES req, oreq;
+	uint32_t length, olength, lengths[CRUD_UNIT_TEST_OBJECTS];
+	uint8_t flags, oflags, res, ores;
+	char *mirror[CRUD_UNIT_TEST_OBJECTS], *tbuf, *fname = "crud_unit_test.crd";
+	char *before, *after;
+	CrudRequest request;
+	CrudResponse resp;
+	CrudHeader cmd;
+	uint64_t version;
+	int i, j;
+
+	// First check the request/response packing
+	for ( i=0; i<CRUD_UNIT_TEST_ITERATIONS; i++ ) {
+		oid = getRandomValue( 0, 0xfffffffe );
+		req = getRandomValue( CRUD_INIT, CRUD_CLOSE );
+		length = getRandomValue( 0, CRUD_MAX_OBJECT_SIZE );
+		flags = getRandomValue( CRUD_NULL_FLAG, CRUD_PRIORITY_OBJECT );
+		res = getRandomValue( 0, 1 );
+		deconstruct_crud_request( construct_crud_request(oid, req, length, flags, res),
+				&ooid, &oreq, &olength, &oflags, &ores );
+		if ( (oid != ooid) || (req != oreq) || (length != olength) ||
+			 (flags != oflags) || (res != ores) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD Unit Test: Failure processing request/response structs" );
+			return( -1 );
+		}
+	}
+	logMessage( LOG_INFO_LEVEL, "CRUD Unit Test: Success processing request/response structs." );
+
+	// Now setup the store, with a clean set of objects
+	memset( oids, 0x0, sizeof(oids) );
+	memset( mirror, 0x0, sizeof(mirror) );
+	tbuf = malloc( CRUD_UNIT_TEST_MAX_SIZE*2 );
+	if ( (crud_bus_request(construct_crud_request(0, CRUD_INIT, 0, 0, 0), NULL) & 0x1) ||
+		 (crud_bus_request(construct_crud_request(0, CRUD_FORMAT, 0, 0, 0), NULL) & 0x1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD Unit test : init failued" );
+		return( -1 );
+	}
+
+	// Do a bunch of random operations, mirroring the contents locally
+	for ( i=0; i<CRUD_UNIT_TEST_ITERATIONS; i++ ) {
+		j = getRandomValue( 0, CRUD_UNIT_TEST_OBJECTS-1 );
+
+		if ( mirror[j] == NULL ) {
+
+			// Create a new object with random contents
+			lengths[j] = getRandomValue( 1, CRUD_UNIT_TEST_MAX_SIZE );
+			mirror[j] = malloc( lengths[j] );
+			memset( mirror[j], getRandomValue(0, 0xff), lengths[j] );
+			resp = crud_bus_request( construct_crud_request(0, CRUD_CREATE, lengths[j], 0, 0), mirror[j] );
+			deconstruct_crud_request( resp, &oids[j], &req, &length, &flags, &res );
+			if ( res || (length != lengths[j]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure creating block." );
+				return( -1 );
+			}
+
+		} else {
+
+			// Read the object back and compare to the mirror
+			resp = crud_bus_request( construct_crud_request(oids[j], CRUD_READ, CRUD_UNIT_TEST_MAX_SIZE, 0, 0), tbuf );
+			deconstruct_crud_request( resp, &oid, &req, &length, &flags, &res );
+			if ( res || (length != lengths[j]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading block." );
+				return( -1 );
+			}
+			if ( memcmp(tbuf, mirror[j], length) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure read comparison block." );
+				return( -1 );
+			}
+
+			// Now either update or delete it
+			if ( getRandomValue(0, 1) ) {
+				lengths[j] = getRandomValue( 1, CRUD_UNIT_TEST_MAX_SIZE );
+				mirror[j] = realloc( mirror[j], lengths[j] );
+				memset( mirror[j], getRandomValue(0, 0xff), lengths[j] );
+				resp = crud_bus_request( construct_crud_request(oids[j], CRUD_UPDATE, lengths[j], 0, 0), mirror[j] );
+				if ( resp & 0x1 ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure updating block [%d].", oids[j] );
+					return( -1 );
+				}
+			} else {
+				resp = crud_bus_request( construct_crud_request(oids[j], CRUD_DELETE, 0, 0, 0), NULL );
+				if ( resp & 0x1 ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure deleting block [%d].", oids[j] );
+					return( -1 );
+				}
+				free( mirror[j] );
+				mirror[j] = NULL;
+			}
+		}
+	}
+
+	// Save the store, then load it into a partitioned store and read it back
+	crud_store_setup( parts, CRUD_UNIT_TEST_PARTITIONS );
+	for ( i=0; i<CRUD_UNIT_TEST_PARTITIONS; i++ ) {
+		initHashTable( &parts[i].objects, CRUD_STORE_HASH_BITS );
+		parts[i].initialized = 1;
+	}
+	if ( crud_save_store(fname) || crud_store_load(parts, fname) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure saving/loading partitions." );
+		return( -1 );
+	}
+	for ( j=0; j<CRUD_UNIT_TEST_OBJECTS; j++ ) {
+		if ( mirror[j] != NULL ) {
+			request = construct_crud_request( oids[j], CRUD_READ, CRUD_UNIT_TEST_MAX_SIZE, 0, 0 );
+			resp = crud_store_request( parts, crud_store_owner(parts, request, 0), request, tbuf );
+			deconstruct_crud_request( resp, &oid, &req, &length, &flags, &res );
+			if ( res || (length != lengths[j]) || memcmp(tbuf, mirror[j], length) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading partitioned block [%d].", oids[j] );
+				return( -1 );
+			}
+		}
+	}
+
+	// New objects land in the creating partition
+	for ( i=0; i<CRUD_UNIT_TEST_PARTITIONS; i++ ) {
+		request = construct_crud_request( 0, CRUD_CREATE, 1, 0, 0 );
+		resp = crud_store_request( parts, crud_store_owner(parts, request, i), request, tbuf );
+		deconstruct_crud_request( resp, &oid, &req, &length, &flags, &res );
+		if ( res || (crud_store_owner(parts, construct_crud_request(oid, CRUD_READ, 0, 0, 0), 0) != i) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure creating partitioned block [%d].", i );
+			return( -1 );
+		}
+	}
+
+	// Change the mapped objects (some in place, some growing out of their
+	// slots), the file is left alone until the changes are saved, then map
+	// the image again
+	before = malloc( parts->image.size );
+	after = malloc( parts->image.size );
+	if ( pread(parts->image.fd, before, parts->image.size, 0) != parts->image.size ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading the store image." );
+		return( -1 );
+	}
+	for ( j=0; j<CRUD_UNIT_TEST_OBJECTS; j++ ) {
+		if ( mirror[j] == NULL ) {
+			continue;
+		}
+		if ( getRandomValue(0, 3) == 0 ) {
+			request = construct_crud_request( oids[j], CRUD_DELETE, 0, 0, 0 );
+			resp = crud_store_request( parts, crud_store_owner(parts, request, 0), request, NULL );
+			free( mirror[j] );
+			mirror[j] = NULL;
+		} else {
+			lengths[j] = getRandomValue( 1, CRUD_UNIT_TEST_MAX_SIZE*2 );
+			mirror[j] = realloc( mirror[j], lengths[j] );
+			memset( mirror[j], getRandomValue(0, 0xff), lengths[j] );
+			request = construct_crud_request( oids[j], CRUD_UPDATE, lengths[j], 0, 0 );
+			resp = crud_store_request( parts, crud_store_owner(parts, request, 0), request, mirror[j] );
+		}
+		if ( resp & 0x1 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure changing partitioned block [%d].", oids[j] );
+			return( -1 );
+		}
+	}
+	if ( (pread(parts->image.fd, after, parts->image.size, 0) != parts->image.size) ||
+		 memcmp(before, after, parts->image.size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Store image changed before it was saved." );
+		return( -1 );
+	}
+	free( before );
+	free( after );
+	if ( crud_store_save(parts, fname) || (parts[0].image.fname[0] == 0x0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure saving partition changes." );
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_UNIT_TEST_PARTITIONS; i++ ) {
+		clear_crud_objects( &parts[i] );
+		cleanupHashTable( &parts[i].objects );
+	}
+	crud_store_setup( parts, CRUD_UNIT_TEST_PARTITIONS-1 );
+	for ( i=0; i<parts->partitions; i++ ) {
+		initHashTable( &parts[i].objects, CRUD_STORE_HASH_BITS );
+		parts[i].initialized = 1;
+	}
+	if ( crud_store_load(parts, fname) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reloading partitions." );
+		return( -1 );
+	}
+	for ( j=0; j<CRUD_UNIT_TEST_OBJECTS; j++ ) {
+		if ( mirror[j] != NULL ) {
+			request = construct_crud_request( oids[j], CRUD_READ, CRUD_UNIT_TEST_MAX_SIZE*2, 0, 0 );
+			resp = crud_store_request( parts, crud_store_owner(parts, request, 0), request, tbuf );
+			deconstruct_crud_request( resp, &oid, &req, &length, &flags, &res );
+			if ( res || (length != lengths[j]) || memcmp(tbuf, mirror[j], length) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading reloaded block [%d].", oids[j] );
+				return( -1 );
+			}
+		}
+	}
+
+	// Conditional reads are only answered with the contents if the version
+	// changed (an update gives the object a new one)
+	for ( j=0; j<CRUD_UNIT_TEST_OBJECTS; j++ ) {
+		if ( mirror[j] == NULL ) {
+			continue;
+		}
+		request = construct_crud_request( oids[j], CRUD_READ, 0, 0, 0 );
+		memset( &cmd, 0x0, sizeof(cmd) );
+		cmd.oid = oids[j];
+		cmd.req = CRUD_READ;
+		cmd.length = CRUD_UNIT_TEST_MAX_SIZE*2;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, tbuf );
+		version = cmd.objver;
+		cmd.req = CRUD_READ;
+		cmd.length = CRUD_UNIT_TEST_MAX_SIZE*2;
+		cmd.flags = CRUD_IF_CHANGED;
+		memset( tbuf, 0x0, lengths[j] );
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, tbuf );
+		if ( cmd.res || (version == 0) || (cmd.objver != version) || (cmd.flags != CRUD_IF_CHANGED) ||
+			 (cmd.length != lengths[j]) || !memcmp(tbuf, mirror[j], lengths[j]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading unchanged block [%d].", oids[j] );
+			return( -1 );
+		}
+		cmd.req = CRUD_UPDATE;
+		cmd.length = lengths[j];
+		cmd.flags = 0;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, mirror[j] );
+		cmd.req = CRUD_READ;
+		cmd.length = CRUD_UNIT_TEST_MAX_SIZE*2;
+		cmd.flags = CRUD_IF_CHANGED;
+		cmd.objver = version;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, tbuf );
+		if ( cmd.res || (cmd.objver == version) || (cmd.flags != 0) || (cmd.length != lengths[j]) ||
+			 memcmp(tbuf, mirror[j], lengths[j]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading changed block [%d].", oids[j] );
+			return( -1 );
+		}
+
+		// Conditional updates only apply to the current version (a stale
+		// one leaves the object alone and gets the current version back)
+		version = cmd.objver;
+		tbuf[0] ^= 0xff;
+		cmd.req = CRUD_UPDATE;
+		cmd.length = lengths[j];
+		cmd.flags = CRUD_IF_VERSION;
+		cmd.objver = version-1;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, tbuf );
+		if ( (!cmd.res) || (cmd.objver != version) || (cmd.flags != CRUD_IF_VERSION) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure detecting conflicting update [%d].", oids[j] );
+			return( -1 );
+		}
+		cmd.req = CRUD_UPDATE;
+		cmd.length = lengths[j];
+		cmd.flags = CRUD_IF_VERSION;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, mirror[j] );
+		if ( cmd.res || (cmd.objver == version) || (cmd.objver == 0) || (cmd.flags != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure applying conditional update [%d].", oids[j] );
+			return( -1 );
+		}
+		cmd.req = CRUD_READ;
+		cmd.length = CRUD_UNIT_TEST_MAX_SIZE*2;
+		cmd.flags = 0;
+		crud_store_execute( parts, crud_store_owner(parts, request, 0), &cmd, tbuf );
+		if ( cmd.res || (cmd.length != lengths[j]) || memcmp(tbuf, mirror[j], lengths[j]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading conditionally updated block [%d].", oids[j] );
+			return( -1 );
+		}
+	}
+
+	// Cleanup the objects and stores (without saving), return successfully
+	for ( i=0; i<CRUD_UNIT_TEST_OBJECTS; i++ ) {
+		free( mirror[i] );
+	}
+	free( tbuf );
+	unlink( fname );
+	for ( i=0; i<parts->partitions; i++ ) {
+		clear_crud_objects( &parts[i] );
+		cleanupHashTable( &parts[i].objects );
+	}
+	clear_crud_objects( &crud_driver_store );
+	cleanupHashTable( &crud_driver_store.objects );
+	crud_store_setup( &crud_driver_store, 1 );
+	logMessage( LOG_INFO_LEVEL, "CRUD Unit Test: object store test successful." );
+	return( 0 );
+}
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : initialize_crud
+// Description  : Initialize the object store, loading any saved contents.
+//                Every client INITs, so only the first session does the work.
+//
+// Inputs       : stores - the array of partitions
+// Outputs      : the response structure
+
+CrudResponse initialize_crud( CrudStore *stores ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Already initialized, just count the session
+	if ( stores->initialized ) {
+		stores->sessions ++;
+		return( construct_crud_request(0, CRUD_INIT, 0, 0, 0) );
+	}
+
+	// Open the log, the OIDs carry on from the highest it has seen
+	if ( stores->log != NULL ) {
+		if ( crud_log_open(stores->log) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: unable to open log of crud device." );
+			return( construct_crud_request(0, CRUD_INIT, 0, 0, 1) );
+		}
+		for ( i=0; i<stores->partitions; i++ ) {
+			stores[i].priority = NULL;
+			stores[i].next_oid = first_crud_oid( &stores[i], stores->log->high+1 );
+			stores[i].initialized = 1;
+		}
+		stores->sessions = 1;
+		logMessage( LOG_INFO_LEVEL, "CRUD: Object store initialized [first OID %u, log %s, partitions=%u]",
+				stores->next_oid, stores->log->dir, stores->partitions );
+		return( construct_crud_request(0, CRUD_INIT, 0, 0, 0) );
+	}
+
+	// Setup the tables, then load the contents of the device
+	for ( i=0; i<stores->partitions; i++ ) {
+		stores[i].priority = NULL;
+		stores[i].next_oid = first_crud_oid( &stores[i], 1 );
+		if ( initHashTable(&stores[i].objects, CRUD_STORE_HASH_BITS) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: initialization of object storage failed." );
+			return( construct_crud_request(0, CRUD_INIT, 0, 0, 1) );
+		}
+	}
+	if ( (stores->fname != NULL) && crud_store_load(stores, stores->fname) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: unable to load contents of crud device." );
+		for ( i=0; i<stores->partitions; i++ ) {
+			clear_crud_objects( &stores[i] );
+			cleanupHashTable( &stores[i].objects );
+		}
+		return( construct_crud_request(0, CRUD_INIT, 0, 0, 1) );
+	}
+
+	// Log, return successfully
+	for ( i=0; i<stores->partitions; i++ ) {
+		stores[i].initialized = 1;
+	}
+	stores->sessions = 1;
+	logMessage( LOG_INFO_LEVEL, "CRUD: Object store initialized [first OID %u, bit width=%d, partitions=%u]",
+			stores->next_oid, CRUD_STORE_HASH_BITS, stores->partitions );
+	return( construct_crud_request(0, CRUD_INIT, 0, 0, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : format_crud
+// Description  : Format the object store (remove all objects)
+//
+// Inputs       : stores - the array of partitions
+// Outputs      : the response structure
+
+CrudResponse format_crud( CrudStore *stores ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Remove all of the objects, reset the OIDs
+	if ( (stores->log != NULL) && crud_log_format(stores->log) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: format of crud log failed." );
+		return( construct_crud_request(0, CRUD_FORMAT, 0, 0, 1) );
+	}
+	for ( i=0; i<stores->partitions; i++ ) {
+		clear_crud_objects( &stores[i] );
+		stores[i].next_oid = first_crud_oid( &stores[i], 1 );
+	}
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: Object store formatted." );
+	return( construct_crud_request(0, CRUD_FORMAT, 0, 0, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : create_crud_object
+// Description  : Create a new object in the store
+//
+// Inputs       : store - the partition to create the object in
+//                oid - the object ID (ignored, assigned by store)
+//                length - the length of the new object
+//                flags - the object flags
+//                buf - the initial contents of the object
+//                version - the version of the new object (returned)
+// Outputs      : the response structure
+
+CrudResponse create_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf, uint64_t *version ) {
+
+	// Local variables
+	CrudObject *obj;
+
+	// Check the size of the object
+	if ( length > CRUD_MAX_V2_OBJECT_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: create object too large [%d]", length );
+		return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+	}
+
+	// Logged objects are just appended (the priority object is OID 0)
+	if ( store->log != NULL ) {
+		oid = (flags & CRUD_PRIORITY_OBJECT) ? CRUD_NO_OBJECT : store->next_oid;
+		if ( (flags & CRUD_PRIORITY_OBJECT) && (crud_log_lookup(store->log, oid, NULL, NULL, NULL) == 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: cannot create priority object, one already exists" );
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		if ( crud_log_put(store->log, oid, flags, buf, length, version) ) {
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		if ( !(flags & CRUD_PRIORITY_OBJECT) ) {
+			store->next_oid += store->partitions;
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD: new object [OID %u], length %d bytes", oid, length );
+		return( construct_crud_request(oid, CRUD_CREATE, length, flags, 0) );
+	}
+
+	// Priority objects are stored on the side (always OID 0)
+	if ( flags & CRUD_PRIORITY_OBJECT ) {
+		if ( store->priority != NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: cannot create priority object, one already exists" );
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		if ( (store->priority = new_crud_object(store, CRUD_NO_OBJECT, length, flags, buf)) == NULL ) {
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		obj = store->priority;
+
+	} else {
+
+		// Create the object, add it to the table
+		if ( (obj = new_crud_object(store, store->next_oid, length, flags, buf)) == NULL ) {
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		if ( insertValueInHashTable(&store->objects, obj->oid, obj) ) {
+			logMessage( LOG_ERROR_LEVEL, "Inserting new object that already exists [OID=%d]", obj->oid );
+			free_crud_object( store, obj );
+			return( construct_crud_request(oid, CRUD_CREATE, length, flags, 1) );
+		}
+		store->next_oid += store->partitions;
+	}
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: new object [OID %u], length %d bytes", obj->oid, obj->length );
+	*version = obj->version;
+	return( construct_crud_request(obj->oid, CRUD_CREATE, obj->length, flags, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_crud_object
+// Description  : Read an object from the store.  A CRUD_IF_CHANGED read of
+//                an object still at the version given is not copied out, the
+//                response keeps the flag.
+//
+// Inputs       : store - the partition holding the object
+//                oid - the object ID
+//                length - the size of the target buffer (the object size on
+//                         return, which may not fit the response)
+//                flags - the object flags
+//                buf - the buffer to read into
+//                version - the version the caller has (if CRUD_IF_CHANGED),
+//                          the object's version on return
+// Outputs      : the response structure (length is the object size)
+
+CrudResponse read_crud_object( CrudStore *store, CrudOID oid, uint32_t *length, uint8_t flags, void *buf, uint64_t *version ) {
+
+	// Local variables
+	CrudObject *obj;
+	CrudOID key;
+	uint32_t olength;
+	uint64_t oversion;
+	uint8_t oflags;
+
+	// Logged objects are read straight out of the segment (if they changed)
+	if ( store->log != NULL ) {
+		key = (flags & CRUD_PRIORITY_OBJECT) ? CRUD_NO_OBJECT : oid;
+		if ( (flags & CRUD_IF_CHANGED) && (crud_log_lookup(store->log, key, &olength, NULL, &oversion) == 0) &&
+			 (oversion == *version) ) {
+			logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] not modified.", oid );
+			*length = olength;
+			return( construct_crud_request(oid, CRUD_READ, olength, flags, 0) );
+		}
+		if ( crud_log_get(store->log, key, buf, *length, &olength, &oflags, version) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: failure reading object [OID %u]", oid );
+			return( construct_crud_request(oid, CRUD_READ, 0, flags, 1) );
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] read %d bytes.", oid, olength );
+		*length = olength;
+		return( construct_crud_request(oid, CRUD_READ, olength, flags & ~CRUD_IF_CHANGED, 0) );
+	}
+
+	// Find the object, there is nothing to copy if the caller has this version
+	if ( (obj = find_crud_object(store, oid, flags)) == NULL ) {
+		return( construct_crud_request(oid, CRUD_READ, 0, flags, 1) );
+	}
+	if ( (flags & CRUD_IF_CHANGED) && (obj->version == *version) ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] not modified.", obj->oid );
+		*length = obj->length;
+		return( construct_crud_request(oid, CRUD_READ, obj->length, flags, 0) );
+	}
+
+	// Make sure it fits, then copy it out
+	if ( *length < obj->length ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: read target buffer too small [OID %d<%d]", *length, obj->length );
+		return( construct_crud_request(oid, CRUD_READ, 0, flags, 1) );
+	}
+	memcpy( buf, obj->data, obj->length );
+	*length = obj->length;
+	*version = obj->version;
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] read %d bytes.", obj->oid, obj->length );
+	return( construct_crud_request(oid, CRUD_READ, obj->length, flags & ~CRUD_IF_CHANGED, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : update_crud_object
+// Description  : Update (replace) the contents of an object in the store.
+//                Note that the object may change size on update (the
+//                contents stay where they are if the size class fits).  A
+//                CRUD_IF_VERSION update of an object no longer at the
+//                version given fails, the response keeps the flag.
+//
+// Inputs       : store - the partition holding the object
+//                oid - the object ID
+//                length - the new length of the object
+//                flags - the object flags
+//                buf - the new contents of the object
+//                version - the version the caller expects (if
+//                          CRUD_IF_VERSION), the object's version on return
+// Outputs      : the response structure
+
+CrudResponse update_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf, uint64_t *version ) {
+
+	// Local variables
+	CrudObject *obj;
+	CrudOID key;
+	uint64_t oversion;
+	uint8_t oflags;
+	char *data;
+
+	// Check the size
+	if ( length > CRUD_MAX_V2_OBJECT_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: update length too large [OID %u]", oid );
+		return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+	}
+
+	// Logged objects get a new record (keeping the flags they were created with)
+	if ( store->log != NULL ) {
+		key = (flags & CRUD_PRIORITY_OBJECT) ? CRUD_NO_OBJECT : oid;
+		if ( crud_log_lookup(store->log, key, NULL, &oflags, &oversion) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: non-existent object [OID %u]", oid );
+			return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+		}
+		if ( (flags & CRUD_IF_VERSION) && (oversion != *version) ) {
+			logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] version conflict.", oid );
+			*version = oversion;
+			return( construct_crud_request(oid, CRUD_UPDATE, length, flags, 1) );
+		}
+		if ( crud_log_put(store->log, key, oflags, buf, length, version) ) {
+			return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] update %d bytes.", oid, length );
+		return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 0) );
+	}
+
+	// Find the object, it is left alone if it is not at the version expected
+	if ( (obj = find_crud_object(store, oid, flags)) == NULL ) {
+		return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+	}
+	if ( (flags & CRUD_IF_VERSION) && (obj->version != *version) ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] version conflict.", obj->oid );
+		*version = obj->version;
+		return( construct_crud_request(oid, CRUD_UPDATE, length, flags, 1) );
+	}
+
+	// Contents in the (private) mapping are replaced in place if the slot is
+	// big enough, otherwise they move to memory
+	if ( obj->mapped ) {
+		if ( length > obj->capacity ) {
+			if ( (data = crud_slab_alloc(crud_object_slab(store, obj->flags), length)) == NULL ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD: update allocation failed [OID %u]", oid );
+				return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+			}
+			obj->data = data;
+			obj->mapped = 0;
+			obj->slot = 0;
+		}
+		obj->length = length;
+	}
+
+	// Resize the contents if necessary, then copy
+	if ( length != obj->length ) {
+		if ( (data = crud_slab_replace(crud_object_slab(store, obj->flags), obj->data, obj->length, length)) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: update allocation failed [OID %u]", oid );
+			return( construct_crud_request(oid, CRUD_UPDATE, length, flags & ~CRUD_IF_VERSION, 1) );
+		}
+		obj->data = data;
+		obj->length = length;
+	}
+	memcpy( obj->data, buf, length );
+	obj->dirty = 1;
+	obj->version = next_crud_version( store, obj->flags );
+	*version = obj->version;
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] update %d bytes.", obj->oid, obj->length );
+	return( construct_crud_request(oid, CRUD_UPDATE, obj->length, flags & ~CRUD_IF_VERSION, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delete_crud_object
+// Description  : Delete an object from the store
+//
+// Inputs       : store - the partition holding the object
+//                oid - the object ID
+//                flags - the object flags
+// Outputs      : the response structure
+
+CrudResponse delete_crud_object( CrudStore *store, CrudOID oid, uint8_t flags ) {
+
+	// Local variables
+	CrudObject *obj;
+
+	// Logged objects get a delete record
+	if ( store->log != NULL ) {
+		if ( crud_log_delete(store->log, (flags & CRUD_PRIORITY_OBJECT) ? CRUD_NO_OBJECT : oid) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: failure deleting non-existent object [OID %u]", oid );
+			return( construct_crud_request(oid, CRUD_DELETE, 0, flags, 1) );
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] deleted.", oid );
+		return( construct_crud_request(oid, CRUD_DELETE, 0, flags, 0) );
+	}
+
+	// Remove the object from wherever it lives
+	if ( flags & CRUD_PRIORITY_OBJECT ) {
+		obj = store->priority;
+		store->priority = NULL;
+	} else {
+		obj = deleteValueFromHashTable( &store->objects, oid );
+	}
+	if ( obj == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: failure deleting non-existent object [OID %u]", oid );
+		return( construct_crud_request(oid, CRUD_DELETE, 0, flags, 1) );
+	}
+	free_crud_object( store, obj );
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: object [OID %u] deleted.", oid );
+	return( construct_crud_request(oid, CRUD_DELETE, 0, flags, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : shutdown_crud
+// Description  : Close the object store, saving the contents to disk.  The
+//                store only really closes when the last session does.
+//
+// Inputs       : stores - the array of partitions
+// Outputs      : the response structure
+
+CrudResponse shutdown_crud( CrudStore *stores ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Other sessions still have the store open
+	if ( stores->sessions > 1 ) {
+		stores->sessions --;
+		return( construct_crud_request(0, CRUD_CLOSE, 0, 0, 0) );
+	}
+
+	// Save the contents of the store (a log is already on disk, just close it)
+	crud_store_report( stores );
+	if ( stores->log != NULL ) {
+		if ( crud_log_close(stores->log) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: close of crud log failed." );
+			return( construct_crud_request(0, CRUD_CLOSE, 0, 0, 1) );
+		}
+	} else if ( (stores->fname != NULL) && crud_store_save(stores, stores->fname) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: save crud content failed." );
+		return( construct_crud_request(0, CRUD_CLOSE, 0, 0, 1) );
+	}
+
+	// Release all of the objects and the tables
+	for ( i=0; i<stores->partitions; i++ ) {
+		clear_crud_objects( &stores[i] );
+		cleanupHashTable( &stores[i].objects );
+		stores[i].initialized = 0;
+	}
+	stores->sessions = 0;
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD: Object store closed" );
+	return( construct_crud_request(0, CRUD_CLOSE, 0, 0, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_crud_object
+// Description  : Find an object in the store (priority or otherwise)
+//
+// Inputs       : store - the partition holding the object
+//                oid - the object ID
+//                flags - the request flags
+// Outputs      : the object, NULL if not found
+
+CrudObject * find_crud_object( CrudStore *store, CrudOID oid, uint8_t flags ) {
+
+	// Local variables
+	CrudObject *obj;
+
+	// Priority objects are found by flag, not OID
+	if ( flags & CRUD_PRIORITY_OBJECT ) {
+		if ( store->priority == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: cannot find priority object" );
+		}
+		return( store->priority );
+	}
+
+	// Look in the table
+	if ( (obj = findValueInHashTable(&store->objects, oid)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: non-existent object [OID %u]", oid );
+	}
+	return( obj );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : new_crud_object
+// Description  : Allocate a new object, copying in the contents (if any)
+//
+// Inputs       : store - the partition the object belongs to
+//                oid - the object ID
+//                length - the object length
+//                flags - the object flags
+//                buf - the initial contents (NULL to leave uninitialized)
+// Outputs      : the new object, NULL if failure
+
+CrudObject * new_crud_object( CrudStore *store, CrudOID oid, uint32_t length, uint8_t flags, void *buf ) {
+
+	// Allocate the object and its contents
+	CrudSlab *slab = crud_object_slab( store, flags );
+	CrudObject *obj = crud_slab_alloc( slab, sizeof(CrudObject) );
+	if ( obj == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: object allocation failed [OID %u]", oid );
+		return( NULL );
+	}
+	memset( obj, 0x0, sizeof(CrudObject) );
+	obj->oid = oid;
+	obj->length = length;
+	obj->flags = flags;
+	obj->dirty = 1;
+	obj->version = next_crud_version( store, flags );
+	if ( (obj->data = crud_slab_alloc(slab, length)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: object allocation failed [OID %u]", oid );
+		crud_slab_free( slab, obj, sizeof(CrudObject) );
+		return( NULL );
+	}
+
+	// Copy the contents (if provided), return the object
+	if ( (buf != NULL) && (length > 0) ) {
+		memcpy( obj->data, buf, length );
+	}
+	return( obj );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : free_crud_object
+// Description  : Release an object and its contents (unless they are in the
+//                mapped image)
+//
+// Inputs       : store - the partition the object belongs to
+//                obj - the object to free (may be NULL)
+// Outputs      : none
+
+void free_crud_object( CrudStore *store, CrudObject *obj ) {
+	if ( obj != NULL ) {
+		if ( !obj->mapped ) {
+			crud_slab_free( crud_object_slab(store, obj->flags), obj->data, obj->length );
+		}
+		crud_slab_free( crud_object_slab(store, obj->flags), obj, sizeof(CrudObject) );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clear_crud_objects
+// Description  : Remove and free all of the objects in a partition (the
+//                allocator is emptied all at once), and unmap the image they
+//                were loaded from
+//
+// Inputs       : store - the partition to clear
+// Outputs      : none
+
+void clear_crud_objects( CrudStore *store ) {
+
+	// Local variables
+	uint16_t bits = store->objects.htTableSize;
+
+	// Rebuild an empty table, then release the objects
+	if ( store->objects.hasHTable != NULL ) {
+		cleanupHashTable( &store->objects );
+		initHashTable( &store->objects, bits );
+	}
+	crud_slab_cleanup( &store->slab );
+	crud_slab_cleanup( &store->priority_slab );
+	store->priority = NULL;
+	if ( store->image.base != NULL ) {
+		munmap( store->image.base, store->image.size );
+		close( store->image.fd );
+	}
+	memset( &store->image, 0x0, sizeof(CrudImage) );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_object_slab
+// Description  : Find the allocator for an object (the priority object has
+//                its own, so it can be changed while other requests run on
+//                its partition)
+//
+// Inputs       : store - the partition the object belongs to
+//                flags - the object flags
+// Outputs      : the allocator
+
+CrudSlab * crud_object_slab( CrudStore *store, uint8_t flags ) {
+	return( (flags & CRUD_PRIORITY_OBJECT) ? &store->priority_slab : &store->slab );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_crud_version
+// Description  : Hand out the next version for an object (the priority
+//                object has its own)
+//
+// Inputs       : store - the partition the object belongs to
+//                flags - the object flags
+// Outputs      : the version
+
+uint64_t next_crud_version( CrudStore *store, uint8_t flags ) {
+	return( (flags & CRUD_PRIORITY_OBJECT) ? store->priority_version++ : store->version++ );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : first_crud_oid
+// Description  : Find the first OID at or after a value that the partition
+//                hands out (OID 0 is never handed out)
+//
+// Inputs       : store - the partition
+//                from - the lowest acceptable OID
+// Outputs      : the OID
+
+CrudOID first_crud_oid( CrudStore *store, CrudOID from ) {
+
+	// Round up to the next OID congruent to the partition
+	CrudOID oid = from + (store->partition + store->partitions - (from % store->partitions)) % store->partitions;
+	return( (oid == 0) ? store->partitions : oid );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : list_crud_objects
+// Description  : Make a list of the objects in all partitions of the store
+//
+// Inputs       : stores - the array of partitions
+//                count - the number of objects (returned)
+// Outputs      : the list (to be freed by the caller), NULL if failure
+
+CrudObject ** list_crud_objects( CrudStore *stores, uint32_t *count ) {
+
+	// Local variables
+	CrudObject **objs, *obj;
+	HtIterator it;
+	uint32_t i;
+
+	// Size the list, then fill it with each partition's objects
+	for ( i=0, *count=0; i<stores->partitions; i++ ) {
+		*count += stores[i].objects.elements + ((stores[i].priority != NULL) ? 1 : 0);
+	}
+	if ( (objs = malloc((*count+1)*sizeof(CrudObject *))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: object list allocation failed [%u]", *count );
+		return( NULL );
+	}
+	for ( i=0, *count=0; i<stores->partitions; i++ ) {
+		if ( stores[i].priority != NULL ) {
+			objs[(*count)++] = stores[i].priority;
+		}
+		initHashTableIterator( &stores[i].objects, &it );
+		while ( (obj = iterateHashTable(&it)) != NULL ) {
+			objs[(*count)++] = obj;
+		}
+	}
+	return( objs );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_crud_image
+// Description  : Write a new image of the store, replacing the file only
+//                once it is complete.  A mapped image the store was loaded
+//                from stays mapped (it is just no longer the file).
+//
+// Inputs       : stores - the array of partitions
+//                fname - the file to write the store to
+//                objs - the objects
+//                count - the number of objects
+// Outputs      : 0 if successful, -1 if failure
+
+int save_crud_image( CrudStore *stores, char *fname, CrudObject **objs, uint32_t count ) {
+
+	// Local variables
+	char tname[CRUD_STORE_MAX_PATH+8];
+	CrudImageHeader hdr;
+	CrudImageEntry *dir;
+	uint64_t offset = CRUD_IMAGE_PAGE;
+	uint32_t i;
+	int fh;
+
+	// Open the new image file
+	snprintf( tname, sizeof(tname), "%s.tmp", fname );
+	if ( (fh = open(tname, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening array data for store [%s], error=[%s]",
+				tname, strerror(errno) );
+		return( -1 );
+	}
+	if ( (dir = calloc(count+1, sizeof(CrudImageEntry))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: image directory allocation failed [%u]", count );
+		close( fh );
+		return( -1 );
+	}
+
+	// Write each object into its own (page aligned) slot
+	for ( i=0; i<count; i++ ) {
+		dir[i].oid = objs[i]->oid;
+		dir[i].length = objs[i]->length;
+		dir[i].capacity = CRUD_IMAGE_ROUND(objs[i]->length);
+		dir[i].flags = objs[i]->flags;
+		dir[i].offset = offset;
+		if ( pwrite(fh, objs[i]->data, objs[i]->length, offset) != objs[i]->length ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD data [%s], error=[%s]",
+					tname, strerror(errno) );
+			free( dir );
+			close( fh );
+			return( -1 );
+		}
+		offset += dir[i].capacity;
+	}
+
+	// Then the directory, and finally the header (the file covers the whole
+	// image, even when the store is empty)
+	memset( &hdr, 0x0, sizeof(hdr) );
+	hdr.magic = CRUD_IMAGE_MAGIC;
+	hdr.version = CRUD_IMAGE_VERSION;
+	hdr.elements = count;
+	hdr.directory = offset;
+	hdr.end = CRUD_IMAGE_ROUND(offset+count*sizeof(CrudImageEntry));
+	for ( i=0; i<stores->partitions; i++ ) {
+		if ( stores[i].next_oid > hdr.next_oid ) {
+			hdr.next_oid = stores[i].next_oid;
+		}
+	}
+	if ( (pwrite(fh, dir, count*sizeof(CrudImageEntry), offset) != count*sizeof(CrudImageEntry)) ||
+		 (pwrite(fh, &hdr, sizeof(hdr), 0) != sizeof(hdr)) || (ftruncate(fh, hdr.end) == -1) ||
+		 (fdatasync(fh) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD directory [%s], error=[%s]",
+				tname, strerror(errno) );
+		free( dir );
+		close( fh );
+		return( -1 );
+	}
+	free( dir );
+	close( fh );
+
+	// Put the new image in place of the old one
+	if ( rename(tname, fname) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure replacing CRUD data [%s], error=[%s]",
+				fname, strerror(errno) );
+		return( -1 );
+	}
+	stores->image.fname[0] = 0x0;
+	if ( sync_crud_directory(fname) ) {
+		return( -1 );
+	}
+
+	// Log and return successfully
+	logMessage( LOG_INFO_LEVEL, "Stored the disk array contents successfully." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sync_crud_directory
+// Description  : Flush the directory holding a file (so a rename of the file
+//                is on disk, not just its contents)
+//
+// Inputs       : fname - the file whose directory to flush
+// Outputs      : 0 if successful, -1 if failure
+
+int sync_crud_directory( char *fname ) {
+
+	// Local variables
+	char dname[CRUD_STORE_MAX_PATH];
+	char *sep;
+	int fd, ret = 0;
+
+	// Work out the directory (the current one if the name has no path)
+	strncpy( dname, fname, sizeof(dname)-1 );
+	dname[sizeof(dname)-1] = 0x0;
+	if ( (sep = strrchr(dname, '/')) == NULL ) {
+		strcpy( dname, "." );
+	} else if ( sep == dname ) {
+		dname[1] = 0x0;
+	} else {
+		*sep = 0x0;
+	}
+
+	// Open the directory and sync it
+	if ( ((fd = open(dname, O_RDONLY|O_DIRECTORY)) == -1) || (fsync(fd) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure flushing CRUD directory [%s], error=[%s]",
+				dname, strerror(errno) );
+		ret = -1;
+	}
+	if ( fd != -1 ) {
+		close( fd );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_crud_changes
+// Description  : Write the objects that changed since the store was loaded
+//                (or last saved) to the image it was loaded from.  Each goes
+//                to a new slot at the end (a slot the old directory uses is
+//                never written), then a new directory after them, and only
+//                once they are on disk the header pointing at it.  A crash
+//                before the header is written leaves the old image intact.
+//
+// Inputs       : stores - the array of partitions
+//                objs - the objects
+//                count - the number of objects
+// Outputs      : 0 if successful, -1 if failure
+
+int save_crud_changes( CrudStore *stores, CrudObject **objs, uint32_t count ) {
+
+	// Local variables
+	CrudImage *image = &stores->image;
+	CrudImageHeader hdr;
+	CrudImageEntry *dir;
+	CrudObject *obj;
+	uint32_t i, changed = 0;
+
+	// Write out each of the changed objects
+	if ( (dir = calloc(count+1, sizeof(CrudImageEntry))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: image directory allocation failed [%u]", count );
+		return( -1 );
+	}
+	for ( i=0; i<count; i++ ) {
+		obj = objs[i];
+		if ( obj->dirty || (obj->slot == 0) ) {
+			obj->slot = image->end;
+			obj->capacity = CRUD_IMAGE_ROUND(obj->length);
+			image->end += obj->capacity;
+			if ( pwrite(image->fd, obj->data, obj->length, obj->slot) != obj->length ) {
+				logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD data [OID %u], error=[%s]",
+						obj->oid, strerror(errno) );
+				free( dir );
+				return( -1 );
+			}
+			obj->dirty = 0;
+			changed ++;
+		}
+		dir[i].oid = obj->oid;
+		dir[i].length = obj->length;
+		dir[i].capacity = obj->capacity;
+		dir[i].flags = obj->flags;
+		dir[i].offset = obj->slot;
+	}
+
+	// Write the new directory at the end, then the header pointing at it
+	memcpy( &hdr, image->base, sizeof(hdr) );
+	hdr.elements = count;
+	hdr.directory = image->end;
+	hdr.next_oid = 0;
+	for ( i=0; i<stores->partitions; i++ ) {
+		if ( stores[i].next_oid > hdr.next_oid ) {
+			hdr.next_oid = stores[i].next_oid;
+		}
+	}
+	image->end = hdr.end = CRUD_IMAGE_ROUND(hdr.directory+count*sizeof(CrudImageEntry));
+	if ( (pwrite(image->fd, dir, count*sizeof(CrudImageEntry), hdr.directory) != count*sizeof(CrudImageEntry)) ||
+		 (fdatasync(image->fd) == -1) || (pwrite(image->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+		 (fdatasync(image->fd) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD directory [%s], error=[%s]",
+				image->fname, strerror(errno) );
+		free( dir );
+		return( -1 );
+	}
+	free( dir );
+
+	// Log and return successfully
+	logMessage( LOG_INFO_LEVEL, "Stored the changed disk array contents successfully [%u of %u objects].",
+			changed, count );
+	return( 0 );
+}
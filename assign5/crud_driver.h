@@ -16,7 +16,18 @@
 
 // Defines
 #define CRUD_MAX_OBJECT_SIZE 0xfffff
+#define CRUD_MAX_V2_OBJECT_SIZE 0x4000000
 #define CRUD_NO_OBJECT 0
+#define CRUD_PROTOCOL_V1 1
+#define CRUD_PROTOCOL_V2 2
+#define CRUD_PROTOCOL_VERSION_MASK 0xff
+#define CRUD_PROTOCOL_CRC32C 0x100
+#define CRUD_PROTOCOL_LEASES 0x200
+#define CRUD_PROTOCOL_VERSIONS 0x400
+#define CRUD_LEASE_TIME 10000000 // How long a read lease lasts (usecs)
+#define CRUD_TRAILER_SIZE 4
+#define CRUD_CHUNK_SIZE 0x10000
+#define CRUD_MAX_CHUNK_SIZE 0x100000
 
 //
 // Type definitions
@@ -25,30 +36,43 @@ typedef uint32_t CrudOID; // This is the request object identifier (unique to ob
 
 // These are the request types
 typedef enum {
-	CRUD_INIT    = 0, // Initialize the CRUD interface
-	CRUD_FORMAT  = 1, // Format the CRUD storage device
-	CRUD_CREATE  = 2, // Create a new object
-	CRUD_READ    = 3, // Read an object
-	CRUD_UPDATE  = 4, // Update the object
-	CRUD_DELETE  = 5, // Delete an object
-	CRUD_CLOSE   = 6, // Close the CRUD device
-	CRUD_UNKNOWN = 7, // Unknown type
-	CRUD_MAXVAL  = 8, // Max value
+	CRUD_INIT       = 0, // Initialize the CRUD interface
+	CRUD_FORMAT     = 1, // Format the CRUD storage device
+	CRUD_CREATE     = 2, // Create a new object
+	CRUD_READ       = 3, // Read an object
+	CRUD_UPDATE     = 4, // Update the object
+	CRUD_DELETE     = 5, // Delete an object
+	CRUD_CLOSE      = 6, // Close the CRUD device
+	CRUD_UNKNOWN    = 7, // Unknown type
+	CRUD_INVALIDATE = 8, // Drop a cached object (server to client, acknowledged back, see below)
+	CRUD_MAXVAL     = 9, // Max value
 } CRUD_REQUEST_TYPES;
-const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
+extern const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
 
 // These are the CRUD flags
 typedef enum {
 	CRUD_NULL_FLAG       = 0,  // This is the "no flag" flag
 	CRUD_PRIORITY_OBJECT = 1,  // Flag indicating that object is a "priority object"
-	CRUD_FLAGMAX         = 2,  // Max value
+	CRUD_IF_CHANGED      = 2,  // Flag making a READ conditional on the object version
+	CRUD_IF_VERSION      = 4,  // Flag making an UPDATE conditional on the object version
+	CRUD_FLAGMAX         = 8,  // Max value (the flags are a bitmask, this is every combination)
 } CRUD_FLAG_TYPES;
-const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX];
+extern const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX];
 
 // CRUD request and response types
 typedef uint64_t CrudRequest;
 typedef uint64_t CrudResponse;
 
+// The fields of a request or response (any version, see below)
+typedef struct {
+	uint64_t           oid;    // The object ID
+	CRUD_REQUEST_TYPES req;    // The request type
+	uint64_t           length; // The size of the object in bytes
+	uint8_t            flags;  // The flags
+	uint8_t            res;    // The result bit
+	uint64_t           objver; // The object version (if agreed, see below)
+} CrudHeader;
+
 /*
 
  Request/Response Specification
@@ -69,6 +93,71 @@ typedef uint64_t CrudResponse;
   60-62 - Flags - these are flags for commands (UNUSED)
      63 - R - this is the result bit (0 success, 1 is failure)
 
+ Protocol Version 2
+
+ A client asks for version 2 by sending CRUD_INIT with the Length set to 2
+ (version 1 clients send 0).  A server that speaks it answers with Length 2
+ and both sides switch after the response; older servers answer 0 and the
+ connection stays on version 1.  A version 2 header is three 64-bit words:
+
+  Word    Description
+  -----   -------------------------------------------------------------
+      0 - the version 1 layout above, OID and Length 0
+      1 - OID - the object ID
+      2 - Length - this is the size of the object in bytes
+
+ The payload of a CREATE/UPDATE request or READ response is sent as chunks,
+ each a 32-bit chunk length (1 to CRUD_MAX_CHUNK_SIZE) followed by that many
+ bytes, until Length bytes have been sent, so the receiver can use each
+ chunk as it arrives.  All words are in network byte order.
+
+ Payload Checksums
+
+ The INIT Length holds the version in its low byte (CRUD_PROTOCOL_VERSION_MASK)
+ and options above it.  A client asks for checksums with CRUD_PROTOCOL_CRC32C,
+ and the server answers with the options it agreed to (along with the version,
+ so a version 1 answer is 0x101 rather than 0).  Once agreed, every payload of
+ one or more bytes (CREATE/UPDATE requests, READ responses, either version) is
+ followed by a 32-bit trailer holding the CRC32C of the whole payload.  The
+ server fails requests whose payload does not match, the client READs.
+
+ Read Leases
+
+ A client that caches objects asks for leases with CRUD_PROTOCOL_LEASES.  Once
+ agreed, each successful READ, CREATE or UPDATE of an object (not the priority
+ object) grants the client a lease on it for CRUD_LEASE_TIME, during which it
+ may use its copy without asking the server (timed from when it sent the
+ request).  When another client changes or deletes the object (or formats the
+ store) the server revokes the lease and sends a CRUD_INVALIDATE header with
+ the OID (in the connection's version, no payload) between responses, and the
+ client drops its copy, then acknowledges by sending the same header back (no
+ response).  An invalidation may arrive while the client waits on a response,
+ or with no request outstanding, and is acknowledged in the order received.
+ The response to the change is held until every holder told has acknowledged
+ or its lease has run out, so once a client hears its change is done no other
+ client answers a READ from an older copy.  A client holding leases has to
+ keep reading its connection, or the changes to what it holds wait out the
+ lease.  A CRUD_INVALIDATE from a client that did not agree to leases is
+ failed like any other unknown request.
+
+ Object Versions
+
+ A client asks for object versions with CRUD_PROTOCOL_VERSIONS.  Once agreed,
+ every header (either version, invalidations too) is followed by one more
+ 64-bit word, the object version.  The server gives each object a new version
+ whenever it is created or updated (versions are never reused, even across
+ restarts) and returns it in the responses to CREATE, READ and UPDATE (0 in
+ the rest).  A READ with the CRUD_IF_CHANGED flag is only answered with the
+ object if its version is not the one in the request; otherwise the response
+ keeps the flag and carries the Length and version but no payload, so a
+ client can revalidate its copy for the price of the headers.
+
+ An UPDATE with the CRUD_IF_VERSION flag is only applied if the object's
+ version is the one in the request.  If it is not, the UPDATE fails (R is 1)
+ and the response keeps the flag and carries the current version, so a
+ client can tell a lost race from any other failure, read the object again
+ and retry (compare-and-swap).  An applied UPDATE clears the flag.
+
 */
 
 //
@@ -101,4 +190,17 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 		uint8_t *res);
     // Extract values from a 64-bit bus request buffer
 
+void pack_crud_header(CrudHeader *hdr, int format, uint64_t *wire);
+    // Put the header in wire format (see size_crud_header, network order)
+
+void unpack_crud_header(uint64_t *wire, int format, CrudHeader *hdr);
+    // Extract the header from wire format (see size_crud_header, network order)
+
+uint32_t size_crud_header(int format);
+    // The size of the wire header of a protocol version (and the options
+    // that change it, CRUD_PROTOCOL_VERSIONS)
+
+uint64_t first_crud_version(void);
+    // The first object version a store started now hands out
+
 #endif
@@ -0,0 +1,620 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_dump.c
+//  Description    : This is the implementation of the whole-filesystem
+//                   extract (see crud_dump.h).  The files are fetched
+//                   largest first, each worker taking the next one as it is
+//                   done with the last, so the connections stay busy to the
+//                   end.  Into a directory each worker writes its own files;
+//                   into an archive a file's header and contents go out
+//                   together, under a lock, as soon as the file is fetched.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// Project includes
+#include <crud_dump.h>
+#include <crud_file_io.h>
+#include <crud_backend.h>
+#include <crud_codec.h>
+#include <crud_hist.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_DUMP_BLOCK 512                // The tar block size
+#define CRUD_DUMP_NAME_SIZE 100            // The name field of a tar header
+#define CRUD_DUMP_LONG_NAME "././@LongLink" // The GNU entry holding a longer name
+#define CRUD_DUMP_MAX_PATH 256
+#define CRUD_DUMP_UNIT_TEST_DIR "crud_dump_test"
+#define CRUD_DUMP_UNIT_TEST_ARCHIVE "crud_dump_test.tar"
+#define CRUD_DUMP_UNIT_TEST_WORKERS 3
+
+//
+// Type definitions
+
+// This is the header of a tar (ustar) archive entry
+typedef struct {
+	char name[100];     // The file name (terminated if shorter)
+	char mode[8];       // The permissions (octal)
+	char uid[8];        // The owner (octal)
+	char gid[8];        // The group (octal)
+	char size[12];      // The size (octal)
+	char mtime[12];     // The modification time (octal, seconds since the epoch)
+	char chksum[8];     // The sum of the header bytes (octal, counted as spaces)
+	char typeflag;      // The type of entry ('0' a file, 'L' a long name)
+	char linkname[100]; // The link target (unused)
+	char magic[6];      // "ustar"
+	char version[2];    // "00"
+	char uname[32];     // The owner name (unused)
+	char gname[32];     // The group name (unused)
+	char devmajor[8];   // The device (unused)
+	char devminor[8];   // The device (unused)
+	char prefix[155];   // The directory of the name (unused)
+	char pad[12];       // Unused
+} CrudDumpHeader;
+
+// This is an extract
+typedef struct {
+	CrudFileAllocationType *table;   // The file allocation table
+	uint32_t               *order;   // The files, largest first (indexes into the table)
+	uint32_t                count;   // The number of files
+	uint32_t                next;    // The next file to fetch
+	const char             *target;  // The directory (or archive) extracted into
+	int                     archive; // The archive (-1 if a directory)
+	pthread_mutex_t         lock;    // Serializes the archive
+	uint64_t                mtime;   // The modification time of the archived files
+	uint64_t                bytes;   // The bytes extracted
+	int                     failed;  // Flag indicating a file was not extracted
+} CrudDumpExtract;
+
+//
+// Local functions
+
+static void *crud_dump_table( void *arg );
+static void *crud_dump_worker( void *arg );
+static int crud_dump_file( CrudDumpExtract *dump, CrudFileAllocationType *file, unsigned char *buf, uint32_t len );
+static int crud_dump_entry( CrudDumpExtract *dump, const char *name, char type, const void *buf, uint32_t len );
+static int crud_dump_write( int fd, const void *buf, size_t len );
+static int crud_dump_compare( const void *a, const void *b );
+static CrudFileAllocationType *crud_dump_sorted = NULL; // The table being sorted (see crud_dump_compare)
+static int crud_dump_check( const char *name, const unsigned char *buf, uint32_t len, int file );
+static int crud_dump_check_archive( const char *archive, uint32_t files );
+
+// The sizes of the unit test files
+static const uint32_t crud_dump_unit_test_sizes[] = { 0, 1, 511, 512, 513, 4096, 65537, CRUD_MAX_OBJECT_SIZE };
+#define CRUD_DUMP_UNIT_TEST_FILES (sizeof(crud_dump_unit_test_sizes)/sizeof(crud_dump_unit_test_sizes[0]))
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_extract
+// Description  : Extract every file of the filesystem: read the file
+//                allocation table, then fetch the files on the workers into
+//                the directory or archive.
+//
+// Inputs       : target - the directory or archive (.tar, "-" for stdout)
+//                workers - the number of connections to fetch over
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_dump_extract( const char *target, int workers ) {
+
+	// Local variables
+	CrudDumpExtract dump;
+	pthread_t walker, threads[CRUD_DUMP_MAX_WORKERS];
+	char zero[CRUD_DUMP_BLOCK*2];
+	size_t len = strlen( target );
+	uint64_t start, nsecs;
+	uint32_t i;
+	int started, ret = 0;
+
+	// Read the file allocation table (on a client of its own)
+	memset( &dump, 0x0, sizeof(dump) );
+	dump.target = target;
+	dump.archive = -1;
+	workers = (workers < 1) ? 1 : ((workers > CRUD_DUMP_MAX_WORKERS) ? CRUD_DUMP_MAX_WORKERS : workers);
+	start = crud_hist_now();
+	if ( pthread_create(&walker, NULL, crud_dump_table, &dump) ) {
+		return( -1 );
+	}
+	pthread_join( walker, NULL );
+	if ( dump.table == NULL ) {
+		return( -1 );
+	}
+
+	// Fetch the files largest first
+	if ( (dump.order = malloc(sizeof(uint32_t)*CRUD_MAX_TOTAL_FILES)) == NULL ) {
+		free( dump.table );
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		if ( strcmp(dump.table[i].filename, "empty") ) {
+			dump.order[dump.count++] = i;
+		}
+	}
+	crud_dump_sorted = dump.table;
+	qsort( dump.order, dump.count, sizeof(uint32_t), crud_dump_compare );
+
+	// Open the archive, or make the directory
+	if ( strcmp(target, "-") == 0 ) {
+		dump.archive = STDOUT_FILENO;
+	} else if ( (len > 4) && (strcmp(&target[len-4], ".tar") == 0) ) {
+		if ( (dump.archive = open(target, O_WRONLY|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP)) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure creating archive [%s], error: %s.", target, strerror(errno) );
+			ret = -1;
+		}
+	} else if ( (mkdir(target, S_IRWXU|S_IRGRP|S_IXGRP) == -1) && (errno != EEXIST) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure making directory [%s], error: %s.", target, strerror(errno) );
+		ret = -1;
+	}
+	dump.mtime = time( NULL );
+	pthread_mutex_init( &dump.lock, NULL );
+
+	// Fetch on the workers, then finish off the archive
+	for ( started=0; (ret == 0) && (started < workers); started++ ) {
+		if ( pthread_create(&threads[started], NULL, crud_dump_worker, &dump) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure starting worker %d", started );
+			ret = -1;
+			break;
+		}
+	}
+	while ( started > 0 ) {
+		pthread_join( threads[--started], NULL );
+	}
+	if ( (ret == 0) && (dump.archive != -1) ) {
+		memset( zero, 0x0, sizeof(zero) );
+		ret = crud_dump_write( dump.archive, zero, sizeof(zero) );
+	}
+	if ( (dump.archive != -1) && (dump.archive != STDOUT_FILENO) && close(dump.archive) ) {
+		ret = -1;
+	}
+	ret |= dump.failed;
+
+	// Log, cleanup and return
+	nsecs = crud_hist_now()-start;
+	if ( ret == 0 ) {
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_DUMP : extracted %u files (%lu bytes) into [%s] over %d connections "
+				"in %.3f secs (%.2f MB/sec)", dump.count, dump.bytes, target, workers, nsecs/1e9,
+				(nsecs > 0) ? dump.bytes*1e3/nsecs : 0.0 );
+	}
+	pthread_mutex_destroy( &dump.lock );
+	free( dump.order );
+	free( dump.table );
+	return( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_table
+// Description  : Read the file allocation table (the priority object), as a
+//                client of its own
+//
+// Inputs       : arg - the extract (the table is left in it, NULL if failure)
+// Outputs      : NULL
+
+static void *crud_dump_table( void *arg ) {
+
+	// Local variables
+	CrudDumpExtract *dump = arg;
+	CrudFileAllocationType *table;
+	CrudResponse res;
+	uint32_t size = CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), i;
+
+	if ( (table = malloc(size)) == NULL ) {
+		return( NULL );
+	}
+	if ( crud_backend_attach() ) {
+		free( table );
+		return( NULL );
+	}
+	res = crud_backend_operation( crud_codec_encode(0, CRUD_READ, size, CRUD_PRIORITY_OBJECT, 0), table );
+	crud_backend_detach();
+	if ( (res == (CrudResponse)-1) || crud_codec_result(res) || (crud_codec_length(res) != size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: cannot read the file allocation table (not formatted?)" );
+		free( table );
+		return( NULL );
+	}
+
+	// The names are used as they are, so they have to be terminated
+	for ( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		table[i].filename[CRUD_MAX_PATH_LENGTH-1] = 0x0;
+	}
+	dump->table = table;
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_worker
+// Description  : Fetch files (the next one each time) and extract them, as a
+//                client of its own
+//
+// Inputs       : arg - the extract
+// Outputs      : NULL
+
+static void *crud_dump_worker( void *arg ) {
+
+	// Local variables
+	CrudDumpExtract *dump = arg;
+	CrudFileAllocationType *file;
+	CrudResponse res;
+	unsigned char *buf;
+	uint32_t next;
+
+	if ( (buf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ) {
+		dump->failed = 1;
+		return( NULL );
+	}
+	if ( crud_backend_attach() ) {
+		dump->failed = 1;
+		free( buf );
+		return( NULL );
+	}
+	while ( (next = __sync_fetch_and_add(&dump->next, 1)) < dump->count ) {
+		file = &dump->table[dump->order[next]];
+		res = crud_backend_operation( crud_codec_encode(file->object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0, 0), buf );
+		if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD dump: cannot read [%s] (object %u)", file->filename, file->object_id );
+			dump->failed = 1;
+			continue;
+		}
+		if ( crud_dump_file(dump, file, buf, crud_codec_length(res)) ) {
+			dump->failed = 1;
+		} else {
+			__sync_fetch_and_add( &dump->bytes, crud_codec_length(res) );
+		}
+	}
+	crud_backend_detach();
+	free( buf );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_file
+// Description  : Extract a file fetched into the directory (a new file, not
+//                overwriting one) or the archive
+//
+// Inputs       : dump - the extract
+//                file - the file
+//                buf - the contents
+//                len - the length of the contents
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_dump_file( CrudDumpExtract *dump, CrudFileAllocationType *file, unsigned char *buf, uint32_t len ) {
+
+	// Local variables
+	char path[CRUD_DUMP_MAX_PATH];
+	int fd, ret;
+
+	// The name has to be a file name, not a path
+	if ( (file->filename[0] == 0x0) || strchr(file->filename, '/') || (strcmp(file->filename, ".") == 0) ||
+		 (strcmp(file->filename, "..") == 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: bad file name [%s], not extracted", file->filename );
+		return( -1 );
+	}
+
+	// Into the archive
+	if ( dump->archive != -1 ) {
+		pthread_mutex_lock( &dump->lock );
+		ret = 0;
+		if ( strlen(file->filename) >= CRUD_DUMP_NAME_SIZE ) {
+			ret = crud_dump_entry( dump, file->filename, 'L', file->filename, strlen(file->filename)+1 );
+		}
+		ret = ret ? ret : crud_dump_entry( dump, file->filename, '0', buf, len );
+		pthread_mutex_unlock( &dump->lock );
+		return( ret );
+	}
+
+	// Into the directory
+	snprintf( path, sizeof(path), "%s/%s", dump->target, file->filename );
+	if ( (fd = open(path, O_WRONLY|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure creating [%s], error: %s.", path, strerror(errno) );
+		return( -1 );
+	}
+	ret = crud_dump_write( fd, buf, len );
+	if ( close(fd) || ret ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure writing [%s], error: %s.", path, strerror(errno) );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_entry
+// Description  : Write an entry into the archive: the header, the contents,
+//                then zeros to the end of the block (the lock is held)
+//
+// Inputs       : dump - the extract
+//                name - the name of the file
+//                type - the type of entry ('0' a file, 'L' the long name of
+//                       the next entry)
+//                buf - the contents
+//                len - the length of the contents
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_dump_entry( CrudDumpExtract *dump, const char *name, char type, const void *buf, uint32_t len ) {
+
+	// Local variables
+	CrudDumpHeader hdr;
+	unsigned char *byte = (unsigned char *)&hdr;
+	char pad[CRUD_DUMP_BLOCK];
+	uint32_t sum = 0, i;
+
+	// Fill in the header, then the checksum
+	memset( &hdr, 0x0, sizeof(hdr) );
+	strncpy( hdr.name, (type == 'L') ? CRUD_DUMP_LONG_NAME : name, sizeof(hdr.name) );
+	snprintf( hdr.mode, sizeof(hdr.mode), "%07o", 0644 );
+	snprintf( hdr.uid, sizeof(hdr.uid), "%07o", 0 );
+	snprintf( hdr.gid, sizeof(hdr.gid), "%07o", 0 );
+	snprintf( hdr.size, sizeof(hdr.size), "%011o", len );
+	snprintf( hdr.mtime, sizeof(hdr.mtime), "%011lo", (type == 'L') ? 0 : (unsigned long)dump->mtime );
+	hdr.typeflag = type;
+	memcpy( hdr.magic, "ustar", 6 );
+	memcpy( hdr.version, "00", 2 );
+	memset( hdr.chksum, ' ', sizeof(hdr.chksum) );
+	for ( i=0; i<sizeof(hdr); i++ ) {
+		sum += byte[i];
+	}
+	snprintf( hdr.chksum, sizeof(hdr.chksum), "%06o", sum );
+	hdr.chksum[7] = ' ';
+
+	// Write it out
+	memset( pad, 0x0, sizeof(pad) );
+	if ( crud_dump_write(dump->archive, &hdr, sizeof(hdr)) || crud_dump_write(dump->archive, buf, len) ||
+		 crud_dump_write(dump->archive, pad, (CRUD_DUMP_BLOCK-len%CRUD_DUMP_BLOCK)%CRUD_DUMP_BLOCK) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD dump: failure writing archive [%s], error: %s.", dump->target,
+				strerror(errno) );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_write
+// Description  : Write all of a buffer (writes to pipes may come up short)
+//
+// Inputs       : fd - the file
+//                buf - the buffer
+//                len - the length of the buffer
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_dump_write( int fd, const void *buf, size_t len ) {
+
+	// Local variables
+	ssize_t n;
+
+	while ( len > 0 ) {
+		if ( (n = write(fd, buf, len)) == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			return( -1 );
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_compare
+// Description  : Order two files, largest first (for qsort)
+//
+// Inputs       : a, b - the files (indexes into crud_dump_sorted)
+// Outputs      : <0, 0, >0 as a is larger, the same as, smaller than b
+
+static int crud_dump_compare( const void *a, const void *b ) {
+	uint32_t x = crud_dump_sorted[*(const uint32_t *)a].length, y = crud_dump_sorted[*(const uint32_t *)b].length;
+	return( (x < y) - (x > y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_check
+// Description  : Check the contents extracted of a unit test file
+//
+// Inputs       : name - the name of the file
+//                buf - the contents
+//                len - the length of the contents
+//                file - the number of the file
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_dump_check( const char *name, const unsigned char *buf, uint32_t len, int file ) {
+
+	// Local variables
+	uint32_t i;
+
+	if ( len != crud_dump_unit_test_sizes[file] ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : [%s] is %u bytes, should be %u", name, len,
+				crud_dump_unit_test_sizes[file] );
+		return( -1 );
+	}
+	for ( i=0; i<len; i++ ) {
+		if ( buf[i] != (unsigned char)('a' + (i+file)%26) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : [%s] is wrong at byte %u", name, i );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_check_archive
+// Description  : Read back the unit test archive: each entry's header
+//                (checksum, long names) and contents, then the end
+//
+// Inputs       : archive - the archive
+//                files - the number of files it should hold
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_dump_check_archive( const char *archive, uint32_t files ) {
+
+	// Local variables
+	CrudDumpHeader *hdr;
+	struct stat st;
+	unsigned char *map, *end, *pos;
+	char name[CRUD_MAX_PATH_LENGTH+1], chksum[8];
+	uint32_t found = 0, sum, i, len, file;
+	int fd, ret = 0;
+
+	// Map the archive
+	if ( ((fd = open(archive, O_RDONLY)) == -1) || (fstat(fd, &st) == -1) || (st.st_size % CRUD_DUMP_BLOCK) ||
+		 ((map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : cannot read archive [%s]", archive );
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		return( -1 );
+	}
+	close( fd );
+	end = map + st.st_size;
+
+	// Walk the entries, until the zero block at the end (the mapping is
+	// private, so the checksums can be blanked in place)
+	name[0] = 0x0;
+	for ( pos=map; (ret == 0) && (pos+CRUD_DUMP_BLOCK <= end) && (pos[0] != 0x0); ) {
+		hdr = (CrudDumpHeader *)pos;
+		memcpy( chksum, hdr->chksum, sizeof(chksum) );
+		memset( hdr->chksum, ' ', sizeof(hdr->chksum) );
+		for ( i=0, sum=0; i<CRUD_DUMP_BLOCK; i++ ) {
+			sum += pos[i];
+		}
+		len = strtoul( hdr->size, NULL, 8 );
+		pos += CRUD_DUMP_BLOCK;
+		if ( (strtoul(chksum, NULL, 8) != sum) || memcmp(hdr->magic, "ustar", 6) || (pos+len > end) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : bad archive header" );
+			ret = -1;
+		} else if ( hdr->typeflag == 'L' ) {
+			memcpy( name, pos, (len > CRUD_MAX_PATH_LENGTH) ? CRUD_MAX_PATH_LENGTH : len );
+			name[CRUD_MAX_PATH_LENGTH] = 0x0;
+		} else {
+			if ( name[0] == 0x0 ) {
+				memcpy( name, hdr->name, sizeof(hdr->name) );
+				name[sizeof(hdr->name)] = 0x0;
+			}
+			if ( (sscanf(name, "dump%u", &file) != 1) || (file >= files) ||
+				 crud_dump_check(name, pos, len, file) ) {
+				ret = -1;
+			}
+			name[0] = 0x0;
+			found ++;
+		}
+		pos += (len+CRUD_DUMP_BLOCK-1)/CRUD_DUMP_BLOCK*CRUD_DUMP_BLOCK;
+	}
+	if ( (ret == 0) && ((found != files) || (pos+2*CRUD_DUMP_BLOCK != end)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : archive holds %u files, should be %u", found, files );
+		ret = -1;
+	}
+	munmap( map, st.st_size );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_dump_unit_test
+// Description  : Write files of all sizes (around the tar block size, and a
+//                name too long for a tar header), extract them into a
+//                directory and an archive and check both.  A session is
+//                held open throughout so a memory store outlives the
+//                unmount.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_dump_unit_test( void ) {
+
+	// Local variables
+	char name[CRUD_MAX_PATH_LENGTH], path[CRUD_DUMP_MAX_PATH];
+	unsigned char *buf;
+	struct stat st;
+	uint32_t file, i;
+	int16_t fh;
+	int fd, ret = 0;
+	ssize_t len;
+
+	// Write the files
+	if ( (buf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ) {
+		return( -1 );
+	}
+	if ( crud_backend_attach() || crud_format() || crud_mount() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : format/mount failed" );
+		free( buf );
+		return( -1 );
+	}
+	for ( file=0; (file < CRUD_DUMP_UNIT_TEST_FILES) && (ret == 0); file++ ) {
+		snprintf( name, sizeof(name), (file%2) ? "dump%u.dat" : "dump%u-%0120u", file, 0 );
+		for ( i=0; i<crud_dump_unit_test_sizes[file]; i++ ) {
+			buf[i] = 'a' + (i+file)%26;
+		}
+		if ( ((fh = crud_open(name)) == -1) ||
+			 (crud_write(fh, buf, crud_dump_unit_test_sizes[file]) != (int32_t)crud_dump_unit_test_sizes[file]) ||
+			 crud_close(fh) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : cannot write [%s]", name );
+			ret = -1;
+		}
+	}
+	if ( crud_unmount() ) {
+		ret = -1;
+	}
+
+	// Extract them both ways (not over what a run before left)
+	unlink( CRUD_DUMP_UNIT_TEST_ARCHIVE );
+	if ( (ret == 0) && (crud_dump_extract(CRUD_DUMP_UNIT_TEST_DIR, CRUD_DUMP_UNIT_TEST_WORKERS) ||
+		 crud_dump_extract(CRUD_DUMP_UNIT_TEST_ARCHIVE, CRUD_DUMP_UNIT_TEST_WORKERS)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : extract failed" );
+		ret = -1;
+	}
+
+	// Check the directory, then the archive (cleaning up as it goes)
+	for ( file=0; file<CRUD_DUMP_UNIT_TEST_FILES; file++ ) {
+		snprintf( name, sizeof(name), (file%2) ? "dump%u.dat" : "dump%u-%0120u", file, 0 );
+		snprintf( path, sizeof(path), "%s/%s", CRUD_DUMP_UNIT_TEST_DIR, name );
+		fd = -1;
+		if ( (ret == 0) && (((fd = open(path, O_RDONLY)) == -1) || (fstat(fd, &st) == -1) ||
+			 (st.st_size > CRUD_MAX_OBJECT_SIZE) || ((len = read(fd, buf, st.st_size)) != st.st_size) ||
+			 crud_dump_check(path, buf, len, file)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_DUMP_UNIT_TEST : bad extract of [%s]", path );
+			ret = -1;
+		}
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		unlink( path );
+	}
+	rmdir( CRUD_DUMP_UNIT_TEST_DIR );
+	if ( (ret == 0) && crud_dump_check_archive(CRUD_DUMP_UNIT_TEST_ARCHIVE, CRUD_DUMP_UNIT_TEST_FILES) ) {
+		ret = -1;
+	}
+	unlink( CRUD_DUMP_UNIT_TEST_ARCHIVE );
+
+	// Cleanup, log and return
+	if ( crud_backend_detach() ) {
+		ret = -1;
+	}
+	free( buf );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD dump unit test completed successfully." );
+	}
+	return( ret );
+}
@@ -0,0 +1,36 @@
+#ifndef CRUD_DUMP_INCLUDED
+#define CRUD_DUMP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_dump.h
+//  Description   : This is the interface to the whole-filesystem extract.
+//                  The file allocation table is read from the store, then
+//                  the objects of its files are fetched in parallel (each
+//                  thread a client of its own) and written into a directory,
+//                  or streamed into a single tar (ustar) archive.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Defines
+#define CRUD_DUMP_DEFAULT_WORKERS 4 // The connections used if not told otherwise
+#define CRUD_DUMP_MAX_WORKERS 64
+
+//
+// Extract interface
+
+int crud_dump_extract( const char *target, int workers );
+	// Extract every file of the filesystem into target: a tar archive if
+	// it ends in .tar (or is "-", for the standard output), a directory if
+	// not (made if needed), fetched over workers connections
+
+//
+// Unit Testing
+
+int crud_dump_unit_test( void );
+	// Write files of all sizes, extract them into a directory and an
+	// archive and check what was extracted
+
+#endif
@@ -2,7 +2,10 @@
 //
 //  File           : crud_file_io.h
 //  Description    : This is the implementation of the standardized IO functions
-//                   for used to access the CRUD storage system.
+//                   for used to access the CRUD storage system.  Nothing is
+//                   cached here, every read asks the backend for the object;
+//                   with -L the network client answers those from objects it
+//                   holds under read leases (see crud_client.c).
 //
 //  Author         : John Walter Stockwell
 //  Last Modified  : Sun Nov 16 10:23PM
@@ -11,21 +14,30 @@
 // Includes
 #include <malloc.h>
 #include <string.h>
+#include <pthread.h>
 
 // Project Includes
 #include <crud_file_io.h>
+#include <crud_backend.h>
+#include <crud_codec.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
 #define CIO_UNIT_TEST_MAX_WRITE_SIZE 1024
 #define CRUD_IO_UNIT_TEST_ITERATIONS 10240
+#define CRUD_MAX_WRITE_RETRIES 100 // Lost update races before crud_write gives up
 
 // Student definitions and structures
 #define FILE_HANDLE_BASE_VALUE 0
 
 int8_t crud_initialized = 0;
 int16_t current_handle = FILE_HANDLE_BASE_VALUE;
+uint64_t write_retries = 0; // Writes redone after another client got there first
+
+// Threads may use different files at the same time (crud_sim -w), so the table
+// entries are only changed under this lock (and opens go through it)
+pthread_mutex_t crud_table_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Struct intended for interacting with the object store
 typedef struct 
@@ -85,7 +97,7 @@ uint16_t crud_format(void) {
 
 	// Format the store
 	CrudRequest req = createRequest(0, CRUD_FORMAT, 0, 0);
-	CrudResponse res = crud_client_operation(req, NULL);
+	CrudResponse res = crud_backend_operation(req, NULL);
 	file_st local_file = processResponse(res, -1);
 	
 	// Check that the response did not include a failure
@@ -98,7 +110,7 @@ uint16_t crud_format(void) {
 	
 	// Initialize the priority object
 	req = createRequest(0, CRUD_CREATE, CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT);
-	res = crud_client_operation(req, crud_file_table);
+	res = crud_backend_operation(req, crud_file_table);
 	local_file = processResponse(res, -1);
 	
 	// Zero out the file handle
@@ -132,7 +144,7 @@ uint16_t crud_mount(void) {
 
 	// Request the priority object from the file store
 	CrudRequest req = createRequest(0, CRUD_READ, CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT);
-	CrudResponse res = crud_client_operation(req, buf);
+	CrudResponse res = crud_backend_operation(req, buf);
 	file_st local_file = processResponse(res, -1);
 	
 	// Check that the response did not include a failure
@@ -171,7 +183,7 @@ uint16_t crud_unmount(void) {
 	
 	// Update the priority object
 	CrudRequest req = createRequest(0, CRUD_UPDATE, CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), CRUD_PRIORITY_OBJECT);
-	CrudResponse res = crud_client_operation(req, crud_file_table);
+	CrudResponse res = crud_backend_operation(req, crud_file_table);
 	file_st local_file = processResponse(res, -1);
 	
 	if(local_file.result == 1)
@@ -179,12 +191,17 @@ uint16_t crud_unmount(void) {
 
 	// Close all the shit
 	req = createRequest(0, CRUD_CLOSE, 0, 0);
-	res = crud_client_operation(req, crud_file_table);
+	res = crud_backend_operation(req, crud_file_table);
 	local_file = processResponse(res, -1);
 
 	if(local_file.result == 1)
 		return -1;
 
+	// The next operation mounts again (possibly on another backend)
+	crud_initialized = 0;
+	if(write_retries)
+		logMessage(LOG_INFO_LEVEL, "crud_unmount : %lu writes redone after other clients changed the file", write_retries);
+
 	// Log, return successfully
 	logMessage(LOG_INFO_LEVEL, "... unmount complete.");
 	return (0);
@@ -207,27 +224,41 @@ int16_t crud_open(char *path)
 		crud_init();
 
 	// Return the file handle of the file if the file already exists in crud_file_table
+	pthread_mutex_lock(&crud_table_lock);
 	int16_t i = 0;
-	for(i = 0; i<=CRUD_MAX_TOTAL_FILES; i++)
+	for(i = 0; i<CRUD_MAX_TOTAL_FILES; i++)
 	{
 		if(strcmp(crud_file_table[i].filename, path) == 0)
 		{
 			crud_file_table[i].open = 1;
 			crud_file_table[i].position = 0;
+			pthread_mutex_unlock(&crud_table_lock);
 			return i;
 		}
 	}
 
+	// The file table is full, there is no handle for a new file
+	if(current_handle >= CRUD_MAX_TOTAL_FILES)
+	{
+		pthread_mutex_unlock(&crud_table_lock);
+		logMessage(LOG_ERROR_LEVEL, "crud_open : file table full (%d files), cannot create [%s]", CRUD_MAX_TOTAL_FILES, path);
+		return -1;
+	}
+
 	// Create a new file on the store if it doesn't exist
 	CrudRequest req = createRequest(0, CRUD_CREATE, 0, 0);
-	CrudResponse res = crud_client_operation(req, NULL);
+	CrudResponse res = crud_backend_operation(req, NULL);
 	file_st local_file = processResponse(res, -1);
 	
 	// Check that the response did not include a failure
 	if(local_file.result == 1)
+	{
+		pthread_mutex_unlock(&crud_table_lock);
 		return -1;
+	}
 
 	int16_t handle = getNewHandle();
+	pthread_mutex_unlock(&crud_table_lock);
 	convertToCrudFileType(local_file, handle, path);
 
 	return handle;
@@ -274,7 +305,7 @@ int32_t crud_read(int16_t fd, void *buf, int32_t count)
 
 	// Create a request to send to the crud bus
 	CrudRequest req = createRequest(crud_file_table[fd].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0);
-	CrudResponse res = crud_client_operation(req, tmpBuf);
+	CrudResponse res = crud_backend_operation(req, tmpBuf);
 	file_st local_file = processResponse(res, fd);
 	
 	if(local_file.result == 1)
@@ -299,7 +330,7 @@ int32_t crud_read(int16_t fd, void *buf, int32_t count)
 	return count;
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : crud_write
 // Description  : Writes "count" bytes to the file handle "fd" from the
@@ -312,9 +343,20 @@ int32_t crud_read(int16_t fd, void *buf, int32_t count)
 //
 // If we get an error from the hardware, we did something wrong.
 //
+// Other clients may be writing the same file, so the UPDATE only applies to
+// the version of the object we read (when the backend has versions, -V or -L
+// on the network). If someone else got there first we read it again and redo
+// our change on top of theirs, no locks and one UPDATE if nobody else wrote.
+//
 int32_t crud_write(int16_t fd, void *buf, int32_t count) 
 {
 	unsigned char tmpBuf[CRUD_MAX_OBJECT_SIZE];
+	CrudRequest req;
+	CrudResponse res;
+	file_st local_file;
+	uint64_t objver;
+	int32_t length;
+	int tries;
 	
 	if(!crud_initialized)
 		crud_init();
@@ -324,51 +366,59 @@ int32_t crud_write(int16_t fd, void *buf, int32_t count)
 	if(!current_file.open)
 		return -1;
 
-	// Given the fild handle, find it's OID and read the data from the store
-	CrudRequest req = createRequest(current_file.object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0);
-	CrudResponse res = crud_client_operation(req, tmpBuf);
-	file_st local_file = processResponse(res, fd);
-
-	if(local_file.result == 1)
-		return -1;
-
-	// Ensures that we're not writing off the end of our file.
-	// If the count goes past the file length, we reassign our file length
-	// to the count + our current position. And then create a file of that
-	// size. After we delete our old file of course.
-	if(count+local_file.position > local_file.length)
+	for(tries = 0; tries < CRUD_MAX_WRITE_RETRIES; tries++)
 	{
-		int32_t length = count+local_file.position;
-		if(length>CRUD_MAX_OBJECT_SIZE)
-			length = CRUD_MAX_OBJECT_SIZE;
-
-		req = createRequest(local_file.oid, CRUD_DELETE, 0, 0);
-		int32_t tmpPos = local_file.position;
-
-		crud_client_operation(req, NULL);
-
-		req = createRequest(0, CRUD_CREATE, length, 0);
-		res = crud_client_operation(req, tmpBuf);
-		file_st new_file = processResponse(res, fd);
+		// Given the fild handle, find it's OID and read the data (and its
+		// version) from the store
+		objver = 0;
+		req = createRequest(current_file.object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0);
+		res = crud_backend_versioned(req, tmpBuf, &objver);
+		local_file = processResponse(res, fd);
+
+		if(local_file.result == 1)
+			return -1;
+
+		// Ensures that we're not writing off the end of our file.
+		// If the count goes past the file length, we reassign our file length
+		// to the count + our current position. The UPDATE resizes the object
+		// so it keeps its OID (other clients have it in their file tables).
+		length = local_file.length;
+		if(count+local_file.position > length)
+		{
+			length = count+local_file.position;
+			if(length>CRUD_MAX_OBJECT_SIZE)
+				length = CRUD_MAX_OBJECT_SIZE;
+		}
+		
+		// Loop through, assigning positions in our temp buffer to positions in our 
+		// passed buffer.
+		int i = 0;
+		for( i = 0; i<count && local_file.position+i<length; i++)
+		{
+			tmpBuf[local_file.position+i] = ((unsigned char*)buf)[i];
+		}
+		
+		// Update our file with the temporary buffer, as long as it is still
+		// the version we read
+		req = createRequest(local_file.oid, CRUD_UPDATE, length, objver ? CRUD_IF_VERSION : 0);
+		res = crud_backend_versioned(req, tmpBuf, &objver);
+		if(!crud_codec_result(res))
+			break;
 
-		local_file = new_file;
-		local_file.position = tmpPos;
+		// Anything other than losing the race is a real failure
+		if(res == (CrudResponse)-1 || !(crud_codec_flags(res) & CRUD_IF_VERSION))
+			return -1;
+		logMessage(LOG_INFO_LEVEL, "crud_write : %s changed under us, retrying", current_file.filename);
+		__sync_fetch_and_add(&write_retries, 1);
 	}
-	
-	// Loop through, assigning positions in our temp buffer to positions in our 
-	// passed buffer.
-	int i = 0;
-	for( i = 0; i<count; i++)
+
+	if(tries == CRUD_MAX_WRITE_RETRIES)
 	{
-		tmpBuf[local_file.position+i] = ((unsigned char*)buf)[i];
+		logMessage(LOG_ERROR_LEVEL, "crud_write : gave up on %s after %d retries", current_file.filename, tries);
+		return -1;
 	}
-	//int32_t tmpPos = local_file.position;
-	
-	// Update our file with the temporary buffer
-	req = createRequest(local_file.oid, CRUD_UPDATE, local_file.length, 0);
-	res = crud_client_operation(req, tmpBuf);
+
 	local_file = processResponse(res, fd);
-	//local_file.position = tmpPos;
 	
 	// Update our position
 	local_file.position+=count;
@@ -401,7 +451,9 @@ int32_t crud_seek(int16_t fd, uint32_t loc)
 	// Seek to the shit
 	local_file.position = (int32_t)loc;
 
+	pthread_mutex_lock(&crud_table_lock);
 	crud_file_table[fd] = local_file;
+	pthread_mutex_unlock(&crud_table_lock);
 
 	return 0;
 }
@@ -419,7 +471,7 @@ void crud_init()
 {
 	void *buf = NULL;
 	CrudRequest req = createRequest(0, CRUD_INIT, 0, 0);
-	CrudResponse res = crud_client_operation(req, buf);
+	CrudResponse res = crud_backend_operation(req, buf);
 	file_st file = processResponse(res, -1);
 	
 	if(file.result)
@@ -444,22 +496,8 @@ void crud_init()
 // Outputs      : 0 if successful or -1 if failure
 CrudRequest createRequest(int32_t oid, int8_t request, int32_t length, int8_t flags)
 {
-	CrudRequest req = 0;
-	
-	// Add the 32 bits of oid to the 64 least significant bits of req
-	req+= oid;
-	req<<=4;
-	// Add the however many from the request and length
-	req+= (15 & request);
-	req<<=24;
-
-	req+= (16777215 & length);
-	req<<=3;
-
-	req+= (int8_t)( 7 & flags );
-	req<<=1;
-	
-	return req;
+	// The codec does the shifting (see crud_codec.h)
+	return crud_codec_encode(oid, request, length, flags, 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -475,28 +513,11 @@ CrudRequest createRequest(int32_t oid, int8_t request, int32_t length, int8_t fl
 file_st processResponse(CrudResponse res, int16_t fd)
 {
 	file_st file;
-	file.result = (int8_t)( 1 & res );
-	res>>=1;
-	//printf("result:%u\n",file.result);
-
-	// Flags
-	file.flags = (int8_t)( 7 & res );
-	res>>=3;
-	//printf("flags:%u\n",file.flags);
-
-	// Length
-	file.length = (int32_t)(16777215 & res);
-	res>>=24;
-	//printf("length:%u\n",file.length);
-
-	// Request
-	file.request = (int8_t)(15 & res);
-	res>>=4;
-	//printf("request:%u\n",file.request);
-
-	// OID
-	file.oid = (int32_t)(4294967295 & res);
-	// No need to shift res again.
+	file.result = crud_codec_result(res);
+	file.flags = crud_codec_flags(res);
+	file.length = crud_codec_length(res);
+	file.request = crud_codec_req(res);
+	file.oid = crud_codec_oid(res);
 	
 	if(fd>=0)
 		file.position = crud_file_table[fd].position;
@@ -533,7 +554,9 @@ CrudFileAllocationType convertToCrudFileType(file_st file, int16_t fd, char* fil
 	newFile.length = file.length;
 	newFile.open = 1;
 	strcpy(newFile.filename, filename);
+	pthread_mutex_lock(&crud_table_lock);
 	crud_file_table[fd] = newFile;
+	pthread_mutex_unlock(&crud_table_lock);
 
 	return newFile;
 }
@@ -701,7 +724,7 @@ int crudIOUnitTest(void) {
 
 		// Make a fake request to get file handle, then check it
 		request = construct_crud_request(crud_file_table[0].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0);
-		response = crud_client_operation(request, tbuf);
+		response = crud_backend_operation(request, tbuf);
 		if ((deconstruct_crud_request(response, &oid, &req, &length, &flags, &res) != 0) || (res != 0))  {
 			logMessage(LOG_ERROR_LEVEL, "Read failure, bad CRUD response [%x]", response);
 			return(-1);
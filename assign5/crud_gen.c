@@ -0,0 +1,598 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_gen.c
+//  Description    : This is the implementation of the synthetic workload
+//                   generator (see crud_gen.h).  The generator keeps the
+//                   size and position of every file, so each command it
+//                   writes is one the filesystem will carry out as expected
+//                   when the workload is replayed.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// Project includes
+#include <crud_gen.h>
+#include <crud_trace.h>
+#include <crud_driver.h>
+#include <crud_file_io.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_GEN_UNIT_TEST_TEXT "crud_gen_test.txt"
+#define CRUD_GEN_UNIT_TEST_TRACE "crud_gen_test.trc"
+#define CRUD_GEN_UNIT_TEST_SPEC "files=50,ops=20000,skew=1.2,mix=40:20:10:30,size=uniform:1:3000,max=8192,seed=311"
+
+//
+// Type definitions
+
+// This is a workload being generated
+typedef struct {
+	CrudGenSpec      *gen;     // The shape of the workload
+	uint64_t          state;   // The state of the random generator (xorshift64*)
+	double           *cdf;     // The cumulative popularity of each rank
+	uint32_t         *perm;    // The file at each rank of popularity
+	int32_t          *size;    // The size of each file
+	int32_t          *pos;     // The position in each file
+	char             *payload; // The bytes written (max)
+	char              fname[CRUD_MAX_PATH_LENGTH]; // The name of the file
+	uint64_t          emitted; // The commands written
+	FILE             *fh;      // The text workload (NULL if a trace)
+	CrudTraceBuilder *tb;      // The trace (NULL if text)
+} CrudGenState;
+
+//
+// Local functions
+
+static uint64_t crud_gen_random( CrudGenState *gs );
+static double crud_gen_uniform( CrudGenState *gs );
+static uint32_t crud_gen_file( CrudGenState *gs );
+static int32_t crud_gen_size( CrudGenState *gs, int32_t room );
+static int crud_gen_emit( CrudGenState *gs, uint32_t file, CRUD_SIM_COMMANDS command, int32_t len, int32_t off );
+static int crud_gen_setup( CrudGenState *gs, CrudGenSpec *gen );
+static void crud_gen_release( CrudGenState *gs );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_parse
+// Description  : Parse a workload spec, a comma separated list of
+//                <name>=<value>.  Anything not given is as in
+//                CRUD_GEN_DEFAULT_SPEC.
+//
+// Inputs       : spec - the spec
+//                gen - the shape of the workload (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_gen_parse( char *spec, CrudGenSpec *gen ) {
+
+	// Local variables
+	char defaults[] = CRUD_GEN_DEFAULT_SPEC, *copy, *tok, *save, *val;
+	unsigned long long seed;
+	uint32_t *mix = gen->mix;
+	int pass, ok, n;
+
+	// Parse the defaults, then the spec over them
+	memset( gen, 0x0, sizeof(CrudGenSpec) );
+	for ( pass=0; pass<2; pass++ ) {
+		if ( (copy = strdup((pass == 0) ? defaults : spec)) == NULL ) {
+			return( -1 );
+		}
+		for ( tok=strtok_r(copy, ",", &save); tok != NULL; tok=strtok_r(NULL, ",", &save) ) {
+			if ( (val = strchr(tok, '=')) == NULL ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD gen: bad workload spec [%s]", tok );
+				free( copy );
+				return( -1 );
+			}
+			*val++ = 0x0;
+			if ( strcmp(tok, "files") == 0 ) {
+				ok = (sscanf(val, "%u", &gen->files) == 1) && (gen->files > 0);
+			} else if ( strcmp(tok, "ops") == 0 ) {
+				ok = (sscanf(val, "%llu", &seed) == 1);
+				gen->ops = seed;
+			} else if ( strcmp(tok, "skew") == 0 ) {
+				ok = (sscanf(val, "%lf", &gen->skew) == 1) && (gen->skew >= 0.0);
+			} else if ( strcmp(tok, "mix") == 0 ) {
+				mix[3] = 0;
+				n = sscanf( val, "%u:%u:%u:%u", &mix[0], &mix[1], &mix[2], &mix[3] );
+				ok = (n >= 3) && (mix[0]+mix[1]+mix[2]+mix[3] > 0);
+			} else if ( strcmp(tok, "size") == 0 ) {
+				if ( strncmp(val, "fixed:", 6) == 0 ) {
+					gen->sizes = CRUD_GEN_FIXED;
+					ok = (sscanf(&val[6], "%u", &gen->a) == 1) && (gen->a > 0);
+				} else if ( strncmp(val, "uniform:", 8) == 0 ) {
+					gen->sizes = CRUD_GEN_UNIFORM;
+					ok = (sscanf(&val[8], "%u:%u", &gen->a, &gen->b) == 2) && (gen->a > 0) && (gen->a <= gen->b);
+				} else if ( strncmp(val, "exp:", 4) == 0 ) {
+					gen->sizes = CRUD_GEN_EXP;
+					ok = (sscanf(&val[4], "%u", &gen->a) == 1) && (gen->a > 0);
+				} else {
+					ok = 0;
+				}
+			} else if ( strcmp(tok, "max") == 0 ) {
+				ok = (sscanf(val, "%u", &gen->max) == 1) && (gen->max > 0) && (gen->max <= CRUD_MAX_OBJECT_SIZE);
+			} else if ( strcmp(tok, "seed") == 0 ) {
+				ok = (sscanf(val, "%llu", &seed) == 1);
+				gen->seed = seed;
+			} else {
+				ok = 0;
+			}
+			if ( ! ok ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD gen: bad workload spec [%s=%s]", tok, val );
+				free( copy );
+				return( -1 );
+			}
+		}
+		free( copy );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_workload
+// Description  : Write a workload: FORMAT and MOUNT, the commands, then
+//                UNMOUNT.  Each command picks a file by popularity, then a
+//                command by the mix:
+//
+//                READ - the size from the distribution, cut to what is left
+//                       after the position (a SEEK back into the file first
+//                       if it is at the end, a WRITE instead if it is empty)
+//                WRITE - at the position, cut to the ceiling (a WRITEAT if
+//                        the file is full)
+//                SEEK - to anywhere in the file
+//                WRITEAT - to anywhere in the file (that keeps it under
+//                          the ceiling)
+//
+//                The bytes of each write are a single letter.
+//
+// Inputs       : gen - the shape of the workload
+//                wload - the workload to write (a trace if it ends in .trc)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_gen_workload( CrudGenSpec *gen, char *wload ) {
+
+	// Local variables
+	CrudGenState gs;
+	uint64_t pick, total;
+	uint32_t file;
+	int32_t len, off, room;
+	size_t nlen = strlen( wload );
+	int ret = 0, op;
+
+	// Setup the state, then the workload (text or trace)
+	if ( crud_gen_setup(&gs, gen) ) {
+		return( -1 );
+	}
+	if ( (nlen >= 4) && (strcmp(&wload[nlen-4], ".trc") == 0) ) {
+		gs.tb = crud_trace_begin();
+	} else if ( (gs.fh = fopen(wload, "w")) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD gen: failure creating [%s], error: %s.", wload, strerror(errno) );
+	}
+	if ( (gs.tb == NULL) && (gs.fh == NULL) ) {
+		crud_gen_release( &gs );
+		return( -1 );
+	}
+
+	// Write the commands
+	ret = crud_gen_emit( &gs, 0, CRUD_SIM_FORMAT, 0, 0 ) || crud_gen_emit( &gs, 0, CRUD_SIM_MOUNT, 0, 0 );
+	gs.emitted = 0;
+	total = (uint64_t)gen->mix[0] + gen->mix[1] + gen->mix[2] + gen->mix[3];
+	while ( (ret == 0) && (gs.emitted < gen->ops) ) {
+
+		// Pick the file and command
+		file = crud_gen_file( &gs );
+		pick = crud_gen_random( &gs ) % total;
+		for ( op=0; pick >= gen->mix[op]; pick-=gen->mix[op], op++ );
+		if ( (op == 0) && (gs.size[file] == 0) ) {
+			op = 1;
+		}
+		if ( (op == 1) && (gs.pos[file] >= (int32_t)gen->max) ) {
+			op = 3;
+		}
+
+		// Keep the file (and position) as the filesystem will
+		switch ( op ) {
+
+		case 0: // READ
+			if ( gs.pos[file] >= gs.size[file] ) {
+				off = crud_gen_random( &gs ) % gs.size[file];
+				ret = crud_gen_emit( &gs, file, CRUD_SIM_SEEK, 0, off );
+				gs.pos[file] = off;
+				if ( gs.emitted == gen->ops ) {
+					break;
+				}
+			}
+			len = crud_gen_size( &gs, gs.size[file]-gs.pos[file] );
+			ret = ret || crud_gen_emit( &gs, file, CRUD_SIM_READ, len, 0 );
+			gs.pos[file] += len;
+			break;
+
+		case 1: // WRITE
+			len = crud_gen_size( &gs, gen->max-gs.pos[file] );
+			ret = crud_gen_emit( &gs, file, CRUD_SIM_WRITE, len, 0 );
+			gs.pos[file] += len;
+			break;
+
+		case 2: // SEEK
+			off = crud_gen_random( &gs ) % (gs.size[file]+1);
+			ret = crud_gen_emit( &gs, file, CRUD_SIM_SEEK, 0, off );
+			gs.pos[file] = off;
+			break;
+
+		default: // WRITEAT
+			len = crud_gen_size( &gs, gen->max );
+			room = (int32_t)gen->max - len;
+			off = crud_gen_random( &gs ) % (((gs.size[file] < room) ? gs.size[file] : room) + 1);
+			ret = crud_gen_emit( &gs, file, CRUD_SIM_WRITEAT, len, off );
+			gs.pos[file] = off+len;
+			break;
+		}
+		gs.size[file] = (gs.pos[file] > gs.size[file]) ? gs.pos[file] : gs.size[file];
+	}
+	ret = ret || crud_gen_emit( &gs, 0, CRUD_SIM_UNMOUNT, 0, 0 );
+
+	// Finish off the workload
+	if ( gs.fh != NULL ) {
+		if ( fclose(gs.fh) && (ret == 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD gen: failure writing [%s], error: %s.", wload, strerror(errno) );
+			ret = -1;
+		}
+	} else if ( crud_trace_end(gs.tb, (ret == 0) ? wload : NULL) ) {
+		ret = -1;
+	}
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD gen: wrote [%s], %lu commands over %u files (skew %.2f)", wload,
+				gen->ops, gen->files, gen->skew );
+	}
+	crud_gen_release( &gs );
+	return( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_unit_test
+// Description  : Generate the same workload as text and as a trace, then
+//                check the two match command for command, that the workload
+//                would replay (no read past the end of a file, no seek
+//                past it, no file over the ceiling), and that the files
+//                are as popular as the Zipf distribution says.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_gen_unit_test( void ) {
+
+	// Local variables
+	char spec[] = CRUD_GEN_UNIT_TEST_SPEC, *text = MAP_FAILED, *tmap = MAP_FAILED, *line, *eol, *end, *buf = NULL;
+	CrudSimulationCommand expect, got;
+	CrudGenSpec gen;
+	CrudTrace trace;
+	struct stat st, tst;
+	int32_t *size = NULL, *pos = NULL;
+	uint32_t *count = NULL, i, f, hot;
+	double total = 0.0, share;
+	int fd, tfd, ret = 0;
+
+	// Generate the text and the trace, map them
+	if ( crud_gen_parse(spec, &gen) || crud_gen_workload(&gen, CRUD_GEN_UNIT_TEST_TEXT) ||
+		 crud_gen_workload(&gen, CRUD_GEN_UNIT_TEST_TRACE) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD gen unit test: generation failed" );
+		return( -1 );
+	}
+	fd = open( CRUD_GEN_UNIT_TEST_TEXT, O_RDONLY );
+	tfd = open( CRUD_GEN_UNIT_TEST_TRACE, O_RDONLY );
+	if ( (fd != -1) && (tfd != -1) && (fstat(fd, &st) == 0) && (fstat(tfd, &tst) == 0) ) {
+		text = mmap( NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		tmap = mmap( NULL, tst.st_size, PROT_READ, MAP_PRIVATE, tfd, 0 );
+	}
+	close( fd );
+	close( tfd );
+	if ( (text == MAP_FAILED) || (tmap == MAP_FAILED) || crud_trace_attach(&trace, tmap, tst.st_size) ||
+		 (trace.header->records != gen.ops+3) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD gen unit test: bad workload" );
+		ret = -1;
+	}
+
+	// Walk the two, keeping the files as the filesystem would
+	if ( ret == 0 ) {
+		size = calloc( trace.header->files, sizeof(int32_t) );
+		pos = calloc( trace.header->files, sizeof(int32_t) );
+		count = calloc( trace.header->files, sizeof(uint32_t) );
+		buf = malloc( CRUD_MAX_OBJECT_SIZE );
+		ret = ((size == NULL) || (pos == NULL) || (count == NULL) || (buf == NULL)) ? -1 : 0;
+	}
+	end = text + st.st_size;
+	for ( i=0, line=text; (ret == 0) && (line < end); line=eol+1, i++ ) {
+		if ( (eol = memchr(line, '\n', end-line)) == NULL ) {
+			eol = end;
+		}
+		if ( crud_trace_parse(line, eol, end, &expect) || crud_trace_command(&trace, i, &got, buf) ||
+			 strcmp(expect.fname, got.fname) || (expect.command != got.command) ||
+			 (expect.len != got.len) || (expect.off != got.off) ||
+			 (((got.command == CRUD_SIM_WRITE) || (got.command == CRUD_SIM_WRITEAT)) &&
+			   memcmp(expect.text, got.text, got.len)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD gen unit test: command %u of the trace does not match the text", i );
+			ret = -1;
+			continue;
+		}
+		f = trace.records[i].file;
+		switch ( got.command ) {
+		case CRUD_SIM_READ:
+			ret = ((got.len < 1) || (got.len > size[f]-pos[f])) ? -1 : 0;
+			pos[f] += got.len;
+			break;
+		case CRUD_SIM_SEEK:
+			ret = ((got.off < 0) || (got.off > size[f]) || (got.len != 0)) ? -1 : 0;
+			pos[f] = got.off;
+			break;
+		case CRUD_SIM_WRITEAT:
+			ret = ((got.off < 0) || (got.off > size[f])) ? -1 : 0;
+			pos[f] = got.off;
+			// Fall through to the write
+		case CRUD_SIM_WRITE:
+			ret = (ret || (got.len < 1) || (pos[f]+got.len > (int32_t)gen.max)) ? -1 : 0;
+			pos[f] += got.len;
+			break;
+		default:
+			break;
+		}
+		size[f] = (pos[f] > size[f]) ? pos[f] : size[f];
+		count[f] ++;
+		if ( ret ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD gen unit test: command %u would not replay [%.*s]", i,
+					(int)((eol-line < 60) ? eol-line : 60), line );
+		}
+	}
+
+	// The most popular file should get its share (1/H(files,skew)), +-15%
+	// (the first file of the trace is x, of FORMAT/MOUNT/UNMOUNT)
+	if ( ret == 0 ) {
+		for ( i=1; i<=gen.files; i++ ) {
+			total += 1.0/pow( i, gen.skew );
+		}
+		for ( f=1, hot=1; f<trace.header->files; f++ ) {
+			hot = (count[f] > count[hot]) ? f : hot;
+		}
+		share = (double)count[hot]/gen.ops;
+		if ( fabs(share*total-1.0) > 0.15 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD gen unit test: hottest file has %.3f of the commands, should be %.3f",
+					share, 1.0/total );
+			ret = -1;
+		}
+	}
+
+	// Cleanup, return the result
+	if ( tmap != MAP_FAILED ) {
+		crud_trace_detach( &trace );
+		munmap( tmap, tst.st_size );
+	}
+	if ( text != MAP_FAILED ) {
+		munmap( text, st.st_size );
+	}
+	free( size );
+	free( pos );
+	free( count );
+	free( buf );
+	unlink( CRUD_GEN_UNIT_TEST_TEXT );
+	unlink( CRUD_GEN_UNIT_TEST_TRACE );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD gen unit test completed successfully." );
+	}
+	return( ret );
+}
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_random
+// Description  : Get the next value of the generator (xorshift64*), so that
+//                a seed always gives the same workload
+//
+// Inputs       : gs - the workload being generated
+// Outputs      : the value
+
+static uint64_t crud_gen_random( CrudGenState *gs ) {
+	gs->state ^= gs->state >> 12;
+	gs->state ^= gs->state << 25;
+	gs->state ^= gs->state >> 27;
+	return( gs->state * 0x2545F4914F6CDD1DULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_uniform
+// Description  : Get a value uniform in [0, 1)
+//
+// Inputs       : gs - the workload being generated
+// Outputs      : the value
+
+static double crud_gen_uniform( CrudGenState *gs ) {
+	return( (crud_gen_random(gs) >> 11) / 9007199254740992.0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_file
+// Description  : Pick a file by popularity (a binary search of the
+//                cumulative popularity for the rank, then the file there)
+//
+// Inputs       : gs - the workload being generated
+// Outputs      : the file
+
+static uint32_t crud_gen_file( CrudGenState *gs ) {
+
+	// Local variables
+	double u = crud_gen_uniform( gs );
+	uint32_t lo = 0, hi = gs->gen->files-1, mid;
+
+	while ( lo < hi ) {
+		mid = lo + (hi-lo)/2;
+		if ( gs->cdf[mid] > u ) {
+			hi = mid;
+		} else {
+			lo = mid+1;
+		}
+	}
+	return( gs->perm[lo] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_size
+// Description  : Pick the size of a read or write from the distribution
+//
+// Inputs       : gs - the workload being generated
+//                room - the largest it can be
+// Outputs      : the size (1 to room)
+
+static int32_t crud_gen_size( CrudGenState *gs, int32_t room ) {
+
+	// Local variables
+	CrudGenSpec *gen = gs->gen;
+	double len;
+
+	switch ( gen->sizes ) {
+	case CRUD_GEN_UNIFORM:
+		len = gen->a + crud_gen_random(gs) % (gen->b-gen->a+1);
+		break;
+	case CRUD_GEN_EXP:
+		len = ceil( -log(1.0-crud_gen_uniform(gs)) * gen->a );
+		break;
+	default:
+		len = gen->a;
+		break;
+	}
+	len = (len < 1.0) ? 1.0 : len;
+	return( (len > room) ? room : (int32_t)len );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_emit
+// Description  : Write a command of the workload (a line of text, or a
+//                record of the trace)
+//
+// Inputs       : gs - the workload being generated
+//                file - the file
+//                command - the command
+//                len - the length (or expected result)
+//                off - the offset
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_gen_emit( CrudGenState *gs, uint32_t file, CRUD_SIM_COMMANDS command, int32_t len, int32_t off ) {
+
+	// Local variables
+	CrudSimulationCommand cmd;
+	int write = ((command == CRUD_SIM_WRITE) || (command == CRUD_SIM_WRITEAT));
+
+	// Name the file (x for the filesystem commands), fill in the bytes
+	if ( (command == CRUD_SIM_FORMAT) || (command == CRUD_SIM_MOUNT) || (command == CRUD_SIM_UNMOUNT) ) {
+		strcpy( gs->fname, "x" );
+	} else {
+		snprintf( gs->fname, CRUD_MAX_PATH_LENGTH, "file%u.txt", file );
+	}
+	if ( write ) {
+		memset( gs->payload, 'a'+crud_gen_random(gs)%26, len );
+	}
+	gs->emitted ++;
+
+	// Write it out
+	if ( gs->fh != NULL ) {
+		fprintf( gs->fh, "%s %s %d %d :", gs->fname, CRUD_SIM_COMMAND_LABELS[command], len, off );
+		if ( write ) {
+			fwrite( gs->payload, 1, len, gs->fh );
+		}
+		return( (fputc('\n', gs->fh) == EOF) ? -1 : 0 );
+	}
+	cmd.fname = gs->fname;
+	cmd.command = command;
+	cmd.len = len;
+	cmd.off = off;
+	cmd.text = gs->payload;
+	return( crud_trace_add(gs->tb, &cmd) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_setup
+// Description  : Setup a workload to generate: seed the generator, work out
+//                the popularity of each rank (1/rank^skew, cumulative) and
+//                shuffle the files over the ranks.
+//
+// Inputs       : gs - the workload being generated
+//                gen - the shape of the workload
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_gen_setup( CrudGenState *gs, CrudGenSpec *gen ) {
+
+	// Local variables
+	double total = 0.0;
+	uint32_t i, j, t;
+
+	// Allocate the tables
+	memset( gs, 0x0, sizeof(CrudGenState) );
+	gs->gen = gen;
+	gs->state = (gen->seed ^ 0x9E3779B97F4A7C15ULL) | 0x1;
+	gs->cdf = malloc( sizeof(double)*gen->files );
+	gs->perm = malloc( sizeof(uint32_t)*gen->files );
+	gs->size = calloc( gen->files, sizeof(int32_t) );
+	gs->pos = calloc( gen->files, sizeof(int32_t) );
+	gs->payload = malloc( gen->max );
+	if ( (gs->cdf == NULL) || (gs->perm == NULL) || (gs->size == NULL) || (gs->pos == NULL) ||
+		 (gs->payload == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD gen: allocation failed (%u files)", gen->files );
+		crud_gen_release( gs );
+		return( -1 );
+	}
+
+	// The popularity of the ranks, then a file for each
+	for ( i=0; i<gen->files; i++ ) {
+		total += 1.0/pow( i+1, gen->skew );
+		gs->cdf[i] = total;
+		gs->perm[i] = i;
+	}
+	for ( i=0; i<gen->files; i++ ) {
+		gs->cdf[i] /= total;
+	}
+	for ( i=gen->files-1; i>0; i-- ) {
+		j = crud_gen_random( gs ) % (i+1);
+		t = gs->perm[i];
+		gs->perm[i] = gs->perm[j];
+		gs->perm[j] = t;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gen_release
+// Description  : Release the tables of a workload being generated
+//
+// Inputs       : gs - the workload being generated
+// Outputs      : none
+
+static void crud_gen_release( CrudGenState *gs ) {
+	free( gs->cdf );
+	free( gs->perm );
+	free( gs->size );
+	free( gs->pos );
+	free( gs->payload );
+	return;
+}
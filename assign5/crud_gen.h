@@ -0,0 +1,65 @@
+#ifndef CRUD_GEN_INCLUDED
+#define CRUD_GEN_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_gen.h
+//  Description   : This is the interface to the synthetic workload generator.
+//                  It writes workloads crud_sim replays (text, or a binary
+//                  trace, see crud_trace.h) of any number of files and
+//                  commands: the files picked by a Zipf popularity, the
+//                  commands by a read/write/seek mix, the writes sized by a
+//                  distribution and kept under a file size ceiling.  The
+//                  same parameters and seed always give the same workload.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CRUD_GEN_DEFAULT_SPEC "files=100,ops=100000,skew=0.99,mix=30:20:10:40,size=exp:256,max=65536,seed=1"
+
+//
+// Type definitions
+
+// These are the distributions of the write sizes
+typedef enum {
+	CRUD_GEN_FIXED   = 0, // Always the same size (a)
+	CRUD_GEN_UNIFORM = 1, // Uniform between two sizes (a to b)
+	CRUD_GEN_EXP     = 2, // Exponential with a mean (a)
+	CRUD_GEN_MAXVAL  = 3, // Max value
+} CRUD_GEN_SIZES;
+
+// This is the shape of a generated workload
+typedef struct {
+	uint32_t       files;   // The number of files
+	uint64_t       ops;     // The number of commands (not counting FORMAT/MOUNT/UNMOUNT)
+	double         skew;    // The Zipf exponent of the file popularity (0 for uniform)
+	uint32_t       mix[4];  // The weights of READ, WRITE, SEEK and WRITEAT
+	CRUD_GEN_SIZES sizes;   // The distribution of the write (and read) sizes
+	uint32_t       a, b;    // The parameters of the distribution
+	uint32_t       max;     // The size a file is kept under (the ceiling)
+	uint64_t       seed;    // The seed of the generator
+} CrudGenSpec;
+
+//
+// Generator interface
+
+int crud_gen_parse( char *spec, CrudGenSpec *gen );
+	// Parse a workload spec ("files=<n>,ops=<n>,skew=<s>,mix=<r>:<w>:<s>[:<wa>],
+	// size=fixed:<n>|uniform:<lo>:<hi>|exp:<mean>,max=<n>,seed=<n>", any of
+	// them, the rest as in CRUD_GEN_DEFAULT_SPEC)
+
+int crud_gen_workload( CrudGenSpec *gen, char *wload );
+	// Write a workload, as a binary trace if the name ends in .trc
+
+//
+// Unit Testing
+
+int crud_gen_unit_test( void );
+	// Generate a workload as text and a trace, check they match and replay
+
+#endif
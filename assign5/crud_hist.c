@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_hist.c
+//  Description    : This is the implementation of the latency histograms
+//                   (see crud_hist.h).  Only recording is on the fast path,
+//                   the percentiles are found by walking the buckets.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+
+// Project includes
+#include <crud_hist.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_HIST_UNIT_TEST_VALUES 10000
+
+//
+// Local functions
+
+static uint64_t crud_hist_rank( uint64_t count, double pct );
+static int crud_hist_compare( const void *a, const void *b );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_init
+// Description  : Empty a histogram
+//
+// Inputs       : hist - the histogram
+// Outputs      : none
+
+void crud_hist_init( CrudHistogram *hist ) {
+	memset( hist, 0x0, sizeof(CrudHistogram) );
+	hist->min = UINT64_MAX;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_merge
+// Description  : Add the values of one histogram to another (e.g., those of
+//                the threads that recorded separately)
+//
+// Inputs       : to - the histogram added to
+//                from - the histogram added
+// Outputs      : none
+
+void crud_hist_merge( CrudHistogram *to, const CrudHistogram *from ) {
+
+	// Local variables
+	uint32_t i;
+
+	for ( i=0; i<CRUD_HIST_BUCKETS; i++ ) {
+		to->buckets[i] += from->buckets[i];
+	}
+	to->count += from->count;
+	to->sum += from->sum;
+	to->min = (from->min < to->min) ? from->min : to->min;
+	to->max = (from->max > to->max) ? from->max : to->max;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_lowest
+// Description  : The smallest value that goes in a bucket
+//
+// Inputs       : bucket - the bucket
+// Outputs      : the value
+
+uint64_t crud_hist_lowest( uint32_t bucket ) {
+
+	// Local variables
+	uint32_t shift;
+
+	if ( bucket < CRUD_HIST_SUB_BUCKETS ) {
+		return( bucket );
+	}
+	shift = (bucket-CRUD_HIST_SUB_BUCKETS)/CRUD_HIST_HALF + 1;
+	return( (uint64_t)((bucket-CRUD_HIST_SUB_BUCKETS)%CRUD_HIST_HALF + CRUD_HIST_HALF) << shift );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_highest
+// Description  : The largest value that goes in a bucket
+//
+// Inputs       : bucket - the bucket
+// Outputs      : the value
+
+uint64_t crud_hist_highest( uint32_t bucket ) {
+
+	// Local variables
+	uint32_t shift;
+
+	if ( bucket < CRUD_HIST_SUB_BUCKETS ) {
+		return( bucket );
+	}
+	shift = (bucket-CRUD_HIST_SUB_BUCKETS)/CRUD_HIST_HALF + 1;
+	return( crud_hist_lowest(bucket) + (((uint64_t)1) << shift) - 1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_percentile
+// Description  : Find the value below which (at least) some percent of the
+//                values fall.  This is the largest value of the bucket the
+//                value is in (so it is never below the real one), kept
+//                between the smallest and largest value recorded.
+//
+// Inputs       : hist - the histogram
+//                pct - the percentile (0-100)
+// Outputs      : the value (0 if the histogram is empty)
+
+uint64_t crud_hist_percentile( const CrudHistogram *hist, double pct ) {
+
+	// Local variables
+	uint64_t rank, seen = 0, val;
+	uint32_t i;
+
+	if ( hist->count == 0 ) {
+		return( 0 );
+	}
+
+	// Walk the buckets until enough values are seen
+	rank = crud_hist_rank( hist->count, pct );
+	for ( i=0; i<CRUD_HIST_BUCKETS; i++ ) {
+		seen += hist->buckets[i];
+		if ( seen >= rank ) {
+			break;
+		}
+	}
+	val = (i < CRUD_HIST_BUCKETS) ? crud_hist_highest(i) : hist->max;
+	val = (val > hist->max) ? hist->max : val;
+	return( (val < hist->min) ? hist->min : val );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_mean
+// Description  : The mean of the values
+//
+// Inputs       : hist - the histogram
+// Outputs      : the mean (0 if the histogram is empty)
+
+double crud_hist_mean( const CrudHistogram *hist ) {
+	return( (hist->count == 0) ? 0.0 : (double)hist->sum/hist->count );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_rank
+// Description  : Which value (counting from 1, in order) is at a percentile
+//
+// Inputs       : count - the number of values
+//                pct - the percentile (0-100)
+// Outputs      : the rank (1 to count)
+
+static uint64_t crud_hist_rank( uint64_t count, double pct ) {
+
+	// Local variables
+	double exact = pct/100.0*count;
+	uint64_t rank = (uint64_t)exact;
+
+	// Round up, staying in range
+	rank += (rank < exact);
+	rank = (rank < 1) ? 1 : rank;
+	return( (rank > count) ? count : rank );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_compare
+// Description  : Order two values (for qsort)
+//
+// Inputs       : a, b - the values
+// Outputs      : <0, 0, >0 as a is below, the same as, above b
+
+static int crud_hist_compare( const void *a, const void *b ) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return( (x > y) - (x < y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_unit_test
+// Description  : Check that the buckets tile the values, then record random
+//                values (of all sizes) and check the percentiles against the
+//                sorted values, and that merging the halves gives the whole.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_hist_unit_test( void ) {
+
+	// Local variables
+	const double pcts[] = { 0.0, 0.1, 1.0, 50.0, 90.0, 99.0, 99.9, 100.0 };
+	CrudHistogram *whole, *half, *other;
+	uint64_t *vals, exact, val, sum = 0;
+	uint32_t i;
+
+	// Each bucket starts right after the one before, and holds its range
+	for ( i=0; i<CRUD_HIST_BUCKETS; i++ ) {
+		if ( (crud_hist_bucket(crud_hist_lowest(i)) != i) || (crud_hist_bucket(crud_hist_highest(i)) != i) ||
+			 ((i > 0) && (crud_hist_lowest(i) != crud_hist_highest(i-1)+1)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_HIST_UNIT_TEST : bad bucket %u [%lu-%lu]", i,
+					crud_hist_lowest(i), crud_hist_highest(i) );
+			return( -1 );
+		}
+	}
+	if ( crud_hist_highest(CRUD_HIST_BUCKETS-1) != UINT64_MAX ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_HIST_UNIT_TEST : buckets do not reach the largest value" );
+		return( -1 );
+	}
+
+	// Record random values into the whole, and each into one of the halves
+	whole = malloc( sizeof(CrudHistogram) );
+	half = malloc( sizeof(CrudHistogram) );
+	other = malloc( sizeof(CrudHistogram) );
+	vals = malloc( sizeof(uint64_t)*CRUD_HIST_UNIT_TEST_VALUES );
+	if ( (whole == NULL) || (half == NULL) || (other == NULL) || (vals == NULL) ) {
+		free( whole );
+		free( half );
+		free( other );
+		free( vals );
+		return( -1 );
+	}
+	crud_hist_init( whole );
+	crud_hist_init( half );
+	crud_hist_init( other );
+	for ( i=0; i<CRUD_HIST_UNIT_TEST_VALUES; i++ ) {
+		vals[i] = ((uint64_t)getRandomValue(0, 100000)) << getRandomValue(0, 30);
+		crud_hist_record( whole, vals[i] );
+		crud_hist_record( (i%2) ? half : other, vals[i] );
+		sum += vals[i];
+	}
+	crud_hist_merge( half, other );
+	free( other );
+
+	// Check each percentile is in the bucket of the real one (and not below)
+	qsort( vals, CRUD_HIST_UNIT_TEST_VALUES, sizeof(uint64_t), crud_hist_compare );
+	for ( i=0; i<sizeof(pcts)/sizeof(pcts[0]); i++ ) {
+		exact = vals[crud_hist_rank(CRUD_HIST_UNIT_TEST_VALUES, pcts[i])-1];
+		val = crud_hist_percentile( whole, pcts[i] );
+		if ( (val < exact) || (crud_hist_bucket(val) != crud_hist_bucket(exact)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_HIST_UNIT_TEST : p%.1f is %lu, should be %lu", pcts[i], val, exact );
+			free( whole );
+			free( half );
+			free( vals );
+			return( -1 );
+		}
+	}
+
+	// Check the summary, and that the merged halves are the whole
+	if ( (whole->count != CRUD_HIST_UNIT_TEST_VALUES) || (whole->sum != sum) || (whole->min != vals[0]) ||
+		 (whole->max != vals[CRUD_HIST_UNIT_TEST_VALUES-1]) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_HIST_UNIT_TEST : bad summary [%lu values, sum %lu, %lu-%lu]",
+				whole->count, whole->sum, whole->min, whole->max );
+		free( whole );
+		free( half );
+		free( vals );
+		return( -1 );
+	}
+	if ( memcmp(half, whole, sizeof(CrudHistogram)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_HIST_UNIT_TEST : merged histogram does not match" );
+		free( whole );
+		free( half );
+		free( vals );
+		return( -1 );
+	}
+
+	// Cleanup, log and return successfully
+	free( whole );
+	free( half );
+	free( vals );
+	logMessage( LOG_INFO_LEVEL, "CRUD hist unit test completed successfully." );
+	return( 0 );
+}
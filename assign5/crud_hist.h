@@ -0,0 +1,127 @@
+#ifndef CRUD_HIST_INCLUDED
+#define CRUD_HIST_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_hist.h
+//  Description   : This is the interface to the latency histograms (in the
+//                  style of HdrHistogram).  Values below 2^CRUD_HIST_SUB_BITS
+//                  get a bucket each, above that every power of two is split
+//                  into 2^(CRUD_HIST_SUB_BITS-1) equal buckets, so a value is
+//                  known to within 1/32 of itself whatever its size.  Recording
+//                  is inline and takes a count-leading-zeros and an add, so
+//                  timing a call costs little more than reading the clock.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <time.h>
+
+// Defines
+#define CRUD_HIST_SUB_BITS    6 // Bits of precision kept of each value
+#define CRUD_HIST_SUB_BUCKETS (1 << CRUD_HIST_SUB_BITS)
+#define CRUD_HIST_HALF        (CRUD_HIST_SUB_BUCKETS/2)
+#define CRUD_HIST_BUCKETS     (CRUD_HIST_SUB_BUCKETS + (64-CRUD_HIST_SUB_BITS)*CRUD_HIST_HALF)
+
+//
+// Type definitions
+
+// This is a histogram of values (e.g., latencies in nanoseconds)
+typedef struct {
+	uint64_t count;   // The number of values recorded
+	uint64_t sum;     // The sum of the values
+	uint64_t min;     // The smallest value (UINT64_MAX if none)
+	uint64_t max;     // The largest value
+	uint64_t buckets[CRUD_HIST_BUCKETS]; // The values in each bucket
+} CrudHistogram;
+
+//
+// Recording functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_bucket
+// Description  : Find the bucket a value goes in
+//
+// Inputs       : val - the value
+// Outputs      : the bucket
+
+static inline uint32_t crud_hist_bucket( uint64_t val ) {
+
+	// Local variables
+	uint32_t shift;
+
+	// Small values are exact, the rest keep their top bits
+	if ( val < CRUD_HIST_SUB_BUCKETS ) {
+		return( (uint32_t)val );
+	}
+	shift = (63 - __builtin_clzll(val)) - (CRUD_HIST_SUB_BITS-1);
+	return( CRUD_HIST_SUB_BUCKETS + (shift-1)*CRUD_HIST_HALF + (uint32_t)(val >> shift) - CRUD_HIST_HALF );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_record
+// Description  : Record a value in a histogram
+//
+// Inputs       : hist - the histogram
+//                val - the value
+// Outputs      : none
+
+static inline void crud_hist_record( CrudHistogram *hist, uint64_t val ) {
+	hist->buckets[crud_hist_bucket(val)] ++;
+	hist->count ++;
+	hist->sum += val;
+	hist->min = (val < hist->min) ? val : hist->min;
+	hist->max = (val > hist->max) ? val : hist->max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_hist_now
+// Description  : Read the clock the latencies are timed with
+//
+// Inputs       : none
+// Outputs      : the time (nanoseconds on the monotonic clock)
+
+static inline uint64_t crud_hist_now( void ) {
+
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec );
+}
+
+//
+// Histogram interface
+
+void crud_hist_init( CrudHistogram *hist );
+	// Empty a histogram
+
+void crud_hist_merge( CrudHistogram *to, const CrudHistogram *from );
+	// Add the values of one histogram to another
+
+uint64_t crud_hist_lowest( uint32_t bucket );
+	// The smallest value that goes in a bucket
+
+uint64_t crud_hist_highest( uint32_t bucket );
+	// The largest value that goes in a bucket
+
+uint64_t crud_hist_percentile( const CrudHistogram *hist, double pct );
+	// The value below which (at least) pct percent of the values fall, to
+	// within the precision of the buckets (0 if empty)
+
+double crud_hist_mean( const CrudHistogram *hist );
+	// The mean of the values (0 if empty)
+
+//
+// Unit Testing
+
+int crud_hist_unit_test( void );
+	// Check the buckets and the percentiles against sorted values
+
+#endif
@@ -0,0 +1,581 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_import.c
+//  Description    : This is the implementation of the bulk import (see
+//                   crud_import.h).  The files are sized and named up front
+//                   (so a bad one stops the import before anything is
+//                   stored), then read and created largest first on the
+//                   workers, each taking the next file as it is done with
+//                   the last.  The file allocation table is read before and
+//                   written once after (on a client of its own, so the
+//                   caller's session is left alone); if a file could not be
+//                   stored the objects created are deleted and the table is
+//                   left as it was.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Project includes
+#include <crud_import.h>
+#include <crud_file_io.h>
+#include <crud_backend.h>
+#include <crud_codec.h>
+#include <crud_hist.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CRUD_IMPORT_MAX_LINE 4096
+#define CRUD_IMPORT_UNIT_TEST_DIR "crud_import_test"
+#define CRUD_IMPORT_UNIT_TEST_LIST "crud_import_test.lst"
+#define CRUD_IMPORT_UNIT_TEST_WORKERS 3
+
+//
+// Type definitions
+
+// This is a file being imported
+typedef struct {
+	char    *path;    // The local path
+	char    *name;    // The name in the filesystem (the last component of path)
+	uint32_t size;    // The size of the file
+	CrudOID  oid;     // The object created for it
+	int      created; // Flag indicating the object was created
+} CrudImportFile;
+
+// This is an import
+typedef struct {
+	CrudImportFile *files;   // The files
+	uint32_t       *order;   // The files, largest first (indexes into files)
+	uint32_t        count;   // The number of files
+	uint32_t        next;    // The next file to store
+	uint64_t        bytes;   // The bytes stored
+	int             workers; // The number of connections to store over
+	int             failed;  // Flag indicating a file was not stored
+	int             result;  // The result of the import (0 if successful)
+} CrudImportLoad;
+
+//
+// Local functions
+
+static int crud_import_add( CrudImportLoad *load, const char *path, int listed );
+static void *crud_import_table( void *arg );
+static void *crud_import_worker( void *arg );
+static int crud_import_read( const char *path, unsigned char *buf, uint32_t size );
+static int crud_import_compare( const void *a, const void *b );
+static CrudImportFile *crud_import_sorted = NULL; // The files being sorted (see crud_import_compare)
+static int crud_import_check( const char *name, uint32_t size, int file );
+
+// The sizes of the unit test files
+static const uint32_t crud_import_unit_test_sizes[] = { 0, 1, 1023, 1025, 65537, CRUD_MAX_OBJECT_SIZE };
+#define CRUD_IMPORT_UNIT_TEST_FILES (sizeof(crud_import_unit_test_sizes)/sizeof(crud_import_unit_test_sizes[0]))
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import
+// Description  : Import the files of a directory (or a list of files) into
+//                the filesystem: name and size them, store them on the
+//                workers, then add them to the file allocation table
+//
+// Inputs       : source - the directory, or the file listing the files
+//                workers - the number of connections to store over
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_import( const char *source, int workers ) {
+
+	// Local variables
+	CrudImportLoad load;
+	pthread_t table;
+	char path[CRUD_IMPORT_MAX_LINE];
+	struct dirent *entry;
+	struct stat st;
+	uint32_t i;
+	uint64_t start, nsecs;
+	DIR *dir;
+	FILE *list;
+	int ret = 0;
+
+	// Name and size the files, from the directory or the list
+	memset( &load, 0x0, sizeof(load) );
+	workers = (workers < 1) ? 1 : ((workers > CRUD_IMPORT_MAX_WORKERS) ? CRUD_IMPORT_MAX_WORKERS : workers);
+	start = crud_hist_now();
+	if ( ((load.files = calloc(CRUD_MAX_TOTAL_FILES, sizeof(CrudImportFile))) == NULL) ||
+		 ((load.order = malloc(CRUD_MAX_TOTAL_FILES*sizeof(uint32_t))) == NULL) || (stat(source, &st) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot import [%s], error: %s.", source, strerror(errno) );
+		free( load.files );
+		free( load.order );
+		return( -1 );
+	}
+	if ( S_ISDIR(st.st_mode) ) {
+		if ( (dir = opendir(source)) == NULL ) {
+			ret = -1;
+		}
+		while ( (ret == 0) && ((entry = readdir(dir)) != NULL) ) {
+			if ( entry->d_name[0] != '.' ) {
+				snprintf( path, sizeof(path), "%s/%s", source, entry->d_name );
+				ret = crud_import_add( &load, path, 0 );
+			}
+		}
+		if ( dir != NULL ) {
+			closedir( dir );
+		}
+	} else if ( (list = fopen(source, "r")) != NULL ) {
+		while ( (ret == 0) && (fgets(path, sizeof(path), list) != NULL) ) {
+			path[strcspn(path, "\r\n")] = 0x0;
+			if ( path[0] != 0x0 ) {
+				ret = crud_import_add( &load, path, 1 );
+			}
+		}
+		fclose( list );
+	} else {
+		ret = -1;
+	}
+	if ( ret ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: failure reading [%s], nothing imported", source );
+	}
+
+	// Read the table, store the files and add them to it (on a client of its own)
+	load.workers = workers;
+	if ( (ret == 0) && (pthread_create(&table, NULL, crud_import_table, &load) == 0) ) {
+		pthread_join( table, NULL );
+		ret = load.result;
+	} else if ( ret == 0 ) {
+		ret = -1;
+	}
+
+	// Log, cleanup and return
+	nsecs = crud_hist_now()-start;
+	if ( ret == 0 ) {
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_IMPORT : imported %u files (%lu bytes) from [%s] over %d connections "
+				"in %.3f secs (%.2f MB/sec)", load.count, load.bytes, source, workers, nsecs/1e9,
+				(nsecs > 0) ? load.bytes*1e3/nsecs : 0.0 );
+	}
+	for ( i=0; i<load.count; i++ ) {
+		free( load.files[i].path );
+	}
+	free( load.files );
+	free( load.order );
+	return( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_table
+// Description  : Read the file allocation table, store the files on the
+//                workers, then add them to the table (or take back the
+//                objects created), as a client of its own holding a session
+//                throughout (so a caller's session is left alone)
+//
+// Inputs       : arg - the import (the result is left in it)
+// Outputs      : NULL
+
+static void *crud_import_table( void *arg ) {
+
+	// Local variables
+	CrudImportLoad *load = arg;
+	CrudFileAllocationType *table = NULL;
+	CrudResponse res;
+	pthread_t threads[CRUD_IMPORT_MAX_WORKERS];
+	uint32_t size = CRUD_MAX_TOTAL_FILES*sizeof(CrudFileAllocationType), free_entry, i, j;
+	int started, ret = 0;
+
+	// Read the file allocation table (the names have to be new, and fit)
+	if ( ((table = malloc(size)) == NULL) || crud_backend_attach() ) {
+		free( table );
+		load->result = -1;
+		return( NULL );
+	}
+	res = crud_backend_operation( crud_codec_encode(0, CRUD_READ, size, CRUD_PRIORITY_OBJECT, 0), table );
+	if ( (res == (CrudResponse)-1) || crud_codec_result(res) || (crud_codec_length(res) != size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot read the file allocation table (not formatted?)" );
+		ret = -1;
+	}
+	for ( free_entry=0; (ret == 0) && (free_entry < CRUD_MAX_TOTAL_FILES) &&
+			strncmp(table[free_entry].filename, "empty", CRUD_MAX_PATH_LENGTH); free_entry++ ) {
+		for ( i=0; (ret == 0) && (i<load->count); i++ ) {
+			if ( strncmp(table[free_entry].filename, load->files[i].name, CRUD_MAX_PATH_LENGTH) == 0 ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD import: [%s] is already in the filesystem, nothing imported",
+						load->files[i].name );
+				ret = -1;
+			}
+		}
+	}
+	if ( (ret == 0) && (load->count > CRUD_MAX_TOTAL_FILES-free_entry) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: %u files, room for %u, nothing imported", load->count,
+				CRUD_MAX_TOTAL_FILES-free_entry );
+		ret = -1;
+	}
+
+	// Store the files on the workers, largest first
+	for ( i=0; i<load->count; i++ ) {
+		load->order[i] = i;
+	}
+	crud_import_sorted = load->files;
+	qsort( load->order, load->count, sizeof(uint32_t), crud_import_compare );
+	for ( started=0; (ret == 0) && (started < load->workers); started++ ) {
+		if ( pthread_create(&threads[started], NULL, crud_import_worker, load) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import: failure starting worker %d", started );
+			load->failed = 1;
+			break;
+		}
+	}
+	while ( started > 0 ) {
+		pthread_join( threads[--started], NULL );
+	}
+	ret |= load->failed;
+
+	// Add the files to the table, or take back the objects created
+	for ( i=0; (ret == 0) && (i<load->count); i++ ) {
+		memset( &table[free_entry+i], 0x0, sizeof(CrudFileAllocationType) );
+		strcpy( table[free_entry+i].filename, load->files[i].name );
+		table[free_entry+i].object_id = load->files[i].oid;
+		table[free_entry+i].length = load->files[i].size;
+	}
+	if ( ret == 0 ) {
+		res = crud_backend_operation( crud_codec_encode(0, CRUD_UPDATE, size, CRUD_PRIORITY_OBJECT, 0), table );
+		if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot write the file allocation table" );
+			ret = -1;
+		}
+	}
+	for ( i=0, j=0; ret && (i<load->count); i++ ) {
+		if ( load->files[i].created ) {
+			crud_backend_operation( crud_codec_encode(load->files[i].oid, CRUD_DELETE, 0, 0, 0), NULL );
+			j++;
+		}
+	}
+	if ( ret && (j > 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: %u objects created deleted, nothing imported", j );
+	}
+	if ( crud_backend_detach() ) {
+		ret = -1;
+	}
+	load->result = ret ? -1 : 0;
+	free( table );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_add
+// Description  : Add a file to an import, checking it can be stored (its
+//                size, its name and that no other file has that name)
+//
+// Inputs       : load - the import
+//                path - the local path of the file
+//                listed - flag indicating the file was listed (anything but
+//                         a regular file is refused, not skipped)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_import_add( CrudImportLoad *load, const char *path, int listed ) {
+
+	// Local variables
+	CrudImportFile *file;
+	struct stat st;
+	const char *name;
+	uint32_t i;
+
+	if ( stat(path, &st) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot import [%s], error: %s.", path, strerror(errno) );
+		return( -1 );
+	}
+	if ( !S_ISREG(st.st_mode) ) {
+		if ( listed ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import: [%s] is not a file", path );
+			return( -1 );
+		}
+		return( 0 );
+	}
+
+	// The name is the last component, it has to fit (and not be the free mark)
+	name = (strrchr(path, '/') != NULL) ? strrchr(path, '/')+1 : path;
+	if ( (name[0] == 0x0) || (strlen(name) >= CRUD_MAX_PATH_LENGTH) || (strcmp(name, "empty") == 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: [%s] cannot be named in the filesystem", path );
+		return( -1 );
+	}
+	if ( st.st_size > CRUD_MAX_OBJECT_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: [%s] is %ld bytes, larger than an object (%u bytes)", path,
+				(long)st.st_size, CRUD_MAX_OBJECT_SIZE );
+		return( -1 );
+	}
+	if ( load->count == CRUD_MAX_TOTAL_FILES ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: more than %d files", CRUD_MAX_TOTAL_FILES );
+		return( -1 );
+	}
+	for ( i=0; i<load->count; i++ ) {
+		if ( strcmp(load->files[i].name, name) == 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import: [%s] and [%s] have the same name", load->files[i].path, path );
+			return( -1 );
+		}
+	}
+
+	// Add it
+	file = &load->files[load->count];
+	if ( (file->path = strdup(path)) == NULL ) {
+		return( -1 );
+	}
+	file->name = file->path + (name-path);
+	file->size = st.st_size;
+	load->count ++;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_worker
+// Description  : Store files (the next one each time), each created at its
+//                full length in a single request, as a client of its own
+//
+// Inputs       : arg - the import
+// Outputs      : NULL
+
+static void *crud_import_worker( void *arg ) {
+
+	// Local variables
+	CrudImportLoad *load = arg;
+	CrudImportFile *file;
+	CrudResponse res;
+	unsigned char *buf;
+	uint32_t next;
+
+	if ( (buf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ) {
+		load->failed = 1;
+		return( NULL );
+	}
+	if ( crud_backend_attach() ) {
+		load->failed = 1;
+		free( buf );
+		return( NULL );
+	}
+	while ( !load->failed && ((next = __sync_fetch_and_add(&load->next, 1)) < load->count) ) {
+		file = &load->files[load->order[next]];
+		if ( crud_import_read(file->path, buf, file->size) ) {
+			load->failed = 1;
+			break;
+		}
+		res = crud_backend_operation( crud_codec_encode(0, CRUD_CREATE, file->size, 0, 0), buf );
+		if ( (res == (CrudResponse)-1) || crud_codec_result(res) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot store [%s]", file->path );
+			load->failed = 1;
+			break;
+		}
+		file->oid = crud_codec_oid( res );
+		file->created = 1;
+		__sync_fetch_and_add( &load->bytes, file->size );
+	}
+	crud_backend_detach();
+	free( buf );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_read
+// Description  : Read a file, which has to still be the size it was
+//
+// Inputs       : path - the file
+//                buf - the buffer to read into (CRUD_MAX_OBJECT_SIZE bytes)
+//                size - the size of the file
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_import_read( const char *path, unsigned char *buf, uint32_t size ) {
+
+	// Local variables
+	uint32_t got = 0;
+	ssize_t n = 1;
+	int fd;
+
+	if ( (fd = open(path, O_RDONLY)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: cannot open [%s], error: %s.", path, strerror(errno) );
+		return( -1 );
+	}
+	while ( (got <= size) && (got < CRUD_MAX_OBJECT_SIZE) && (n > 0) ) {
+		if ( ((n = read(fd, buf+got, CRUD_MAX_OBJECT_SIZE-got)) == -1) && (errno == EINTR) ) {
+			n = 1;
+		} else if ( n > 0 ) {
+			got += n;
+		}
+	}
+	close( fd );
+	if ( (n == -1) || (got != size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD import: failure reading [%s] (changed while imported?)", path );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_compare
+// Description  : Order two files, largest first (for qsort)
+//
+// Inputs       : a, b - the files (indexes into crud_import_sorted)
+// Outputs      : <0, 0, >0 as a is larger, the same as, smaller than b
+
+static int crud_import_compare( const void *a, const void *b ) {
+	uint32_t x = crud_import_sorted[*(const uint32_t *)a].size, y = crud_import_sorted[*(const uint32_t *)b].size;
+	return( (x < y) - (x > y) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_check
+// Description  : Read a unit test file back through the filesystem and check
+//                its contents
+//
+// Inputs       : name - the name of the file
+//                size - the size it should be
+//                file - the number of the file (the pattern of its contents)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_import_check( const char *name, uint32_t size, int file ) {
+
+	// Local variables
+	unsigned char *buf;
+	uint32_t i;
+	int16_t fh;
+	int32_t len;
+	int ret = 0;
+
+	if ( (buf = malloc(CRUD_MAX_OBJECT_SIZE+1)) == NULL ) {
+		return( -1 );
+	}
+	if ( ((fh = crud_open((char *)name)) == -1) || ((len = crud_read(fh, buf, CRUD_MAX_OBJECT_SIZE+1)) == -1) ||
+		 crud_close(fh) || ((uint32_t)len != size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : cannot read [%s] back", name );
+		ret = -1;
+	}
+	for ( i=0; (ret == 0) && (i<size); i++ ) {
+		if ( buf[i] != (unsigned char)('A' + (i*7+file)%26) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : [%s] is wrong at byte %u", name, i );
+			ret = -1;
+		}
+	}
+	free( buf );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_import_unit_test
+// Description  : Import a directory of files of all sizes into a filesystem
+//                holding a file already, then a list of files (one with the
+//                name of a file imported, refused, then new ones), and read
+//                them all back.  A session is held open throughout so a
+//                memory store outlives the unmounts.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_import_unit_test( void ) {
+
+	// Local variables
+	char path[CRUD_MAX_PATH_LENGTH*2], name[CRUD_MAX_PATH_LENGTH];
+	unsigned char *buf;
+	uint32_t file, i;
+	int16_t fh;
+	FILE *list;
+	int fd, ret = 0;
+
+	// Write the files (the last two to be imported from the list)
+	if ( (buf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ) {
+		return( -1 );
+	}
+	mkdir( CRUD_IMPORT_UNIT_TEST_DIR, S_IRWXU );
+	for ( file=0; (file < CRUD_IMPORT_UNIT_TEST_FILES+2) && (ret == 0); file++ ) {
+		for ( i=0; i<crud_import_unit_test_sizes[file%CRUD_IMPORT_UNIT_TEST_FILES]; i++ ) {
+			buf[i] = 'A' + (i*7+file)%26;
+		}
+		snprintf( path, sizeof(path), (file < CRUD_IMPORT_UNIT_TEST_FILES) ? "%s/import%u.dat" : "%s.%u.dat",
+				CRUD_IMPORT_UNIT_TEST_DIR, file );
+		if ( ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR)) == -1) ||
+			 (write(fd, buf, crud_import_unit_test_sizes[file%CRUD_IMPORT_UNIT_TEST_FILES]) !=
+				(ssize_t)crud_import_unit_test_sizes[file%CRUD_IMPORT_UNIT_TEST_FILES]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : cannot write [%s]", path );
+			ret = -1;
+		}
+		if ( fd != -1 ) {
+			close( fd );
+		}
+	}
+
+	// Format, with a file there already, then import the directory
+	if ( (ret == 0) && (crud_backend_attach() || crud_format() || crud_mount() ||
+		 ((fh = crud_open("existing")) == -1) || (crud_write(fh, "existing", 8) != 8) || crud_close(fh) ||
+		 crud_unmount()) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : format/mount failed" );
+		ret = -1;
+	}
+	if ( (ret == 0) && crud_import(CRUD_IMPORT_UNIT_TEST_DIR, CRUD_IMPORT_UNIT_TEST_WORKERS) ) {
+		ret = -1;
+	}
+
+	// Import a list naming a file already imported (refused), then a good one
+	for ( i=0; (ret == 0) && (i<2); i++ ) {
+		if ( (list = fopen(CRUD_IMPORT_UNIT_TEST_LIST, "w")) == NULL ) {
+			ret = -1;
+			break;
+		}
+		fprintf( list, "%s.%u.dat\n\n%s.%u.dat\n", CRUD_IMPORT_UNIT_TEST_DIR, (uint32_t)CRUD_IMPORT_UNIT_TEST_FILES,
+				CRUD_IMPORT_UNIT_TEST_DIR, (uint32_t)CRUD_IMPORT_UNIT_TEST_FILES+1 );
+		if ( i == 0 ) {
+			fprintf( list, "%s/import0.dat\n", CRUD_IMPORT_UNIT_TEST_DIR );
+		}
+		fclose( list );
+		if ( (crud_import(CRUD_IMPORT_UNIT_TEST_LIST, CRUD_IMPORT_UNIT_TEST_WORKERS) == 0) != (i == 1) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : list import %s", i ? "failed" : "not refused" );
+			ret = -1;
+		}
+	}
+
+	// Read them all back through the filesystem
+	if ( (ret == 0) && crud_mount() ) {
+		ret = -1;
+	}
+	for ( file=0; (ret == 0) && (file < CRUD_IMPORT_UNIT_TEST_FILES+2); file++ ) {
+		if ( file < CRUD_IMPORT_UNIT_TEST_FILES ) {
+			snprintf( name, sizeof(name), "import%u.dat", file );
+		} else {
+			snprintf( name, sizeof(name), "%s.%u.dat", CRUD_IMPORT_UNIT_TEST_DIR, file );
+		}
+		ret = crud_import_check( name, crud_import_unit_test_sizes[file%CRUD_IMPORT_UNIT_TEST_FILES], file );
+	}
+	if ( (ret == 0) && (((fh = crud_open("existing")) == -1) || (crud_read(fh, buf, 16) != 8) ||
+		 memcmp(buf, "existing", 8) || crud_close(fh)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_IMPORT_UNIT_TEST : file there before the import lost" );
+		ret = -1;
+	}
+	if ( (ret == 0) && crud_unmount() ) {
+		ret = -1;
+	}
+
+	// Cleanup, log and return
+	for ( file=0; file < CRUD_IMPORT_UNIT_TEST_FILES+2; file++ ) {
+		snprintf( path, sizeof(path), (file < CRUD_IMPORT_UNIT_TEST_FILES) ? "%s/import%u.dat" : "%s.%u.dat",
+				CRUD_IMPORT_UNIT_TEST_DIR, file );
+		unlink( path );
+	}
+	rmdir( CRUD_IMPORT_UNIT_TEST_DIR );
+	unlink( CRUD_IMPORT_UNIT_TEST_LIST );
+	if ( crud_backend_detach() ) {
+		ret = -1;
+	}
+	free( buf );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD import unit test completed successfully." );
+	}
+	return( ret );
+}
@@ -0,0 +1,39 @@
+#ifndef CRUD_IMPORT_INCLUDED
+#define CRUD_IMPORT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_import.h
+//  Description   : This is the interface to the bulk import, the inverse of
+//                  the extract (see crud_dump.h).  Local files are loaded
+//                  into the filesystem each as a single object created at its
+//                  full length, in parallel (each thread a client of its
+//                  own), and added to the file allocation table together
+//                  once all are stored.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Defines
+#define CRUD_IMPORT_DEFAULT_WORKERS 4 // The connections used if not told otherwise
+#define CRUD_IMPORT_MAX_WORKERS 64
+
+//
+// Import interface
+
+int crud_import( const char *source, int workers );
+	// Import the files of source into the (formatted) filesystem: the regular
+	// files of a directory (not the hidden ones), or the files listed in a
+	// file (a path a line), each named by its last path component, over
+	// workers connections.
+	// Nothing is imported if any name is already in the filesystem.
+
+//
+// Unit Testing
+
+int crud_import_unit_test( void );
+	// Import a directory and a list of files and read them back through the
+	// filesystem
+
+#endif
@@ -0,0 +1,359 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_lease.c
+//  Description   : This is the implementation of the lease table (see
+//                  crud_lease.h).  Expired leases are dropped from a bucket
+//                  whenever it is walked, so the table only grows with the
+//                  leases in use.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project Include Files
+#include <crud_lease.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_LEASE_UNIT_TEST_BUCKETS 16
+#define CRUD_LEASE_UNIT_TEST_TTL 1000
+#define CRUD_LEASE_UNIT_TEST_HOLDERS 8
+#define CRUD_LEASE_UNIT_TEST_OBJECTS 100
+#define CRUD_LEASE_UNIT_TEST_ITERATIONS 10000
+
+//
+// Local functions
+
+static uint32_t crud_lease_drop( CrudLeases *leases, uint32_t bucket, CrudOID oid, int all,
+		uint64_t writer, uint64_t now, CrudLeaseRevoker fn, void *arg );
+static void crud_lease_unit_revoker( void *arg, uint64_t holder, CrudOID oid, uint64_t expires );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_setup
+// Description  : Setup an empty table of some number of buckets, the leases
+//                granted lasting ttl
+//
+// Inputs       : leases - the table to setup
+//                size - the number of buckets (a power of 2)
+//                ttl - how long a lease lasts (usecs)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_lease_setup( CrudLeases *leases, uint32_t size, uint64_t ttl ) {
+
+	// Setup the table, then the buckets
+	memset( leases, 0x0, sizeof(CrudLeases) );
+	pthread_mutex_init( &leases->lock, NULL );
+	leases->size = size;
+	leases->ttl = ttl;
+	if ( (size == 0) || (size & (size-1)) ||
+		 ((leases->buckets = calloc(size, sizeof(CrudLease *))) == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD lease table setup failed [%u buckets]", size );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_cleanup
+// Description  : Release the table and the leases in it
+//
+// Inputs       : leases - the table
+// Outputs      : none
+
+void crud_lease_cleanup( CrudLeases *leases ) {
+
+	// Local variables
+	CrudLease *lease, *next;
+	uint32_t i;
+
+	// Free the chains, then the table
+	for ( i=0; (leases->buckets != NULL) && (i<leases->size); i++ ) {
+		for ( lease=leases->buckets[i]; lease!=NULL; lease=next ) {
+			next = lease->next;
+			free( lease );
+		}
+	}
+	free( leases->buckets );
+	pthread_mutex_destroy( &leases->lock );
+	memset( leases, 0x0, sizeof(CrudLeases) );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_now
+// Description  : The current time as the table measures it (the monotonic
+//                clock, which is not moved by changes to the system time)
+//
+// Inputs       : none
+// Outputs      : the time in usecs
+
+uint64_t crud_lease_now( void ) {
+
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_grant
+// Description  : Grant the holder a lease on the object (renewing the one it
+//                has, if any), running until now plus the table's ttl
+//
+// Inputs       : leases - the table
+//                oid - the object
+//                holder - the holder of the lease
+//                now - the current time (see crud_lease_now)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_lease_grant( CrudLeases *leases, CrudOID oid, uint64_t holder, uint64_t now ) {
+
+	// Local variables
+	uint32_t bucket = oid & (leases->size-1);
+	CrudLease *lease, **prev;
+
+	// Walk the bucket, renewing the holder's lease and dropping dead ones
+	pthread_mutex_lock( &leases->lock );
+	prev = &leases->buckets[bucket];
+	while ( (lease = *prev) != NULL ) {
+		if ( (lease->oid == oid) && (lease->holder == holder) ) {
+			lease->expires = now + leases->ttl;
+			pthread_mutex_unlock( &leases->lock );
+			return( 0 );
+		}
+		if ( lease->expires <= now ) {
+			*prev = lease->next;
+			free( lease );
+			leases->count --;
+			continue;
+		}
+		prev = &lease->next;
+	}
+
+	// None yet, add one
+	if ( (lease = malloc(sizeof(CrudLease))) == NULL ) {
+		pthread_mutex_unlock( &leases->lock );
+		logMessage( LOG_ERROR_LEVEL, "CRUD lease allocation failed [%u]", oid );
+		return( -1 );
+	}
+	lease->oid = oid;
+	lease->holder = holder;
+	lease->expires = now + leases->ttl;
+	lease->next = leases->buckets[bucket];
+	leases->buckets[bucket] = lease;
+	leases->count ++;
+	pthread_mutex_unlock( &leases->lock );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_revoke
+// Description  : Drop all of the leases on the object (the object changed),
+//                calling fn for each holder other than the writer whose
+//                lease had not run out.  fn is called with the table locked.
+//
+// Inputs       : leases - the table
+//                oid - the object
+//                writer - the holder that changed the object
+//                now - the current time (see crud_lease_now)
+//                fn - the function told of each revoked holder
+//                arg - passed to fn
+// Outputs      : the number of holders told
+
+uint32_t crud_lease_revoke( CrudLeases *leases, CrudOID oid, uint64_t writer, uint64_t now,
+		CrudLeaseRevoker fn, void *arg ) {
+
+	// Local variables
+	uint32_t told;
+
+	pthread_mutex_lock( &leases->lock );
+	told = crud_lease_drop( leases, oid & (leases->size-1), oid, 0, writer, now, fn, arg );
+	pthread_mutex_unlock( &leases->lock );
+	return( told );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_revoke_all
+// Description  : Drop every lease in the table (the store was formatted),
+//                calling fn for each one not the writer's that had not run
+//                out.  fn is called with the table locked.
+//
+// Inputs       : leases - the table
+//                writer - the holder that changed the store
+//                now - the current time (see crud_lease_now)
+//                fn - the function told of each revoked lease
+//                arg - passed to fn
+// Outputs      : the number of leases told
+
+uint32_t crud_lease_revoke_all( CrudLeases *leases, uint64_t writer, uint64_t now,
+		CrudLeaseRevoker fn, void *arg ) {
+
+	// Local variables
+	uint32_t i, told = 0;
+
+	pthread_mutex_lock( &leases->lock );
+	for ( i=0; i<leases->size; i++ ) {
+		told += crud_lease_drop( leases, i, 0, 1, writer, now, fn, arg );
+	}
+	pthread_mutex_unlock( &leases->lock );
+	return( told );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_unit_test
+// Description  : Perform a test of the lease table functionality
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_lease_unit_test( void ) {
+
+	// Local variables
+	uint64_t expires[CRUD_LEASE_UNIT_TEST_OBJECTS][CRUD_LEASE_UNIT_TEST_HOLDERS];
+	uint32_t told[CRUD_LEASE_UNIT_TEST_HOLDERS], expected, got, i, j, k;
+	CrudLeases leases;
+	uint64_t now = 1, writer;
+	CrudOID oid;
+
+	// Setup the table, check the basic cases
+	if ( crud_lease_setup(&leases, CRUD_LEASE_UNIT_TEST_BUCKETS, CRUD_LEASE_UNIT_TEST_TTL) ) {
+		return( -1 );
+	}
+	memset( told, 0x0, sizeof(told) );
+	for ( i=1; i<=3; i++ ) {
+		crud_lease_grant( &leases, 1, i, now );
+	}
+	crud_lease_grant( &leases, 1, 1, now );
+	if ( (leases.count != 3) ||
+		 (crud_lease_revoke(&leases, 1, 2, now, crud_lease_unit_revoker, told) != 2) ||
+		 (told[1] != 1) || (told[2] != 0) || (told[3] != 1) || (leases.count != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LEASE_UNIT_TEST : revoke of live leases failed." );
+		return( -1 );
+	}
+	crud_lease_grant( &leases, 2, 1, now );
+	crud_lease_grant( &leases, 2+CRUD_LEASE_UNIT_TEST_BUCKETS, 1, now );
+	now += CRUD_LEASE_UNIT_TEST_TTL;
+	crud_lease_grant( &leases, 2, 2, now );
+	if ( (leases.count != 1) ||
+		 (crud_lease_revoke(&leases, 2, 2, now, crud_lease_unit_revoker, told) != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LEASE_UNIT_TEST : expired leases not dropped." );
+		return( -1 );
+	}
+
+	// Now grant, revoke and let expire at random against a reference
+	memset( expires, 0x0, sizeof(expires) );
+	for ( i=0; i<CRUD_LEASE_UNIT_TEST_ITERATIONS; i++ ) {
+		now += getRandomValue( 0, CRUD_LEASE_UNIT_TEST_TTL/10 );
+		oid = getRandomValue( 0, CRUD_LEASE_UNIT_TEST_OBJECTS-1 );
+		writer = getRandomValue( 0, CRUD_LEASE_UNIT_TEST_HOLDERS-1 );
+		if ( getRandomValue(0, 3) ) {
+			crud_lease_grant( &leases, oid, writer, now );
+			expires[oid][writer] = now + CRUD_LEASE_UNIT_TEST_TTL;
+			continue;
+		}
+		memset( told, 0x0, sizeof(told) );
+		for ( expected=0, k=0; k<CRUD_LEASE_UNIT_TEST_HOLDERS; k++ ) {
+			expected += ((k != writer) && (expires[oid][k] > now));
+			expires[oid][k] = 0;
+		}
+		got = crud_lease_revoke( &leases, oid, writer, now, crud_lease_unit_revoker, told );
+		if ( (got != expected) || (told[writer] != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_LEASE_UNIT_TEST : revoke of %u told %u holders, expected %u.",
+					oid, got, expected );
+			return( -1 );
+		}
+	}
+	for ( expected=0, j=0; j<CRUD_LEASE_UNIT_TEST_OBJECTS; j++ ) {
+		for ( k=1; k<CRUD_LEASE_UNIT_TEST_HOLDERS; k++ ) {
+			expected += (expires[j][k] > now);
+		}
+	}
+	if ( (got = crud_lease_revoke_all(&leases, 0, now, crud_lease_unit_revoker, told)) != expected ||
+		 (leases.count != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LEASE_UNIT_TEST : revoke of all told %u holders, expected %u.",
+				got, expected );
+		return( -1 );
+	}
+
+	// Cleanup, log, return successfully
+	crud_lease_cleanup( &leases );
+	logMessage( LOG_INFO_LEVEL, "CRUD lease unit test successful." );
+	return( 0 );
+}
+
+//
+// Local Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_drop
+// Description  : Drop the leases on an object (or all of them) in a bucket,
+//                calling fn for the live ones not held by the writer.  Dead
+//                leases are dropped along the way.  The table must be locked.
+//
+// Inputs       : leases - the table
+//                bucket - the bucket to walk
+//                oid - the object
+//                all - flag indicating every lease in the bucket is dropped
+//                writer - the holder that changed the object(s)
+//                now - the current time
+//                fn - the function told of each revoked lease
+//                arg - passed to fn
+// Outputs      : the number of leases told
+
+static uint32_t crud_lease_drop( CrudLeases *leases, uint32_t bucket, CrudOID oid, int all,
+		uint64_t writer, uint64_t now, CrudLeaseRevoker fn, void *arg ) {
+
+	// Local variables
+	CrudLease *lease, **prev;
+	uint32_t told = 0;
+
+	prev = &leases->buckets[bucket];
+	while ( (lease = *prev) != NULL ) {
+		if ( (!all) && (lease->oid != oid) && (lease->expires > now) ) {
+			prev = &lease->next;
+			continue;
+		}
+		if ( ((all) || (lease->oid == oid)) && (lease->holder != writer) && (lease->expires > now) ) {
+			fn( arg, lease->holder, lease->oid, lease->expires );
+			told ++;
+		}
+		*prev = lease->next;
+		free( lease );
+		leases->count --;
+	}
+	return( told );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lease_unit_revoker
+// Description  : Count the revocations of each holder (unit test)
+//
+// Inputs       : arg - the counts
+//                holder - the holder told
+//                oid - the object
+//                expires - when the lease would have run out
+// Outputs      : none
+
+static void crud_lease_unit_revoker( void *arg, uint64_t holder, CrudOID oid, uint64_t expires ) {
+	((uint32_t *)arg)[holder] ++;
+	return;
+}
@@ -0,0 +1,80 @@
+#ifndef CRUD_LEASE_INCLUDED
+#define CRUD_LEASE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_lease.h
+//  Description   : This is the interface to the table of read leases the
+//                  server grants to caching clients.  A lease says that the
+//                  holder may use its copy of an object until the lease
+//                  expires, unless the server tells it otherwise; a change
+//                  to the object revokes the leases of the other holders,
+//                  which are then sent an invalidation (and waited on to
+//                  acknowledge it, until the lease would have run out).  The
+//                  table is shared by all of the server threads (one lock).
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <pthread.h>
+
+// Project includes
+#include <crud_driver.h>
+
+//
+// Type definitions
+
+// This is a lease on an object held by a client (connection)
+typedef struct crud_lease {
+	CrudOID            oid;     // The object leased
+	uint64_t           holder;  // The holder of the lease
+	uint64_t           expires; // When the lease runs out (usecs, see crud_lease_now)
+	struct crud_lease *next;    // The next lease in the bucket
+} CrudLease;
+
+// This is called for each holder whose lease is revoked before it ran out
+// (expires is when it would have)
+typedef void (*CrudLeaseRevoker)( void *arg, uint64_t holder, CrudOID oid, uint64_t expires );
+
+// This is the table of leases (hashed on the OID)
+typedef struct {
+	pthread_mutex_t lock;    // The lock protecting the table
+	CrudLease     **buckets; // The lease chains
+	uint32_t        size;    // The number of buckets (a power of 2)
+	uint32_t        count;   // The number of leases in the table
+	uint64_t        ttl;     // How long a lease lasts (usecs)
+} CrudLeases;
+
+//
+// Lease interface
+
+int crud_lease_setup( CrudLeases *leases, uint32_t size, uint64_t ttl );
+	// Setup an empty table of some number of buckets, leases lasting ttl
+
+void crud_lease_cleanup( CrudLeases *leases );
+	// Release the table and the leases in it
+
+uint64_t crud_lease_now( void );
+	// The current time as the table measures it (monotonic usecs)
+
+int crud_lease_grant( CrudLeases *leases, CrudOID oid, uint64_t holder, uint64_t now );
+	// Grant (or renew) the holder's lease on the object
+
+uint32_t crud_lease_revoke( CrudLeases *leases, CrudOID oid, uint64_t writer, uint64_t now,
+		CrudLeaseRevoker fn, void *arg );
+	// Drop the leases on the object, calling fn for the live ones not the writer's
+
+uint32_t crud_lease_revoke_all( CrudLeases *leases, uint64_t writer, uint64_t now,
+		CrudLeaseRevoker fn, void *arg );
+	// Drop every lease, calling fn for the live ones not the writer's
+
+//
+// Unit Testing
+
+int crud_lease_unit_test( void );
+	// Perform a test of the lease table functionality
+
+#endif
@@ -0,0 +1,1292 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_log.c
+//  Description   : This is the implementation of the log-structured
+//                  persistent object store (see crud_log.h).  A segment is a
+//                  header followed by records (a record header, then the
+//                  object contents); deletes append a record with no
+//                  contents.  Only the record headers are read on open, the
+//                  contents are read from the segments on demand.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// Project Include Files
+#include <crud_log.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_LOG_MAGIC 0x4c445243 // "CRDL"
+#define CRUD_LOG_SEGMENT_NAME "crud-%08u.seg"
+#define CRUD_LOG_PATH_SIZE (CRUD_LOG_MAX_PATH+32)
+#define CRUD_LOG_RECORD_SIZE(len) ((uint32_t)sizeof(CrudLogRecord)+(len))
+#define CRUD_LOG_UNIT_TEST_DIR "crud_log_unit_test.d"
+#define CRUD_LOG_UNIT_TEST_SEGMENT 0x10000
+#define CRUD_LOG_UNIT_TEST_OBJECTS 64
+#define CRUD_LOG_UNIT_TEST_ITERATIONS 10000
+#define CRUD_LOG_UNIT_TEST_MAX_SIZE 4096
+
+//
+// Type definitions
+
+// These are the record types
+typedef enum {
+	CRUD_LOG_PUT    = 0, // The contents of an object
+	CRUD_LOG_DELETE = 1, // The object was deleted (no contents)
+} CRUD_LOG_RECORD_TYPES;
+
+// This is the on-disk header at the start of each segment
+typedef struct {
+	uint32_t magic; // The log magic number
+	uint32_t id;    // The segment number
+	CrudOID  high;  // The highest OID written before the segment
+} CrudLogHeader;
+
+// This is the on-disk header of each record
+typedef struct {
+	uint32_t magic;  // The log magic number
+	CrudOID  oid;    // The object identifier
+	uint32_t length; // The length of the contents following the header
+	uint8_t  flags;  // The object flags
+	uint8_t  type;   // The record type (CRUD_LOG_RECORD_TYPES)
+	uint16_t unused; // Padding (zero)
+} CrudLogRecord;
+
+//
+// Local functions
+
+static void crud_log_path( CrudLog *log, uint32_t id, char *path );
+static int crud_log_grow( CrudLog *log );
+static CrudLogSegment * crud_log_segment( CrudLog *log, uint32_t id );
+static CrudLogSegment * crud_log_new_segment( CrudLog *log );
+static void crud_log_remove_segment( CrudLog *log, uint32_t id );
+static void crud_log_unpin( CrudLog *log, uint32_t id );
+static int crud_log_sync( CrudLog *log, uint32_t id );
+static int crud_log_sync_dir( CrudLog *log );
+static int crud_log_scan( CrudLog *log, CrudLogSegment *seg );
+static int crud_log_append( CrudLog *log, CrudLogRecord *rec, void *buf, uint32_t *segment, uint32_t *offset );
+static int crud_log_apply( CrudLog *log, CrudLogRecord *rec, uint32_t segment, uint32_t offset, uint64_t version );
+static int crud_log_victim( CrudLog *log );
+static int crud_log_compact_segment( CrudLog *log, uint32_t id );
+static void * crud_log_compactor( void *arg );
+static void crud_log_clear( CrudLog *log );
+static int crud_log_compare( const void *a, const void *b );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_setup
+// Description  : Setup (but do not open) a log kept in a directory
+//
+// Inputs       : log - the log
+//                dir - the directory holding the segment files
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_setup( CrudLog *log, const char *dir ) {
+
+	// Check the directory name fits
+	if ( strlen(dir) >= CRUD_LOG_MAX_PATH ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD log directory name too long [%s]", dir );
+		return( -1 );
+	}
+
+	// Start closed, with the default segment size
+	memset( log, 0x0, sizeof(CrudLog) );
+	strncpy( log->dir, dir, CRUD_LOG_MAX_PATH-1 );
+	log->segment_size = CRUD_LOG_SEGMENT_SIZE;
+	pthread_mutex_init( &log->lock, NULL );
+	pthread_cond_init( &log->wake, NULL );
+	pthread_cond_init( &log->unpinned, NULL );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_open
+// Description  : Open the log: find the segments, rebuild the index from the
+//                record headers (oldest segment first, so the latest record
+//                of each object wins), and start the compactor
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_open( CrudLog *log ) {
+
+	// Local variables
+	char name[64];
+	struct dirent *ent;
+	DIR *dir;
+	uint32_t id, i;
+
+	// Make sure the directory is there, start empty
+	if ( (mkdir(log->dir, S_IRWXU) == -1) && (errno != EEXIST) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure creating CRUD log directory [%s], error=[%s]",
+				log->dir, strerror(errno) );
+		return( -1 );
+	}
+	if ( (dir = opendir(log->dir)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening CRUD log directory [%s], error=[%s]",
+				log->dir, strerror(errno) );
+		return( -1 );
+	}
+	log->count = log->next_id = log->high = 0;
+	log->appended = log->copied = log->reclaimed = 0;
+	log->versions = first_crud_version();
+	if ( initHashTable(&log->index, CRUD_LOG_HASH_BITS) ) {
+		closedir( dir );
+		return( -1 );
+	}
+
+	// Find the segment files, in the order they were written
+	while ( (ent = readdir(dir)) != NULL ) {
+		if ( sscanf(ent->d_name, "crud-%u.seg", &id) != 1 ) {
+			continue;
+		}
+		snprintf( name, sizeof(name), CRUD_LOG_SEGMENT_NAME, id );
+		if ( strcmp(name, ent->d_name) ) {
+			continue;
+		}
+		if ( crud_log_grow(log) ) {
+			closedir( dir );
+			crud_log_clear( log );
+			return( -1 );
+		}
+		memset( &log->segments[log->count], 0x0, sizeof(CrudLogSegment) );
+		log->segments[log->count].id = id;
+		log->segments[log->count].fd = -1;
+		log->count ++;
+	}
+	closedir( dir );
+	qsort( log->segments, log->count, sizeof(CrudLogSegment), crud_log_compare );
+
+	// Rebuild the index from each segment in turn
+	for ( i=0; i<log->count; i++ ) {
+		if ( crud_log_scan(log, &log->segments[i]) ) {
+			crud_log_clear( log );
+			return( -1 );
+		}
+	}
+	log->next_id = (log->count > 0) ? log->segments[log->count-1].id+1 : 0;
+
+	// Appends go to the last segment, unless it is full (or there is none)
+	if ( ((log->count == 0) || (log->segments[log->count-1].size >= log->segment_size)) &&
+		 (crud_log_new_segment(log) == NULL) ) {
+		crud_log_clear( log );
+		return( -1 );
+	}
+
+	// Start the compactor (there may already be work for it)
+	log->shutdown = 0;
+	if ( pthread_create(&log->compactor, NULL, crud_log_compactor, log) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD log compactor create failed." );
+		crud_log_clear( log );
+		return( -1 );
+	}
+	log->open = 1;
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD log opened [%s, %u segments, %u objects, high OID %u]",
+			log->dir, log->count, log->index.elements, log->high );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_close
+// Description  : Stop the compactor, flush the active segment and close the
+//                log
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_close( CrudLog *log ) {
+
+	// Local variables
+	int ret = 0;
+
+	// Nothing to do if not open
+	if ( !log->open ) {
+		return( 0 );
+	}
+
+	// Stop the compactor, wait for it
+	pthread_mutex_lock( &log->lock );
+	log->shutdown = 1;
+	pthread_cond_broadcast( &log->wake );
+	pthread_mutex_unlock( &log->lock );
+	pthread_join( log->compactor, NULL );
+
+	// Make sure the appends are on disk, then release everything
+	if ( fdatasync(log->segments[log->count-1].fd) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure flushing CRUD log [%s], error=[%s]",
+				log->dir, strerror(errno) );
+		ret = -1;
+	}
+	crud_log_clear( log );
+	log->open = 0;
+
+	// Log, return
+	logMessage( LOG_INFO_LEVEL, "CRUD log closed [%s]", log->dir );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_format
+// Description  : Remove every object (and segment) from the log
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_format( CrudLog *log ) {
+
+	// Local variables
+	CrudLogEntry *entry;
+	HtIterator it;
+	int ret = 0;
+
+	// Remove the segments and the index entries
+	pthread_mutex_lock( &log->lock );
+	while ( log->count > 0 ) {
+		crud_log_remove_segment( log, log->segments[0].id );
+	}
+	initHashTableIterator( &log->index, &it );
+	while ( (entry = iterateHashTable(&it)) != NULL ) {
+		free( entry );
+	}
+	cleanupHashTable( &log->index );
+	log->high = 0;
+
+	// Start over with an empty segment
+	if ( initHashTable(&log->index, CRUD_LOG_HASH_BITS) || (crud_log_new_segment(log) == NULL) ) {
+		ret = -1;
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_put
+// Description  : Write the (new) contents of an object
+//
+// Inputs       : log - the log
+//                oid - the object identifier
+//                flags - the object flags
+//                buf - the contents
+//                length - the length of the contents
+//                version - the new version of the object (returned, may be NULL)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_put( CrudLog *log, CrudOID oid, uint8_t flags, void *buf, uint32_t length, uint64_t *version ) {
+
+	// Local variables
+	CrudLogRecord rec;
+	uint32_t segment, offset;
+	int ret;
+
+	// Append the record, then point the index at it
+	memset( &rec, 0x0, sizeof(rec) );
+	rec.oid = oid;
+	rec.length = length;
+	rec.flags = flags;
+	rec.type = CRUD_LOG_PUT;
+	pthread_mutex_lock( &log->lock );
+	ret = crud_log_append( log, &rec, buf, &segment, &offset );
+	if ( ret == 0 ) {
+		ret = crud_log_apply( log, &rec, segment, offset, ++log->versions );
+		log->appended += CRUD_LOG_RECORD_SIZE(length);
+		if ( version != NULL ) {
+			*version = log->versions;
+		}
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_get
+// Description  : Read the contents of an object into a buffer.  The read is
+//                done with the lock released (other requests are not held up
+//                behind a large object), the segment is pinned until it is
+//                done.
+//
+// Inputs       : log - the log
+//                oid - the object identifier
+//                buf - the buffer to read into
+//                size - the size of the buffer
+//                length - the length of the object (returned)
+//                flags - the object flags (returned)
+//                version - the version of the object (returned, may be NULL)
+// Outputs      : 0 if successful, -1 if failure (not found, or too large)
+
+int crud_log_get( CrudLog *log, CrudOID oid, void *buf, uint32_t size, uint32_t *length, uint8_t *flags,
+		uint64_t *version ) {
+
+	// Local variables
+	CrudLogEntry *entry;
+	CrudLogSegment *seg;
+	uint32_t segment, offset;
+	int fd = -1, ret = -1;
+
+	// Find the record, pin the segment holding it
+	pthread_mutex_lock( &log->lock );
+	if ( ((entry = findValueInHashTable(&log->index, oid)) != NULL) &&
+		 ((seg = crud_log_segment(log, entry->segment)) != NULL) ) {
+		*length = entry->length;
+		*flags = entry->flags;
+		if ( version != NULL ) {
+			*version = entry->version;
+		}
+		if ( entry->length > size ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD log read buffer too small [OID %u, %u<%u]",
+					oid, size, entry->length );
+		} else {
+			seg->readers ++;
+			fd = seg->fd;
+			segment = entry->segment;
+			offset = entry->offset+sizeof(CrudLogRecord);
+		}
+	}
+	pthread_mutex_unlock( &log->lock );
+
+	// Read the contents from the segment (records are never overwritten), unpin it
+	if ( fd != -1 ) {
+		if ( pread(fd, buf, *length, offset) != *length ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure reading CRUD log segment [%u], error=[%s]",
+					segment, strerror(errno) );
+		} else {
+			ret = 0;
+		}
+		pthread_mutex_lock( &log->lock );
+		crud_log_unpin( log, segment );
+		pthread_mutex_unlock( &log->lock );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_lookup
+// Description  : Find the length, flags and version of an object
+//
+// Inputs       : log - the log
+//                oid - the object identifier
+//                length - the length of the object (returned, may be NULL)
+//                flags - the object flags (returned, may be NULL)
+//                version - the version of the object (returned, may be NULL)
+// Outputs      : 0 if found, -1 if not
+
+int crud_log_lookup( CrudLog *log, CrudOID oid, uint32_t *length, uint8_t *flags, uint64_t *version ) {
+
+	// Local variables
+	CrudLogEntry *entry;
+
+	// Look the object up in the index
+	pthread_mutex_lock( &log->lock );
+	if ( (entry = findValueInHashTable(&log->index, oid)) != NULL ) {
+		if ( length != NULL ) {
+			*length = entry->length;
+		}
+		if ( flags != NULL ) {
+			*flags = entry->flags;
+		}
+		if ( version != NULL ) {
+			*version = entry->version;
+		}
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( (entry == NULL) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_delete
+// Description  : Remove an object (appending a delete record, so the object
+//                stays deleted when the index is rebuilt)
+//
+// Inputs       : log - the log
+//                oid - the object identifier
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_delete( CrudLog *log, CrudOID oid ) {
+
+	// Local variables
+	CrudLogRecord rec;
+	uint32_t segment, offset;
+	int ret = -1;
+
+	// Append the delete record if there is an object to delete
+	memset( &rec, 0x0, sizeof(rec) );
+	rec.oid = oid;
+	rec.type = CRUD_LOG_DELETE;
+	pthread_mutex_lock( &log->lock );
+	if ( (findValueInHashTable(&log->index, oid) != NULL) &&
+		 (crud_log_append(log, &rec, NULL, &segment, &offset) == 0) ) {
+		ret = crud_log_apply( log, &rec, segment, offset, 0 );
+		log->appended += CRUD_LOG_RECORD_SIZE(0);
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_compact
+// Description  : Compact every segment the compactor would, now
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_compact( CrudLog *log ) {
+
+	// Local variables
+	int victim, ret = 0;
+
+	// Keep going until no sealed segment is worth compacting
+	pthread_mutex_lock( &log->lock );
+	while ( (ret == 0) && ((victim = crud_log_victim(log)) != -1) ) {
+		ret = crud_log_compact_segment( log, log->segments[victim].id );
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_report
+// Description  : Log the segment statistics: the size and live bytes of each
+//                segment, and the bytes appended, copied and reclaimed
+//
+// Inputs       : log - the log
+// Outputs      : none
+
+void crud_log_report( CrudLog *log ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+	uint64_t size = 0, live = 0;
+	uint32_t i;
+
+	// Totals first, then each segment
+	pthread_mutex_lock( &log->lock );
+	for ( i=0; i<log->count; i++ ) {
+		size += log->segments[i].size;
+		live += log->segments[i].live;
+	}
+	logMessage( LOG_INFO_LEVEL, "CRUD log [%s]: %u objects, %u segments, %llu bytes (%llu live), "
+			"%llu appended, %llu copied, %llu reclaimed", log->dir, log->index.elements, log->count,
+			(unsigned long long)size, (unsigned long long)live, (unsigned long long)log->appended,
+			(unsigned long long)log->copied, (unsigned long long)log->reclaimed );
+	for ( i=0; i<log->count; i++ ) {
+		seg = &log->segments[i];
+		logMessage( LOG_INFO_LEVEL, "CRUD log [%s]:   segment %u : %u bytes, %u live (%.1f%%)%s",
+				log->dir, seg->id, seg->size, seg->live, 100.0*seg->live/seg->size,
+				(i == log->count-1) ? " active" : "" );
+	}
+	pthread_mutex_unlock( &log->lock );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_unit_test
+// Description  : Perform a test of the log-structured store: random
+//                puts/deletes against a mirror (with small segments so the
+//                compactor is busy, which must not change the versions), then
+//                reopen and check the index (and that the versions are new)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_log_unit_test( void ) {
+
+	// Local variables
+	CrudLog log;
+	CrudOID oids[CRUD_LOG_UNIT_TEST_OBJECTS], next = 1;
+	uint32_t lengths[CRUD_LOG_UNIT_TEST_OBJECTS], length, i;
+	uint64_t versions[CRUD_LOG_UNIT_TEST_OBJECTS], version, last;
+	char *mirror[CRUD_LOG_UNIT_TEST_OBJECTS], *tbuf, path[CRUD_LOG_PATH_SIZE];
+	uint8_t flags;
+	int j;
+
+	// Start with an empty log (no object has an OID yet)
+	memset( mirror, 0x0, sizeof(mirror) );
+	memset( oids, 0xff, sizeof(oids) );
+	tbuf = malloc( CRUD_LOG_UNIT_TEST_MAX_SIZE );
+	crud_log_setup( &log, CRUD_LOG_UNIT_TEST_DIR );
+	log.segment_size = CRUD_LOG_UNIT_TEST_SEGMENT;
+	if ( crud_log_open(&log) || crud_log_format(&log) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : open failed." );
+		return( -1 );
+	}
+
+	// Do a bunch of random operations (object 0 is re-created as OID 0)
+	for ( i=0; i<CRUD_LOG_UNIT_TEST_ITERATIONS; i++ ) {
+		j = getRandomValue( 0, CRUD_LOG_UNIT_TEST_OBJECTS-1 );
+
+		if ( mirror[j] == NULL ) {
+
+			// Create a new object with random contents
+			oids[j] = (j == 0) ? 0 : next++;
+			lengths[j] = getRandomValue( 0, CRUD_LOG_UNIT_TEST_MAX_SIZE );
+			mirror[j] = malloc( lengths[j]+1 );
+			memset( mirror[j], getRandomValue(0, 0xff), lengths[j] );
+			if ( crud_log_put(&log, oids[j], (j == 0), mirror[j], lengths[j], &versions[j]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : put failed [%u].", oids[j] );
+				return( -1 );
+			}
+
+		} else {
+
+			// Read the object back and compare to the mirror
+			if ( crud_log_get(&log, oids[j], tbuf, CRUD_LOG_UNIT_TEST_MAX_SIZE, &length, &flags, &version) ||
+				 (length != lengths[j]) || (flags != (j == 0)) || memcmp(tbuf, mirror[j], length) ||
+				 (version != versions[j]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : get failed [%u].", oids[j] );
+				return( -1 );
+			}
+
+			// Now either update (a newer version) or delete it
+			if ( getRandomValue(0, 1) ) {
+				lengths[j] = getRandomValue( 0, CRUD_LOG_UNIT_TEST_MAX_SIZE );
+				mirror[j] = realloc( mirror[j], lengths[j]+1 );
+				memset( mirror[j], getRandomValue(0, 0xff), lengths[j] );
+				if ( crud_log_put(&log, oids[j], (j == 0), mirror[j], lengths[j], &version) ||
+					 (version <= versions[j]) ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : update failed [%u].", oids[j] );
+					return( -1 );
+				}
+				versions[j] = version;
+			} else {
+				if ( crud_log_delete(&log, oids[j]) ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : delete failed [%u].", oids[j] );
+					return( -1 );
+				}
+				free( mirror[j] );
+				mirror[j] = NULL;
+			}
+		}
+	}
+
+	// Finish the compaction, no sealed segment should be left mostly dead
+	if ( crud_log_compact(&log) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : compaction failed." );
+		return( -1 );
+	}
+	pthread_mutex_lock( &log.lock );
+	for ( i=0; i+1<log.count; i++ ) {
+		if ( (uint64_t)log.segments[i].live*100 < (uint64_t)log.segments[i].size*CRUD_LOG_COMPACT_LIVE ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : segment not compacted [%u].", log.segments[i].id );
+			pthread_mutex_unlock( &log.lock );
+			return( -1 );
+		}
+	}
+	pthread_mutex_unlock( &log.lock );
+	if ( log.reclaimed == 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : nothing reclaimed." );
+		return( -1 );
+	}
+	crud_log_report( &log );
+
+	// Reopen the log, the objects (and deletes) must come back from the
+	// segments, with versions not handed out before
+	last = log.versions;
+	if ( crud_log_close(&log) || crud_log_open(&log) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : reopen failed." );
+		return( -1 );
+	}
+	if ( log.high != next-1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : bad high OID [%u != %u].", log.high, next-1 );
+		return( -1 );
+	}
+	for ( j=0; j<CRUD_LOG_UNIT_TEST_OBJECTS; j++ ) {
+		if ( mirror[j] != NULL ) {
+			if ( crud_log_get(&log, oids[j], tbuf, CRUD_LOG_UNIT_TEST_MAX_SIZE, &length, &flags, &version) ||
+				 (length != lengths[j]) || memcmp(tbuf, mirror[j], length) || (version <= last) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : get after reopen failed [%u].", oids[j] );
+				return( -1 );
+			}
+		} else if ( (oids[j] != (CrudOID)-1) && (crud_log_lookup(&log, oids[j], NULL, NULL, NULL) == 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_LOG_UNIT_TEST : deleted object back after reopen [%u].", oids[j] );
+			return( -1 );
+		}
+	}
+
+	// Cleanup the objects and the log (format leaves one empty segment), return successfully
+	for ( j=0; j<CRUD_LOG_UNIT_TEST_OBJECTS; j++ ) {
+		free( mirror[j] );
+	}
+	free( tbuf );
+	crud_log_format( &log );
+	crud_log_path( &log, log.segments[0].id, path );
+	crud_log_close( &log );
+	unlink( path );
+	rmdir( CRUD_LOG_UNIT_TEST_DIR );
+	logMessage( LOG_INFO_LEVEL, "CRUD log unit test successful." );
+	return( 0 );
+}
+
+//
+// Local Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_path
+// Description  : Build the path of a segment file
+//
+// Inputs       : log - the log
+//                id - the segment number
+//                path - the path (returned, CRUD_LOG_PATH_SIZE bytes)
+// Outputs      : none
+
+static void crud_log_path( CrudLog *log, uint32_t id, char *path ) {
+	snprintf( path, CRUD_LOG_PATH_SIZE, "%s/" CRUD_LOG_SEGMENT_NAME, log->dir, id );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_grow
+// Description  : Make sure there is room for another segment in the array
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_grow( CrudLog *log ) {
+
+	// Local variables
+	CrudLogSegment *segments;
+	uint32_t capacity;
+
+	// Double the array when full
+	if ( log->count == log->capacity ) {
+		capacity = (log->capacity == 0) ? 16 : log->capacity*2;
+		if ( (segments = realloc(log->segments, capacity*sizeof(CrudLogSegment))) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD log segment allocation failed [%u]", capacity );
+			return( -1 );
+		}
+		log->segments = segments;
+		log->capacity = capacity;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_segment
+// Description  : Find a segment by number (the array is in segment order)
+//
+// Inputs       : log - the log
+//                id - the segment number
+// Outputs      : the segment, NULL if it is gone
+
+static CrudLogSegment * crud_log_segment( CrudLog *log, uint32_t id ) {
+
+	// Local variables
+	uint32_t lo = 0, hi = log->count, mid;
+
+	// Binary search for the number
+	while ( lo < hi ) {
+		mid = (lo+hi)/2;
+		if ( log->segments[mid].id < id ) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	return( ((lo < log->count) && (log->segments[lo].id == id)) ? &log->segments[lo] : NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_new_segment
+// Description  : Create a new (active) segment at the end of the log.  Note
+//                that this may move the segment array.
+//
+// Inputs       : log - the log
+// Outputs      : the segment, NULL if failure
+
+static CrudLogSegment * crud_log_new_segment( CrudLog *log ) {
+
+	// Local variables
+	char path[CRUD_LOG_PATH_SIZE];
+	CrudLogSegment *seg;
+	CrudLogHeader hdr;
+	int fd;
+
+	// Create the file and write the header
+	if ( crud_log_grow(log) ) {
+		return( NULL );
+	}
+	crud_log_path( log, log->next_id, path );
+	if ( (fd = open(path, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure creating CRUD log segment [%s], error=[%s]",
+				path, strerror(errno) );
+		return( NULL );
+	}
+	memset( &hdr, 0x0, sizeof(hdr) );
+	hdr.magic = CRUD_LOG_MAGIC;
+	hdr.id = log->next_id;
+	hdr.high = log->high;
+	if ( write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD log segment [%s], error=[%s]",
+				path, strerror(errno) );
+		close( fd );
+		unlink( path );
+		return( NULL );
+	}
+
+	// Make sure the file is still there after a crash
+	if ( crud_log_sync_dir(log) ) {
+		close( fd );
+		unlink( path );
+		return( NULL );
+	}
+
+	// Add it to the end of the array
+	seg = &log->segments[log->count++];
+	seg->id = log->next_id++;
+	seg->fd = fd;
+	seg->size = sizeof(CrudLogHeader);
+	seg->live = 0;
+	seg->readers = 0;
+	return( seg );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_remove_segment
+// Description  : Close and remove a segment file (the directory is synced,
+//                so the segment does not come back after a crash), once the
+//                reads in it are done
+//
+// Inputs       : log - the log (locked)
+//                id - the segment number
+// Outputs      : none
+
+static void crud_log_remove_segment( CrudLog *log, uint32_t id ) {
+
+	// Local variables
+	char path[CRUD_LOG_PATH_SIZE];
+	CrudLogSegment *seg;
+	uint32_t i;
+
+	// Wait for the segment to be unpinned, remove the file, then close up the array
+	while ( ((seg = crud_log_segment(log, id)) != NULL) && (seg->readers > 0) ) {
+		pthread_cond_wait( &log->unpinned, &log->lock );
+	}
+	if ( seg == NULL ) {
+		return;
+	}
+	close( seg->fd );
+	crud_log_path( log, id, path );
+	if ( unlink(path) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure removing CRUD log segment [%s], error=[%s]",
+				path, strerror(errno) );
+	}
+	crud_log_sync_dir( log );
+	i = seg - log->segments;
+	memmove( &log->segments[i], &log->segments[i+1], (log->count-i-1)*sizeof(CrudLogSegment) );
+	log->count --;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_unpin
+// Description  : Finish a read of a pinned segment
+//
+// Inputs       : log - the log (locked)
+//                id - the segment number
+// Outputs      : none
+
+static void crud_log_unpin( CrudLog *log, uint32_t id ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+
+	// A pinned segment is still there, wake anyone waiting to remove it
+	if ( ((seg = crud_log_segment(log, id)) != NULL) && (--seg->readers == 0) ) {
+		pthread_cond_broadcast( &log->unpinned );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_sync
+// Description  : Flush a segment and every segment after it to disk (each
+//                is pinned, and the lock released, while it is flushed)
+//
+// Inputs       : log - the log (locked)
+//                id - the first segment number to flush
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_sync( CrudLog *log, uint32_t id ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+	uint32_t last = log->next_id;
+	int fd, ret = 0;
+
+	// Flush the segments up to the active one
+	for ( ; (ret == 0) && (id<last); id++ ) {
+		if ( (seg = crud_log_segment(log, id)) == NULL ) {
+			continue;
+		}
+		seg->readers ++;
+		fd = seg->fd;
+		pthread_mutex_unlock( &log->lock );
+		if ( fdatasync(fd) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure flushing CRUD log segment [%u], error=[%s]",
+					id, strerror(errno) );
+			ret = -1;
+		}
+		pthread_mutex_lock( &log->lock );
+		crud_log_unpin( log, id );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_sync_dir
+// Description  : Flush the log directory to disk (after a segment file is
+//                created or removed)
+//
+// Inputs       : log - the log
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_sync_dir( CrudLog *log ) {
+
+	// Local variables
+	int fd, ret = 0;
+
+	// Open the directory and sync it
+	if ( ((fd = open(log->dir, O_RDONLY|O_DIRECTORY)) == -1) || (fsync(fd) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure flushing CRUD log directory [%s], error=[%s]",
+				log->dir, strerror(errno) );
+		ret = -1;
+	}
+	if ( fd != -1 ) {
+		close( fd );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_scan
+// Description  : Open a segment and add its records to the index, reading
+//                only the record headers.  A torn record at the end (from a
+//                crash in the middle of an append) is cut off.
+//
+// Inputs       : log - the log
+//                seg - the segment
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_scan( CrudLog *log, CrudLogSegment *seg ) {
+
+	// Local variables
+	char path[CRUD_LOG_PATH_SIZE];
+	CrudLogHeader hdr;
+	CrudLogRecord rec;
+	struct stat st;
+	uint32_t offset;
+
+	// Open the file, check the header
+	crud_log_path( log, seg->id, path );
+	if ( ((seg->fd = open(path, O_RDWR)) == -1) || (fstat(seg->fd, &st) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening CRUD log segment [%s], error=[%s]",
+				path, strerror(errno) );
+		return( -1 );
+	}
+	if ( (pread(seg->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+		 (hdr.magic != CRUD_LOG_MAGIC) || (hdr.id != seg->id) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad CRUD log segment header [%s]", path );
+		return( -1 );
+	}
+	if ( hdr.high > log->high ) {
+		log->high = hdr.high;
+	}
+
+	// Walk the record headers, skipping over the contents
+	offset = seg->size = sizeof(CrudLogHeader);
+	seg->live = 0;
+	while ( offset+sizeof(CrudLogRecord) <= st.st_size ) {
+		if ( (pread(seg->fd, &rec, sizeof(rec), offset) != sizeof(rec)) ||
+			 (rec.magic != CRUD_LOG_MAGIC) || (rec.type > CRUD_LOG_DELETE) ||
+			 (rec.length > CRUD_MAX_V2_OBJECT_SIZE) ||
+			 (offset+CRUD_LOG_RECORD_SIZE(rec.length) > st.st_size) ) {
+			break;
+		}
+		seg->size = offset+CRUD_LOG_RECORD_SIZE(rec.length);
+		if ( crud_log_apply(log, &rec, seg->id, offset, 0) ) {
+			return( -1 );
+		}
+		offset = seg->size;
+	}
+	if ( offset < st.st_size ) {
+		logMessage( LOG_WARNING_LEVEL, "CRUD log segment [%s] truncated at %u bytes (was %lu)",
+				path, offset, (unsigned long)st.st_size );
+		if ( ftruncate(seg->fd, offset) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure truncating CRUD log segment [%s], error=[%s]",
+					path, strerror(errno) );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_append
+// Description  : Append a record (and its contents) to the active segment,
+//                sealing it and starting a new one if the record does not fit
+//
+// Inputs       : log - the log (locked)
+//                rec - the record header
+//                buf - the contents (rec->length bytes)
+//                segment - the segment written to (returned)
+//                offset - the offset of the record (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_append( CrudLog *log, CrudLogRecord *rec, void *buf, uint32_t *segment, uint32_t *offset ) {
+
+	// Local variables
+	CrudLogSegment *seg = &log->segments[log->count-1];
+	uint32_t size = CRUD_LOG_RECORD_SIZE(rec->length);
+	struct iovec iov[2];
+
+	// Seal the segment if the record will not fit (an empty segment takes anything)
+	if ( (seg->size+size > log->segment_size) && (seg->size > sizeof(CrudLogHeader)) ) {
+		if ( (seg = crud_log_new_segment(log)) == NULL ) {
+			return( -1 );
+		}
+		pthread_cond_signal( &log->wake );
+	}
+
+	// Write the header and contents at the end of the segment
+	rec->magic = CRUD_LOG_MAGIC;
+	iov[0].iov_base = rec;
+	iov[0].iov_len = sizeof(CrudLogRecord);
+	iov[1].iov_base = buf;
+	iov[1].iov_len = rec->length;
+	if ( pwritev(seg->fd, iov, (rec->length > 0) ? 2 : 1, seg->size) != size ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure writing CRUD log segment [%u], error=[%s]",
+				seg->id, strerror(errno) );
+		return( -1 );
+	}
+	*segment = seg->id;
+	*offset = seg->size;
+	seg->size += size;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_apply
+// Description  : Point the index at a new record (or drop the object for a
+//                delete), moving the live bytes from the object's old record
+//                to the new one.  A delete record stays live until it is
+//                compacted, as it may hide older records of the object.
+//
+// Inputs       : log - the log (locked)
+//                rec - the record header
+//                segment - the segment holding the record
+//                offset - the offset of the record
+//                version - the new version of the object (0 to keep the one
+//                          it has, objects new to the index get the next one)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_log_apply( CrudLog *log, CrudLogRecord *rec, uint32_t segment, uint32_t offset, uint64_t version ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+	CrudLogEntry *entry;
+
+	// The new record is live
+	if ( (seg = crud_log_segment(log, segment)) != NULL ) {
+		seg->live += CRUD_LOG_RECORD_SIZE(rec->length);
+	}
+	if ( rec->oid > log->high ) {
+		log->high = rec->oid;
+	}
+
+	// The old one is not (the compactor wants to hear if its segment is now mostly dead)
+	if ( (entry = findValueInHashTable(&log->index, rec->oid)) != NULL ) {
+		if ( (seg = crud_log_segment(log, entry->segment)) != NULL ) {
+			seg->live -= CRUD_LOG_RECORD_SIZE(entry->length);
+			if ( (seg != &log->segments[log->count-1]) &&
+				 ((uint64_t)seg->live*100 < (uint64_t)seg->size*CRUD_LOG_COMPACT_LIVE) ) {
+				pthread_cond_signal( &log->wake );
+			}
+		}
+	}
+
+	// Drop the object, or point the index at the new record
+	if ( rec->type == CRUD_LOG_DELETE ) {
+		if ( entry != NULL ) {
+			deleteValueFromHashTable( &log->index, rec->oid );
+			free( entry );
+		}
+		return( 0 );
+	}
+	if ( entry == NULL ) {
+		if ( ((entry = malloc(sizeof(CrudLogEntry))) == NULL) ||
+			 (insertValueInHashTable(&log->index, rec->oid, entry)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD log index insert failed [OID %u]", rec->oid );
+			free( entry );
+			return( -1 );
+		}
+		entry->version = (version != 0) ? version : ++log->versions;
+	} else if ( version != 0 ) {
+		entry->version = version;
+	}
+	entry->segment = segment;
+	entry->offset = offset;
+	entry->length = rec->length;
+	entry->flags = rec->flags;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_victim
+// Description  : Pick the sealed segment to compact next: the one with the
+//                smallest live fraction, if that is below the threshold
+//
+// Inputs       : log - the log (locked)
+// Outputs      : the index of the segment, -1 if none
+
+static int crud_log_victim( CrudLog *log ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+	int victim = -1;
+	uint32_t i;
+
+	// Look over every segment but the active one
+	for ( i=0; i+1<log->count; i++ ) {
+		seg = &log->segments[i];
+		if ( ((uint64_t)seg->live*100 < (uint64_t)seg->size*CRUD_LOG_COMPACT_LIVE) &&
+			 ((victim == -1) || ((uint64_t)seg->live*log->segments[victim].size <
+								 (uint64_t)log->segments[victim].live*seg->size)) ) {
+			victim = i;
+		}
+	}
+	return( victim );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_compact_segment
+// Description  : Copy the live records of a segment to the end of the log,
+//                then remove it.  The lock is released between records (and
+//                while the contents are read) so requests are not held up,
+//                so the segment may be removed (by a format) underneath us.
+//                Delete records are dropped when nothing older can need
+//                them: in the oldest segment, or if the object has been
+//                created again since.  The copies are flushed to disk before
+//                the segment is removed.
+//
+// Inputs       : log - the log (locked)
+//                id - the segment number
+// Outputs      : 0 if successful, -1 if failure (or shutting down)
+
+static int crud_log_compact_segment( CrudLog *log, uint32_t id ) {
+
+	// Local variables
+	CrudLogSegment *seg;
+	CrudLogEntry *entry;
+	CrudLogRecord rec;
+	uint32_t offset = sizeof(CrudLogHeader), size, segment, to, capacity = CRUD_MAX_OBJECT_SIZE;
+	uint32_t first = log->next_id-1;
+	uint64_t copied = log->copied;
+	char *data, *bigger;
+	ssize_t got;
+	int fd;
+
+	// Get a buffer big enough for most objects (it grows for larger ones)
+	if ( (data = malloc(capacity)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD log compaction allocation failed." );
+		return( -1 );
+	}
+
+	// Walk the records of the segment
+	while ( ((seg = crud_log_segment(log, id)) != NULL) && (offset < seg->size) ) {
+		if ( log->shutdown ) {
+			free( data );
+			return( -1 );
+		}
+		if ( (pread(seg->fd, &rec, sizeof(rec), offset) != sizeof(rec)) || (rec.magic != CRUD_LOG_MAGIC) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad CRUD log record [segment %u, offset %u]", id, offset );
+			free( data );
+			return( -1 );
+		}
+		size = CRUD_LOG_RECORD_SIZE(rec.length);
+
+		if ( rec.type == CRUD_LOG_DELETE ) {
+
+			// A delete that may still hide an older record moves along
+			seg->live -= size;
+			if ( (seg != &log->segments[0]) && (findValueInHashTable(&log->index, rec.oid) == NULL) ) {
+				if ( crud_log_append(log, &rec, NULL, &segment, &to) ) {
+					free( data );
+					return( -1 );
+				}
+				crud_log_segment( log, segment )->live += size;
+				log->copied += size;
+			}
+
+		} else if ( ((entry = findValueInHashTable(&log->index, rec.oid)) != NULL) &&
+					(entry->segment == id) && (entry->offset == offset) ) {
+
+			// The latest record of an object, read it with the segment pinned
+			// (and the lock released)
+			if ( rec.length > capacity ) {
+				if ( (bigger = realloc(data, rec.length)) == NULL ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD log compaction allocation failed." );
+					free( data );
+					return( -1 );
+				}
+				data = bigger;
+				capacity = rec.length;
+			}
+			seg->readers ++;
+			fd = seg->fd;
+			pthread_mutex_unlock( &log->lock );
+			got = pread( fd, data, rec.length, offset+sizeof(CrudLogRecord) );
+			pthread_mutex_lock( &log->lock );
+			crud_log_unpin( log, id );
+			if ( got != rec.length ) {
+				logMessage( LOG_ERROR_LEVEL, "Failure reading CRUD log segment [%u], error=[%s]",
+						id, strerror(errno) );
+				free( data );
+				return( -1 );
+			}
+
+			// Copy it, unless the object was written (or deleted) during the read
+			if ( ((entry = findValueInHashTable(&log->index, rec.oid)) != NULL) &&
+				 (entry->segment == id) && (entry->offset == offset) ) {
+				if ( crud_log_append(log, &rec, data, &segment, &to) ||
+					 crud_log_apply(log, &rec, segment, to, 0) ) {
+					free( data );
+					return( -1 );
+				}
+				log->copied += size;
+			}
+		}
+
+		// Let the requests in before the next record
+		offset += size;
+		pthread_mutex_unlock( &log->lock );
+		pthread_mutex_lock( &log->lock );
+	}
+
+	// Everything needed has moved (make sure the copies are on disk), remove the segment
+	if ( ((seg = crud_log_segment(log, id)) != NULL) && (log->copied > copied) && crud_log_sync(log, first) ) {
+		free( data );
+		return( -1 );
+	}
+	if ( (seg = crud_log_segment(log, id)) != NULL ) {
+		log->reclaimed += seg->size;
+		crud_log_remove_segment( log, id );
+		logMessage( LOG_INFO_LEVEL, "CRUD log compacted segment %u [%s]", id, log->dir );
+	}
+	free( data );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_compactor
+// Description  : The compaction thread, compacts segments until there are no
+//                more worth doing, then waits to be told there may be more
+//
+// Inputs       : arg - the log
+// Outputs      : NULL
+
+static void * crud_log_compactor( void *arg ) {
+
+	// Local variables
+	CrudLog *log = arg;
+	int victim;
+
+	// Compact (or wait) until shutdown
+	pthread_mutex_lock( &log->lock );
+	while ( !log->shutdown ) {
+		if ( ((victim = crud_log_victim(log)) == -1) ||
+			 crud_log_compact_segment(log, log->segments[victim].id) ) {
+			if ( !log->shutdown ) {
+				pthread_cond_wait( &log->wake, &log->lock );
+			}
+		}
+	}
+	pthread_mutex_unlock( &log->lock );
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_clear
+// Description  : Close the segment files and release the index
+//
+// Inputs       : log - the log
+// Outputs      : none
+
+static void crud_log_clear( CrudLog *log ) {
+
+	// Local variables
+	CrudLogEntry *entry;
+	HtIterator it;
+	uint32_t i;
+
+	// Close the segments
+	for ( i=0; i<log->count; i++ ) {
+		if ( log->segments[i].fd != -1 ) {
+			close( log->segments[i].fd );
+		}
+	}
+	free( log->segments );
+	log->segments = NULL;
+	log->count = log->capacity = 0;
+
+	// Free the index entries, then the table
+	initHashTableIterator( &log->index, &it );
+	while ( (entry = iterateHashTable(&it)) != NULL ) {
+		free( entry );
+	}
+	cleanupHashTable( &log->index );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_log_compare
+// Description  : Order segments by number (for qsort)
+//
+// Inputs       : a, b - the segments
+// Outputs      : <0, 0, >0 as a is before, the same as, or after b
+
+static int crud_log_compare( const void *a, const void *b ) {
+	uint32_t x = ((const CrudLogSegment *)a)->id, y = ((const CrudLogSegment *)b)->id;
+	return( (x < y) ? -1 : (x > y) );
+}
@@ -0,0 +1,124 @@
+#ifndef CRUD_LOG_INCLUDED
+#define CRUD_LOG_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_log.h
+//  Description   : This is the interface to the log-structured persistent
+//                  object store.  Every CREATE/UPDATE/DELETE is appended to
+//                  the active segment file of a directory, an in-memory index
+//                  maps each OID to its latest record, and a background
+//                  compaction thread copies the live records out of mostly
+//                  dead segments so they can be removed.  Opening the log
+//                  rebuilds the index from the record headers alone.  Each
+//                  object has a version, a new one every time it is written
+//                  (compaction keeps it, reopening hands out new ones).  The
+//                  log is thread safe (one lock), all of the partitions of a
+//                  store share it.  Object contents are read with the lock
+//                  released, the segment is pinned so it is not removed
+//                  underneath the read.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <pthread.h>
+
+// Project includes
+#include <crud_driver.h>
+#include <cmpsc311_hashtable.h>
+
+// Defines
+#define CRUD_LOG_MAX_PATH 256           // The longest log directory name
+#define CRUD_LOG_SEGMENT_SIZE 0x400000  // Segments are sealed at this size
+#define CRUD_LOG_COMPACT_LIVE 50        // Compact sealed segments below this % live
+#define CRUD_LOG_HASH_BITS 12           // The width of the index hash table
+
+//
+// Type definitions
+
+// This is where the latest record of an object lives
+typedef struct {
+	uint32_t segment; // The segment holding the record
+	uint32_t offset;  // The offset of the record in the segment
+	uint32_t length;  // The length of the object
+	uint8_t  flags;   // The flags the object was created with
+	uint64_t version; // The version of the object
+} CrudLogEntry;
+
+// This is a segment file
+typedef struct {
+	uint32_t id;      // The segment number (segments are written in order)
+	int      fd;      // The open segment file
+	uint32_t size;    // The bytes written to the segment
+	uint32_t live;    // The bytes of records still needed
+	uint32_t readers; // The reads in progress (pinning the segment)
+} CrudLogSegment;
+
+// This is the log
+typedef struct {
+	char             dir[CRUD_LOG_MAX_PATH]; // The directory of segment files
+	uint32_t         segment_size; // The size at which segments are sealed
+	int              open;         // Flag indicating the log is open
+	pthread_mutex_t  lock;         // The lock protecting everything below
+	pthread_cond_t   wake;         // Signaled when there may be compaction to do
+	pthread_cond_t   unpinned;     // Signaled when a segment has no more readers
+	pthread_t        compactor;    // The compaction thread
+	int              shutdown;     // Flag telling the compactor to exit
+	HTable           index;        // The latest record of each object (by OID)
+	CrudLogSegment  *segments;     // The segments, oldest first (last is active)
+	uint32_t         count;        // The number of segments
+	uint32_t         capacity;     // The size of the segment array
+	uint32_t         next_id;      // The number of the next segment
+	CrudOID          high;         // The highest OID ever written
+	uint64_t         versions;     // The last object version handed out
+	uint64_t         appended;     // The bytes appended by requests
+	uint64_t         copied;       // The bytes copied by compaction
+	uint64_t         reclaimed;    // The bytes released by compaction
+} CrudLog;
+
+//
+// Log interface
+
+int crud_log_setup( CrudLog *log, const char *dir );
+	// Setup (but do not open) a log kept in a directory
+
+int crud_log_open( CrudLog *log );
+	// Open the log, rebuilding the index, and start the compactor
+
+int crud_log_close( CrudLog *log );
+	// Stop the compactor, flush the active segment and close the log
+
+int crud_log_format( CrudLog *log );
+	// Remove every object (and segment) from the log
+
+int crud_log_put( CrudLog *log, CrudOID oid, uint8_t flags, void *buf, uint32_t length, uint64_t *version );
+	// Write the (new) contents of an object, giving it a new version (version
+	// may be NULL)
+
+int crud_log_get( CrudLog *log, CrudOID oid, void *buf, uint32_t size, uint32_t *length, uint8_t *flags,
+		uint64_t *version );
+	// Read the contents of an object into a buffer of size bytes (version may
+	// be NULL)
+
+int crud_log_lookup( CrudLog *log, CrudOID oid, uint32_t *length, uint8_t *flags, uint64_t *version );
+	// Find the length, flags and version of an object (any may be NULL)
+
+int crud_log_delete( CrudLog *log, CrudOID oid );
+	// Remove an object
+
+int crud_log_compact( CrudLog *log );
+	// Compact every segment the compactor would, now
+
+void crud_log_report( CrudLog *log );
+	// Log the segment statistics (sizes, live bytes, compaction)
+
+//
+// Unit Testing
+
+int crud_log_unit_test( void );
+	// Perform a test of the log-structured store
+
+#endif
@@ -11,6 +11,7 @@
 //
 
 // Include Files
+#include <signal.h>
 
 // Project Include Files
 #include <crud_driver.h>
@@ -18,23 +19,52 @@
 // Defines
 #define CRUD_MAX_BACKLOG 5
 #define CRUD_NET_HEADER_SIZE sizeof(CrudResponse)
+#define CRUD_NET_HEADER2_SIZE (3*sizeof(uint64_t))
+#define CRUD_NET_MAX_HEADER_SIZE (4*sizeof(uint64_t))
+#define CRUD_NET_CHUNK_HEADER_SIZE sizeof(uint32_t)
 #define CRUD_DEFAULT_IP "127.0.0.1"
 #define CRUD_DEFAULT_PORT 19876
 
+//
+// Type definitions
+
+typedef int (*CrudStreamFunction)(void *arg, void *chunk, uint32_t length, uint64_t offset);
+    // Produces (CREATE/UPDATE) or consumes (READ) a chunk of a streamed
+    // payload, returning 0 if successful, -1 if failure
+
 //
 // Functional Prototypes
 
 CrudResponse crud_client_operation(CrudRequest op, void *buf);
     // This is the implementation of the client operation (crud_client.c)
 
+CrudResponse crud_client_versioned(CrudRequest op, void *buf, uint64_t *objver);
+    // The client operation carrying an object version (if agreed, in and out)
+
+int crud_client_stream(CrudHeader *hdr, CrudStreamFunction fn, void *arg);
+    // Execute a version 2 request, streaming the payload through fn
+
+void crud_client_disconnect(void);
+    // Close the connection of this thread (each thread has its own)
+
+int crudClientUnitTest(void);
+    // Stream a large object through the server (needs version 2)
+
+int crudClientBenchmark(int clients);
+    // Run some number of clients against shared objects at the same time
+
 int crud_server( void );
     // This is the implementation of the server application (crud_server.c)
 
 //
 // Network Global Data
 
-extern int            crud_network_shutdown; // Flag indicating shutdown
+extern volatile sig_atomic_t crud_network_shutdown; // Flag indicating shutdown (signal handlers set it, use __atomic_*)
 extern unsigned char *crud_network_address;  // Address of CRUD server 
 extern unsigned short crud_network_port;     // Port of CRUD server
+extern int            crud_network_protocol; // Protocol version asked for at INIT
+extern int            crud_network_checksums; // Ask for payload checksums at INIT
+extern int            crud_network_leases;   // Ask for read leases at INIT (cache objects)
+extern int            crud_network_versions; // Ask for object versions at INIT (see crud_write)
 
 #endif
@@ -0,0 +1,422 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_pool.c
+//  Description   : This is the implementation of the work-stealing thread
+//                  pool (see crud_pool.h).
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+// Project Include Files
+#include <crud_pool.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_POOL_UNIT_TEST_WORKERS 4
+#define CRUD_POOL_UNIT_TEST_JOBS 10000
+
+//
+// Local functions
+
+static void * crud_pool_worker( void *arg );
+static void * crud_pool_take( CrudPoolWorker *worker );
+static int crud_deque_init( CrudDeque *dq );
+static void crud_deque_cleanup( CrudDeque *dq );
+static int crud_deque_push( CrudDeque *dq, void *job );
+static void * crud_deque_pop( CrudDeque *dq, int newest );
+static void crud_pool_unit_job( void *job, uint32_t worker );
+
+//
+// Global data
+
+static __thread CrudPoolWorker *crud_pool_self = NULL; // The worker running on this thread (if any)
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_start
+// Description  : Start a pool of some number of workers executing jobs with
+//                the handler
+//
+// Inputs       : pool - the pool to start
+//                workers - the number of workers
+//                handler - the function executing the jobs
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_pool_start( CrudPool *pool, uint32_t workers, CrudPoolHandler handler ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Setup the pool and the deques
+	memset( pool, 0x0, sizeof(CrudPool) );
+	pool->workers = workers;
+	pool->handler = handler;
+	pthread_mutex_init( &pool->lock, NULL );
+	pthread_cond_init( &pool->wake, NULL );
+	if ( (pool->worker = calloc(workers, sizeof(CrudPoolWorker))) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD pool allocation failed [%u workers]", workers );
+		return( -1 );
+	}
+	for ( i=0; i<workers; i++ ) {
+		pool->worker[i].pool = pool;
+		pool->worker[i].id = i;
+		if ( crud_deque_init(&pool->worker[i].deque) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD pool allocation failed [%u workers]", workers );
+			return( -1 );
+		}
+	}
+
+	// Now start the workers
+	for ( i=0; i<workers; i++ ) {
+		if ( pthread_create(&pool->worker[i].thread, NULL, crud_pool_worker, &pool->worker[i]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD pool thread create failed [%u]", i );
+			pool->workers = i;
+			crud_pool_stop( pool );
+			return( -1 );
+		}
+	}
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD pool started [%u workers]", workers );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_submit
+// Description  : Submit a job to the pool.  A worker submitting a job pushes
+//                it onto its own deque, anyone else onto the deque of the
+//                worker asked for (idle workers steal to even things out).
+//
+// Inputs       : pool - the pool
+//                job - the job to execute
+//                worker - the worker to give the job to (if not a worker)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_pool_submit( CrudPool *pool, void *job, uint32_t worker ) {
+
+	// Local variables
+	CrudDeque *dq;
+
+	// Add the job to a deque
+	if ( (crud_pool_self != NULL) && (crud_pool_self->pool == pool) ) {
+		dq = &crud_pool_self->deque;
+	} else {
+		dq = &pool->worker[worker % pool->workers].deque;
+	}
+	if ( crud_deque_push(dq, job) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD pool submit failed." );
+		return( -1 );
+	}
+
+	// Now wake an idle worker to take it (the busy ones find it themselves,
+	// the count is read after the push, so a worker going idle sees the job)
+	if ( __sync_fetch_and_add(&pool->idle, 0) > 0 ) {
+		pthread_mutex_lock( &pool->lock );
+		pthread_cond_signal( &pool->wake );
+		pthread_mutex_unlock( &pool->lock );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_stop
+// Description  : Stop the workers (jobs not yet taken are dropped) and
+//                cleanup the pool
+//
+// Inputs       : pool - the pool
+// Outputs      : none
+
+void crud_pool_stop( CrudPool *pool ) {
+
+	// Local variables
+	uint32_t i;
+
+	// Tell the workers to exit, wait for them
+	pthread_mutex_lock( &pool->lock );
+	pool->shutdown = 1;
+	pthread_cond_broadcast( &pool->wake );
+	pthread_mutex_unlock( &pool->lock );
+	for ( i=0; i<pool->workers; i++ ) {
+		pthread_join( pool->worker[i].thread, NULL );
+	}
+
+	// Release everything
+	if ( pool->worker != NULL ) {
+		for ( i=0; i<pool->workers; i++ ) {
+			crud_deque_cleanup( &pool->worker[i].deque );
+		}
+		free( pool->worker );
+		pool->worker = NULL;
+	}
+	pthread_cond_destroy( &pool->wake );
+	pthread_mutex_destroy( &pool->lock );
+	return;
+}
+
+//
+// Unit Testing
+
+CrudPool crud_pool_unit_pool;                        // The pool under test
+int crud_pool_unit_counts[CRUD_POOL_UNIT_TEST_JOBS]; // Times each job ran
+uint32_t crud_pool_unit_done = 0;                    // Jobs completed
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_unit_test
+// Description  : Perform a test of the thread pool functionality: the first
+//                half of the jobs are submitted here, each of those submits
+//                one of the second half from its worker
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_pool_unit_test( void ) {
+
+	// Local variables
+	CrudPool *pool = &crud_pool_unit_pool;
+	uintptr_t i;
+
+	// Start the pool, submit a bunch of jobs
+	memset( crud_pool_unit_counts, 0x0, sizeof(crud_pool_unit_counts) );
+	crud_pool_unit_done = 0;
+	if ( crud_pool_start(pool, CRUD_POOL_UNIT_TEST_WORKERS, crud_pool_unit_job) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : start failed." );
+		return( -1 );
+	}
+	for ( i=1; i<=CRUD_POOL_UNIT_TEST_JOBS/2; i++ ) {
+		if ( crud_pool_submit(pool, (void *)i, i) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : submit failed [%lu].", i );
+			return( -1 );
+		}
+	}
+
+	// Wait for them to finish, then stop the pool
+	while ( __sync_fetch_and_add(&crud_pool_unit_done, 0) < CRUD_POOL_UNIT_TEST_JOBS ) {
+		sched_yield();
+	}
+	crud_pool_stop( pool );
+
+	// Each of the jobs should have run exactly once
+	for ( i=0; i<CRUD_POOL_UNIT_TEST_JOBS; i++ ) {
+		if ( crud_pool_unit_counts[i] != 1 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : job %lu ran %d times.",
+					i, crud_pool_unit_counts[i] );
+			return( -1 );
+		}
+	}
+
+	// Log, return successfully
+	logMessage( LOG_INFO_LEVEL, "CRUD pool unit test successful." );
+	return( 0 );
+}
+
+//
+// Local Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_worker
+// Description  : The main loop of a worker, taking and executing jobs until
+//                the pool shuts down
+//
+// Inputs       : arg - the worker
+// Outputs      : NULL
+
+static void * crud_pool_worker( void *arg ) {
+
+	// Local variables
+	CrudPoolWorker *worker = arg;
+	CrudPool *pool = worker->pool;
+	void *job;
+
+	crud_pool_self = worker;
+	while ( !pool->shutdown ) {
+
+		// Take a job, if there are none wait (idle) until one is pushed
+		if ( (job = crud_pool_take(worker)) == NULL ) {
+			pthread_mutex_lock( &pool->lock );
+			__sync_fetch_and_add( &pool->idle, 1 );
+			while ( ((job = crud_pool_take(worker)) == NULL) && (!pool->shutdown) ) {
+				pthread_cond_wait( &pool->wake, &pool->lock );
+			}
+			__sync_fetch_and_sub( &pool->idle, 1 );
+			pthread_mutex_unlock( &pool->lock );
+			if ( job == NULL ) {
+				break;
+			}
+		}
+
+		// Execute it
+		pool->handler( job, worker->id );
+	}
+
+	// Return, nothing to report
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_take
+// Description  : Take a job for the worker: the newest of our own (the one
+//                most likely still in the cache), then the oldest of
+//                somebody else's (the other end of the deque from its owner,
+//                the job that has waited longest).
+//
+// Inputs       : worker - the worker
+// Outputs      : the job, NULL if none found
+
+static void * crud_pool_take( CrudPoolWorker *worker ) {
+
+	// Local variables
+	CrudPool *pool = worker->pool;
+	uint32_t i;
+	void *job;
+
+	// Ours first
+	if ( (job = crud_deque_pop(&worker->deque, 1)) != NULL ) {
+		return( job );
+	}
+
+	// Nothing, try to steal from the others (starting with our neighbor)
+	for ( i=1; i<pool->workers; i++ ) {
+		job = crud_deque_pop( &pool->worker[(worker->id+i)%pool->workers].deque, 0 );
+		if ( job != NULL ) {
+			return( job );
+		}
+	}
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_deque_init
+// Description  : Initialize an (empty) deque
+//
+// Inputs       : dq - the deque
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_deque_init( CrudDeque *dq ) {
+
+	// Setup the ring
+	pthread_mutex_init( &dq->lock, NULL );
+	dq->size = CRUD_POOL_DEQUE_SIZE;
+	dq->head = 0;
+	dq->count = 0;
+	dq->jobs = malloc( sizeof(void *)*dq->size );
+	return( (dq->jobs == NULL) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_deque_cleanup
+// Description  : Release a deque
+//
+// Inputs       : dq - the deque
+// Outputs      : none
+
+static void crud_deque_cleanup( CrudDeque *dq ) {
+	free( dq->jobs );
+	dq->jobs = NULL;
+	pthread_mutex_destroy( &dq->lock );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_deque_push
+// Description  : Add a job to the new end of the deque (growing as needed)
+//
+// Inputs       : dq - the deque
+//                job - the job to add
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_deque_push( CrudDeque *dq, void *job ) {
+
+	// Local variables
+	void **jobs;
+	uint32_t i;
+
+	pthread_mutex_lock( &dq->lock );
+
+	// Double the ring if full, unwrapping the jobs as we go
+	if ( dq->count == dq->size ) {
+		if ( (jobs = malloc(sizeof(void *)*dq->size*2)) == NULL ) {
+			pthread_mutex_unlock( &dq->lock );
+			return( -1 );
+		}
+		for ( i=0; i<dq->count; i++ ) {
+			jobs[i] = dq->jobs[(dq->head+i) & (dq->size-1)];
+		}
+		free( dq->jobs );
+		dq->jobs = jobs;
+		dq->size *= 2;
+		dq->head = 0;
+	}
+
+	// Add the job at the tail
+	dq->jobs[(dq->head+dq->count) & (dq->size-1)] = job;
+	dq->count ++;
+	pthread_mutex_unlock( &dq->lock );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_deque_pop
+// Description  : Remove a job from one end of the deque
+//
+// Inputs       : dq - the deque
+//                newest - flag indicating take the newest (else the oldest)
+// Outputs      : the job, NULL if empty
+
+static void * crud_deque_pop( CrudDeque *dq, int newest ) {
+
+	// Local variables
+	void *job = NULL;
+
+	// Take from the tail or the head
+	pthread_mutex_lock( &dq->lock );
+	if ( dq->count > 0 ) {
+		if ( newest ) {
+			job = dq->jobs[(dq->head+dq->count-1) & (dq->size-1)];
+		} else {
+			job = dq->jobs[dq->head];
+			dq->head = (dq->head+1) & (dq->size-1);
+		}
+		dq->count --;
+	}
+	pthread_mutex_unlock( &dq->lock );
+	return( job );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pool_unit_job
+// Description  : The job executed by the unit test, counts the run (a job
+//                in the first half submits its partner in the second)
+//
+// Inputs       : job - the job number (from 1, NULL is no job)
+//                worker - the worker running the job
+// Outputs      : none
+
+static void crud_pool_unit_job( void *job, uint32_t worker ) {
+	if ( ((uintptr_t)job <= CRUD_POOL_UNIT_TEST_JOBS/2) &&
+		 crud_pool_submit(&crud_pool_unit_pool, (void *)((uintptr_t)job+CRUD_POOL_UNIT_TEST_JOBS/2), 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_POOL_UNIT_TEST : worker submit failed [%lu].", (uintptr_t)job );
+	}
+	__sync_fetch_and_add( &crud_pool_unit_counts[(uintptr_t)job-1], 1 );
+	__sync_fetch_and_add( &crud_pool_unit_done, 1 );
+	return;
+}
@@ -0,0 +1,78 @@
+#ifndef CRUD_POOL_INCLUDED
+#define CRUD_POOL_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_pool.h
+//  Description   : This is the interface to the work-stealing thread pool
+//                  used by the server to execute requests off the I/O
+//                  threads.  Each worker has its own deque of jobs: jobs are
+//                  pushed onto the deque of the worker submitting them (or
+//                  the one asked for), the owner takes the newest, and idle
+//                  workers steal the oldest from the other end.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <pthread.h>
+
+// Defines
+#define CRUD_POOL_DEQUE_SIZE 64 // Initial deque size (grows as needed)
+
+//
+// Type definitions
+
+// This is the function that executes a job (on the worker numbered worker)
+typedef void (*CrudPoolHandler)( void *job, uint32_t worker );
+
+// This is a double ended queue of jobs (a growable ring)
+typedef struct {
+	pthread_mutex_t lock;  // The lock protecting the deque
+	void          **jobs;  // The ring of jobs
+	uint32_t        size;  // The size of the ring (a power of 2)
+	uint32_t        head;  // The oldest job in the ring
+	uint32_t        count; // The number of jobs in the ring
+} CrudDeque;
+
+// This is a worker in the pool
+typedef struct {
+	struct crud_pool *pool;   // The pool the worker belongs to
+	uint32_t          id;     // The worker number
+	pthread_t         thread; // The thread running the worker
+	CrudDeque         deque;  // The worker's jobs
+} CrudPoolWorker;
+
+// This is the pool
+typedef struct crud_pool {
+	uint32_t         workers;  // The number of workers
+	CrudPoolWorker  *worker;   // The workers
+	CrudPoolHandler  handler;  // The function executing the jobs
+	pthread_mutex_t  lock;     // The lock the idle workers wait under
+	pthread_cond_t   wake;     // Signaled when there are jobs to do
+	uint32_t         idle;     // The number of workers waiting for jobs
+	int              shutdown; // Flag indicating the workers should exit
+} CrudPool;
+
+//
+// Pool interface
+
+int crud_pool_start( CrudPool *pool, uint32_t workers, CrudPoolHandler handler );
+	// Start a pool of some number of workers executing jobs with the handler
+
+int crud_pool_submit( CrudPool *pool, void *job, uint32_t worker );
+	// Submit a (non-NULL) job to the deque of a worker (the caller's own if it
+	// is a worker)
+
+void crud_pool_stop( CrudPool *pool );
+	// Stop the workers (jobs not yet taken are dropped) and cleanup the pool
+
+//
+// Unit Testing
+
+int crud_pool_unit_test( void );
+	// Perform a test of the thread pool functionality
+
+#endif
@@ -0,0 +1,49 @@
+#!/bin/bash
+################################################################################
+#
+#  File          : crud_scale.sh
+#  Description   : This is a scaling benchmark for the CRUD server.  For each
+#                  number of server threads it formats the store (workload
+#                  one), then times a number of concurrent clients each
+#                  running a workload (three by default).
+#
+#  Usage         : crud_scale.sh [clients] [threads...]
+#                  e.g., crud_scale.sh 8 1 2 4 8
+#                  (SERVER_ARGS/CLIENT_ARGS are passed to the server/clients,
+#                  e.g., CLIENT_ARGS=-L to cache under read leases)
+#
+#  Author        : Patrick McDaniel
+#  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+#
+
+CLIENTS=${1:-$(nproc)}
+shift
+THREADS=${@:-1 $(nproc)}
+PORT=${PORT:-19899}
+WORKLOAD=${WORKLOAD:-workload-three.txt}
+
+for t in $THREADS; do
+
+	# Start the server, format the store
+	./crud_server -t $t $SERVER_ARGS -p $PORT > /dev/null 2>&1 &
+	SPID=$!
+	sleep 0.5
+	./crud_client -p $PORT workload-one.txt > /dev/null 2>&1
+
+	# Run the clients at the same time, wait for them all
+	START=$(date +%s%N)
+	for (( c=0; c<CLIENTS; c++ )); do
+		./crud_client $CLIENT_ARGS -p $PORT $WORKLOAD > /dev/null 2>&1 &
+	done
+	FAILED=0
+	for job in $(jobs -p); do
+		[ $job = $SPID ] && continue
+		wait $job || FAILED=$((FAILED+1))
+	done
+	ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+
+	# Report, stop the server
+	echo "threads=$t clients=$CLIENTS elapsed=${ELAPSED}ms failed=$FAILED"
+	kill -INT $SPID
+	wait $SPID
+done
@@ -0,0 +1,1808 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_server.c
+//  Description   : This is the server side of the CRUD communication protocol.
+//                  Each server thread runs an epoll event loop servicing any
+//                  number of non-blocking client connections, and owns one
+//                  partition of the object store (see crud_store.h).  The
+//                  threads share the port with SO_REUSEPORT; a request for an
+//                  object in another thread's partition is forwarded to that
+//                  thread's inbox, and comes back to the connection's thread
+//                  once executed.  INIT/FORMAT/CLOSE touch every partition so
+//                  they run with the other threads stopped.  With a worker
+//                  pool the loops only do the socket I/O, and the workers
+//                  execute requests holding the lock of the partition.  The
+//                  priority object (the FAT) is run by whichever thread
+//                  received the request, under a lock of its own.
+//                  With -d the objects are kept in a log-structured store
+//                  on disk rather than in memory.  Clients may negotiate
+//                  protocol version 2 (see crud_driver.h) at INIT, and then
+//                  send and receive payloads in chunks.  Clients that cache
+//                  objects are granted read leases (see crud_lease.h), and
+//                  are sent invalidations by their loop when others change
+//                  the objects they hold (the change is not answered until
+//                  each has acknowledged, or its lease has run out), and may
+//                  revalidate their copies with conditional READs by object
+//                  version.
+//
+//   Author       : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#define _GNU_SOURCE // For the writer-preferring rwlock
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Project Include Files
+#include <crud_codec.h>
+#include <crud_crc.h>
+#include <crud_lease.h>
+#include <crud_network.h>
+#include <crud_store.h>
+#include <crud_pool.h>
+#include <crud_slab.h>
+#include <cmpsc311_hashtable.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_SERVER_MAX_EVENTS 64
+#define CRUD_SERVER_MAX_THREADS 64
+#define CRUD_SERVER_LEASE_BUCKETS 65536
+#define CRUD_SERVER_REGISTRY_BITS 10
+#define CRUD_SERVER_BARRIER_BITS 8
+#define CRUD_SERVER_ARGUMENTS "hvul:A:p:t:w:d:"
+#define USAGE \
+	"USAGE: crud_server [-h] [-v] [-u] [-l <logfile>] [-A <policy>] [-p <port>] [-t <threads>] [-w <workers>]\n" \
+	"                   [-d <directory>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -u - run the unit tests instead of the server\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -A - write the log on a thread of its own, <policy> (block or drop)\n" \
+	"         saying whether a message waits or is dropped when it falls behind\n" \
+	"    -p - port number to listen on.\n" \
+	"    -t - number of server threads (event loops), default 1.\n" \
+	"    -w - number of worker threads executing requests, default 0 (the\n" \
+	"         event loops execute the requests themselves).\n" \
+	"    -d - keep the objects in a log-structured store in <directory>\n" \
+	"         (default keeps them in memory, saved to a file on close).\n" \
+	"\n" \
+
+//
+// Type definitions
+
+// These are the states of a client connection
+typedef enum {
+	CRUD_CONN_HEADER   = 0, // Receiving the request header
+	CRUD_CONN_PAYLOAD  = 1, // Receiving the request payload (CREATE/UPDATE)
+	CRUD_CONN_RESPONSE = 2, // Sending the response header and payload
+	CRUD_CONN_WAITING  = 3, // Waiting on another thread to execute the request
+	CRUD_CONN_CHUNK    = 4, // Receiving the length of a payload chunk (version 2)
+	CRUD_CONN_TRAILER  = 5, // Receiving the payload checksum
+	CRUD_CONN_HELD     = 6, // Waiting on the holders told of a change to acknowledge
+} CRUD_CONNECTION_STATE;
+
+// This is an invalidation sent to a lease holder
+typedef struct {
+	CrudOID  oid;     // The object changed
+	uint64_t barrier; // The change waiting on the acknowledgement
+} CrudInvalidation;
+
+// This is a client connection
+typedef struct crud_connection {
+	int                   sock;     // The socket for the connection
+	CRUD_CONNECTION_STATE state;    // Where we are in the request/response
+	int                   version;  // The protocol version agreed on
+	int                   format;   // The header format (version, CRUD_PROTOCOL_VERSIONS)
+	int                   checksums; // Flag indicating payloads carry a CRC32C trailer
+	int                   leases;   // Flag indicating the client caches under leases
+	uint64_t              id;       // The holder of the client's leases
+	uint64_t              header[4]; // The header being sent/received (network order)
+	uint32_t              hdrlen;   // The size of the header
+	uint32_t              hdrpos;   // The header bytes transferred so far
+	CrudHeader            cmd;      // The request being processed (host order)
+	char                 *buf;      // The payload buffer
+	uint32_t              bufsize;  // The allocated size of the payload buffer
+	uint32_t              length;   // The payload bytes to transfer
+	uint32_t              pos;      // The payload bytes transferred so far
+	uint32_t              chunk;    // The bytes left in the current chunk
+	uint32_t              chkhdr;   // The chunk length (network order)
+	uint32_t              chkpos;   // The chunk length bytes transferred so far
+	uint32_t              trailer;  // The payload CRC32C (network order)
+	uint32_t              crc;      // The CRC32C of the payload received so far
+	uint32_t              trllen;   // The size of the trailer (0 if none)
+	uint32_t              trlpos;   // The trailer bytes transferred so far
+	int                   badsum;   // Flag indicating the payload failed its checksum
+	int                   writing;  // Flag indicating we are waiting on EPOLLOUT
+	uint32_t              home;     // The loop that owns the socket
+	uint32_t              sessions; // INITs without a CLOSE on this connection
+	int                   closing;  // Flag indicating the client has gone away
+	struct crud_connection *next;   // Next connection in an inbox/global list
+	CrudInvalidation     *pending;  // Invalidations not yet acknowledged (registry lock)
+	uint32_t              npending; // The number of invalidations pending
+	uint32_t              maxpending; // The allocated size of the pending array
+	uint32_t              acked;    // The pending invalidations acknowledged
+	uint32_t              noticed;  // The pending invalidations taken by the loop
+	int                   notified; // Flag indicating the loop has been told (registry lock)
+	struct crud_connection *nextnotify; // Next connection in a notify list
+	char                 *notice;   // The invalidations being sent (wire format)
+	uint32_t              noticesize; // The allocated size of the notice buffer
+	uint32_t              noticelen; // The invalidation bytes to send
+	uint32_t              noticepos; // The invalidation bytes sent so far
+	uint64_t              barrier;  // The change waiting on acknowledgements (0 if none)
+	uint32_t              awaiting; // The acknowledgements it waits on (registry lock)
+	uint64_t              deadline; // When the last lease it revoked runs out
+	int                   held;     // Flag indicating the response is held (registry lock)
+	struct crud_connection *nextheld; // Next connection in the held list
+	uint64_t              ack[4];   // The acknowledgement received while held (network order)
+	uint32_t              ackpos;   // The acknowledgement bytes received so far
+	struct sockaddr_in    addr;     // The address of the client
+} CrudConnection;
+
+// This is a server event loop (one per thread)
+typedef struct {
+	uint32_t          id;     // The loop number (and the partition it owns)
+	pthread_t         thread; // The thread running the loop
+	int               epfd;   // The epoll instance
+	int               lsock;  // The listening socket
+	int               evfd;   // The eventfd signaling the inbox
+	pthread_mutex_t   lock;   // The lock protecting the inbox
+	CrudConnection   *inbox;  // Connections forwarded to this loop
+	CrudConnection   *global; // Connections waiting to run INIT/FORMAT/CLOSE
+	CrudConnection   *notify; // Connections with invalidations to send
+	CrudConnection   *held;   // Connections whose response is held (loop only)
+} CrudLoop;
+
+//
+// Global data
+volatile sig_atomic_t crud_network_shutdown = 0; // Flag indicating shutdown (see crud_network.h)
+unsigned char *crud_network_address = NULL;  // Address of CRUD server
+unsigned short crud_network_port = 0;        // Port of CRUD server
+uint32_t         crud_server_threads = 1;    // Number of server threads
+CrudLoop        *crud_server_loops = NULL;   // The server event loops
+uint32_t         crud_server_workers = 0;    // Number of pool workers
+CrudPool         crud_server_pool;           // The pool executing requests
+CrudStore       *crud_server_stores = NULL;  // The store partitions
+pthread_mutex_t *crud_server_locks = NULL;   // The partition locks (pool only)
+pthread_mutex_t  crud_server_priority_lock;  // The lock of the priority object
+pthread_rwlock_t crud_server_world;          // Held to stop the other loops
+CrudLog          crud_server_log;            // The log holding the objects (-d)
+int              crud_server_logged = 0;     // Flag indicating the log is used
+CrudLeases       crud_server_leases;         // The read leases granted
+HTable           crud_server_registry;       // The connections holding leases (by id)
+HTable           crud_server_barriers;       // The changes waiting on acknowledgements (by barrier)
+pthread_mutex_t  crud_server_registry_lock;  // The lock protecting the registry (and barriers)
+int              crud_server_leasing = 0;    // Flag indicating leases have been granted
+uint64_t         crud_server_next_id = 0;    // The last connection id given out
+
+//
+// Functional Prototypes
+
+int crud_server_listen( void );
+int crud_server_setup_loop( CrudLoop *loop, uint32_t id );
+void * crud_server_loop( void *arg );
+CrudConnection * crud_server_accept( CrudLoop *loop );
+void crud_server_close( CrudLoop *loop, CrudConnection *conn );
+int crud_server_handle_connection( CrudLoop *loop, CrudConnection *conn );
+int crud_server_dispatch( CrudLoop *loop, CrudConnection *conn );
+uint32_t crud_server_owner( CrudConnection *conn, uint32_t local );
+void crud_server_execute( uint32_t owner, CrudConnection *conn );
+void crud_server_lease( CrudConnection *conn, CRUD_REQUEST_TYPES req );
+void crud_server_revoked( void *arg, uint64_t holder, CrudOID oid, uint64_t expires );
+int crud_server_acknowledge( CrudConnection *conn, CrudOID oid );
+void crud_server_resolve( uint64_t barrier );
+int crud_server_respond( CrudLoop *loop, CrudConnection *conn );
+int crud_server_unhold( CrudLoop *loop );
+int crud_server_notify( int epfd, CrudConnection *conn );
+int crud_server_flush( int epfd, CrudConnection *conn );
+void crud_server_work( void *job, uint32_t worker );
+void crud_server_post( CrudLoop *loop, CrudConnection *conn );
+void crud_server_inbox( CrudLoop *loop );
+void crud_server_global( CrudLoop *loop );
+int crud_server_send( int epfd, CrudConnection *conn );
+int crud_server_buffer( CrudConnection *conn, uint32_t length );
+void crud_server_release( CrudConnection *conn );
+void crud_signal_handler( int sig );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the CRUD server
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, async_log = -1;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CRUD_SERVER_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		case 'u': // Unit Tests Flag
+			unit_tests = 1;
+			break;
+
+		case 'l': // Set the log filename
+			initializeLogWithFilename( optarg );
+			log_initialized = 1;
+			break;
+
+		case 'A': // Write the log asynchronously
+			if ( strcmp(optarg, "block") == 0 ) {
+				async_log = CMPSC311_LOG_BLOCK;
+			} else if ( strcmp(optarg, "drop") == 0 ) {
+				async_log = CMPSC311_LOG_DROP;
+			} else {
+				fprintf( stderr, "Bad log policy [%s], should be block or drop\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &crud_network_port) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  port number [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 't': // Set the number of server threads
+			if ( (sscanf(optarg, "%u", &crud_server_threads) != 1) ||
+				 (crud_server_threads < 1) || (crud_server_threads > CRUD_SERVER_MAX_THREADS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of threads [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'w': // Set the number of pool workers
+			if ( (sscanf(optarg, "%u", &crud_server_workers) != 1) ||
+				 (crud_server_workers > CRUD_SERVER_MAX_THREADS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of workers [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'd': // Keep the objects in a log
+			if ( crud_log_setup(&crud_server_log, optarg) ) {
+				return( -1 );
+			}
+			crud_server_logged = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log as needed
+	if ( ! log_initialized ) {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+	if ( verbose ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+	}
+	if ( (async_log != -1) && startAsyncLog(async_log) ) {
+		return( -1 );
+	}
+
+	// If we are running the unit tests, do that
+	if ( unit_tests ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+		if ( b64UnitTest() || crud_codec_unit_test() || crud_crc_unit_test() || hashTableUnitTest() || crud_pool_unit_test() || crud_slab_unit_test() ||
+			 crud_log_unit_test() || crud_lease_unit_test() || crud_unit_test() ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server unit tests failed.\n\n" );
+			return( -1 );
+		}
+		logMessage( LOG_INFO_LEVEL, "CRUD server unit tests completed successfully.\n\n" );
+		return( 0 );
+	}
+
+	// Run the server
+	if ( crud_server() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server failed, aborting.\n\n" );
+		return( -1 );
+	}
+
+	// Return successfully
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server
+// Description  : This is the implementation of the server application.  It
+//                starts the event loops (the first runs in this thread) and
+//                services requests until a shutdown signal is received.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server( void ) {
+
+	// Local variables
+	pthread_rwlockattr_t attr;
+	struct sigaction act;
+	sigset_t mask, omask;
+	uint64_t wake = 1;
+	uint32_t i, started, partitions;
+
+	// Catch the shutdown signals, ignore broken connections
+	memset( &act, 0x0, sizeof(act) );
+	act.sa_handler = crud_signal_handler;
+	sigaction( SIGINT, &act, NULL );
+	sigaction( SIGTERM, &act, NULL );
+	act.sa_handler = SIG_IGN;
+	sigaction( SIGPIPE, &act, NULL );
+
+	// Setup the store partitions (one per loop, or per worker with a pool)
+	// and the lock used to stop the world (writers are preferred, otherwise
+	// busy threads could starve INIT/FORMAT/CLOSE)
+	partitions = (crud_server_workers > 0) ? crud_server_workers : crud_server_threads;
+	crud_server_loops = calloc( crud_server_threads, sizeof(CrudLoop) );
+	crud_server_stores = calloc( partitions, sizeof(CrudStore) );
+	crud_server_locks = calloc( partitions, sizeof(pthread_mutex_t) );
+	if ( (crud_server_loops == NULL) || (crud_server_stores == NULL) || (crud_server_locks == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server allocation failed [%u threads]", crud_server_threads );
+		return( -1 );
+	}
+	crud_store_setup( crud_server_stores, partitions );
+	if ( crud_server_logged ) {
+		crud_store_persist( crud_server_stores, &crud_server_log );
+	}
+	for ( i=0; i<partitions; i++ ) {
+		pthread_mutex_init( &crud_server_locks[i], NULL );
+	}
+	pthread_mutex_init( &crud_server_priority_lock, NULL );
+	pthread_rwlockattr_init( &attr );
+	pthread_rwlockattr_setkind_np( &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+	pthread_rwlock_init( &crud_server_world, &attr );
+	pthread_rwlockattr_destroy( &attr );
+	if ( (crud_lease_setup(&crud_server_leases, CRUD_SERVER_LEASE_BUCKETS, CRUD_LEASE_TIME)) ||
+		 (initHashTable(&crud_server_registry, CRUD_SERVER_REGISTRY_BITS)) ||
+		 (initHashTable(&crud_server_barriers, CRUD_SERVER_BARRIER_BITS)) ) {
+		return( -1 );
+	}
+	pthread_mutex_init( &crud_server_registry_lock, NULL );
+
+	// Setup each of the loops (with its own listening socket)
+	for ( i=0; i<crud_server_threads; i++ ) {
+		if ( crud_server_setup_loop(&crud_server_loops[i], i) ) {
+			return( -1 );
+		}
+	}
+
+	// Start the pool and the other loops, with the signals left to this thread
+	sigemptyset( &mask );
+	sigaddset( &mask, SIGINT );
+	sigaddset( &mask, SIGTERM );
+	pthread_sigmask( SIG_BLOCK, &mask, &omask );
+	if ( (crud_server_workers > 0) &&
+		 (crud_pool_start(&crud_server_pool, crud_server_workers, crud_server_work)) ) {
+		return( -1 );
+	}
+	for ( started=1; started<crud_server_threads; started++ ) {
+		if ( pthread_create(&crud_server_loops[started].thread, NULL,
+				crud_server_loop, &crud_server_loops[started]) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server thread create failed [%u]", started );
+			__atomic_store_n( &crud_network_shutdown, 1, __ATOMIC_SEQ_CST );
+			break;
+		}
+	}
+	pthread_sigmask( SIG_SETMASK, &omask, NULL );
+
+	// Run the first loop here, then stop and wait for the others
+	if ( !__atomic_load_n(&crud_network_shutdown, __ATOMIC_SEQ_CST) ) {
+		crud_server_loop( &crud_server_loops[0] );
+	}
+	__atomic_store_n( &crud_network_shutdown, 1, __ATOMIC_SEQ_CST );
+	for ( i=1; i<started; i++ ) {
+		if ( write(crud_server_loops[i].evfd, &wake, sizeof(wake)) != sizeof(wake) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server wakeup failed [%u]", i );
+		}
+		pthread_join( crud_server_loops[i].thread, NULL );
+	}
+	if ( crud_server_workers > 0 ) {
+		crud_pool_stop( &crud_server_pool );
+	}
+
+	// Cleanup (a log left open by clients is flushed) and return
+	logMessage( LOG_INFO_LEVEL, "Shutting down CRUD server ..." );
+	if ( crud_server_logged ) {
+		crud_log_close( &crud_server_log );
+	}
+	for ( i=0; i<crud_server_threads; i++ ) {
+		close( crud_server_loops[i].epfd );
+		close( crud_server_loops[i].evfd );
+		close( crud_server_loops[i].lsock );
+		pthread_mutex_destroy( &crud_server_loops[i].lock );
+	}
+	for ( i=0; i<partitions; i++ ) {
+		pthread_mutex_destroy( &crud_server_locks[i] );
+	}
+	pthread_mutex_destroy( &crud_server_priority_lock );
+	pthread_rwlock_destroy( &crud_server_world );
+	crud_lease_cleanup( &crud_server_leases );
+	cleanupHashTable( &crud_server_registry );
+	cleanupHashTable( &crud_server_barriers );
+	pthread_mutex_destroy( &crud_server_registry_lock );
+	free( crud_server_loops );
+	free( crud_server_stores );
+	free( crud_server_locks );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_listen
+// Description  : Create the (non-blocking) listening socket for the server.
+//                With more than one thread each loop has its own socket on
+//                the port, and the kernel spreads new connections over them.
+//
+// Inputs       : none
+// Outputs      : the socket if successful, -1 if failure
+
+int crud_server_listen( void ) {
+
+	// Local variables
+	struct sockaddr_in saddr;
+	int sock, optval = 1;
+
+	// Create the socket, allow reuse of the port
+	if ( (sock = socket(PF_INET, SOCK_STREAM|SOCK_NONBLOCK, 0)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD socket() create failed : [%s]", strerror(errno) );
+		return( -1 );
+	}
+	if ( (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1) ||
+		 ((crud_server_threads > 1) &&
+		  (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD set socket option create failed : [%s]", strerror(errno) );
+		close( sock );
+		return( -1 );
+	}
+
+	// Bind to the server port, then listen
+	memset( &saddr, 0x0, sizeof(saddr) );
+	saddr.sin_family = AF_INET;
+	saddr.sin_port = htons( (crud_network_port == 0) ? CRUD_DEFAULT_PORT : crud_network_port );
+	saddr.sin_addr.s_addr = htonl( INADDR_ANY );
+	if ( bind(sock, (struct sockaddr *)&saddr, sizeof(saddr)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD bind() create failed : [%s]", strerror(errno) );
+		close( sock );
+		return( -1 );
+	}
+	if ( listen(sock, CRUD_MAX_BACKLOG) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD listen() create failed : [%s]", strerror(errno) );
+		close( sock );
+		return( -1 );
+	}
+
+	// Log and return the socket
+	logMessage( LOG_INFO_LEVEL, "Server bound and listening on port [%d]", ntohs(saddr.sin_port) );
+	return( sock );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_setup_loop
+// Description  : Setup an event loop, with its listening socket and inbox
+//
+// Inputs       : loop - the loop to setup
+//                id - the loop number
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_setup_loop( CrudLoop *loop, uint32_t id ) {
+
+	// Local variables
+	struct epoll_event ev;
+
+	// Create the socket, the event loop and the inbox signal
+	loop->id = id;
+	pthread_mutex_init( &loop->lock, NULL );
+	if ( (loop->lsock = crud_server_listen()) == -1 ) {
+		return( -1 );
+	}
+	if ( ((loop->epfd = epoll_create1(0)) == -1) ||
+		 ((loop->evfd = eventfd(0, EFD_NONBLOCK)) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD event loop create failed : [%s]", strerror(errno) );
+		return( -1 );
+	}
+
+	// Watch the listening socket (NULL) and the inbox (the loop)
+	memset( &ev, 0x0, sizeof(ev) );
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl( loop->epfd, EPOLL_CTL_ADD, loop->lsock, &ev );
+	ev.data.ptr = loop;
+	epoll_ctl( loop->epfd, EPOLL_CTL_ADD, loop->evfd, &ev );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_loop
+// Description  : Run an event loop until shutdown.  Events are handled with
+//                the world lock held for read, so requests needing the whole
+//                store are run between batches with it held for write.  The
+//                wait ends in time to send the held responses whose leases
+//                run out.
+//
+// Inputs       : arg - the loop to run
+// Outputs      : NULL
+
+void * crud_server_loop( void *arg ) {
+
+	// Local variables
+	struct epoll_event events[CRUD_SERVER_MAX_EVENTS];
+	CrudLoop *loop = arg;
+	CrudConnection *conn;
+	int nfds, i, timeout;
+
+	// Loop until we are told to shutdown
+	while ( !__atomic_load_n(&crud_network_shutdown, __ATOMIC_SEQ_CST) ) {
+
+		// Send the responses no longer held, then wait for something to happen
+		timeout = crud_server_unhold( loop );
+		if ( loop->global != NULL ) {
+			timeout = 0;
+		}
+		if ( (nfds = epoll_wait(loop->epfd, events, CRUD_SERVER_MAX_EVENTS, timeout)) == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			logMessage( LOG_ERROR_LEVEL, "CRUD server wait failued, aborting." );
+			break;
+		}
+
+		// Walk the events, accepting or servicing as needed
+		pthread_rwlock_rdlock( &crud_server_world );
+		for ( i=0; i<nfds; i++ ) {
+			if ( events[i].data.ptr == NULL ) {
+				while ( crud_server_accept(loop) != NULL );
+				continue;
+			}
+			if ( events[i].data.ptr == loop ) {
+				crud_server_inbox( loop );
+				continue;
+			}
+			conn = events[i].data.ptr;
+			if ( (events[i].events & (EPOLLERR|EPOLLHUP)) ||
+				 (crud_server_handle_connection(loop, conn)) ) {
+				crud_server_close( loop, conn );
+			}
+		}
+		pthread_rwlock_unlock( &crud_server_world );
+
+		// Now run any requests that need the whole store
+		while ( loop->global != NULL ) {
+			crud_server_global( loop );
+		}
+	}
+
+	// Return, nothing to report
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_accept
+// Description  : Accept a new client connection and add it to the event loop
+//
+// Inputs       : loop - the event loop
+// Outputs      : the new connection, NULL if none (or failure)
+
+CrudConnection * crud_server_accept( CrudLoop *loop ) {
+
+	// Local variables
+	struct epoll_event ev;
+	CrudConnection *conn;
+	socklen_t alen;
+	int sock, optval = 1;
+
+	// Accept the connection (if there is one)
+	if ( (conn = calloc(1, sizeof(CrudConnection))) == NULL ) {
+		return( NULL );
+	}
+	alen = sizeof(conn->addr);
+	if ( (sock = accept(loop->lsock, (struct sockaddr *)&conn->addr, &alen)) == -1 ) {
+		if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server accept failued : [%s]", strerror(errno) );
+		}
+		free( conn );
+		return( NULL );
+	}
+	fcntl( sock, F_SETFL, fcntl(sock, F_GETFL)|O_NONBLOCK );
+	setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval) );
+	conn->sock = sock;
+	conn->state = CRUD_CONN_HEADER;
+	conn->version = CRUD_PROTOCOL_V1;
+	conn->format = CRUD_PROTOCOL_V1;
+	conn->hdrlen = CRUD_NET_HEADER_SIZE;
+	conn->home = loop->id;
+	conn->id = __sync_add_and_fetch( &crud_server_next_id, 1 );
+
+	// Add it to the event loop
+	memset( &ev, 0x0, sizeof(ev) );
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	if ( epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sock, &ev) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD epoll_ctl() failed : [%s]", strerror(errno) );
+		close( sock );
+		free( conn );
+		return( NULL );
+	}
+
+	// Log and return the connection
+	logMessage( LOG_INFO_LEVEL, "Server new client connection [%s/%d, loop %u]",
+			inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port), loop->id );
+	return( conn );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_close
+// Description  : Close a client connection and release its resources.  If
+//                the client went away with the store open, its sessions are
+//                closed (with the next global requests) before the release.
+//                A client holding leases is no longer told of changes (nor
+//                waited on to acknowledge them), and a held response is
+//                dropped.
+//
+// Inputs       : loop - the event loop
+//                conn - the connection to close
+// Outputs      : none
+
+void crud_server_close( CrudLoop *loop, CrudConnection *conn ) {
+
+	// Local variables
+	CrudConnection **prev;
+	int notified = 0;
+	uint32_t i;
+
+	// Log, remove from the loop (and the held list), then cleanup
+	logMessage( LOG_INFO_LEVEL, "Closing client connection [%s/%d]",
+			inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port) );
+	epoll_ctl( loop->epfd, EPOLL_CTL_DEL, conn->sock, NULL );
+	close( conn->sock );
+	if ( conn->barrier != 0 ) {
+		pthread_mutex_lock( &crud_server_registry_lock );
+		if ( conn->awaiting > 0 ) {
+			deleteValueFromHashTable( &crud_server_barriers, conn->barrier );
+			conn->awaiting = 0;
+		}
+		if ( conn->held ) {
+			for ( prev=&loop->held; *prev!=NULL; prev=&(*prev)->nextheld ) {
+				if ( *prev == conn ) {
+					*prev = conn->nextheld;
+					break;
+				}
+			}
+			conn->held = 0;
+		}
+		conn->barrier = 0;
+		pthread_mutex_unlock( &crud_server_registry_lock );
+	}
+
+	// Leave the registry, the changes waiting on us go ahead
+	if ( conn->leases ) {
+		pthread_mutex_lock( &crud_server_registry_lock );
+		deleteValueFromHashTable( &crud_server_registry, conn->id );
+		for ( i=conn->acked; i<conn->npending; i++ ) {
+			crud_server_resolve( conn->pending[i].barrier );
+		}
+		conn->acked = conn->noticed = conn->npending = 0;
+		notified = conn->notified;
+		conn->notified = 0;
+		if ( notified ) {
+			pthread_mutex_lock( &loop->lock );
+			for ( prev=&loop->notify; *prev!=NULL; prev=&(*prev)->nextnotify ) {
+				if ( *prev == conn ) {
+					*prev = conn->nextnotify;
+					break;
+				}
+			}
+			pthread_mutex_unlock( &loop->lock );
+		}
+		pthread_mutex_unlock( &crud_server_registry_lock );
+	}
+	if ( conn->sessions > 0 ) {
+		conn->closing = 1;
+		conn->next = loop->global;
+		loop->global = conn;
+		return;
+	}
+	crud_server_release( conn );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_handle_connection
+// Description  : Service a connection that is ready, receiving as much of
+//                the request as is available and processing each complete
+//                request in turn.  The acknowledgements of invalidations
+//                are taken between requests, and while a response is held.
+//
+// Inputs       : loop - the event loop
+//                conn - the connection to service
+// Outputs      : 0 if successful, -1 if failure (connection should close)
+
+int crud_server_handle_connection( CrudLoop *loop, CrudConnection *conn ) {
+
+	// Local variables
+	CrudHeader hdr;
+	ssize_t n;
+	int ret;
+
+	// Finish sending any invalidations (unless a response is under way)
+	if ( (conn->noticepos < conn->noticelen) && (conn->state != CRUD_CONN_RESPONSE) &&
+		 (conn->state != CRUD_CONN_WAITING) && (crud_server_flush(loop->epfd, conn)) ) {
+		return( -1 );
+	}
+
+	// Keep going until the socket would block
+	while ( 1 ) {
+
+		switch ( conn->state ) {
+
+		case CRUD_CONN_HEADER: // Get the request header
+			n = recv( conn->sock, ((char *)conn->header)+conn->hdrpos, conn->hdrlen-conn->hdrpos, 0 );
+			if ( n <= 0 ) {
+				break;
+			}
+			conn->hdrpos += n;
+			if ( conn->hdrpos < conn->hdrlen ) {
+				continue;
+			}
+
+			// Have the header, an acknowledgement has no response (from a
+			// client that did not agree to leases it is just a bad request)
+			unpack_crud_header( conn->header, conn->format, &conn->cmd );
+			if ( (conn->cmd.req == CRUD_INVALIDATE) && conn->leases ) {
+				if ( crud_server_acknowledge(conn, (CrudOID)conn->cmd.oid) ) {
+					return( -1 );
+				}
+				conn->hdrpos = 0;
+				continue;
+			}
+
+			// See if there is a payload to receive (version 1 sends it as a
+			// single unframed chunk)
+			conn->length = 0;
+			conn->pos = 0;
+			conn->chunk = 0;
+			conn->chkpos = 0;
+			conn->trllen = 0;
+			conn->trlpos = 0;
+			conn->badsum = 0;
+			conn->crc = 0;
+			if ( ((conn->cmd.req == CRUD_CREATE) || (conn->cmd.req == CRUD_UPDATE)) && (conn->cmd.length > 0) ) {
+				if ( conn->cmd.length > CRUD_MAX_V2_OBJECT_SIZE ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD server object too large [%llu]",
+							(unsigned long long)conn->cmd.length );
+					return( -1 );
+				}
+				if ( crud_server_buffer(conn, conn->cmd.length) ) {
+					return( -1 );
+				}
+				conn->length = conn->cmd.length;
+				conn->trllen = conn->checksums ? CRUD_TRAILER_SIZE : 0;
+				if ( conn->version >= CRUD_PROTOCOL_V2 ) {
+					conn->state = CRUD_CONN_CHUNK;
+				} else {
+					conn->chunk = conn->length;
+					conn->state = CRUD_CONN_PAYLOAD;
+				}
+				continue;
+			}
+			if ( (ret = crud_server_dispatch(loop, conn)) != 0 ) {
+				return( (ret == -1) ? -1 : 0 );
+			}
+			continue;
+
+		case CRUD_CONN_CHUNK: // Get the length of the next chunk
+			n = recv( conn->sock, ((char *)&conn->chkhdr)+conn->chkpos, CRUD_NET_CHUNK_HEADER_SIZE-conn->chkpos, 0 );
+			if ( n <= 0 ) {
+				break;
+			}
+			conn->chkpos += n;
+			if ( conn->chkpos < CRUD_NET_CHUNK_HEADER_SIZE ) {
+				continue;
+			}
+			conn->chunk = ntohl( conn->chkhdr );
+			conn->chkpos = 0;
+			if ( (conn->chunk == 0) || (conn->chunk > CRUD_MAX_CHUNK_SIZE) ||
+				 (conn->chunk > conn->length-conn->pos) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD server bad payload chunk [%u]", conn->chunk );
+				return( -1 );
+			}
+			conn->state = CRUD_CONN_PAYLOAD;
+			continue;
+
+		case CRUD_CONN_PAYLOAD: // Get the request payload (or chunk of it)
+			n = recv( conn->sock, conn->buf+conn->pos, conn->chunk, 0 );
+			if ( n <= 0 ) {
+				break;
+			}
+			if ( conn->trllen > 0 ) {
+				// Checksum the bytes while they are still in the cache
+				conn->crc = crud_crc32c( conn->crc, conn->buf+conn->pos, n );
+			}
+			conn->pos += n;
+			conn->chunk -= n;
+			if ( conn->chunk > 0 ) {
+				continue;
+			}
+			if ( conn->pos < conn->length ) {
+				conn->state = CRUD_CONN_CHUNK;
+				continue;
+			}
+			if ( conn->trllen > 0 ) {
+				conn->state = CRUD_CONN_TRAILER;
+				continue;
+			}
+			if ( (ret = crud_server_dispatch(loop, conn)) != 0 ) {
+				return( (ret == -1) ? -1 : 0 );
+			}
+			continue;
+
+		case CRUD_CONN_TRAILER: // Get the payload checksum, check it
+			n = recv( conn->sock, ((char *)&conn->trailer)+conn->trlpos, conn->trllen-conn->trlpos, 0 );
+			if ( n <= 0 ) {
+				break;
+			}
+			conn->trlpos += n;
+			if ( conn->trlpos < conn->trllen ) {
+				continue;
+			}
+			if ( ntohl(conn->trailer) != conn->crc ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD server payload checksum mismatch [%s, %u bytes]",
+						CRUD_REQUEST_TYPE_LABLES[conn->cmd.req], conn->length );
+				conn->badsum = 1;
+			}
+			if ( (ret = crud_server_dispatch(loop, conn)) != 0 ) {
+				return( (ret == -1) ? -1 : 0 );
+			}
+			continue;
+
+		case CRUD_CONN_RESPONSE: // Waiting on the response to drain
+			if ( crud_server_send(loop->epfd, conn) ) {
+				return( -1 );
+			}
+			if ( conn->state == CRUD_CONN_RESPONSE ) {
+				return( 0 );
+			}
+			continue;
+
+		case CRUD_CONN_WAITING: // Nothing to do until the request is done
+			return( 0 );
+
+		case CRUD_CONN_HELD: // Only acknowledgements come until the response
+			n = recv( conn->sock, ((char *)conn->ack)+conn->ackpos, conn->hdrlen-conn->ackpos, 0 );
+			if ( n <= 0 ) {
+				break;
+			}
+			conn->ackpos += n;
+			if ( conn->ackpos < conn->hdrlen ) {
+				continue;
+			}
+			unpack_crud_header( conn->ack, conn->format, &hdr );
+			if ( (hdr.req != CRUD_INVALIDATE) || (!conn->leases) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD server request while response held [%s]",
+						(hdr.req < CRUD_MAXVAL) ? CRUD_REQUEST_TYPE_LABLES[hdr.req] : "BAD" );
+				return( -1 );
+			}
+			if ( crud_server_acknowledge(conn, (CrudOID)hdr.oid) ) {
+				return( -1 );
+			}
+			conn->ackpos = 0;
+			continue;
+		}
+
+		// We only get here on a failed or empty receive
+		if ( n == 0 ) {
+			return( -1 );
+		}
+		if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+			return( 0 );
+		}
+		if ( errno == EINTR ) {
+			continue;
+		}
+		logMessage( LOG_ERROR_LEVEL, "CRUD receive failed : [%s]", strerror(errno) );
+		return( -1 );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_dispatch
+// Description  : Route a fully received request to the partition that owns
+//                it: run it here, forward it to the owning loop (or the pool),
+//                or queue it to run with the world stopped.  Requests on the
+//                priority object (the FAT) always run here, under its own
+//                lock, so they never wait behind other requests.
+//
+// Inputs       : loop - the event loop
+//                conn - the connection with the request
+// Outputs      : 0 if done, 1 if the request is waiting, -1 if failure
+
+int crud_server_dispatch( CrudLoop *loop, CrudConnection *conn ) {
+
+	// Local variables
+	uint32_t owner;
+
+	// Reads need a buffer as big as the client's (up to the largest object)
+	if ( (conn->cmd.req == CRUD_READ) && crud_server_buffer(conn,
+			(conn->cmd.length > CRUD_MAX_V2_OBJECT_SIZE) ? CRUD_MAX_V2_OBJECT_SIZE : conn->cmd.length) ) {
+		return( -1 );
+	}
+
+	// Requests on the whole store wait for the end of the batch
+	conn->state = CRUD_CONN_WAITING;
+	owner = crud_server_owner( conn, loop->id );
+	if ( owner == CRUD_STORE_ALL_PARTITIONS ) {
+		conn->next = loop->global;
+		loop->global = conn;
+		return( 1 );
+	}
+
+	// The FAT is small and kept apart from the rest of its partition, run it
+	if ( conn->cmd.flags & CRUD_PRIORITY_OBJECT ) {
+		pthread_mutex_lock( &crud_server_priority_lock );
+		crud_server_execute( owner, conn );
+		pthread_mutex_unlock( &crud_server_priority_lock );
+		return( crud_server_respond(loop, conn) );
+	}
+
+	// With a pool the workers execute everything else (the socket leaves
+	// this loop until the request comes back), each request going to the
+	// worker of the partition owning it
+	if ( crud_server_workers > 0 ) {
+		epoll_ctl( loop->epfd, EPOLL_CTL_DEL, conn->sock, NULL );
+		conn->writing = 0;
+		if ( crud_pool_submit(&crud_server_pool, conn, owner) ) {
+			return( -1 );
+		}
+		return( 1 );
+	}
+
+	// Another loop owns the object, hand the connection over
+	if ( owner != loop->id ) {
+		epoll_ctl( loop->epfd, EPOLL_CTL_DEL, conn->sock, NULL );
+		conn->writing = 0;
+		crud_server_post( &crud_server_loops[owner], conn );
+		return( 1 );
+	}
+
+	// Ours, run it and start the response
+	crud_server_execute( owner, conn );
+	return( crud_server_respond(loop, conn) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_owner
+// Description  : Which partition executes the request of a connection (see
+//                crud_store_owner)
+//
+// Inputs       : conn - the connection with the request
+//                local - the partition of the caller
+// Outputs      : the partition number (CRUD_STORE_ALL_PARTITIONS if all)
+
+uint32_t crud_server_owner( CrudConnection *conn, uint32_t local ) {
+	return( crud_store_owner(crud_server_stores, construct_crud_request((CrudOID)conn->cmd.oid,
+			conn->cmd.req, 0, conn->cmd.flags, 0), local) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_execute
+// Description  : Execute a fully received request against the object store,
+//                setting up the response to be sent.
+//
+// Inputs       : owner - the partition (or all) to execute on
+//                conn - the connection with the request
+// Outputs      : none
+
+void crud_server_execute( uint32_t owner, CrudConnection *conn ) {
+
+	// Local variables
+	CRUD_REQUEST_TYPES req = conn->cmd.req;
+	uint64_t options = (req == CRUD_INIT) ? conn->cmd.length : 0;
+	int version = ((options & CRUD_PROTOCOL_VERSION_MASK) >= CRUD_PROTOCOL_V2) ? CRUD_PROTOCOL_V2 : CRUD_PROTOCOL_V1;
+	int checksums = ((options & CRUD_PROTOCOL_CRC32C) != 0);
+	int leases = ((options & CRUD_PROTOCOL_LEASES) != 0);
+	int format = version | (options & CRUD_PROTOCOL_VERSIONS);
+
+	// Perform the request (version 1 objects keep the version 1 limit, and
+	// payloads must match their checksum), keeping track of the client's
+	// sessions (an INIT answers with the version and options agreed on, 0
+	// for plain version 1)
+	if ( (conn->version < CRUD_PROTOCOL_V2) && ((req == CRUD_CREATE) || (req == CRUD_UPDATE)) &&
+		 (conn->cmd.length > CRUD_MAX_OBJECT_SIZE) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server object too large [%llu]", (unsigned long long)conn->cmd.length );
+		conn->cmd.res = 1;
+	} else if ( conn->badsum ) {
+		conn->cmd.res = 1;
+	} else {
+		crud_store_execute( crud_server_stores, owner, &conn->cmd, conn->buf );
+	}
+	// A client caching under leases is registered to be told of changes
+	// (INIT runs with the world stopped)
+	if ( (req == CRUD_INIT) && (conn->cmd.res == 0) && (leases) && (!conn->leases) ) {
+		pthread_mutex_lock( &crud_server_registry_lock );
+		if ( insertValueInHashTable(&crud_server_registry, conn->id, conn) == 0 ) {
+			conn->leases = 1;
+			crud_server_leasing = 1;
+		}
+		pthread_mutex_unlock( &crud_server_registry_lock );
+		leases = conn->leases;
+	}
+	if ( (req == CRUD_INIT) && (conn->cmd.res == 0) ) {
+		conn->sessions ++;
+		conn->cmd.length = ((format != CRUD_PROTOCOL_V1) || checksums || leases) ?
+				(format | (checksums ? CRUD_PROTOCOL_CRC32C : 0) | (leases ? CRUD_PROTOCOL_LEASES : 0)) : 0;
+	} else if ( (req == CRUD_CLOSE) && (conn->cmd.res == 0) && (conn->sessions > 0) ) {
+		conn->sessions --;
+	}
+	crud_server_lease( conn, req );
+
+	// Setup the response in the format of the request, then switch (an
+	// unchanged object is not sent)
+	pack_crud_header( &conn->cmd, conn->format, conn->header );
+	conn->hdrlen = size_crud_header( conn->format );
+	conn->hdrpos = 0;
+	if ( (req == CRUD_INIT) && (conn->cmd.res == 0) ) {
+		conn->version = version;
+		conn->format = format;
+		conn->checksums = checksums;
+	}
+	conn->length = ((req == CRUD_READ) && (conn->cmd.res == 0) && !(conn->cmd.flags & CRUD_IF_CHANGED)) ?
+			conn->cmd.length : 0;
+	conn->pos = 0;
+	conn->chunk = 0;
+	conn->chkpos = 0;
+	conn->trllen = 0;
+	conn->trlpos = 0;
+	if ( conn->checksums && (conn->length > 0) ) {
+		conn->trailer = htonl( crud_crc32c(0, conn->buf, conn->length) );
+		conn->trllen = CRUD_TRAILER_SIZE;
+	}
+	conn->state = CRUD_CONN_RESPONSE;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_lease
+// Description  : Keep the leases up to date after a request has executed: a
+//                change to an object revokes the leases of the other clients
+//                (queuing their invalidations, the writer only hears back
+//                once they are acknowledged, see crud_server_respond), and a
+//                caching client is granted a lease on the objects it reads
+//                or writes.  The priority object is never leased.
+//
+// Inputs       : conn - the connection with the request (and response)
+//                req - the request type
+// Outputs      : none
+
+void crud_server_lease( CrudConnection *conn, CRUD_REQUEST_TYPES req ) {
+
+	// Local variables
+	CrudOID oid = (CrudOID)conn->cmd.oid;
+	uint64_t now;
+
+	// Nothing to do unless someone caches, or the request failed
+	if ( (!crud_server_leasing) || (conn->cmd.res) || (conn->cmd.flags & CRUD_PRIORITY_OBJECT) ) {
+		return;
+	}
+
+	// Revoke the leases on what changed (the holders told are waited on
+	// under a new barrier), then grant the client its own
+	now = crud_lease_now();
+	if ( (req == CRUD_FORMAT) || (req == CRUD_UPDATE) || (req == CRUD_DELETE) ) {
+		conn->barrier = __sync_add_and_fetch( &crud_server_next_id, 1 );
+		conn->deadline = 0;
+	}
+	if ( req == CRUD_FORMAT ) {
+		crud_lease_revoke_all( &crud_server_leases, conn->id, now, crud_server_revoked, conn );
+	} else if ( (req == CRUD_UPDATE) || (req == CRUD_DELETE) ) {
+		crud_lease_revoke( &crud_server_leases, oid, conn->id, now, crud_server_revoked, conn );
+	}
+	if ( (conn->leases) && ((req == CRUD_READ) || (req == CRUD_CREATE) || (req == CRUD_UPDATE)) ) {
+		crud_lease_grant( &crud_server_leases, oid, conn->id, now );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_revoked
+// Description  : Queue an invalidation for the holder of a revoked lease, and
+//                tell the holder's loop (once) to send what is queued.  The
+//                writer waits on the holder's acknowledgement, or for the
+//                lease to run out.  A holder that has gone away is skipped.
+//
+// Inputs       : arg - the connection that changed the object
+//                holder - the connection holding the lease
+//                oid - the object changed
+//                expires - when the lease would have run out
+// Outputs      : none
+
+void crud_server_revoked( void *arg, uint64_t holder, CrudOID oid, uint64_t expires ) {
+
+	// Local variables
+	CrudConnection *conn, *writer = arg;
+	CrudInvalidation *pending;
+	CrudLoop *loop;
+	uint64_t wake = 1;
+
+	// Find the connection, the writer now waits on it
+	pthread_mutex_lock( &crud_server_registry_lock );
+	if ( (conn = findValueInHashTable(&crud_server_registry, holder)) == NULL ) {
+		pthread_mutex_unlock( &crud_server_registry_lock );
+		return;
+	}
+	if ( expires > writer->deadline ) {
+		writer->deadline = expires;
+	}
+	if ( (writer->awaiting++ == 0) &&
+		 (insertValueInHashTable(&crud_server_barriers, writer->barrier, writer)) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server barrier insert failed [%u]", oid );
+	}
+
+	// Queue the invalidation (dropping the acknowledged ones when full)
+	if ( conn->npending == conn->maxpending ) {
+		if ( conn->acked > 0 ) {
+			memmove( conn->pending, conn->pending+conn->acked, (conn->npending-conn->acked)*sizeof(CrudInvalidation) );
+			conn->npending -= conn->acked;
+			conn->noticed -= conn->acked;
+			conn->acked = 0;
+		} else if ( (pending = realloc(conn->pending, (conn->maxpending*2+8)*sizeof(CrudInvalidation))) == NULL ) {
+			pthread_mutex_unlock( &crud_server_registry_lock );
+			logMessage( LOG_ERROR_LEVEL, "CRUD server invalidation allocation failed [%u]", oid );
+			return;
+		} else {
+			conn->pending = pending;
+			conn->maxpending = conn->maxpending*2+8;
+		}
+	}
+	conn->pending[conn->npending].oid = oid;
+	conn->pending[conn->npending].barrier = writer->barrier;
+	conn->npending ++;
+
+	// Put it on the loop's notify list (while the registry keeps it alive)
+	if ( !conn->notified ) {
+		conn->notified = 1;
+		loop = &crud_server_loops[conn->home];
+		pthread_mutex_lock( &loop->lock );
+		conn->nextnotify = loop->notify;
+		loop->notify = conn;
+		pthread_mutex_unlock( &loop->lock );
+		if ( write(loop->evfd, &wake, sizeof(wake)) != sizeof(wake) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server notify signal failed : [%s]", strerror(errno) );
+		}
+	}
+	pthread_mutex_unlock( &crud_server_registry_lock );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_acknowledge
+// Description  : Take a client's acknowledgement of the oldest invalidation
+//                sent to it (they come back in order), letting the change
+//                that caused it go ahead once it is the last
+//
+// Inputs       : conn - the connection acknowledging
+//                oid - the object acknowledged
+// Outputs      : 0 if successful, -1 if failure (not the one expected)
+
+int crud_server_acknowledge( CrudConnection *conn, CrudOID oid ) {
+
+	// Check it is the next one, then resolve it
+	pthread_mutex_lock( &crud_server_registry_lock );
+	if ( (conn->acked == conn->noticed) || (conn->pending[conn->acked].oid != oid) ) {
+		pthread_mutex_unlock( &crud_server_registry_lock );
+		logMessage( LOG_ERROR_LEVEL, "CRUD server unexpected acknowledgement [OID %u]", oid );
+		return( -1 );
+	}
+	crud_server_resolve( conn->pending[conn->acked++].barrier );
+	if ( conn->acked == conn->npending ) {
+		conn->acked = conn->noticed = conn->npending = 0;
+	}
+	pthread_mutex_unlock( &crud_server_registry_lock );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_resolve
+// Description  : Count off one of the acknowledgements a change waits on,
+//                waking the writer's loop when it was the last (if the
+//                response is held there).  The registry must be locked.
+//
+// Inputs       : barrier - the change
+// Outputs      : none
+
+void crud_server_resolve( uint64_t barrier ) {
+
+	// Local variables
+	CrudConnection *writer;
+	uint64_t wake = 1;
+
+	// Find the writer (gone if it gave up waiting), count it off
+	if ( (writer = findValueInHashTable(&crud_server_barriers, barrier)) == NULL ) {
+		return;
+	}
+	if ( --writer->awaiting == 0 ) {
+		deleteValueFromHashTable( &crud_server_barriers, barrier );
+		if ( (writer->held) &&
+			 (write(crud_server_loops[writer->home].evfd, &wake, sizeof(wake)) != sizeof(wake)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server release signal failed : [%s]", strerror(errno) );
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_respond
+// Description  : Start the response to an executed request, unless it
+//                changed objects other clients hold leases on and they have
+//                not all acknowledged the invalidations yet.  Then the
+//                response is held (see crud_server_unhold) until they have,
+//                or their leases have run out.
+//
+// Inputs       : loop - the event loop (the connection's own)
+//                conn - the connection with the response
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_respond( CrudLoop *loop, CrudConnection *conn ) {
+
+	// Local variables
+	uint64_t now;
+
+	// Hold the response while there are holders to hear from
+	if ( conn->barrier != 0 ) {
+		now = crud_lease_now();
+		pthread_mutex_lock( &crud_server_registry_lock );
+		if ( (conn->awaiting > 0) && (conn->deadline > now) ) {
+			conn->held = 1;
+			conn->state = CRUD_CONN_HELD;
+			conn->nextheld = loop->held;
+			loop->held = conn;
+			pthread_mutex_unlock( &crud_server_registry_lock );
+			return( 0 );
+		}
+		if ( conn->awaiting > 0 ) {
+			deleteValueFromHashTable( &crud_server_barriers, conn->barrier );
+			conn->awaiting = 0;
+		}
+		conn->barrier = 0;
+		pthread_mutex_unlock( &crud_server_registry_lock );
+	}
+	return( crud_server_send(loop->epfd, conn) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_unhold
+// Description  : Send the held responses whose changes have been
+//                acknowledged by all of the holders told, or whose leases
+//                have all run out
+//
+// Inputs       : loop - the event loop
+// Outputs      : the msecs until the next lease runs out (-1 if none held)
+
+int crud_server_unhold( CrudLoop *loop ) {
+
+	// Local variables
+	CrudConnection *conn, **prev;
+	uint64_t now, next = 0;
+	int release;
+
+	// Walk the held connections, releasing the ones done waiting
+	now = crud_lease_now();
+	prev = &loop->held;
+	while ( (conn = *prev) != NULL ) {
+		pthread_mutex_lock( &crud_server_registry_lock );
+		if ( (release = ((conn->awaiting == 0) || (conn->deadline <= now))) ) {
+			if ( conn->awaiting > 0 ) {
+				logMessage( LOG_INFO_LEVEL, "CRUD server leases ran out before %u acknowledgements",
+						conn->awaiting );
+				deleteValueFromHashTable( &crud_server_barriers, conn->barrier );
+				conn->awaiting = 0;
+			}
+			conn->held = 0;
+			conn->barrier = 0;
+		}
+		pthread_mutex_unlock( &crud_server_registry_lock );
+		if ( !release ) {
+			next = ((next == 0) || (conn->deadline < next)) ? conn->deadline : next;
+			prev = &conn->nextheld;
+			continue;
+		}
+		*prev = conn->nextheld;
+		conn->state = CRUD_CONN_RESPONSE;
+		if ( crud_server_send(loop->epfd, conn) ) {
+			crud_server_close( loop, conn );
+		}
+	}
+	return( (next == 0) ? -1 : (int)((next-now+999)/1000) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_work
+// Description  : Execute a request on a pool worker, then hand the
+//                connection back to its loop to send the response.
+//
+// Inputs       : job - the connection with the request
+//                worker - the worker number
+// Outputs      : none
+
+void crud_server_work( void *job, uint32_t worker ) {
+
+	// Local variables
+	CrudConnection *conn = job;
+	uint32_t owner;
+
+	// Execute holding the partition (new objects go to our partition)
+	pthread_rwlock_rdlock( &crud_server_world );
+	owner = crud_server_owner( conn, worker );
+	pthread_mutex_lock( &crud_server_locks[owner] );
+	crud_server_execute( owner, conn );
+	pthread_mutex_unlock( &crud_server_locks[owner] );
+	pthread_rwlock_unlock( &crud_server_world );
+
+	// Send it home
+	crud_server_post( &crud_server_loops[conn->home], conn );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_post
+// Description  : Put a connection in a loop's inbox, and wake the loop
+//
+// Inputs       : loop - the loop to post to
+//                conn - the connection
+// Outputs      : none
+
+void crud_server_post( CrudLoop *loop, CrudConnection *conn ) {
+
+	// Local variables
+	uint64_t wake = 1;
+
+	// Add to the inbox, then signal
+	pthread_mutex_lock( &loop->lock );
+	conn->next = loop->inbox;
+	loop->inbox = conn;
+	pthread_mutex_unlock( &loop->lock );
+	if ( write(loop->evfd, &wake, sizeof(wake)) != sizeof(wake) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server inbox signal failed : [%s]", strerror(errno) );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_inbox
+// Description  : Process the connections in the loop's inbox.  Requests from
+//                other loops are executed and sent back, our own connections
+//                are done and rejoin the loop to send the response.  Then
+//                the invalidations queued for our connections are sent.
+//
+// Inputs       : loop - the event loop
+// Outputs      : none
+
+void crud_server_inbox( CrudLoop *loop ) {
+
+	// Local variables
+	struct epoll_event ev;
+	CrudConnection *conn, *next;
+	uint64_t count;
+
+	// Clear the signal, take everything in the inbox
+	if ( read(loop->evfd, &count, sizeof(count)) == -1 ) {
+		return;
+	}
+	pthread_mutex_lock( &loop->lock );
+	conn = loop->inbox;
+	loop->inbox = NULL;
+	pthread_mutex_unlock( &loop->lock );
+
+	// Walk the connections (which are not ours once posted)
+	while ( conn != NULL ) {
+		next = conn->next;
+		if ( conn->home != loop->id ) {
+			crud_server_execute( loop->id, conn );
+			crud_server_post( &crud_server_loops[conn->home], conn );
+		} else {
+			memset( &ev, 0x0, sizeof(ev) );
+			ev.events = EPOLLIN;
+			ev.data.ptr = conn;
+			if ( (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, conn->sock, &ev) == -1) ||
+				 (crud_server_respond(loop, conn)) ) {
+				crud_server_close( loop, conn );
+			}
+		}
+		conn = next;
+	}
+
+	// Now the connections with invalidations to send
+	pthread_mutex_lock( &loop->lock );
+	conn = loop->notify;
+	loop->notify = NULL;
+	pthread_mutex_unlock( &loop->lock );
+	while ( conn != NULL ) {
+		next = conn->nextnotify;
+		if ( crud_server_notify(loop->epfd, conn) ) {
+			crud_server_close( loop, conn );
+		}
+		conn = next;
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_global
+// Description  : Run the requests that touch every partition of the store
+//                (and the CLOSEs of departed clients) with the other loops
+//                stopped, then send the responses.
+//
+// Inputs       : loop - the event loop
+// Outputs      : none
+
+void crud_server_global( CrudLoop *loop ) {
+
+	// Local variables
+	CrudConnection *list, *conn, *next;
+	CrudRequest close_request = construct_crud_request( 0, CRUD_CLOSE, 0, 0, 0 );
+
+	// Take the waiting connections
+	list = loop->global;
+	loop->global = NULL;
+
+	// Execute the requests with the world stopped
+	pthread_rwlock_wrlock( &crud_server_world );
+	for ( conn=list; conn!=NULL; conn=conn->next ) {
+		if ( conn->closing ) {
+			for ( ; conn->sessions>0; conn->sessions-- ) {
+				crud_store_request( crud_server_stores, CRUD_STORE_ALL_PARTITIONS, close_request, NULL );
+			}
+		} else {
+			crud_server_execute( CRUD_STORE_ALL_PARTITIONS, conn );
+		}
+	}
+	pthread_rwlock_unlock( &crud_server_world );
+
+	// Now send the responses (or finish closing)
+	for ( conn=list; conn!=NULL; conn=next ) {
+		next = conn->next;
+		if ( conn->closing ) {
+			crud_server_release( conn );
+		} else if ( crud_server_respond(loop, conn) ) {
+			crud_server_close( loop, conn );
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_send
+// Description  : Send as much of the response as the socket will take,
+//                waiting on EPOLLOUT if it would block.  Version 2 payloads
+//                go out in chunks of CRUD_CHUNK_SIZE, the checksum (if any)
+//                after the last.  Invalidations waiting to go out are sent
+//                before the response starts, or after it is done.
+//
+// Inputs       : epfd - the event loop
+//                conn - the connection with the response
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_send( int epfd, CrudConnection *conn ) {
+
+	// Local variables
+	struct epoll_event ev;
+	struct iovec iov[4];
+	int iovcnt;
+	ssize_t n, part;
+
+	// Finish the invalidations before starting the response
+	if ( (conn->hdrpos == 0) && (conn->noticepos < conn->noticelen) ) {
+		if ( crud_server_flush(epfd, conn) ) {
+			return( -1 );
+		}
+		if ( conn->noticepos < conn->noticelen ) {
+			return( 0 );
+		}
+	}
+
+	// Keep sending until done or the socket would block
+	while ( (conn->hdrpos < conn->hdrlen) || (conn->pos < conn->length) || (conn->trlpos < conn->trllen) ) {
+
+		// Start the next chunk of the payload (version 1 sends the payload
+		// as a single chunk, without the length)
+		if ( (conn->chunk == 0) && (conn->pos < conn->length) ) {
+			conn->chunk = conn->length-conn->pos;
+			conn->chkpos = CRUD_NET_CHUNK_HEADER_SIZE;
+			if ( conn->version >= CRUD_PROTOCOL_V2 ) {
+				conn->chunk = (conn->chunk > CRUD_CHUNK_SIZE) ? CRUD_CHUNK_SIZE : conn->chunk;
+				conn->chkhdr = htonl( conn->chunk );
+				conn->chkpos = 0;
+			}
+		}
+
+		// Setup the remaining header, chunk length, chunk and trailer
+		iovcnt = 0;
+		if ( conn->hdrpos < conn->hdrlen ) {
+			iov[iovcnt].iov_base = ((char *)conn->header)+conn->hdrpos;
+			iov[iovcnt].iov_len = conn->hdrlen-conn->hdrpos;
+			iovcnt ++;
+		}
+		if ( conn->chunk > 0 ) {
+			if ( conn->chkpos < CRUD_NET_CHUNK_HEADER_SIZE ) {
+				iov[iovcnt].iov_base = ((char *)&conn->chkhdr)+conn->chkpos;
+				iov[iovcnt].iov_len = CRUD_NET_CHUNK_HEADER_SIZE-conn->chkpos;
+				iovcnt ++;
+			}
+			iov[iovcnt].iov_base = conn->buf+conn->pos;
+			iov[iovcnt].iov_len = conn->chunk;
+			iovcnt ++;
+		}
+		if ( (conn->pos+conn->chunk == conn->length) && (conn->trlpos < conn->trllen) ) {
+			iov[iovcnt].iov_base = ((char *)&conn->trailer)+conn->trlpos;
+			iov[iovcnt].iov_len = conn->trllen-conn->trlpos;
+			iovcnt ++;
+		}
+
+		// Send, bail out when the socket is full
+		if ( (n = writev(conn->sock, iov, iovcnt)) == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+				if ( !conn->writing ) {
+					ev.events = EPOLLIN|EPOLLOUT;
+					ev.data.ptr = conn;
+					epoll_ctl( epfd, EPOLL_CTL_MOD, conn->sock, &ev );
+					conn->writing = 1;
+				}
+				return( 0 );
+			}
+			logMessage( LOG_ERROR_LEVEL, "CRUD send failed : [%s]", strerror(errno) );
+			return( -1 );
+		}
+
+		// Account for the bytes sent (header, chunk length, chunk, then trailer)
+		part = (n < conn->hdrlen-conn->hdrpos) ? n : conn->hdrlen-conn->hdrpos;
+		conn->hdrpos += part;
+		n -= part;
+		if ( conn->chunk > 0 ) {
+			part = (n < CRUD_NET_CHUNK_HEADER_SIZE-conn->chkpos) ? n : CRUD_NET_CHUNK_HEADER_SIZE-conn->chkpos;
+			conn->chkpos += part;
+			n -= part;
+			part = (n < conn->chunk) ? n : conn->chunk;
+			conn->pos += part;
+			conn->chunk -= part;
+			n -= part;
+		}
+		conn->trlpos += n;
+	}
+
+	// Done, back to waiting on the next request (in the version agreed on)
+	if ( conn->writing ) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		epoll_ctl( epfd, EPOLL_CTL_MOD, conn->sock, &ev );
+		conn->writing = 0;
+	}
+	conn->hdrlen = size_crud_header( conn->format );
+	conn->hdrpos = 0;
+	conn->length = 0;
+	conn->pos = 0;
+	conn->chunk = 0;
+	conn->chkpos = 0;
+	conn->trllen = 0;
+	conn->trlpos = 0;
+	conn->state = CRUD_CONN_HEADER;
+
+	// An acknowledgement cut short while the response was held is finished
+	// like any other header
+	memcpy( conn->header, conn->ack, conn->ackpos );
+	conn->hdrpos = conn->ackpos;
+	conn->ackpos = 0;
+	return( crud_server_flush(epfd, conn) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_notify
+// Description  : Take the invalidations queued for a connection (by
+//                crud_server_revoked) and send them, unless a response is
+//                on its way (then they follow it).  They stay queued until
+//                the client acknowledges them.  Run by the connection's own
+//                loop.
+//
+// Inputs       : epfd - the event loop
+//                conn - the connection
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_notify( int epfd, CrudConnection *conn ) {
+
+	// Local variables
+	uint32_t hdrlen = size_crud_header( conn->format );
+	uint32_t need, i;
+	CrudHeader hdr;
+	char *notice;
+
+	// Put the invalidations in wire format after any not yet sent
+	memset( &hdr, 0x0, sizeof(hdr) );
+	hdr.req = CRUD_INVALIDATE;
+	pthread_mutex_lock( &crud_server_registry_lock );
+	need = conn->noticelen + (conn->npending-conn->noticed)*hdrlen;
+	if ( need > conn->noticesize ) {
+		if ( (notice = realloc(conn->notice, need)) == NULL ) {
+			pthread_mutex_unlock( &crud_server_registry_lock );
+			logMessage( LOG_ERROR_LEVEL, "CRUD server invalidation allocation failed [%u]", need );
+			return( -1 );
+		}
+		conn->notice = notice;
+		conn->noticesize = need;
+	}
+	for ( i=conn->noticed; i<conn->npending; i++ ) {
+		hdr.oid = conn->pending[i].oid;
+		pack_crud_header( &hdr, conn->format, (uint64_t *)(conn->notice+conn->noticelen) );
+		conn->noticelen += hdrlen;
+	}
+	conn->noticed = conn->npending;
+	conn->notified = 0;
+	pthread_mutex_unlock( &crud_server_registry_lock );
+
+	// Send now if nothing else is going out
+	if ( (conn->state == CRUD_CONN_RESPONSE) || (conn->state == CRUD_CONN_WAITING) ) {
+		return( 0 );
+	}
+	return( crud_server_flush(epfd, conn) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_flush
+// Description  : Send as much of the waiting invalidations as the socket will
+//                take, waiting on EPOLLOUT if it would block
+//
+// Inputs       : epfd - the event loop
+//                conn - the connection
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_flush( int epfd, CrudConnection *conn ) {
+
+	// Local variables
+	struct epoll_event ev;
+	ssize_t n;
+
+	// Send until done or the socket would block
+	while ( conn->noticepos < conn->noticelen ) {
+		if ( (n = write(conn->sock, conn->notice+conn->noticepos, conn->noticelen-conn->noticepos)) == -1 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+				if ( !conn->writing ) {
+					ev.events = EPOLLIN|EPOLLOUT;
+					ev.data.ptr = conn;
+					epoll_ctl( epfd, EPOLL_CTL_MOD, conn->sock, &ev );
+					conn->writing = 1;
+				}
+				return( 0 );
+			}
+			logMessage( LOG_ERROR_LEVEL, "CRUD send failed : [%s]", strerror(errno) );
+			return( -1 );
+		}
+		conn->noticepos += n;
+	}
+
+	// Done, stop waiting on EPOLLOUT unless the response needs it
+	conn->noticelen = 0;
+	conn->noticepos = 0;
+	if ( (conn->writing) && (conn->state != CRUD_CONN_RESPONSE) ) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		epoll_ctl( epfd, EPOLL_CTL_MOD, conn->sock, &ev );
+		conn->writing = 0;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_buffer
+// Description  : Make sure the connection payload buffer is big enough (the
+//                buffer is kept between requests to avoid reallocating)
+//
+// Inputs       : conn - the connection
+//                length - the size needed
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server_buffer( CrudConnection *conn, uint32_t length ) {
+
+	// Local variables
+	char *buf;
+
+	// Grow the buffer if necessary
+	if ( (conn->buf == NULL) || (conn->bufsize < length) ) {
+		if ( (buf = realloc(conn->buf, (length > 0) ? length : 1)) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD server buffer allocation failed [%u]", length );
+			return( -1 );
+		}
+		conn->buf = buf;
+		conn->bufsize = length;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_release
+// Description  : Free a closed connection and its buffers
+//
+// Inputs       : conn - the connection
+// Outputs      : none
+
+void crud_server_release( CrudConnection *conn ) {
+	free( conn->buf );
+	free( conn->pending );
+	free( conn->notice );
+	free( conn );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_signal_handler
+// Description  : Catch a shutdown signal, flag the server to stop
+//
+// Inputs       : sig - the signal received
+// Outputs      : none
+
+void crud_signal_handler( int sig ) {
+	__atomic_store_n( &crud_network_shutdown, 1, __ATOMIC_SEQ_CST );
+	return;
+}
@@ -14,9 +14,14 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -25,41 +30,204 @@
 #include <crud_driver.h>
 #include <crud_network.h>
 #include <crud_file_io.h>
+#include <crud_backend.h>
+#include <crud_capture.h>
+#include <crud_dump.h>
+#include <crud_import.h>
+#include <crud_trace.h>
+#include <crud_hist.h>
+#include <crud_gen.h>
+#include <crud_crc.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
-#define CRUD_SIM_MAX_OPEN_FILES 128
-#define CRUD_ARGUMENTS "hvul:x:a:p:"
+#define CRUD_SIM_TABLE_SLOTS 64 // The slots a file table starts with (a power of two)
+#define CRUD_SIM_MAX_WORKERS 64
+#define CRUD_SIM_MAX_RATES 32
+#define CRUD_ARGUMENTS "hvkLVPul:A:x:a:p:b:n:m:T:w:H:r:g:C:R:X:I:"
 #define USAGE \
-	"USAGE: crud [-h] [-v] [-l <logfile>] [-c <sz>] [-x <file>] [-a <ip addr>] [-p <port>] <workload-file>\n" \
+	"USAGE: crud [-h] [-v] [-k] [-L] [-V] [-l <logfile>] [-A <policy>] [-c <sz>] [-x <file>] [-a <ip addr>] [-p <port>] [-b <backend>] [-n <version>]\n" \
+	"            [-m <clients>] [-T <trace>] [-w <workers>] [-H <file>] [-r <rate>[,<rate>...]] [-P] [-g <spec>]\n" \
+	"            [-C <capture>[:crc]] [-R <capture>[:timed]] [-X <target>]\n" \
+	"            [-I <source>]\n" \
+	"            <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -u - run the unit tests instead of the simulator\n" \
 	"    -v - verbose output\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
+	"    -A - write the log on a thread of its own, <policy> (block or drop)\n" \
+	"         saying whether a message waits or is dropped when it falls behind\n" \
 	"    -x - extract a file <file> from the crud filesystem\n" \
 	"    -a - IP address of server to connect to.\n" \
 	"    -p - port number of server to connect to.\n" \
+	"    -b - send the requests to <backend>: network (the server, default),\n" \
+	"         memory (a store in this process) or file[:<image>] (a store in\n" \
+	"         this process saved to <image>, default crud_content.crd)\n" \
+	"    -n - protocol version to ask the server for (1 or 2, default 2)\n" \
+	"    -k - checksum the payloads sent to/from the server (CRC32C)\n" \
+	"    -L - cache the objects read/written under read leases from the server\n" \
+	"    -V - use object versions, so that writes to a file shared with other\n" \
+	"         clients only apply to the contents they read (retrying if not)\n" \
+	"    -m - run the multi-client benchmark with <clients> clients instead of\n" \
+	"         a workload (against the server)\n" \
+	"    -T - convert the (text) workload into the binary trace <trace> instead\n" \
+	"         of running it, the trace can then be run as the workload-file\n" \
+	"    -w - replay the workload on <workers> threads, the files split among\n" \
+	"         them (each file's commands in order, FORMAT/MOUNT/UNMOUNT once all\n" \
+	"         before are done), each a client of its own (default 0, in order\n" \
+	"         on the main thread)\n" \
+	"    -H - also write the latencies of the filesystem calls to <file> (with\n" \
+	"         -r the response times at each rate), as JSON if it ends in .json\n" \
+	"         (with the histogram buckets), CSV if not\n" \
+	"    -r - replay open loop, starting the commands on a schedule of <rate>\n" \
+	"         commands/sec whether or not the ones before are done, each\n" \
+	"         command's response time counted from when it should have started\n" \
+	"         (a list of rates replays the workload at each, for a curve of\n" \
+	"         throughput against response time)\n" \
+	"    -P - with -r, start the commands as Poisson arrivals (at that mean rate)\n" \
+	"    -g - generate a workload of the shape <spec> into the workload-file\n" \
+	"         instead of running one (a binary trace if it ends in .trc), the\n" \
+	"         spec a comma separated list of any of:\n" \
+	"             files=<n>       the number of files\n" \
+	"             ops=<n>         the number of commands\n" \
+	"             skew=<s>        the Zipf skew of the file popularity (0 uniform)\n" \
+	"             mix=<r>:<w>:<s>[:<wa>]  the weights of READ, WRITE, SEEK, WRITEAT\n" \
+	"             size=fixed:<n>|uniform:<lo>:<hi>|exp:<mean>  the write/read sizes\n" \
+	"             max=<n>         the size files are kept under\n" \
+	"             seed=<n>        the seed (the same seed, the same workload)\n" \
+	"         the rest as in " CRUD_GEN_DEFAULT_SPEC "\n" \
+	"    -C - capture the requests sent to the backend (with their responses\n" \
+	"         and timing) to the binary file <capture>, checksumming the\n" \
+	"         payloads if :crc follows the name\n" \
+	"    -R - replay the requests of <capture> straight to the backend instead\n" \
+	"         of running a workload (without the filesystem), a thread for each\n" \
+	"         thread captured, each request sent when it was captured if\n" \
+	"         :timed follows the name, as soon as the one before is done if not\n" \
+	"    -X - extract every file of the filesystem into <target> instead of\n" \
+	"         running a workload: a tar archive if it ends in .tar (- for the\n" \
+	"         standard output), a directory if not, fetched over -w connections\n" \
+	"         (default 4)\n" \
+	"    -I - import the files of the directory <source> (or listed in the\n" \
+	"         file <source>, a path a line) into the filesystem instead of\n" \
+	"         running a workload, each as an object created at its full size,\n" \
+	"         over -w connections (default 4)\n" \
 	"\n" \
-	"    <workload-file> - file contain the workload to simulate\n" \
+	"    <workload-file> - file contain the workload to simulate (text or trace)\n" \
 	"\n" \
 
-// This is the file table
+// Time a filesystem call (the value of the call), recording its latency
+#define CRUD_SIM_TIMED(stats, op, call) ({ \
+	uint64_t start_ = crud_hist_now(); \
+	int32_t res_ = (call); \
+	crud_hist_record( &(stats)->ops[op], crud_hist_now()-start_ ); \
+	res_; })
+
+// These are the filesystem calls timed
+typedef enum {
+	CRUD_SIM_OP_FORMAT  = 0, // crud_format
+	CRUD_SIM_OP_MOUNT   = 1, // crud_mount
+	CRUD_SIM_OP_UNMOUNT = 2, // crud_unmount
+	CRUD_SIM_OP_OPEN    = 3, // crud_open
+	CRUD_SIM_OP_CLOSE   = 4, // crud_close
+	CRUD_SIM_OP_SEEK    = 5, // crud_seek
+	CRUD_SIM_OP_WRITE   = 6, // crud_write
+	CRUD_SIM_OP_READ    = 7, // crud_read
+	CRUD_SIM_OP_MAXVAL  = 8, // Max value
+} CRUD_SIM_OPS;
+
+// These are the latencies of the calls (in nanoseconds)
 typedef struct {
-	char     *filename;  // This is the filename for the test file
-	int16_t   fhandle;   // This is a file handle for the opened file
+	CrudHistogram ops[CRUD_SIM_OP_MAXVAL];      // The filesystem calls
+	CrudHistogram commands[CRUD_SIM_MAXVAL];    // The response times of the commands (open loop)
+} CrudSimulationStats;
+
+// This is the schedule (and result) of an open-loop replay
+typedef struct {
+	double        rate;     // The commands started per second
+	int           poisson;  // Flag indicating Poisson arrivals (a fixed schedule if not)
+	uint64_t      seed;     // The state of the arrival generator (xorshift64*)
+	uint64_t      start;    // When the schedule started (nsecs, 0 if not yet)
+	double        offset;   // When the next command should start (nsecs after start)
+	double        achieved; // The commands completed per second
+	CrudHistogram response; // The response times of all of the commands
+} CrudSimulationLoad;
+
+// This is a file of the file table
+typedef struct {
+	char     *filename;  // This is the filename for the test file (NULL if a free slot)
+	uint32_t  hash;      // The hash of the filename (CRC32C)
+	int32_t   fhandle;   // This is a file handle for the opened file
+} CrudSimulationFile;
+
+// This is the file table, hashed on the filenames (open addressing, the
+// slots doubled once they are 3/4 full)
+typedef struct {
+	CrudSimulationFile *files; // The slots (NULL until the first file)
+	uint32_t            slots; // The number of slots (a power of two)
+	uint32_t            used;  // The number of files in the table
 } CrudSimulationTable;
 
+// This is a workload being replayed by the workers (see simulate_parallel)
+typedef struct {
+	CrudTrace             *trace;    // The trace (NULL if text)
+	CrudSimulationCommand *commands; // The parsed commands (if text)
+	uint32_t               count;    // The number of commands
+	int16_t               *owner;    // The worker running each (-1 if all wait)
+	uint64_t              *when;     // When each should start (open loop, else NULL)
+	uint32_t               start;    // The first command of the current phase
+	uint32_t               end;      // The end of the current phase
+	int                    failed;   // Flag indicating a worker failed
+} CrudSimulationReplay;
+
+// This is a worker of a parallel replay
+typedef struct {
+	CrudSimulationReplay *replay; // The replay
+	int16_t               worker; // The number of the worker
+	pthread_t             thread; // The thread (for the current phase)
+	int                   ret;    // The result of the current phase
+	char                 *rbuf;   // The buffer for reads
+	char                 *tbuf;   // The buffer for expanded trace payloads
+	CrudSimulationTable   ftable; // The files it opened
+	CrudSimulationStats   stats;  // The latencies of its calls
+} CrudSimulationWorker;
+
 //
 // Global Data
 int verbose;
+const char *CRUD_SIM_OP_LABELS[CRUD_SIM_OP_MAXVAL] = {
+	"FORMAT",
+	"MOUNT",
+	"UNMOUNT",
+	"OPEN",
+	"CLOSE",
+	"SEEK",
+	"WRITE",
+	"READ"
+};
 
 //
 // Functional Prototypes
 
-int simulate_CRUD( char *wload );
+int simulate_CRUD( char *wload, int workers, char *hfile, CrudSimulationLoad *load );
+int simulate_parallel( CrudTrace *trace, char *map, char *end, int workers, CrudSimulationStats *stats,
+		CrudSimulationLoad *load );
+void *simulate_worker( void *arg );
+int simulate_fetch( CrudSimulationReplay *replay, uint32_t idx, CrudSimulationCommand *cmd, char *tbuf );
+int simulate_issue( CrudSimulationTable *ftable, CrudSimulationCommand *cmd, char *rbuf, CrudSimulationStats *stats,
+		uint64_t when );
+uint64_t simulate_arrival( CrudSimulationLoad *load );
+int simulate_command( CrudSimulationTable *ftable, CrudSimulationCommand *cmd, char *rbuf, CrudSimulationStats *stats );
+int simulate_close( CrudSimulationTable *ftable, CrudSimulationStats *stats );
+CrudSimulationFile *simulate_lookup( CrudSimulationTable *ftable, char *fname, int *added );
+void simulate_release( CrudSimulationTable *ftable );
+void simulate_stats( CrudSimulationStats *stats );
+int simulate_report( CrudSimulationStats *stats, uint64_t usecs, int workers, char *hfile, CrudSimulationLoad *load );
+int simulate_curve( CrudSimulationLoad *loads, int count, int workers, char *hfile );
+void simulate_log( const char *label, CrudHistogram *hist, double rate );
+void simulate_write( FILE *fh, int json, CrudHistogram *hist );
 int extract_file_from_crud(char *ex_file);
 
 //
@@ -76,9 +244,15 @@ int extract_file_from_crud(char *ex_file);
 
 int main( int argc, char *argv[] ) {
 	// Local variables
-	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0;
+	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0, bench_clients = 0, workers = 0;
+	int async_log = -1;
+	int poisson = 0, rates = 0, i;
 	uint32_t cache_size = 1024; // Defaults to 1024 cache lines
-	char *ex_file = NULL;
+	char *ex_file = NULL, *trace_file = NULL, *hist_file = NULL, *gen_spec = NULL, *rate;
+	char *capture_spec = NULL, *replay_spec = NULL, *dump_target = NULL, *import_source = NULL;
+	CrudGenSpec gen;
+	double rate_list[CRUD_SIM_MAX_RATES];
+	CrudSimulationLoad *loads;
 
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, CRUD_ARGUMENTS)) != -1) {
@@ -92,6 +266,25 @@ int main( int argc, char *argv[] ) {
 			verbose = 1;
 			break;
 
+		case 'k': // Checksum the payloads
+			crud_network_checksums = 1;
+			break;
+
+		case 'L': // Cache under read leases
+			crud_network_leases = 1;
+			break;
+
+		case 'V': // Use object versions
+			crud_network_versions = 1;
+			break;
+
+		case 'm': // Run the benchmark
+			if ( (sscanf(optarg, "%d", &bench_clients) != 1) || (bench_clients < 1) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of clients [%s]", optarg );
+				return(-1);
+			}
+			break;
+
 		case 'u': // Unit Tests Flag
 			unit_tests = 1;
 			break;
@@ -101,6 +294,67 @@ int main( int argc, char *argv[] ) {
 			log_initialized = 1;
 			break;
 
+		case 'A': // Write the log asynchronously
+			if ( strcmp(optarg, "block") == 0 ) {
+				async_log = CMPSC311_LOG_BLOCK;
+			} else if ( strcmp(optarg, "drop") == 0 ) {
+				async_log = CMPSC311_LOG_DROP;
+			} else {
+				fprintf( stderr, "Bad log policy [%s], should be block or drop\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'T': // Convert the workload to a trace
+			trace_file = optarg;
+			break;
+
+		case 'g': // Generate a workload
+			gen_spec = optarg;
+			break;
+
+		case 'C': // Capture the requests
+			capture_spec = optarg;
+			break;
+
+		case 'R': // Replay a capture
+			replay_spec = optarg;
+			break;
+
+		case 'X': // Extract the filesystem
+			dump_target = optarg;
+			break;
+
+		case 'I': // Import into the filesystem
+			import_source = optarg;
+			break;
+
+		case 'H': // Write the latencies to a file
+			hist_file = optarg;
+			break;
+
+		case 'r': // Replay open loop at some rates
+			for ( rate=strtok(optarg, ","); rate != NULL; rate=strtok(NULL, ",") ) {
+				if ( (rates == CRUD_SIM_MAX_RATES) || (sscanf(rate, "%lf", &rate_list[rates]) != 1) ||
+					 (rate_list[rates] <= 0.0) ) {
+					logMessage( LOG_ERROR_LEVEL, "Bad rate [%s]", rate );
+					return(-1);
+				}
+				rates ++;
+			}
+			break;
+
+		case 'P': // Poisson arrivals
+			poisson = 1;
+			break;
+
+		case 'w': // Replay on worker threads
+			if ( (sscanf(optarg, "%d", &workers) != 1) || (workers < 0) || (workers > CRUD_SIM_MAX_WORKERS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of workers [%s]", optarg );
+				return(-1);
+			}
+			break;
+
 		case 'x': // Set the log filename
 			ex_file = optarg;
 			extract_file = 1;
@@ -128,6 +382,21 @@ int main( int argc, char *argv[] ) {
 			}
             break;
 
+		case 'b': // Select the backend
+			if ( crud_backend_select(optarg) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad backend [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'n': // Set the protocol version
+			if ( (sscanf(optarg, "%d", &crud_network_protocol) != 1) ||
+					(crud_network_protocol < CRUD_PROTOCOL_V1) || (crud_network_protocol > CRUD_PROTOCOL_V2) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad protocol version [%s]", optarg );
+				return(-1);
+			}
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -141,18 +410,69 @@ int main( int argc, char *argv[] ) {
 	if ( verbose ) {
 		enableLogLevels( LOG_INFO_LEVEL );
 	}
+	if ( (async_log != -1) && startAsyncLog(async_log) ) {
+		return( -1 );
+	}
+
+	// Capture the requests as needed (the capture is written out at exit)
+	if ( (capture_spec != NULL) && crud_capture_start(capture_spec) ) {
+		return( -1 );
+	}
 
 	// If we are running the unit tests, do that
 	if ( unit_tests ) {
 
 		// Enable verbose, run the tests and check the results
 		enableLogLevels( LOG_INFO_LEVEL );
-		if ( b64UnitTest() || crudIOUnitTest() ) {
+		if ( b64UnitTest() || logUnitTest() || crud_hist_unit_test() || crud_trace_unit_test() || crud_gen_unit_test() || crudIOUnitTest() || crudClientUnitTest() || crud_capture_unit_test() || crud_dump_unit_test() || crud_import_unit_test() ) {
 			logMessage( LOG_ERROR_LEVEL, "CRUD unit tests failed.\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "CRUD unit tests completed successfully.\n\n" );
 		}
 
+	} else if (bench_clients > 0) {
+
+		// Running the benchmark against the server
+		if ( crudClientBenchmark(bench_clients) == 0 ) {
+			logMessage( LOG_INFO_LEVEL, "CRUD benchmark completed successfully.\n\n" );
+		} else {
+			logMessage( LOG_ERROR_LEVEL, "CRUD benchmark failed.\n\n" );
+			return( -1 );
+		}
+
+	} else if (replay_spec != NULL) {
+
+		// Replaying a capture against the backend
+		if ( crud_capture_replay(replay_spec) == 0 ) {
+			crud_backend_report();
+			logMessage( LOG_INFO_LEVEL, "CRUD capture replay completed successfully.\n\n" );
+		} else {
+			logMessage( LOG_ERROR_LEVEL, "CRUD capture replay failed.\n\n" );
+			return( -1 );
+		}
+
+	} else if (dump_target != NULL) {
+
+		// Extracting the whole filesystem
+		if ( crud_dump_extract(dump_target, workers ? workers : CRUD_DUMP_DEFAULT_WORKERS) == 0 ) {
+			crud_backend_report();
+			logMessage( LOG_INFO_LEVEL, "CRUD filesystem extracted successfully.\n\n" );
+		} else {
+			logMessage( LOG_ERROR_LEVEL, "CRUD filesystem extract failed.\n\n" );
+			return( -1 );
+		}
+
+	} else if (import_source != NULL) {
+
+		// Importing files into the filesystem
+		if ( crud_import(import_source, workers ? workers : CRUD_IMPORT_DEFAULT_WORKERS) == 0 ) {
+			crud_backend_report();
+			logMessage( LOG_INFO_LEVEL, "CRUD files imported successfully.\n\n" );
+		} else {
+			logMessage( LOG_ERROR_LEVEL, "CRUD import failed.\n\n" );
+			return( -1 );
+		}
+
 	} else if (extract_file) {
 
 		// Extracting a file from the crud file systems
@@ -173,12 +493,56 @@ int main( int argc, char *argv[] ) {
 
 		}
 
+		// Generate the workload
+		if ( gen_spec != NULL ) {
+			if ( crud_gen_parse(gen_spec, &gen) || crud_gen_workload(&gen, argv[optind]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD workload generation failed.\n\n" );
+				return( -1 );
+			}
+			logMessage( LOG_INFO_LEVEL, "CRUD workload generation completed successfully.\n\n" );
+			return( 0 );
+		}
+
+		// Convert the workload
+		if ( trace_file != NULL ) {
+			if ( crud_trace_convert(argv[optind], trace_file) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD trace conversion failed.\n\n" );
+				return( -1 );
+			}
+			logMessage( LOG_INFO_LEVEL, "CRUD trace conversion completed successfully.\n\n" );
+			return( 0 );
+		}
+
 		// Run the simulation
-		if ( simulate_CRUD(argv[optind]) == 0 ) {
+		if ( rates == 0 ) {
+			if ( simulate_CRUD(argv[optind], workers, hist_file, NULL) == 0 ) {
+				crud_backend_report();
+				logMessage( LOG_INFO_LEVEL, "CRUD simulation completed successfully.\n\n" );
+			} else {
+				logMessage( LOG_INFO_LEVEL, "CRUD simulation failed.\n\n" );
+			}
+			return( 0 );
+		}
+
+		// Replay open loop at each of the rates, then give the curve
+		if ( (loads = calloc(rates, sizeof(CrudSimulationLoad))) == NULL ) {
+			return( -1 );
+		}
+		for ( i=0; i<rates; i++ ) {
+			loads[i].rate = rate_list[i];
+			loads[i].poisson = poisson;
+			loads[i].seed = ((uint64_t)getRandomValue(1, 0x7fffffff) << 32) | (uint32_t)getRandomValue(0, 0x7fffffff);
+			if ( simulate_CRUD(argv[optind], workers, NULL, &loads[i]) ) {
+				break;
+			}
+		}
+		if ( (i == rates) && (simulate_curve(loads, rates, workers, hist_file) == 0) ) {
+			crud_backend_report();
 			logMessage( LOG_INFO_LEVEL, "CRUD simulation completed successfully.\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "CRUD simulation failed.\n\n" );
 		}
+		free( loads );
 	}
 
 	// Return successfully
@@ -189,248 +553,1006 @@ int main( int argc, char *argv[] ) {
 //
 // Function     : simulate_CRUD
 // Description  : The main control loop for the processing of the CRUD
-//                simulation.
+//                simulation.  The workload file is mapped (privately, so
+//                text lines can be tokenized and translated in place), and
+//                replayed as a binary trace if it is one (see crud_trace.h).
+//                With workers the files are replayed in parallel (see
+//                simulate_parallel).  The latency of every filesystem call
+//                is recorded, and reported once the replay is done.  Open
+//                loop the commands start on the schedule of the load rather
+//                than as soon as the one before is done, so a slow system
+//                shows up as queueing in the response times.
 //
-// Inputs       : wload - the name of the workload file
+// Inputs       : wload - the name of the workload file (text or trace)
+//                workers - the number of worker threads (0 for none)
+//                hfile - the file to write the latencies to (NULL if none)
+//                load - the schedule of an open-loop replay (NULL if closed
+//                       loop), the response times are left in it
 // Outputs      : 0 if successful test, -1 if failure
 
-int simulate_CRUD( char *wload ) {
+int simulate_CRUD( char *wload, int workers, char *hfile, CrudSimulationLoad *load ) {
 
 	// Local variables
-	char line[2048], fname[128], command[128], text[2048], *sep, *rbuf;
-	FILE *fhandle = NULL;
-	int32_t err=0, len, off, fields, linecount;
-	CrudSimulationTable ftable[CRUD_SIM_MAX_OPEN_FILES];
-	int idx, i;
+	CrudSimulationTable ftable;
+	CrudSimulationStats *stats;
+	CrudSimulationCommand cmd;
+	CrudTrace trace;
+	char *map, *line, *eol, *end, *rbuf, *tbuf = NULL;
+	struct stat st;
+	struct timeval start, stop;
+	int32_t linecount = 0;
+	uint32_t rec;
+	int fd, ret = 0, traced, i;
 
 	// Setup the file table
-	memset(ftable, 0x0, sizeof(CrudSimulationTable)*CRUD_SIM_MAX_OPEN_FILES);
+	memset(&ftable, 0x0, sizeof(CrudSimulationTable));
 
-	// Open the workload file
-	linecount = 0;
-	if ( (fhandle=fopen(wload, "r")) == NULL ) {
+	// Open and map the workload file (an empty one has nothing to do)
+	if ( ((fd = open(wload, O_RDONLY)) == -1) || (fstat(fd, &st) == -1) ) {
 		logMessage( LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.\n",
 			wload, strerror(errno) );
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		return( -1 );
+	}
+	if ( st.st_size == 0 ) {
+		close( fd );
+		return( 0 );
+	}
+	map = mmap( NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure mapping the workload file [%s], error: %s.\n",
+			wload, strerror(errno) );
+		return( -1 );
+	}
+	madvise( map, st.st_size, MADV_SEQUENTIAL );
+	end = map + st.st_size;
+
+	// The reads all go to the same buffer (as do expanded trace payloads)
+	if ( ((rbuf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL) || ((stats = malloc(sizeof(CrudSimulationStats))) == NULL) ) {
+		free( rbuf );
+		munmap( map, st.st_size );
 		return( -1 );
 	}
+	simulate_stats( stats );
+
+	// The schedule starts with the first command, sleeps to it are not
+	// stretched by the timer slack (the workers inherit this)
+	if ( load != NULL ) {
+		load->start = 0;
+		load->offset = 0.0;
+		prctl( PR_SET_TIMERSLACK, 1 );
+	}
+
+	traced = (crud_trace_attach(&trace, map, st.st_size) == 0);
+	gettimeofday( &start, NULL );
+	if ( workers > 0 ) {
 
-	// While file not done
-	while (!feof(fhandle)) {
+		// Replay on the workers
+		ret = simulate_parallel( traced ? &trace : NULL, map, end, workers, stats, load );
+
+	} else if ( traced ) {
+
+		// Replay the records of the trace
+		if ( (tbuf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ) {
+			ret = -1;
+		}
+		for ( rec=0; (rec < trace.header->records) && (ret == 0); rec++ ) {
+			if ( crud_trace_command(&trace, rec, &cmd, tbuf) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD bad trace record, aborting, record %u", rec );
+				ret = -1;
+			} else {
+				ret = simulate_issue( &ftable, &cmd, rbuf, stats, (load != NULL) ? simulate_arrival(load) : 0 );
+			}
+		}
 
-		// Get the line and bail out on fail
-		if (fgets(line, 2048, fhandle) != NULL) {
+	} else {
 
-			// Parse out the string
+		// Walk the lines, parse then execute each
+		for ( line=map; (line < end) && (ret == 0); line=eol+1 ) {
+			if ( (eol = memchr(line, '\n', end-line)) == NULL ) {
+				eol = end;
+			}
 			linecount ++;
-			fields = sscanf(line, "%s %s %d %d", fname, command, &len, &off);
-			sep = strchr(line, ':');
-			if ( (fields != 4) || (sep == NULL) ) {
-				logMessage( LOG_ERROR_LEVEL, "CRUD un-parsable workload string, aborting [%s], line %d",
-						line, linecount );
-				fclose( fhandle );
-				return( -1 );
+			if ( crud_trace_parse(line, eol, end, &cmd) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD un-parsable workload string, aborting [%.*s], line %d",
+						(int)(eol-line), line, linecount );
+				ret = -1;
+			} else {
+				ret = simulate_issue( &ftable, &cmd, rbuf, stats, (load != NULL) ? simulate_arrival(load) : 0 );
 			}
+		}
+	}
 
-			// Just log the contents
-			logMessage(LOG_INFO_LEVEL, "File [%s], command [%s], len=%d, offset=%d",
-					fname, command, len, off);
+	gettimeofday( &stop, NULL );
+	if ( load != NULL ) {
+		crud_hist_init( &load->response );
+		for ( i=0; i<CRUD_SIM_MAXVAL; i++ ) {
+			crud_hist_merge( &load->response, &stats->commands[i] );
+		}
+		load->achieved = load->response.count/((compareTimes(&start, &stop)+1)/1000000.0);
+	}
+	if ( ret == 0 ) {
+		ret = simulate_report( stats, compareTimes(&start, &stop), workers, hfile, load );
+	}
 
-			// Now process the commands
-			if (strncmp(command, "FORMAT", 6) == 0) {
+	// Release the buffers, the file table and the workload file
+	if ( traced ) {
+		crud_trace_detach( &trace );
+	}
+	simulate_release( &ftable );
+	free( stats );
+	free( tbuf );
+	free( rbuf );
+	munmap( map, st.st_size );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_parallel
+// Description  : Replay the workload on worker threads.  The files are dealt
+//                out to the workers in the order they first appear, and each
+//                worker runs the commands of its files in workload order.
+//                FORMAT, MOUNT and UNMOUNT (and anything unknown) split the
+//                workload into phases: the main thread runs them once the
+//                workers are done with the phase before, then starts the
+//                workers on the next.  A worker attaches to the backend for
+//                each phase it has commands in, so on the network each
+//                worker is a client of its own.
+//
+// Inputs       : trace - the attached trace (NULL if the workload is text)
+//                map - the (private) mapping of the workload
+//                end - the end of the mapping
+//                workers - the number of worker threads
+//                stats - the latencies (the workers' are added in)
+//                load - the schedule of an open-loop replay (NULL if none),
+//                       laid out over all of the commands before they start
+// Outputs      : 0 if successful test, -1 if failure
 
-				// Log the command executed
-				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Formatting CRUD filesystem");
+int simulate_parallel( CrudTrace *trace, char *map, char *end, int workers, CrudSimulationStats *stats,
+		CrudSimulationLoad *load ) {
 
-				// Now perform the format
-				if (crud_format() != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Formatting failed, aborting simulation.");
-					return(-1);
+	// Local variables
+	CrudSimulationTable ftable, names;
+	CrudSimulationWorker *wk = NULL;
+	CrudSimulationReplay replay;
+	CrudSimulationCommand cmd, *grown;
+	CrudSimulationFile *named;
+	char *line, *eol;
+	uint32_t idx, size = 0, files = 0, file = 0, i;
+	int32_t linecount = 0;
+	int ret = 0, w, added;
+
+	// Parse the whole of a text workload up front (the workers share it)
+	memset( &replay, 0x0, sizeof(replay) );
+	memset( &ftable, 0x0, sizeof(ftable) );
+	memset( &names, 0x0, sizeof(names) );
+	replay.trace = trace;
+	if ( trace != NULL ) {
+		replay.count = trace->header->records;
+	} else {
+		for ( line=map; (line < end) && (ret == 0); line=eol+1 ) {
+			if ( (eol = memchr(line, '\n', end-line)) == NULL ) {
+				eol = end;
+			}
+			linecount ++;
+			if ( replay.count == size ) {
+				size = (size == 0) ? 1024 : size*2;
+				if ( (grown = realloc(replay.commands, sizeof(CrudSimulationCommand)*size)) == NULL ) {
+					ret = -1;
+					break;
 				}
+				replay.commands = grown;
+			}
+			if ( crud_trace_parse(line, eol, end, &replay.commands[replay.count]) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD un-parsable workload string, aborting [%.*s], line %d",
+						(int)(eol-line), line, linecount );
+				ret = -1;
+			} else {
+				replay.count ++;
+			}
+		}
+	}
+
+	// Give each command to the worker of its file (a trace has the files
+	// numbered in order already, a text workload numbers them here)
+	if ( (ret == 0) && ((replay.owner = malloc(sizeof(int16_t)*(replay.count+1))) == NULL) ) {
+		ret = -1;
+	}
+	for ( idx=0; (idx < replay.count) && (ret == 0); idx++ ) {
+		if ( trace != NULL ) {
+			cmd.command = trace->records[idx].command;
+			file = trace->records[idx].file;
+		} else {
+			cmd = replay.commands[idx];
+			if ( (named = simulate_lookup(&names, cmd.fname, &added)) == NULL ) {
+				ret = -1;
+				break;
+			}
+			if ( added ) {
+				named->fhandle = files++;
+			}
+			file = named->fhandle;
+		}
+		if ( (cmd.command == CRUD_SIM_FORMAT) || (cmd.command == CRUD_SIM_MOUNT) ||
+			 (cmd.command == CRUD_SIM_UNMOUNT) || (cmd.command >= CRUD_SIM_MAXVAL) ) {
+			replay.owner[idx] = -1;
+		} else {
+			replay.owner[idx] = file % workers;
+		}
+	}
+	simulate_release( &names );
+
+	// Lay out the schedule (the workers go by the time of each command)
+	if ( (ret == 0) && (load != NULL) ) {
+		if ( (replay.when = malloc(sizeof(uint64_t)*(replay.count+1))) == NULL ) {
+			ret = -1;
+		}
+		for ( idx=0; (idx < replay.count) && (ret == 0); idx++ ) {
+			replay.when[idx] = simulate_arrival( load );
+		}
+	}
 
-			} else if (strncmp(command, "MOUNT", 5) == 0) {
+	// Setup the workers
+	if ( (ret == 0) && ((wk = calloc(workers, sizeof(CrudSimulationWorker))) == NULL) ) {
+		ret = -1;
+	}
+	for ( w=0; (w < workers) && (ret == 0); w++ ) {
+		wk[w].replay = &replay;
+		wk[w].worker = w;
+		simulate_stats( &wk[w].stats );
+		if ( ((wk[w].rbuf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL) ||
+			 ((wk[w].tbuf = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL) ) {
+			ret = -1;
+		}
+	}
 
-				// Log the command executed
-				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Mounting CRUD filesystem");
+	// Run the phases, the main thread running the commands between them
+	for ( idx=0; (idx < replay.count) && (ret == 0); idx=replay.end ) {
+		if ( replay.owner[idx] == -1 ) {
 
-				// Now perform the filesystem mount
-				if (crud_mount() != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
-					return(-1);
+			// Everything opened is closed before the unmount
+			replay.end = idx+1;
+			if ( simulate_fetch(&replay, idx, &cmd, wk[0].tbuf) ) {
+				ret = -1;
+			}
+			for ( w=0; (w < workers) && (ret == 0) && (cmd.command == CRUD_SIM_UNMOUNT); w++ ) {
+				ret = simulate_close( &wk[w].ftable, stats );
+			}
+			if ( ret == 0 ) {
+				ret = simulate_issue( &ftable, &cmd, NULL, stats, (replay.when != NULL) ? replay.when[idx] : 0 );
+			}
+
+		} else {
+
+			// Start the workers on the phase, wait for all of them
+			for ( replay.start=idx, replay.end=idx; (replay.end < replay.count) && (replay.owner[replay.end] != -1); replay.end++ );
+			for ( w=0; w<workers; w++ ) {
+				if ( pthread_create(&wk[w].thread, NULL, simulate_worker, &wk[w]) ) {
+					logMessage( LOG_ERROR_LEVEL, "CRUD_SIM : failed to start worker %d, error: %s", w, strerror(errno) );
+					__atomic_store_n( &replay.failed, 1, __ATOMIC_RELAXED );
+					break;
 				}
+			}
+			for ( i=0; i<w; i++ ) {
+				pthread_join( wk[i].thread, NULL );
+				ret = (wk[i].ret == 0) ? ret : -1;
+			}
+			ret = replay.failed ? -1 : ret;
+		}
+	}
 
-			} else if (strncmp(command, "UNMOUNT", 5) == 0) {
+	// Release the workers (keeping their latencies) and the commands
+	for ( w=0; (wk != NULL) && (w < workers); w++ ) {
+		for ( i=0; i<CRUD_SIM_OP_MAXVAL; i++ ) {
+			crud_hist_merge( &stats->ops[i], &wk[w].stats.ops[i] );
+		}
+		for ( i=0; i<CRUD_SIM_MAXVAL; i++ ) {
+			crud_hist_merge( &stats->commands[i], &wk[w].stats.commands[i] );
+		}
+		simulate_release( &wk[w].ftable );
+		free( wk[w].rbuf );
+		free( wk[w].tbuf );
+	}
+	simulate_release( &ftable );
+	free( wk );
+	free( replay.when );
+	free( replay.owner );
+	free( replay.commands );
+	return( ret );
+}
 
-				// Log the command executed
-				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Un-mounting CRUD filesystem");
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_worker
+// Description  : Run the commands of the current phase that belong to a
+//                worker (the thread of the worker), stopping if any worker
+//                fails.
+//
+// Inputs       : arg - the worker (CrudSimulationWorker)
+// Outputs      : NULL (the result is left in the worker)
 
-				// Finished, close all of the files
-				for (idx=0; idx<CRUD_SIM_MAX_OPEN_FILES; idx++) {
+void *simulate_worker( void *arg ) {
 
-					// If file in use, close if
-					if (ftable[idx].filename != NULL) {
-						// Log the file close
-						logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Closing file [%s]", ftable[idx].filename);
-						if (crud_close(ftable[idx].fhandle) == -1) {
-							// Failed, error out
-							logMessage(LOG_ERROR_LEVEL, "Close file [%s] failed, aborting simulation.", ftable[idx].filename);
-							return(-1);
-						}
-						free(ftable[idx].filename);
-						ftable[idx].filename = NULL;
-					}
+	// Local variables
+	CrudSimulationWorker *wk = arg;
+	CrudSimulationReplay *replay = wk->replay;
+	CrudSimulationCommand cmd;
+	int attached = 0;
+	uint32_t idx;
+
+	// Walk the phase, running the commands of our files
+	wk->ret = 0;
+	for ( idx=replay->start; (idx < replay->end) && (wk->ret == 0); idx++ ) {
+		if ( replay->owner[idx] != wk->worker ) {
+			continue;
+		}
+		if ( __atomic_load_n(&replay->failed, __ATOMIC_RELAXED) ) {
+			break;
+		}
+		if ( !attached && ((wk->ret = crud_backend_attach()) == 0) ) {
+			attached = 1;
+		}
+		if ( (wk->ret == 0) && ((wk->ret = simulate_fetch(replay, idx, &cmd, wk->tbuf)) == 0) ) {
+			wk->ret = simulate_issue( &wk->ftable, &cmd, wk->rbuf, &wk->stats,
+					(replay->when != NULL) ? replay->when[idx] : 0 );
+		}
+		if ( wk->ret ) {
+			__atomic_store_n( &replay->failed, 1, __ATOMIC_RELAXED );
+		}
+	}
 
-				}
+	// Leave the backend (the files stay open for the next phase)
+	if ( attached && crud_backend_detach() ) {
+		__atomic_store_n( &replay->failed, 1, __ATOMIC_RELAXED );
+		wk->ret = -1;
+	}
+	return( NULL );
+}
 
-				// Now perform the filesystem unmount
-				if (crud_unmount() != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
-					return(-1);
-				}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_fetch
+// Description  : Get a command of a parallel replay
+//
+// Inputs       : replay - the replay
+//                idx - the command
+//                cmd - the command to fill in
+//                tbuf - the buffer for an expanded trace payload
+// Outputs      : 0 if successful, -1 if failure
+
+int simulate_fetch( CrudSimulationReplay *replay, uint32_t idx, CrudSimulationCommand *cmd, char *tbuf ) {
+
+	// The text was parsed up front, a trace record is decoded now
+	if ( replay->trace == NULL ) {
+		*cmd = replay->commands[idx];
+		return( 0 );
+	}
+	if ( crud_trace_command(replay->trace, idx, cmd, tbuf) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD bad trace record, aborting, record %u", idx );
+		return( -1 );
+	}
+	return( 0 );
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_issue
+// Description  : Execute a command of the workload when it is due.  Open
+//                loop the response time is counted from when the command
+//                should have started, so time spent waiting behind a slow
+//                command before it is not lost (coordinated omission).
+//
+// Inputs       : ftable - the table of open files
+//                cmd - the command
+//                rbuf - the buffer for reads (CRUD_MAX_OBJECT_SIZE)
+//                stats - the latencies of the calls and commands
+//                when - when the command should start (0 if closed loop)
+// Outputs      : 0 if successful test, -1 if failure
 
-			} else {
+int simulate_issue( CrudSimulationTable *ftable, CrudSimulationCommand *cmd, char *rbuf, CrudSimulationStats *stats,
+		uint64_t when ) {
 
-				//
-				// File operations
-
-				// Now walk the the table looking for the file
-				idx = -1;
-				i = 0;
-				while ( (i < CRUD_SIM_MAX_OPEN_FILES) && (idx == -1) ) {
-					if ( (ftable[i].filename != NULL) && (strcmp(ftable[i].filename,fname) == 0) ) {
-						idx = i;
-					}
-					i++;
-				}
+	// Local variables
+	struct timespec ts;
+	int ret;
 
-				// File is not found, open the file
-				if (idx == -1) {
-
-					// Log message, find unused index and save filename for later use
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Opening file [%s]", fname);
-					idx = 0;
-					while ((ftable[idx].filename != NULL) && (idx < CRUD_SIM_MAX_OPEN_FILES)) {
-						idx++;
-					}
-					CMPSC_ASSERT1(idx<CRUD_SIM_MAX_OPEN_FILES, "Too many open files on CRUD sim [%d]", idx);
-					ftable[idx].filename = strdup(fname);
-
-					// Now perform the open
-					ftable[idx].fhandle = crud_open(ftable[idx].filename);
-					if (ftable[idx].fhandle == -1) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", fname);
-						return(-1);
-					}
+	// Closed loop, just run it
+	if ( when == 0 ) {
+		return( simulate_command(ftable, cmd, rbuf, stats) );
+	}
 
-				}
+	// Wait until it is due (if it is not late already), run it
+	if ( crud_hist_now() < when ) {
+		ts.tv_sec = when/1000000000;
+		ts.tv_nsec = when%1000000000;
+		while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR );
+	}
+	if ( (ret = simulate_command(ftable, cmd, rbuf, stats)) == 0 ) {
+		crud_hist_record( &stats->commands[cmd->command], crud_hist_now()-when );
+	}
+	return( ret );
+}
 
-				// Now execute the specific command
-				if (strncmp(command, "WRITEAT", 7) == 0) {
-
-					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes at position %d from file [%s]", len, off, fname);
-
-					// First perform the seek
-					if (crud_seek(ftable[idx].fhandle, off)) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, off);
-						return(-1);
-					}
-
-					// Now see if we need more data to fill, terminate the lines
-					CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-					CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-					strncpy(text, sep+1, len);
-					text[len] = 0x0;
-					for (i=0; i<strlen(text); i++) {
-						if (text[i] == '*') {
-							text[i] = '\n';
-						}
-					}
-
-					// Now perform the write
-					if (crud_write(ftable[idx].fhandle, text, len) != len) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", fname, len);
-						return(-1);
-					}
-
-				} else if (strncmp(command, "WRITE", 5) == 0) {
-
-					// Now see if we need more data to fill, terminate the lines
-					CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-					CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-					strncpy(text, sep+1, len);
-					text[len] = 0x0;
-					for (i=0; i<strlen(text); i++) {
-						if (text[i] == '*') {
-							text[i] = '\n';
-						}
-					}
-
-					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes to file [%s]", len, fname);
-
-					// Now perform the write
-					if (crud_write(ftable[idx].fhandle, text, len) != len) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", fname, len);
-						return(-1);
-					}
-
-				} else if (strncmp(command, "SEEK", 4) == 0) {
-
-					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Seeking to position %d in file [%s]", off, fname);
-
-					// Now perform the seek
-					if (crud_seek(ftable[idx].fhandle, off) != len) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", fname, off);
-						return(-1);
-					}
-
-				} else if (strncmp(command, "READ", 4) == 0) {
-
-					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Reading %d bytes from file [%s]", len, fname);
-
-					// Now perform the read
-					rbuf = malloc(len);
-					if (crud_read(ftable[idx].fhandle, rbuf, len) != len) {
-						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, off);
-						return(-1);
-					}
-					free(rbuf);
-					rbuf = NULL;
-
-				} else {
-
-					// Bomb out, don't understand the command
-					CMPSC_ASSERT1(0, "CRUD_SIM : Failed, unknown command [%s]", command);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_arrival
+// Description  : Get when the next command of an open-loop replay should
+//                start: 1/rate after the one before, or after a gap drawn
+//                from the exponential distribution of that mean (Poisson
+//                arrivals).  The schedule starts at the first call.
+//
+// Inputs       : load - the schedule
+// Outputs      : the time (nsecs, see crud_hist_now)
 
-				}
+uint64_t simulate_arrival( CrudSimulationLoad *load ) {
+
+	// Local variables
+	double gap = 1000000000.0/load->rate, u;
+	uint64_t when;
+
+	// Start the schedule, the command is due at the current offset
+	if ( load->start == 0 ) {
+		load->start = crud_hist_now();
+	}
+	when = load->start + (uint64_t)load->offset;
+
+	// The next one is due after the gap (xorshift64* for the uniform draw)
+	if ( load->poisson ) {
+		load->seed ^= load->seed >> 12;
+		load->seed ^= load->seed << 25;
+		load->seed ^= load->seed >> 27;
+		u = (double)((load->seed * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+		gap *= -log( 1.0-u );
+	}
+	load->offset += gap;
+	return( when );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_command
+// Description  : Execute a command of the workload.
+//
+// Inputs       : ftable - the table of open files
+//                cmd - the command
+//                rbuf - the buffer for reads (CRUD_MAX_OBJECT_SIZE)
+//                stats - the latencies of the calls
+// Outputs      : 0 if successful test, -1 if failure
+
+int simulate_command( CrudSimulationTable *ftable, CrudSimulationCommand *cmd, char *rbuf, CrudSimulationStats *stats ) {
+
+	// Local variables
+	char *fname = cmd->fname;
+	int32_t len = cmd->len, off = cmd->off;
+	CrudSimulationFile *file;
+	int added;
+
+	// Just log the contents
+	logMessage(LOG_INFO_LEVEL, "File [%s], command [%s], len=%d, offset=%d", fname,
+			(cmd->command < CRUD_SIM_MAXVAL) ? CRUD_SIM_COMMAND_LABELS[cmd->command] : "UNKNOWN", len, off);
+
+	// Now process the filesystem commands
+	switch ( cmd->command ) {
+
+	case CRUD_SIM_FORMAT:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Formatting CRUD filesystem");
+
+		// Now perform the format
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_FORMAT, crud_format()) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Formatting failed, aborting simulation.");
+			return(-1);
+		}
+		return(0);
+
+	case CRUD_SIM_MOUNT:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Mounting CRUD filesystem");
+
+		// Now perform the filesystem mount
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_MOUNT, crud_mount()) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
+			return(-1);
+		}
+		return(0);
+
+	case CRUD_SIM_UNMOUNT:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Un-mounting CRUD filesystem");
+
+		// Finished, close all of the files
+		if (simulate_close(ftable, stats)) {
+			return(-1);
+		}
+
+		// Now perform the filesystem unmount
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_UNMOUNT, crud_unmount()) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
+			return(-1);
+		}
+		return(0);
+
+	case CRUD_SIM_MAXVAL:
+		// Bomb out, don't understand the command
+		CMPSC_ASSERT1(0, "CRUD_SIM : Failed, unknown command [%s]", fname);
+		return(-1);
+
+	default:
+		break;
+	}
+
+	//
+	// File operations
+
+	// Now look up the file in the table (adding it if it is not there)
+	if ( (file = simulate_lookup(ftable, fname, &added)) == NULL ) {
+		logMessage(LOG_ERROR_LEVEL, "File table of CRUD sim could not grow, aborting simulation.");
+		return(-1);
+	}
+
+	// File is not found, open the file
+	if (added) {
+
+		// Log message (the filename was saved in the table for later use)
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Opening file [%s]", fname);
+
+		// Now perform the open
+		file->fhandle = CRUD_SIM_TIMED(stats, CRUD_SIM_OP_OPEN, crud_open(file->filename));
+		if (file->fhandle == -1) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", fname);
+			return(-1);
+		}
+
+	}
+
+	// Now execute the specific command
+	switch ( cmd->command ) {
+
+	case CRUD_SIM_WRITEAT:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes at position %d from file [%s]", len, off, fname);
+
+		// First perform the seek
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_SEEK, crud_seek(file->fhandle, off))) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, off);
+			return(-1);
+		}
+		// Fall through to the write
+
+	case CRUD_SIM_WRITE:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes to file [%s]", len, fname);
+
+		// Now perform the write
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_WRITE, crud_write(file->fhandle, cmd->text, len)) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", fname, len);
+			return(-1);
+		}
+		break;
+
+	case CRUD_SIM_SEEK:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Seeking to position %d in file [%s]", off, fname);
+
+		// Now perform the seek
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_SEEK, crud_seek(file->fhandle, off)) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", fname, off);
+			return(-1);
+		}
+		break;
+
+	case CRUD_SIM_READ:
+		// Log the command executed
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Reading %d bytes from file [%s]", len, fname);
+
+		// Now perform the read
+		CMPSC_ASSERT1(((len >= 0) && (len <= CRUD_MAX_OBJECT_SIZE)), "Simulated read too large [%d]", len);
+		if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_READ, crud_read(file->fhandle, rbuf, len)) != len) {
+			// Failed, error out
+			logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, off);
+			return(-1);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	// Return successfully
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_close
+// Description  : Close all of the files in a file table
+//
+// Inputs       : ftable - the table of open files
+//                stats - the latencies of the calls
+// Outputs      : 0 if successful test, -1 if failure
+
+int simulate_close( CrudSimulationTable *ftable, CrudSimulationStats *stats ) {
+
+	// Local variables
+	CrudSimulationFile *file;
+	uint32_t idx;
+
+	for (idx=0; idx<ftable->slots; idx++) {
+
+		// If file in use, close if
+		file = &ftable->files[idx];
+		if (file->filename != NULL) {
+			// Log the file close
+			logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Closing file [%s]", file->filename);
+			if (CRUD_SIM_TIMED(stats, CRUD_SIM_OP_CLOSE, crud_close(file->fhandle)) == -1) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Close file [%s] failed, aborting simulation.", file->filename);
+				return(-1);
 			}
+			free(file->filename);
+			file->filename = NULL;
+			ftable->used --;
+		}
 
-			// Check for the virtual level failing
-			if ( err ) {
-				logMessage( LOG_ERROR_LEVEL, "CRUS system failed, aborting [%d]", err );
-				fclose( fhandle );
-				return( -1 );
+	}
+
+	// Return successfully
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_lookup
+// Description  : Find a file in a file table by name, adding it (with a copy
+//                of the name, and no handle) if it is not there.  The slot
+//                is found by the CRC32C of the name, probing the slots after
+//                it in turn; the table doubles once 3/4 of the slots are used
+//                so the probes stay short however many files there are.
+//
+// Inputs       : ftable - the table of files
+//                fname - the name of the file
+//                added - flag indicating the file was added (returned)
+// Outputs      : the file in the table, NULL if failure
+
+CrudSimulationFile *simulate_lookup( CrudSimulationTable *ftable, char *fname, int *added ) {
+
+	// Local variables
+	size_t len = strlen( fname );
+	uint32_t hash = crud_crc32c( 0, fname, len ), slots, idx, i;
+	CrudSimulationFile *files, *file;
+
+	// Look for the file (a free slot ends the search)
+	*added = 0;
+	for ( i=0; i<ftable->slots; i++ ) {
+		file = &ftable->files[(hash+i) & (ftable->slots-1)];
+		if ( file->filename == NULL ) {
+			break;
+		}
+		if ( (file->hash == hash) && (strcmp(file->filename, fname) == 0) ) {
+			return( file );
+		}
+	}
+
+	// Grow the table (moving the files to their slots in the new one)
+	if ( (ftable->used+1)*4 > ftable->slots*3 ) {
+		slots = (ftable->slots == 0) ? CRUD_SIM_TABLE_SLOTS : ftable->slots*2;
+		if ( (files = calloc(slots, sizeof(CrudSimulationFile))) == NULL ) {
+			return( NULL );
+		}
+		for ( i=0; i<ftable->slots; i++ ) {
+			if ( ftable->files[i].filename != NULL ) {
+				for ( idx=ftable->files[i].hash & (slots-1); files[idx].filename != NULL; idx=(idx+1) & (slots-1) );
+				files[idx] = ftable->files[i];
 			}
 		}
+		free( ftable->files );
+		ftable->files = files;
+		ftable->slots = slots;
+	}
+
+	// Add the file in the first free slot
+	for ( idx=hash & (ftable->slots-1); ftable->files[idx].filename != NULL; idx=(idx+1) & (ftable->slots-1) );
+	file = &ftable->files[idx];
+	if ( (file->filename = strdup(fname)) == NULL ) {
+		return( NULL );
+	}
+	file->hash = hash;
+	file->fhandle = -1;
+	ftable->used ++;
+	*added = 1;
+	return( file );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_release
+// Description  : Release a file table (the files are not closed)
+//
+// Inputs       : ftable - the table of files
+// Outputs      : none
+
+void simulate_release( CrudSimulationTable *ftable ) {
+
+	// Local variables
+	uint32_t idx;
+
+	for ( idx=0; idx<ftable->slots; idx++ ) {
+		free( ftable->files[idx].filename );
 	}
+	free( ftable->files );
+	memset( ftable, 0x0, sizeof(CrudSimulationTable) );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_stats
+// Description  : Empty the latencies of the calls (and the response times
+//                of the commands)
+//
+// Inputs       : stats - the latencies
+// Outputs      : none
+
+void simulate_stats( CrudSimulationStats *stats ) {
+
+	// Local variables
+	int op;
 
-	// Close the workload file, successfully
-	fclose( fhandle );
+	for ( op=0; op<CRUD_SIM_OP_MAXVAL; op++ ) {
+		crud_hist_init( &stats->ops[op] );
+	}
+	for ( op=0; op<CRUD_SIM_MAXVAL; op++ ) {
+		crud_hist_init( &stats->commands[op] );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_report
+// Description  : Log the latencies of the calls made by a replay (count,
+//                mean, percentiles and max in usecs, and calls/sec over the
+//                replay), and write them to a file if asked to: JSON (with
+//                the non-empty buckets, in nsecs) if the name ends in .json,
+//                CSV otherwise.  Open loop the response times of the
+//                commands (from when each should have started) are logged
+//                too.
+//
+// Inputs       : stats - the latencies
+//                usecs - how long the replay took
+//                workers - the number of worker threads
+//                hfile - the file to write them to (NULL if none)
+//                load - the schedule of an open-loop replay (NULL if none)
+// Outputs      : 0 if successful test, -1 if failure
+
+int simulate_report( CrudSimulationStats *stats, uint64_t usecs, int workers, char *hfile, CrudSimulationLoad *load ) {
+
+	// Local variables
+	CrudHistogram *hist;
+	uint64_t calls = 0;
+	double secs = (usecs > 0) ? usecs/1000000.0 : 1e-6;
+	int json = 0, first = 1, op;
+	size_t len;
+	FILE *fh = NULL;
+
+	// Open the file, JSON or CSV
+	if ( hfile != NULL ) {
+		if ( (fh = fopen(hfile, "w")) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure opening the latency file [%s], error: %s.\n",
+				hfile, strerror(errno) );
+			return( -1 );
+		}
+		len = strlen( hfile );
+		json = ((len >= 5) && (strcmp(&hfile[len-5], ".json") == 0));
+		if ( json ) {
+			fprintf( fh, "{\n  \"usecs\": %lu,\n  \"workers\": %d,\n  \"calls\": {", (unsigned long)usecs, workers );
+		} else {
+			fprintf( fh, "call,count,mean_usecs,p50_usecs,p90_usecs,p99_usecs,p999_usecs,max_usecs,calls_per_sec\n" );
+		}
+	}
+
+	// Log (and write) each call made
+	for ( op=0; op<CRUD_SIM_OP_MAXVAL; op++ ) {
+		calls += stats->ops[op].count;
+	}
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : workload replayed in %lu usecs (%d workers), %lu calls, %.1f calls/sec",
+			(unsigned long)usecs, workers, calls, calls/secs );
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : %-7s %9s %10s %10s %10s %10s %10s %10s %12s", "usecs",
+			"count", "mean", "p50", "p90", "p99", "p99.9", "max", "calls/sec" );
+	for ( op=0; op<CRUD_SIM_OP_MAXVAL; op++ ) {
+		hist = &stats->ops[op];
+		if ( hist->count == 0 ) {
+			continue;
+		}
+		simulate_log( CRUD_SIM_OP_LABELS[op], hist, hist->count/secs );
+		if ( (fh != NULL) && json ) {
+			fprintf( fh, "%s\n    \"%s\": {", first ? "" : ",", CRUD_SIM_OP_LABELS[op] );
+			simulate_write( fh, json, hist );
+			fprintf( fh, ", \"calls_per_sec\": %.1f}", hist->count/secs );
+			first = 0;
+		} else if ( fh != NULL ) {
+			fprintf( fh, "%s,", CRUD_SIM_OP_LABELS[op] );
+			simulate_write( fh, json, hist );
+			fprintf( fh, ",%.1f\n", hist->count/secs );
+		}
+	}
+
+	// Log the response times of the commands (open loop)
+	if ( load != NULL ) {
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : open loop at %.1f commands/sec (%s arrivals), achieved %.1f commands/sec",
+				load->rate, load->poisson ? "Poisson" : "fixed", load->achieved );
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : %-7s %9s %10s %10s %10s %10s %10s %10s %12s", "resp",
+				"count", "mean", "p50", "p90", "p99", "p99.9", "max", "cmds/sec" );
+		for ( op=0; op<CRUD_SIM_MAXVAL; op++ ) {
+			hist = &stats->commands[op];
+			if ( hist->count > 0 ) {
+				simulate_log( CRUD_SIM_COMMAND_LABELS[op], hist, hist->count/secs );
+			}
+		}
+		simulate_log( "all", &load->response, load->achieved );
+	}
+
+	// Finish off the file
+	if ( fh != NULL ) {
+		if ( json ) {
+			fprintf( fh, "\n  }\n}\n" );
+		}
+		if ( fclose(fh) ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure writing the latency file [%s], error: %s.\n",
+				hfile, strerror(errno) );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_curve
+// Description  : Log the throughput-vs-latency curve of open-loop replays at
+//                a series of rates (the response times of all commands at
+//                each), and write it to a file if asked to: JSON (with the
+//                non-empty buckets, in nsecs) if the name ends in .json, CSV
+//                otherwise.
+//
+// Inputs       : loads - the replays, one per rate
+//                count - the number of replays
+//                workers - the number of worker threads
+//                hfile - the file to write it to (NULL if none)
+// Outputs      : 0 if successful test, -1 if failure
+
+int simulate_curve( CrudSimulationLoad *loads, int count, int workers, char *hfile ) {
+
+	// Local variables
+	int json = 0, i;
+	size_t len;
+	FILE *fh = NULL;
+
+	// Open the file, JSON or CSV
+	if ( hfile != NULL ) {
+		if ( (fh = fopen(hfile, "w")) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure opening the latency file [%s], error: %s.\n",
+				hfile, strerror(errno) );
+			return( -1 );
+		}
+		len = strlen( hfile );
+		json = ((len >= 5) && (strcmp(&hfile[len-5], ".json") == 0));
+		if ( json ) {
+			fprintf( fh, "{\n  \"poisson\": %s,\n  \"workers\": %d,\n  \"curve\": [",
+					loads[0].poisson ? "true" : "false", workers );
+		} else {
+			fprintf( fh, "rate,achieved,count,mean_usecs,p50_usecs,p90_usecs,p99_usecs,p999_usecs,max_usecs\n" );
+		}
+	}
+
+	// Log (and write) the response times at each rate
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : throughput vs. latency (%s arrivals, %d workers)",
+			loads[0].poisson ? "Poisson" : "fixed", workers );
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : %-12s %9s %10s %10s %10s %10s %10s %10s %12s", "rate",
+			"count", "mean", "p50", "p90", "p99", "p99.9", "max", "achieved" );
+	for ( i=0; i<count; i++ ) {
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : %-12.1f %9lu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %12.1f",
+				loads[i].rate, loads[i].response.count, crud_hist_mean(&loads[i].response)/1000.0,
+				crud_hist_percentile(&loads[i].response, 50.0)/1000.0,
+				crud_hist_percentile(&loads[i].response, 90.0)/1000.0,
+				crud_hist_percentile(&loads[i].response, 99.0)/1000.0,
+				crud_hist_percentile(&loads[i].response, 99.9)/1000.0,
+				loads[i].response.max/1000.0, loads[i].achieved );
+		if ( (fh != NULL) && json ) {
+			fprintf( fh, "%s\n    {\"rate\": %.1f, \"achieved\": %.1f, ", (i == 0) ? "" : ",",
+					loads[i].rate, loads[i].achieved );
+			simulate_write( fh, json, &loads[i].response );
+			fprintf( fh, "}" );
+		} else if ( fh != NULL ) {
+			fprintf( fh, "%.1f,%.1f,", loads[i].rate, loads[i].achieved );
+			simulate_write( fh, json, &loads[i].response );
+			fprintf( fh, "\n" );
+		}
+	}
+
+	// Finish off the file
+	if ( fh != NULL ) {
+		if ( json ) {
+			fprintf( fh, "\n  ]\n}\n" );
+		}
+		if ( fclose(fh) ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure writing the latency file [%s], error: %s.\n",
+				hfile, strerror(errno) );
+			return( -1 );
+		}
+	}
 	return( 0 );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_log
+// Description  : Log a row of latencies (count, mean, percentiles and max in
+//                usecs, then a rate)
+//
+// Inputs       : label - the label of the row
+//                hist - the latencies
+//                rate - the rate (per second)
+// Outputs      : none
+
+void simulate_log( const char *label, CrudHistogram *hist, double rate ) {
+	logMessage( LOG_OUTPUT_LEVEL, "CRUD_SIM : %-7s %9lu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %12.1f",
+			label, hist->count, crud_hist_mean(hist)/1000.0, crud_hist_percentile(hist, 50.0)/1000.0,
+			crud_hist_percentile(hist, 90.0)/1000.0, crud_hist_percentile(hist, 99.0)/1000.0,
+			crud_hist_percentile(hist, 99.9)/1000.0, hist->max/1000.0, rate );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : simulate_write
+// Description  : Write the latencies of a histogram to a file: the CSV
+//                fields (count, mean, percentiles and max in usecs), or the
+//                JSON members (the same, then the non-empty buckets)
+//
+// Inputs       : fh - the file
+//                json - flag indicating JSON (CSV if not)
+//                hist - the latencies
+// Outputs      : none
+
+void simulate_write( FILE *fh, int json, CrudHistogram *hist ) {
+
+	// Local variables
+	uint32_t b;
+	int i;
+
+	if ( ! json ) {
+		fprintf( fh, "%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f", hist->count, crud_hist_mean(hist)/1000.0,
+				crud_hist_percentile(hist, 50.0)/1000.0, crud_hist_percentile(hist, 90.0)/1000.0,
+				crud_hist_percentile(hist, 99.0)/1000.0, crud_hist_percentile(hist, 99.9)/1000.0, hist->max/1000.0 );
+		return;
+	}
+	fprintf( fh, "\"count\": %lu, \"mean_usecs\": %.3f, \"p50_usecs\": %.3f, \"p90_usecs\": %.3f, "
+			"\"p99_usecs\": %.3f, \"p999_usecs\": %.3f, \"max_usecs\": %.3f,\n      \"buckets\": [",
+			hist->count, crud_hist_mean(hist)/1000.0, crud_hist_percentile(hist, 50.0)/1000.0,
+			crud_hist_percentile(hist, 90.0)/1000.0, crud_hist_percentile(hist, 99.0)/1000.0,
+			crud_hist_percentile(hist, 99.9)/1000.0, hist->max/1000.0 );
+	for ( b=0, i=0; b<CRUD_HIST_BUCKETS; b++ ) {
+		if ( hist->buckets[b] > 0 ) {
+			fprintf( fh, "%s[%lu, %lu, %lu]", (i++ == 0) ? "" : ", ", crud_hist_lowest(b),
+					crud_hist_highest(b), hist->buckets[b] );
+		}
+	}
+	fprintf( fh, "]" );
+	return;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : extract_file_from_crud
@@ -0,0 +1,522 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_slab.c
+//  Description   : This is the implementation of the size-class (slab)
+//                  allocator (see crud_slab.h).  The classes are 16 bytes
+//                  apart up to 256 bytes, then about 1/8 apart up to the
+//                  largest class, so a chunk wastes at most ~12% of itself.
+//                  Larger (huge) chunks share the last class, allocated at
+//                  their size rounded to a page.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include <crud_slab.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_SLAB_ALIGN 16
+#define CRUD_SLAB_ROUND(x) (((x)+CRUD_SLAB_ALIGN-1) & ~(CRUD_SLAB_ALIGN-1))
+#define CRUD_SLAB_HEADER CRUD_SLAB_ROUND(sizeof(CrudSlabPage))
+#define CRUD_SLAB_LARGE_HEADER CRUD_SLAB_ROUND(sizeof(CrudSlabLarge))
+#define CRUD_SLAB_LINEAR 256
+#define CRUD_SLAB_HUGE (CRUD_SLAB_MAX_CLASSES-1)
+#define CRUD_SLAB_PAGE 4096
+#define CRUD_SLAB_CHUNK(c, size) (((c) == CRUD_SLAB_HUGE) ? \
+		(((size)+CRUD_SLAB_PAGE-1) & ~(CRUD_SLAB_PAGE-1)) : crud_slab_sizes[c])
+#define CRUD_SLAB_UNIT_TEST_CHUNKS 256
+#define CRUD_SLAB_UNIT_TEST_ITERATIONS 20000
+
+//
+// Global data
+
+uint32_t crud_slab_sizes[CRUD_SLAB_MAX_CLASSES]; // The size of each class
+uint32_t crud_slab_classes = 0;                  // The number of classes
+
+//
+// Local functions
+
+static int crud_slab_class( uint32_t size );
+static void crud_slab_unlink( CrudSlabPage **list, CrudSlabPage *page );
+static void crud_slab_link( CrudSlabPage **list, CrudSlabPage *page );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_init
+// Description  : Initialize an (empty) allocator, setting up the size classes
+//                the first time through
+//
+// Inputs       : slab - the allocator
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_slab_init( CrudSlab *slab ) {
+
+	// Local variables
+	uint32_t size, step;
+
+	// Work out the classes (linear, then geometric)
+	if ( crud_slab_classes == 0 ) {
+		size = CRUD_SLAB_ALIGN;
+		crud_slab_sizes[CRUD_SLAB_HUGE] = (uint32_t)-1;
+		while ( crud_slab_classes < CRUD_SLAB_HUGE ) {
+			crud_slab_sizes[crud_slab_classes++] = size;
+			if ( size >= CRUD_SLAB_MAX_CHUNK ) {
+				break;
+			}
+			step = (size < CRUD_SLAB_LINEAR) ? CRUD_SLAB_ALIGN : CRUD_SLAB_ROUND(size/8);
+			size = (size+step > CRUD_SLAB_MAX_CHUNK) ? CRUD_SLAB_MAX_CHUNK : size+step;
+		}
+	}
+
+	// Start with nothing allocated
+	memset( slab, 0x0, sizeof(CrudSlab) );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_cleanup
+// Description  : Release everything the allocator holds (all chunks become
+//                invalid)
+//
+// Inputs       : slab - the allocator
+// Outputs      : none
+
+void crud_slab_cleanup( CrudSlab *slab ) {
+
+	// Local variables
+	CrudSlabClass *cls;
+	CrudSlabPage *page;
+	CrudSlabLarge *large;
+	uint32_t i;
+
+	// Release the slabs and large chunks of each class (and the huge ones)
+	for ( i=0; i<CRUD_SLAB_MAX_CLASSES; i++ ) {
+		cls = &slab->classes[i];
+		while ( (page = cls->partial) != NULL ) {
+			cls->partial = page->next;
+			free( page );
+		}
+		while ( (page = cls->full) != NULL ) {
+			cls->full = page->next;
+			free( page );
+		}
+		while ( (large = cls->large) != NULL ) {
+			cls->large = large->next;
+			free( large );
+		}
+	}
+
+	// Back to empty
+	memset( slab, 0x0, sizeof(CrudSlab) );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_alloc
+// Description  : Allocate a chunk of at least size bytes
+//
+// Inputs       : slab - the allocator
+//                size - the number of bytes needed
+// Outputs      : the chunk, NULL if failure
+
+void * crud_slab_alloc( CrudSlab *slab, uint32_t size ) {
+
+	// Local variables
+	CrudSlabClass *cls;
+	CrudSlabPage *page;
+	CrudSlabLarge *large;
+	char *chunk;
+	int c;
+
+	// Find the class
+	c = crud_slab_class( size );
+	cls = &slab->classes[c];
+
+	if ( crud_slab_sizes[c] <= CRUD_SLAB_MAX_SMALL ) {
+
+		// Small, get a new slab if none have room, carving it into chunks
+		if ( (page = cls->partial) == NULL ) {
+			if ( posix_memalign((void **)&page, CRUD_SLAB_SIZE, CRUD_SLAB_SIZE) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD slab allocation failed [%u]", size );
+				return( NULL );
+			}
+			memset( page, 0x0, sizeof(CrudSlabPage) );
+			page->cls = c;
+			for ( chunk = (char *)page+CRUD_SLAB_HEADER;
+				  chunk+crud_slab_sizes[c] <= (char *)page+CRUD_SLAB_SIZE;
+				  chunk += crud_slab_sizes[c] ) {
+				*(void **)chunk = page->free;
+				page->free = chunk;
+			}
+			crud_slab_link( &cls->partial, page );
+			cls->slabs ++;
+			slab->resident += CRUD_SLAB_SIZE;
+		}
+
+		// Take a chunk, moving the slab to the full list if it was the last
+		chunk = page->free;
+		page->free = *(void **)chunk;
+		page->used ++;
+		if ( page->free == NULL ) {
+			crud_slab_unlink( &cls->partial, page );
+			crud_slab_link( &cls->full, page );
+		}
+
+	} else {
+
+		// Large (or huge), allocate the chunk on its own
+		if ( (large = malloc(CRUD_SLAB_LARGE_HEADER+CRUD_SLAB_CHUNK(c, size))) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD slab allocation failed [%u]", size );
+			return( NULL );
+		}
+		slab->resident += CRUD_SLAB_LARGE_HEADER+CRUD_SLAB_CHUNK(c, size);
+		large->prev = NULL;
+		large->next = cls->large;
+		if ( large->next != NULL ) {
+			large->next->prev = large;
+		}
+		cls->large = large;
+		chunk = (char *)large+CRUD_SLAB_LARGE_HEADER;
+	}
+
+	// Account for the chunk, return it
+	cls->used ++;
+	cls->requested += size;
+	slab->requested += size;
+	return( chunk );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_free
+// Description  : Free a chunk (size must be the size it was allocated with)
+//
+// Inputs       : slab - the allocator
+//                ptr - the chunk (may be NULL)
+//                size - the size the chunk was allocated with
+// Outputs      : none
+
+void crud_slab_free( CrudSlab *slab, void *ptr, uint32_t size ) {
+
+	// Local variables
+	CrudSlabClass *cls;
+	CrudSlabPage *page;
+	CrudSlabLarge *large;
+	int c, full;
+
+	// Find the class, account for the chunk
+	if ( ptr == NULL ) {
+		return;
+	}
+	c = crud_slab_class( size );
+	cls = &slab->classes[c];
+	cls->used --;
+	cls->requested -= size;
+	slab->requested -= size;
+
+	if ( crud_slab_sizes[c] <= CRUD_SLAB_MAX_SMALL ) {
+
+		// Small, give the chunk back to its slab (found by alignment)
+		page = (CrudSlabPage *)((uintptr_t)ptr & ~((uintptr_t)CRUD_SLAB_SIZE-1));
+		full = (page->free == NULL);
+		*(void **)ptr = page->free;
+		page->free = ptr;
+		page->used --;
+
+		// Release the slab if empty, else make sure it is on the partial list
+		if ( page->used == 0 ) {
+			crud_slab_unlink( full ? &cls->full : &cls->partial, page );
+			free( page );
+			cls->slabs --;
+			slab->resident -= CRUD_SLAB_SIZE;
+		} else if ( full ) {
+			crud_slab_unlink( &cls->full, page );
+			crud_slab_link( &cls->partial, page );
+		}
+
+	} else {
+
+		// Large, take it off the in-use list and release it
+		large = (CrudSlabLarge *)((char *)ptr-CRUD_SLAB_LARGE_HEADER);
+		if ( large->prev != NULL ) {
+			large->prev->next = large->next;
+		} else {
+			cls->large = large->next;
+		}
+		if ( large->next != NULL ) {
+			large->next->prev = large->prev;
+		}
+		free( large );
+		slab->resident -= CRUD_SLAB_LARGE_HEADER+CRUD_SLAB_CHUNK(c, size);
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_replace
+// Description  : Get a chunk for new contents of size bytes in place of ptr
+//                (of old bytes).  The chunk itself is returned when the size
+//                class is unchanged, otherwise the contents are NOT copied.
+//
+// Inputs       : slab - the allocator
+//                ptr - the current chunk
+//                old - the size the chunk was allocated with
+//                size - the new size
+// Outputs      : the chunk to use, NULL if failure (ptr is still valid)
+
+void * crud_slab_replace( CrudSlab *slab, void *ptr, uint32_t old, uint32_t size ) {
+
+	// Local variables
+	CrudSlabClass *cls;
+	void *chunk;
+	int c;
+
+	// Same class (and chunk size), just account for the change in size
+	c = crud_slab_class( size );
+	if ( (c == crud_slab_class(old)) && (CRUD_SLAB_CHUNK(c, size) == CRUD_SLAB_CHUNK(c, old)) ) {
+		cls = &slab->classes[c];
+		cls->requested += (int64_t)size - old;
+		slab->requested += (int64_t)size - old;
+		return( ptr );
+	}
+
+	// Otherwise move to a chunk of the new class
+	if ( (chunk = crud_slab_alloc(slab, size)) == NULL ) {
+		return( NULL );
+	}
+	crud_slab_free( slab, ptr, old );
+	return( chunk );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_report
+// Description  : Log the allocator statistics: the occupancy of each class
+//                in use, the bytes resident and the fragmentation (the part
+//                of the resident bytes not holding requested bytes)
+//
+// Inputs       : slab - the allocator
+//                name - the name of the allocator (for the log)
+// Outputs      : none
+
+void crud_slab_report( CrudSlab *slab, const char *name ) {
+
+	// Local variables
+	CrudSlabClass *cls;
+	uint32_t i, capacity;
+
+	// Totals first
+	logMessage( LOG_INFO_LEVEL, "CRUD slab [%s]: %llu bytes requested, %llu bytes resident, "
+			"fragmentation %.1f%%", name, (unsigned long long)slab->requested,
+			(unsigned long long)slab->resident, (slab->resident == 0) ? 0.0 :
+			100.0*(slab->resident-slab->requested)/slab->resident );
+
+	// Then the classes that hold anything
+	for ( i=0; i<crud_slab_classes; i++ ) {
+		cls = &slab->classes[i];
+		if ( (cls->used == 0) && (cls->slabs == 0) ) {
+			continue;
+		}
+		if ( crud_slab_sizes[i] <= CRUD_SLAB_MAX_SMALL ) {
+			capacity = cls->slabs * ((CRUD_SLAB_SIZE-CRUD_SLAB_HEADER)/crud_slab_sizes[i]);
+			logMessage( LOG_INFO_LEVEL, "CRUD slab [%s]:   class %7u : %u/%u chunks used in %u slabs, %llu bytes requested",
+					name, crud_slab_sizes[i], cls->used, capacity, cls->slabs,
+					(unsigned long long)cls->requested );
+		} else {
+			logMessage( LOG_INFO_LEVEL, "CRUD slab [%s]:   class %7u : %u chunks used, %llu bytes requested",
+					name, crud_slab_sizes[i], cls->used,
+					(unsigned long long)cls->requested );
+		}
+	}
+	if ( slab->classes[CRUD_SLAB_HUGE].used > 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD slab [%s]:   huge          : %u chunks used, %llu bytes requested",
+				name, slab->classes[CRUD_SLAB_HUGE].used,
+				(unsigned long long)slab->classes[CRUD_SLAB_HUGE].requested );
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_unit_test
+// Description  : Perform a test of the slab allocator functionality
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_slab_unit_test( void ) {
+
+	// Local variables
+	CrudSlab slab;
+	char *chunks[CRUD_SLAB_UNIT_TEST_CHUNKS], *chunk;
+	uint32_t sizes[CRUD_SLAB_UNIT_TEST_CHUNKS], size;
+	uint8_t fills[CRUD_SLAB_UNIT_TEST_CHUNKS];
+	uint64_t requested;
+	int i, j, k;
+
+	// Setup the allocator
+	crud_slab_init( &slab );
+	memset( chunks, 0x0, sizeof(chunks) );
+
+	// Do a bunch of random allocate/replace/free operations
+	for ( i=0; i<CRUD_SLAB_UNIT_TEST_ITERATIONS; i++ ) {
+		j = getRandomValue( 0, CRUD_SLAB_UNIT_TEST_CHUNKS-1 );
+
+		// Check the contents of the chunk are intact
+		for ( k=0; (chunks[j] != NULL) && (k<sizes[j]); k++ ) {
+			if ( (uint8_t)chunks[j][k] != fills[j] ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD_SLAB_UNIT_TEST : chunk contents corrupted [%d]", j );
+				return( -1 );
+			}
+		}
+
+		// Mostly small sizes, sometimes large (and rarely huge)
+		size = getRandomValue( 0, 9 ) ? getRandomValue( 0, 1024 ) : getRandomValue( 0, CRUD_SLAB_MAX_CHUNK );
+		size = getRandomValue( 0, 99 ) ? size : CRUD_SLAB_MAX_CHUNK+getRandomValue( 1, CRUD_SLAB_MAX_CHUNK );
+		switch ( (chunks[j] == NULL) ? 0 : getRandomValue(1, 2) ) {
+
+		case 0: // Allocate
+			chunk = crud_slab_alloc( &slab, size );
+			break;
+
+		case 1: // Replace
+			chunk = crud_slab_replace( &slab, chunks[j], sizes[j], size );
+			break;
+
+		default: // Free
+			crud_slab_free( &slab, chunks[j], sizes[j] );
+			chunks[j] = NULL;
+			continue;
+		}
+		if ( chunk == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_SLAB_UNIT_TEST : allocation failed [%u]", size );
+			return( -1 );
+		}
+		chunks[j] = chunk;
+		sizes[j] = size;
+		fills[j] = getRandomValue( 0, 0xff );
+		memset( chunks[j], fills[j], sizes[j] );
+	}
+
+	// The accounting must match what is still allocated
+	for ( j=0, requested=0; j<CRUD_SLAB_UNIT_TEST_CHUNKS; j++ ) {
+		requested += (chunks[j] != NULL) ? sizes[j] : 0;
+	}
+	if ( (requested != slab.requested) || (slab.resident < slab.requested) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_SLAB_UNIT_TEST : bad accounting [%llu != %llu]",
+				(unsigned long long)requested, (unsigned long long)slab.requested );
+		return( -1 );
+	}
+	crud_slab_report( &slab, "unit test" );
+
+	// Free everything, nothing should remain
+	for ( j=0; j<CRUD_SLAB_UNIT_TEST_CHUNKS; j++ ) {
+		crud_slab_free( &slab, chunks[j], sizes[j] );
+	}
+	for ( k=0; k<CRUD_SLAB_MAX_CLASSES; k++ ) {
+		if ( (slab.classes[k].slabs != 0) || (slab.classes[k].used != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD_SLAB_UNIT_TEST : class not empty [%u]", crud_slab_sizes[k] );
+			return( -1 );
+		}
+	}
+	if ( slab.resident != 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD_SLAB_UNIT_TEST : memory still resident [%llu]",
+				(unsigned long long)slab.resident );
+		return( -1 );
+	}
+
+	// Cleanup, log and return successfully
+	crud_slab_cleanup( &slab );
+	logMessage( LOG_INFO_LEVEL, "CRUD slab unit test successful." );
+	return( 0 );
+}
+
+//
+// Local Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_class
+// Description  : Find the (smallest) class that holds a size
+//
+// Inputs       : size - the size
+// Outputs      : the class (CRUD_SLAB_HUGE if larger than any)
+
+static int crud_slab_class( uint32_t size ) {
+
+	// Local variables
+	int lo, hi, mid;
+
+	// Linear classes are direct, search the rest
+	if ( size <= CRUD_SLAB_LINEAR ) {
+		return( (size == 0) ? 0 : (size-1)/CRUD_SLAB_ALIGN );
+	}
+	if ( size > CRUD_SLAB_MAX_CHUNK ) {
+		return( CRUD_SLAB_HUGE );
+	}
+	lo = CRUD_SLAB_LINEAR/CRUD_SLAB_ALIGN;
+	hi = crud_slab_classes-1;
+	while ( lo < hi ) {
+		mid = (lo+hi)/2;
+		if ( crud_slab_sizes[mid] < size ) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	return( lo );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_unlink
+// Description  : Remove a slab from a class list
+//
+// Inputs       : list - the list
+//                page - the slab
+// Outputs      : none
+
+static void crud_slab_unlink( CrudSlabPage **list, CrudSlabPage *page ) {
+	if ( page->prev != NULL ) {
+		page->prev->next = page->next;
+	} else {
+		*list = page->next;
+	}
+	if ( page->next != NULL ) {
+		page->next->prev = page->prev;
+	}
+	page->prev = page->next = NULL;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_slab_link
+// Description  : Add a slab to the front of a class list
+//
+// Inputs       : list - the list
+//                page - the slab
+// Outputs      : none
+
+static void crud_slab_link( CrudSlabPage **list, CrudSlabPage *page ) {
+	page->prev = NULL;
+	page->next = *list;
+	if ( page->next != NULL ) {
+		page->next->prev = page;
+	}
+	*list = page;
+	return;
+}
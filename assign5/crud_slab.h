@@ -0,0 +1,92 @@
+#ifndef CRUD_SLAB_INCLUDED
+#define CRUD_SLAB_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_slab.h
+//  Description   : This is the interface to the size-class (slab) allocator
+//                  used for the object store contents.  Small chunks are
+//                  carved out of aligned slabs (released once empty), larger
+//                  chunks are allocated singly at the class size (so growing
+//                  objects are mostly updated in place), and chunks beyond the
+//                  largest class at their own size.  The allocator is not
+//                  thread safe, each store partition has its own.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CRUD_SLAB_SIZE 8192         // The size (and alignment) of a slab
+#define CRUD_SLAB_MAX_SMALL 1024    // The largest chunk carved from a slab
+#define CRUD_SLAB_MAX_CHUNK 0x100000 // The largest size class (larger chunks are huge)
+#define CRUD_SLAB_MAX_CLASSES 128   // The most size classes (the last holds the huge chunks)
+
+//
+// Type definitions
+
+// This is the header at the start of each slab
+typedef struct crud_slab_page {
+	struct crud_slab_page *prev;  // The previous slab in the class list
+	struct crud_slab_page *next;  // The next slab in the class list
+	void                  *free;  // The free chunks in the slab
+	uint16_t               cls;   // The size class of the slab
+	uint16_t               used;  // The chunks in use
+} CrudSlabPage;
+
+// This is the header in front of each large chunk
+typedef struct crud_slab_large {
+	struct crud_slab_large *prev; // The previous chunk in the list
+	struct crud_slab_large *next; // The next chunk in the list
+} CrudSlabLarge;
+
+// This is a size class
+typedef struct {
+	CrudSlabPage  *partial;  // The slabs with free chunks (small classes)
+	CrudSlabPage  *full;     // The slabs with no free chunks (small classes)
+	CrudSlabLarge *large;    // The chunks in use (large classes)
+	uint32_t       slabs;    // The number of slabs (small classes)
+	uint32_t       used;     // The number of chunks in use
+	uint64_t       requested; // The bytes requested for the chunks in use
+} CrudSlabClass;
+
+// This is an allocator
+typedef struct {
+	CrudSlabClass classes[CRUD_SLAB_MAX_CLASSES]; // The size classes
+	uint64_t       resident;  // The bytes allocated from the system
+	uint64_t       requested; // The bytes requested for the chunks in use
+} CrudSlab;
+
+//
+// Allocator interface
+
+int crud_slab_init( CrudSlab *slab );
+	// Initialize an (empty) allocator
+
+void crud_slab_cleanup( CrudSlab *slab );
+	// Release everything the allocator holds (all chunks become invalid)
+
+void * crud_slab_alloc( CrudSlab *slab, uint32_t size );
+	// Allocate a chunk of at least size bytes
+
+void crud_slab_free( CrudSlab *slab, void *ptr, uint32_t size );
+	// Free a chunk (size must be the size it was allocated with)
+
+void * crud_slab_replace( CrudSlab *slab, void *ptr, uint32_t old, uint32_t size );
+	// Get a chunk for new contents of size bytes in place of ptr (of old
+	// bytes); the chunk itself is returned when the size class is unchanged,
+	// otherwise the contents are NOT copied
+
+void crud_slab_report( CrudSlab *slab, const char *name );
+	// Log the allocator statistics (occupancy, resident bytes, fragmentation)
+
+//
+// Unit Testing
+
+int crud_slab_unit_test( void );
+	// Perform a test of the slab allocator functionality
+
+#endif
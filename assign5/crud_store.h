@@ -0,0 +1,118 @@
+#ifndef CRUD_STORE_INCLUDED
+#define CRUD_STORE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_store.h
+//  Description    : This is the interface to the object store that sits
+//                   behind crud_bus_request.  A store may be split into
+//                   partitions by OID, so that each partition can be owned by
+//                   a single thread of the server and accessed without locks.
+//                   Objects are kept in memory (saved to a file on close), or
+//                   in a log-structured store on disk shared by the partitions
+//                   (see crud_log.h).  The saved file is an image that is
+//                   mapped (privately) on load, so objects are only read in
+//                   as touched, and changes only reach it when it is saved.
+//
+//  Author         : Patrick McDaniel
+//  Last Modified  : Sat Sep  6 08:24:25 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+#include <crud_slab.h>
+#include <crud_log.h>
+#include <cmpsc311_hashtable.h>
+
+// Defines
+#define CRUD_STORE_FILENAME "crud_content.crd"
+#define CRUD_STORE_HASH_BITS 12
+#define CRUD_STORE_ALL_PARTITIONS ((uint32_t)-1)
+#define CRUD_STORE_MAX_PATH 256
+
+//
+// Type definitions
+
+// This is an object in the store
+typedef struct {
+	CrudOID   oid;      // The object identifier
+	uint32_t  length;   // The length of the object (in bytes)
+	uint8_t   flags;    // The flags the object was created with
+	uint8_t   mapped;   // Flag indicating the contents are in the image mapping
+	uint8_t   dirty;    // Flag indicating the object changed since it was saved
+	uint32_t  capacity; // The size of the object's slot in the image
+	uint64_t  slot;     // The offset of the object's slot in the image (0 if none)
+	uint64_t  version;  // The version of the contents (new on every change)
+	char     *data;     // The contents of the object
+} CrudObject;
+
+// This is a store image mapped into memory (kept by partition 0)
+typedef struct {
+	char      fname[CRUD_STORE_MAX_PATH]; // The image file ("" if none)
+	int       fd;   // The open image file
+	char     *base; // The mapped image
+	uint64_t  size; // The size of the mapping
+	uint64_t  end;  // The end of the image file (new slots go here)
+} CrudImage;
+
+// This is a single partition of the store.  Partition p of n hands out the
+// OIDs congruent to p (mod n), and holds the priority object if p is 0 (with
+// an allocator and versions of its own, so requests on the priority object
+// only need exclusive access to it, not to the rest of the partition).
+typedef struct {
+	int         initialized;      // Flag indicating the partition is up
+	uint32_t    sessions;         // Number of INITs without a CLOSE (partition 0)
+	uint32_t    partition;        // The number of this partition
+	uint32_t    partitions;       // The number of partitions in the store
+	HTable      objects;          // The objects, keyed by OID
+	CrudObject *priority;         // The (single) priority object
+	CrudOID     next_oid;         // The next OID to hand out
+	uint64_t    version;          // The next object version to hand out
+	CrudSlab    slab;             // The allocator for the objects
+	CrudSlab    priority_slab;    // The allocator for the priority object
+	uint64_t    priority_version; // The next priority object version to hand out
+	CrudLog    *log;              // The log holding the objects (NULL if in memory)
+	CrudImage   image;            // The image the objects were loaded from
+	char       *fname;            // The image loaded on INIT, saved on CLOSE (NULL if none)
+} CrudStore;
+
+//
+// Store interface
+
+int crud_store_setup( CrudStore *stores, uint32_t partitions );
+	// Setup (but do not initialize) a store of some number of partitions
+
+void crud_store_persist( CrudStore *stores, CrudLog *log );
+	// Keep the objects of all partitions in a (setup) log instead of memory
+
+void crud_store_file( CrudStore *stores, char *fname );
+	// Set the image the store is loaded from and saved to (NULL to keep the
+	// objects in memory only)
+
+uint32_t crud_store_owner( CrudStore *stores, CrudRequest request, uint32_t local );
+	// Which partition executes a request (CRUD_STORE_ALL_PARTITIONS if all)
+
+CrudResponse crud_store_request( CrudStore *stores, uint32_t owner, CrudRequest request, void *buf );
+	// Execute a (version 1) request on the owning partition (or all of them)
+
+CrudResponse crud_store_versioned( CrudStore *stores, uint32_t owner, CrudRequest request, void *buf, uint64_t *version );
+	// Execute a (version 1) request carrying an object version (in and out)
+
+int crud_store_execute( CrudStore *stores, uint32_t owner, CrudHeader *cmd, void *buf );
+	// Execute a request of any version, replacing it with the response
+
+int crud_store_save( CrudStore *stores, char *fname );
+	// Write the contents of all partitions of the store to a disk image (only
+	// the changed objects if the image is the one loaded)
+
+int crud_store_load( CrudStore *stores, char *fname );
+	// Map a disk image into the partitions of the store (the object contents
+	// are paged in as they are used)
+
+void crud_store_report( CrudStore *stores );
+	// Log the memory (or log) use of each partition of the store
+
+#endif
@@ -0,0 +1,811 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_trace.c
+//  Description   : This is the implementation of the crud_sim workloads (see
+//                  crud_trace.h).  Text lines are parsed in place, so the
+//                  file is expected to be mapped privately; a binary trace
+//                  is replayed straight out of its mapping, only payloads
+//                  stored as byte runs being expanded.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Project Include Files
+#include <crud_trace.h>
+#include <crud_crc.h>
+#include <crud_driver.h>
+#include <cmpsc311_hashtable.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_TRACE_HASH_BITS 12 // Width of the tables interning names/payloads
+#define CRUD_TRACE_UNIT_TEST_TEXT "crud_trace_test.txt"
+#define CRUD_TRACE_UNIT_TEST_TRACE "crud_trace_test.trc"
+#define CRUD_TRACE_UNIT_TEST_FILES 8
+#define CRUD_TRACE_UNIT_TEST_LINES 2000
+
+//
+// Type definitions
+
+// This is a buffer a section of a trace is built in
+typedef struct {
+	unsigned char *buf;  // The contents
+	uint64_t       len;  // The bytes used
+	uint64_t       size; // The bytes allocated
+} CrudTraceBuffer;
+
+// This is a trace being built
+struct CrudTraceBuilder {
+	CrudTraceBuffer names;    // The file names (each terminated)
+	CrudTraceBuffer records;  // The records
+	CrudTraceBuffer payloads; // The payloads
+	CrudTraceBuffer runs;     // Scratch space for encoding byte runs
+	uint64_t       *offsets;  // The offset of each name in names
+	uint32_t        files;    // The number of names
+	HTable          named;    // The names stored (file index+1, by CRC/length)
+	HTable          stored;   // The payloads stored (offset+1, by CRC/length)
+};
+
+//
+// Global data
+
+const char *CRUD_SIM_COMMAND_LABELS[CRUD_SIM_MAXVAL] = {
+	"FORMAT",
+	"MOUNT",
+	"UNMOUNT",
+	"WRITEAT",
+	"WRITE",
+	"SEEK",
+	"READ"
+};
+
+//
+// Local functions
+
+static void *crud_trace_map( char *fname, size_t *size );
+static int crud_trace_append( CrudTraceBuffer *tb, const void *data, uint64_t len );
+static int crud_trace_name( CrudTraceBuilder *tb, char *fname, uint32_t *file );
+static int crud_trace_payload( CrudTraceBuilder *tb, char *text, int32_t len, CrudTraceRecord *rec );
+static int crud_trace_save( CrudTraceBuilder *tb, char *tname );
+static void crud_trace_release( CrudTraceBuilder *tb );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_parse
+// Description  : Parse a line of a text workload ("<file> <command> <len>
+//                <off> :<text>") in place.  The name is terminated and the
+//                line breaks put back in the text of a WRITE/WRITEAT, but
+//                only once the line parses (so a bad one can be logged
+//                whole).
+//
+// Inputs       : line - the start of the line
+//                eol - the end of the line (the newline, or end)
+//                end - the end of the workload
+//                cmd - the command to fill in
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_parse( char *line, char *eol, char *end, CrudSimulationCommand *cmd ) {
+
+	// Local variables
+	char *pos = line, *tok, *sep, *fend;
+	int32_t *fields[2] = { &cmd->len, &cmd->off };
+	int32_t val, neg, i;
+	size_t len;
+
+	// The filename (terminated where the space after it is)
+	while ( (pos < eol) && ((*pos == ' ') || (*pos == '\t')) ) pos++;
+	for ( tok=pos; (pos < eol) && (*pos != ' ') && (*pos != '\t'); pos++ );
+	if ( (tok == pos) || (pos == eol) ) {
+		return( -1 );
+	}
+	cmd->fname = tok;
+	fend = pos;
+
+	// The command, looked up in the command table
+	while ( (pos < eol) && ((*pos == ' ') || (*pos == '\t')) ) pos++;
+	for ( tok=pos; (pos < eol) && (*pos != ' ') && (*pos != '\t'); pos++ );
+	if ( (len = pos-tok) == 0 ) {
+		return( -1 );
+	}
+	for ( i=0; i<CRUD_SIM_MAXVAL; i++ ) {
+		if ( (strlen(CRUD_SIM_COMMAND_LABELS[i]) == len) && (memcmp(CRUD_SIM_COMMAND_LABELS[i], tok, len) == 0) ) {
+			break;
+		}
+	}
+	cmd->command = i;
+
+	// The length and offset (decimal, possibly signed)
+	for ( i=0; i<2; i++ ) {
+		while ( (pos < eol) && ((*pos == ' ') || (*pos == '\t')) ) pos++;
+		neg = ((pos < eol) && (*pos == '-'));
+		pos += ((pos < eol) && ((*pos == '-') || (*pos == '+')));
+		for ( tok=pos, val=0; (pos < eol) && (*pos >= '0') && (*pos <= '9'); pos++ ) {
+			val = val*10 + (*pos-'0');
+		}
+		if ( tok == pos ) {
+			return( -1 );
+		}
+		*fields[i] = neg ? -val : val;
+	}
+
+	// The text follows the ':' (and may use the newline ending the line),
+	// a write has to have all of its text
+	if ( (sep = memchr(pos, ':', eol-pos)) == NULL ) {
+		return( -1 );
+	}
+	cmd->text = sep+1;
+	if ( (cmd->command == CRUD_SIM_WRITE) || (cmd->command == CRUD_SIM_WRITEAT) ) {
+		if ( (cmd->len < 0) || (cmd->len > (eol-cmd->text) + (eol < end)) ) {
+			logMessage( LOG_ERROR_LEVEL, "Workload str [%d<%d]", (int)((eol-cmd->text) + (eol < end)), cmd->len );
+			return( -1 );
+		}
+		crud_trace_translate( cmd->text, cmd->len );
+	}
+	*fend = 0x0;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_translate
+// Description  : Turn the '*'s standing in for line breaks in workload text
+//                back into newlines, 16 bytes at a time with SSE2.
+//
+// Inputs       : text - the text (changed in place)
+//                len - the length of the text
+// Outputs      : none
+
+void crud_trace_translate( char *text, int32_t len ) {
+
+	// Local variables
+	int32_t i = 0;
+
+#if defined(__SSE2__)
+	// Blend a newline into each byte that matches
+	const __m128i star = _mm_set1_epi8( '*' ), nl = _mm_set1_epi8( '\n' );
+	__m128i v, m;
+	for ( ; i+16 <= len; i+=16 ) {
+		v = _mm_loadu_si128( (const __m128i *)&text[i] );
+		m = _mm_cmpeq_epi8( v, star );
+		if ( _mm_movemask_epi8(m) ) {
+			_mm_storeu_si128( (__m128i *)&text[i], _mm_or_si128(_mm_andnot_si128(m, v), _mm_and_si128(m, nl)) );
+		}
+	}
+#endif
+	for ( ; i<len; i++ ) {
+		if ( text[i] == '*' ) {
+			text[i] = '\n';
+		}
+	}
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_convert
+// Description  : Convert a text workload into a binary trace.  Each name
+//                and each distinct payload is stored once, a payload as
+//                byte runs if that is smaller than the bytes themselves.
+//
+// Inputs       : wload - the text workload
+//                tname - the trace to write
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_convert( char *wload, char *tname ) {
+
+	// Local variables
+	CrudTraceBuilder *tb;
+	CrudSimulationCommand cmd;
+	char *map, *line, *eol, *end;
+	uint32_t linecount = 0;
+	size_t size;
+	int ret = 0;
+
+	// Map the workload, start the trace
+	if ( (map = crud_trace_map(wload, &size)) == NULL ) {
+		return( -1 );
+	}
+	if ( (tb = crud_trace_begin()) == NULL ) {
+		munmap( map, size );
+		return( -1 );
+	}
+
+	// Turn each line into a record
+	end = map + size;
+	for ( line=map; (line < end) && (ret == 0); line=eol+1 ) {
+		if ( (eol = memchr(line, '\n', end-line)) == NULL ) {
+			eol = end;
+		}
+		linecount ++;
+		if ( crud_trace_parse(line, eol, end, &cmd) || (cmd.command == CRUD_SIM_MAXVAL) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace: un-parsable workload string [%.*s], line %u",
+					(int)(eol-line), line, linecount );
+			ret = -1;
+			continue;
+		}
+		ret = crud_trace_add( tb, &cmd );
+	}
+	munmap( map, size );
+
+	// Write out the trace
+	if ( crud_trace_end(tb, (ret == 0) ? tname : NULL) ) {
+		return( -1 );
+	}
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD trace: converted [%s] (%lu bytes) to [%s]", wload, (unsigned long)size, tname );
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_begin
+// Description  : Start building a binary trace, commands are added with
+//                crud_trace_add and it is written with crud_trace_end.
+//
+// Inputs       : none
+// Outputs      : the trace being built, NULL if failure
+
+CrudTraceBuilder *crud_trace_begin( void ) {
+
+	// Local variables
+	CrudTraceBuilder *tb;
+
+	if ( (tb = calloc(1, sizeof(CrudTraceBuilder))) == NULL ) {
+		return( NULL );
+	}
+	initHashTable( &tb->named, CRUD_TRACE_HASH_BITS );
+	initHashTable( &tb->stored, CRUD_TRACE_HASH_BITS );
+	return( tb );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_add
+// Description  : Add a command to a trace being built, interning its name
+//                and payload
+//
+// Inputs       : tb - the trace being built
+//                cmd - the command
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_add( CrudTraceBuilder *tb, CrudSimulationCommand *cmd ) {
+
+	// Local variables
+	CrudTraceRecord rec;
+
+	memset( &rec, 0x0, sizeof(rec) );
+	rec.command = cmd->command;
+	rec.len = cmd->len;
+	rec.off = cmd->off;
+	if ( (tb->records.len/sizeof(CrudTraceRecord) >= UINT32_MAX) || crud_trace_name(tb, cmd->fname, &rec.file) ||
+		 (((cmd->command == CRUD_SIM_WRITE) || (cmd->command == CRUD_SIM_WRITEAT)) &&
+		   crud_trace_payload(tb, cmd->text, cmd->len, &rec)) ||
+		 crud_trace_append(&tb->records, &rec, sizeof(rec)) ) {
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_end
+// Description  : Write out a trace being built, then release it
+//
+// Inputs       : tb - the trace being built
+//                tname - the file to write (NULL to only release it)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_end( CrudTraceBuilder *tb, char *tname ) {
+
+	// Local variables
+	int ret = 0;
+
+	if ( (tname != NULL) && ((ret = crud_trace_save(tb, tname)) == 0) ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD trace: wrote [%s], %lu records, %u files, %lu payload bytes (%lu bytes)",
+				tname, tb->records.len/sizeof(CrudTraceRecord), tb->files, tb->payloads.len,
+				sizeof(CrudTraceHeader)+tb->records.len+tb->names.len+tb->payloads.len );
+	}
+	crud_trace_release( tb );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_attach
+// Description  : Check a binary trace (header, sections and names) and get
+//                it ready for replay.  The records are checked as they are
+//                read (see crud_trace_command).
+//
+// Inputs       : trace - the trace to attach
+//                map - the trace (mapped)
+//                size - the size of the trace
+// Outputs      : 0 if successful, -1 if failure (or not a trace)
+
+int crud_trace_attach( CrudTrace *trace, void *map, size_t size ) {
+
+	// Local variables
+	CrudTraceHeader *hdr = map;
+	char *name, *end;
+	uint32_t i;
+
+	// Check the header and that the sections are where they should be
+	memset( trace, 0x0, sizeof(CrudTrace) );
+	if ( (size < sizeof(CrudTraceHeader)) || memcmp(hdr->magic, CRUD_TRACE_MAGIC, sizeof(hdr->magic)) ) {
+		return( -1 );
+	}
+	if ( (hdr->order != CRUD_TRACE_ORDER) || (hdr->size != size) || (hdr->files > CRUD_TRACE_MAX_FILES) ||
+		 (hdr->ops != sizeof(CrudTraceHeader)) ||
+		 (hdr->names != hdr->ops + (uint64_t)hdr->records*sizeof(CrudTraceRecord)) ||
+		 (hdr->payloads < hdr->names) || (hdr->payloads > size) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: bad trace header (or byte order)" );
+		return( -1 );
+	}
+
+	// Find the names (each has to be terminated within the table)
+	if ( (trace->names = malloc(sizeof(char *)*(hdr->files+1))) == NULL ) {
+		return( -1 );
+	}
+	name = (char *)map + hdr->names;
+	end = (char *)map + hdr->payloads;
+	for ( i=0; i<hdr->files; i++ ) {
+		trace->names[i] = name;
+		if ( (name = memchr(name, 0x0, end-name)) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace: bad file name table" );
+			free( trace->names );
+			trace->names = NULL;
+			return( -1 );
+		}
+		name ++;
+	}
+
+	// Return successfully
+	trace->header = hdr;
+	trace->records = (CrudTraceRecord *)((char *)map + hdr->ops);
+	trace->payloads = (unsigned char *)map + hdr->payloads;
+	trace->plength = size - hdr->payloads;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_command
+// Description  : Get a command of an attached trace.  A literal payload is
+//                used where it is, one stored as byte runs is expanded.
+//
+// Inputs       : trace - the attached trace
+//                rec - the record number
+//                cmd - the command to fill in
+//                buf - the buffer to expand runs into (CRUD_MAX_OBJECT_SIZE)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_command( CrudTrace *trace, uint32_t rec, CrudSimulationCommand *cmd, char *buf ) {
+
+	// Local variables
+	CrudTraceRecord *r = &trace->records[rec];
+	unsigned char *run;
+	uint64_t left;
+	int32_t pos;
+
+	// Check the record
+	if ( (rec >= trace->header->records) || (r->command >= CRUD_SIM_MAXVAL) ||
+		 (r->file >= trace->header->files) || (r->payload >= CRUD_TRACE_MAXVAL) ||
+		 ((r->payload != CRUD_TRACE_NONE) && ((r->len < 0) || (r->len > CRUD_MAX_OBJECT_SIZE) ||
+		   (r->data > trace->plength))) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: bad record %u", rec );
+		return( -1 );
+	}
+	cmd->fname = trace->names[r->file];
+	cmd->command = r->command;
+	cmd->len = r->len;
+	cmd->off = r->off;
+	cmd->text = NULL;
+
+	// Find (or expand) the payload
+	left = trace->plength - r->data;
+	switch ( r->payload ) {
+
+	case CRUD_TRACE_LITERAL:
+		if ( r->len > left ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace: bad payload in record %u", rec );
+			return( -1 );
+		}
+		cmd->text = (char *)&trace->payloads[r->data];
+		break;
+
+	case CRUD_TRACE_RUNS:
+		for ( pos=0, run=&trace->payloads[r->data]; pos<r->len; pos+=run[1], run+=2, left-=2 ) {
+			if ( (left < 2) || (run[1] == 0) || (run[1] > r->len-pos) ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD trace: bad payload runs in record %u", rec );
+				return( -1 );
+			}
+			memset( &buf[pos], run[0], run[1] );
+		}
+		cmd->text = buf;
+		break;
+
+	default:
+		break;
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_detach
+// Description  : Release what attaching the trace allocated
+//
+// Inputs       : trace - the attached trace
+// Outputs      : none
+
+void crud_trace_detach( CrudTrace *trace ) {
+	free( trace->names );
+	memset( trace, 0x0, sizeof(CrudTrace) );
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_unit_test
+// Description  : Write a random text workload, convert it, then check the
+//                trace gives back every command of the text.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_trace_unit_test( void ) {
+
+	// Local variables
+	CrudSimulationCommand expect, got;
+	CrudTrace trace;
+	FILE *fh;
+	char *text, *tmap, *line, *eol, *end, *buf;
+	size_t tsize, size;
+	int32_t len, i, j, runs, seed;
+	int ret = 0;
+
+	// Write out a workload of every command, text (some of it runs) and '*'s
+	if ( (fh = fopen(CRUD_TRACE_UNIT_TEST_TEXT, "w")) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace unit test: cannot create workload [%s]", strerror(errno) );
+		return( -1 );
+	}
+	fprintf( fh, "x FORMAT 0 0:\nx MOUNT 0 0:\n" );
+	for ( i=0; i<CRUD_TRACE_UNIT_TEST_LINES; i++ ) {
+		j = getRandomValue( CRUD_SIM_WRITEAT, CRUD_SIM_READ );
+		len = getRandomValue( 0, 1000 );
+		fprintf( fh, "file%d.txt %s %d %d :", getRandomValue(0, CRUD_TRACE_UNIT_TEST_FILES-1),
+				CRUD_SIM_COMMAND_LABELS[j], len, getRandomValue(0, 4000) );
+		runs = getRandomValue( 0, 1 );
+		seed = getRandomValue( 0, 0xffff );
+		for ( j=0; j<len; j++ ) {
+			fputc( (j%23 == 22) ? '*' : (runs ? 'a'+j/300 : 'A'+(seed+j*j)%58), fh );
+		}
+		fputc( '\n', fh );
+	}
+	fprintf( fh, "x UNMOUNT 0 0:" );
+	fclose( fh );
+
+	// Convert it, then check the trace against the text (parsed again)
+	if ( crud_trace_convert(CRUD_TRACE_UNIT_TEST_TEXT, CRUD_TRACE_UNIT_TEST_TRACE) ||
+		 ((text = crud_trace_map(CRUD_TRACE_UNIT_TEST_TEXT, &size)) == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace unit test: conversion failed" );
+		return( -1 );
+	}
+	if ( ((tmap = crud_trace_map(CRUD_TRACE_UNIT_TEST_TRACE, &tsize)) == NULL) ||
+		 crud_trace_attach(&trace, tmap, tsize) || (trace.header->records != CRUD_TRACE_UNIT_TEST_LINES+3) ||
+		 (trace.header->files != CRUD_TRACE_UNIT_TEST_FILES+1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace unit test: bad trace" );
+		munmap( text, size );
+		return( -1 );
+	}
+	buf = malloc( CRUD_MAX_OBJECT_SIZE );
+	end = text + size;
+	for ( i=0, line=text; (line < end) && (ret == 0); line=eol+1, i++ ) {
+		if ( (eol = memchr(line, '\n', end-line)) == NULL ) {
+			eol = end;
+		}
+		if ( crud_trace_parse(line, eol, end, &expect) || crud_trace_command(&trace, i, &got, buf) ||
+			 strcmp(expect.fname, got.fname) || (expect.command != got.command) ||
+			 (expect.len != got.len) || (expect.off != got.off) ||
+			 (((got.command == CRUD_SIM_WRITE) || (got.command == CRUD_SIM_WRITEAT)) &&
+			   memcmp(expect.text, got.text, got.len)) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace unit test: record %d does not match the text", i );
+			ret = -1;
+		}
+	}
+	if ( (ret == 0) && (i != CRUD_TRACE_UNIT_TEST_LINES+3) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace unit test: %d lines for %u records", i, trace.header->records );
+		ret = -1;
+	}
+
+	// Cleanup, return the result
+	free( buf );
+	crud_trace_detach( &trace );
+	munmap( tmap, tsize );
+	munmap( text, size );
+	unlink( CRUD_TRACE_UNIT_TEST_TEXT );
+	unlink( CRUD_TRACE_UNIT_TEST_TRACE );
+	if ( ret == 0 ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD trace unit test completed successfully." );
+	}
+	return( ret );
+}
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_map
+// Description  : Map a workload privately (so it can be changed in place)
+//
+// Inputs       : fname - the workload
+//                size - the size of the workload (returned)
+// Outputs      : the mapping, NULL if failure (or empty)
+
+static void *crud_trace_map( char *fname, size_t *size ) {
+
+	// Local variables
+	struct stat st;
+	void *map;
+	int fd;
+
+	// Open and map the file
+	if ( ((fd = open(fname, O_RDONLY)) == -1) || (fstat(fd, &st) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: failure opening [%s], error: %s.", fname, strerror(errno) );
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		return( NULL );
+	}
+	if ( st.st_size == 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: empty workload [%s]", fname );
+		close( fd );
+		return( NULL );
+	}
+	map = mmap( NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: failure mapping [%s], error: %s.", fname, strerror(errno) );
+		return( NULL );
+	}
+	*size = st.st_size;
+	return( map );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_append
+// Description  : Append bytes to a section being built (doubling its size
+//                as needed)
+//
+// Inputs       : tb - the section
+//                data - the bytes to add
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_trace_append( CrudTraceBuffer *tb, const void *data, uint64_t len ) {
+
+	// Local variables
+	unsigned char *buf;
+	uint64_t size;
+
+	// Grow the buffer, then copy
+	if ( tb->len + len > tb->size ) {
+		for ( size=(tb->size ? tb->size : 4096); size<tb->len+len; size*=2 );
+		if ( (buf = realloc(tb->buf, size)) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace: allocation failed (%lu bytes)", size );
+			return( -1 );
+		}
+		tb->buf = buf;
+		tb->size = size;
+	}
+	memcpy( &tb->buf[tb->len], data, len );
+	tb->len += len;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_name
+// Description  : Intern a file name, adding it to the table if it is new
+//
+// Inputs       : tb - the trace being built
+//                fname - the file name
+//                file - the index of the name (returned)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_trace_name( CrudTraceBuilder *tb, char *fname, uint32_t *file ) {
+
+	// Local variables
+	size_t len = strlen( fname );
+	HtIndexValue key = ((HtIndexValue)len << 32) | crud_crc32c( 0, fname, len );
+	uint64_t *offsets;
+	uintptr_t found;
+	uint32_t i;
+
+	// Names are found by CRC, falling back on a search if two share one
+	if ( (found = (uintptr_t)findValueInHashTable(&tb->named, key)) != 0 ) {
+		if ( strcmp((char *)&tb->names.buf[tb->offsets[found-1]], fname) == 0 ) {
+			*file = found-1;
+			return( 0 );
+		}
+		for ( i=0; i<tb->files; i++ ) {
+			if ( strcmp((char *)&tb->names.buf[tb->offsets[i]], fname) == 0 ) {
+				*file = i;
+				return( 0 );
+			}
+		}
+	}
+
+	// Add the name
+	if ( tb->files >= CRUD_TRACE_MAX_FILES ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: too many files in the workload" );
+		return( -1 );
+	}
+	if ( (tb->files & (tb->files-1)) == 0 ) {
+
+		// The offsets double each time they fill (at each power of 2)
+		if ( (offsets = realloc(tb->offsets, sizeof(uint64_t)*(tb->files ? tb->files*2 : 1))) == NULL ) {
+			return( -1 );
+		}
+		tb->offsets = offsets;
+	}
+	tb->offsets[tb->files] = tb->names.len;
+	if ( crud_trace_append(&tb->names, fname, len+1) ) {
+		return( -1 );
+	}
+	if ( found == 0 ) {
+		insertValueInHashTable( &tb->named, key, (void *)(uintptr_t)(tb->files+1) );
+	}
+	*file = tb->files++;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_payload
+// Description  : Store the payload of a record, as byte runs if that is
+//                smaller, reusing an identical payload already stored.
+//
+// Inputs       : tb - the trace being built
+//                text - the payload
+//                len - the length of the payload
+//                rec - the record (its payload fields are set)
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_trace_payload( CrudTraceBuilder *tb, char *text, int32_t len, CrudTraceRecord *rec ) {
+
+	// Local variables
+	unsigned char run[2];
+	const void *enc = text;
+	uint64_t elen = len;
+	HtIndexValue key;
+	uintptr_t found;
+	int32_t i, j;
+
+	// Encode the runs, keeping them if they are smaller
+	tb->runs.len = 0;
+	for ( i=0; (i < len) && (tb->runs.len < (uint64_t)len); i=j ) {
+		for ( j=i+1; (j < len) && (j-i < CRUD_TRACE_MAX_RUN) && (text[j] == text[i]); j++ );
+		run[0] = text[i];
+		run[1] = j-i;
+		if ( crud_trace_append(&tb->runs, run, sizeof(run)) ) {
+			return( -1 );
+		}
+	}
+	rec->payload = CRUD_TRACE_LITERAL;
+	if ( (len > 0) && (tb->runs.len < (uint64_t)len) ) {
+		rec->payload = CRUD_TRACE_RUNS;
+		enc = tb->runs.buf;
+		elen = tb->runs.len;
+	}
+
+	// Use the copy already stored, if there is one
+	key = ((HtIndexValue)rec->payload << 56) | ((HtIndexValue)len << 32) | crud_crc32c( 0, enc, elen );
+	if ( ((found = (uintptr_t)findValueInHashTable(&tb->stored, key)) != 0) &&
+		 (found-1+elen <= tb->payloads.len) && (memcmp(&tb->payloads.buf[found-1], enc, elen) == 0) ) {
+		rec->data = found-1;
+		return( 0 );
+	}
+
+	// Store it
+	if ( tb->payloads.len+elen > UINT32_MAX ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: too much payload in the workload" );
+		return( -1 );
+	}
+	rec->data = tb->payloads.len;
+	if ( crud_trace_append(&tb->payloads, enc, elen) ) {
+		return( -1 );
+	}
+	if ( found == 0 ) {
+		insertValueInHashTable( &tb->stored, key, (void *)(uintptr_t)(rec->data+1) );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_save
+// Description  : Write out a trace (header, records, names then payloads)
+//
+// Inputs       : tb - the trace built
+//                tname - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+static int crud_trace_save( CrudTraceBuilder *tb, char *tname ) {
+
+	// Local variables
+	CrudTraceHeader hdr;
+	CrudTraceBuffer *sections[3] = { &tb->records, &tb->names, &tb->payloads };
+	int fd, i;
+
+	// Setup the header
+	memset( &hdr, 0x0, sizeof(hdr) );
+	memcpy( hdr.magic, CRUD_TRACE_MAGIC, sizeof(hdr.magic) );
+	hdr.order = CRUD_TRACE_ORDER;
+	hdr.files = tb->files;
+	hdr.records = tb->records.len / sizeof(CrudTraceRecord);
+	hdr.ops = sizeof(hdr);
+	hdr.names = hdr.ops + tb->records.len;
+	hdr.payloads = hdr.names + tb->names.len;
+	hdr.size = hdr.payloads + tb->payloads.len;
+
+	// Write the sections out
+	if ( (fd = open(tname, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: failure creating [%s], error: %s.", tname, strerror(errno) );
+		return( -1 );
+	}
+	if ( write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD trace: failure writing [%s], error: %s.", tname, strerror(errno) );
+		close( fd );
+		return( -1 );
+	}
+	for ( i=0; i<3; i++ ) {
+		if ( (sections[i]->len > 0) && (write(fd, sections[i]->buf, sections[i]->len) != (ssize_t)sections[i]->len) ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD trace: failure writing [%s], error: %s.", tname, strerror(errno) );
+			close( fd );
+			return( -1 );
+		}
+	}
+	close( fd );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_trace_release
+// Description  : Release a trace being built (and the builder itself)
+//
+// Inputs       : tb - the trace
+// Outputs      : none
+
+static void crud_trace_release( CrudTraceBuilder *tb ) {
+	free( tb->names.buf );
+	free( tb->records.buf );
+	free( tb->payloads.buf );
+	free( tb->runs.buf );
+	free( tb->offsets );
+	cleanupHashTable( &tb->named );
+	cleanupHashTable( &tb->stored );
+	free( tb );
+	return;
+}
@@ -0,0 +1,140 @@
+#ifndef CRUD_TRACE_INCLUDED
+#define CRUD_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_trace.h
+//  Description   : This is the interface to the workloads run by crud_sim.
+//                  A workload is either the text format (a line per command,
+//                  the file name and text spelled out on every line) or a
+//                  binary trace converted from it: fixed width records that
+//                  refer to an interned table of file names and to payloads
+//                  stored once each (literally, or as byte runs), so that
+//                  replaying it costs next to nothing but the CRUD calls.
+//
+//  Author        : Patrick McDaniel
+//  Last Modified : Thu Oct 30 06:59:59 EDT 2014
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+
+// Defines
+#define CRUD_TRACE_MAGIC "CRUDTRC2" // The first bytes of a binary trace
+#define CRUD_TRACE_ORDER 0x01020304 // Written as is, to detect the byte order
+#define CRUD_TRACE_MAX_FILES 0xfffffffe // The most file names a trace can hold
+#define CRUD_TRACE_MAX_RUN 0xff     // The longest byte run of an encoding
+
+//
+// Type definitions
+
+// These are the workload commands
+typedef enum {
+	CRUD_SIM_FORMAT  = 0, // Format the filesystem
+	CRUD_SIM_MOUNT   = 1, // Mount the filesystem
+	CRUD_SIM_UNMOUNT = 2, // Close the files and unmount the filesystem
+	CRUD_SIM_WRITEAT = 3, // Seek, then write the text
+	CRUD_SIM_WRITE   = 4, // Write the text
+	CRUD_SIM_SEEK    = 5, // Seek
+	CRUD_SIM_READ    = 6, // Read
+	CRUD_SIM_MAXVAL  = 7, // Max value (an unknown command)
+} CRUD_SIM_COMMANDS;
+extern const char *CRUD_SIM_COMMAND_LABELS[CRUD_SIM_MAXVAL];
+
+// This is a command of the workload (pointing into the workload itself)
+typedef struct {
+	char              *fname;   // The file name (terminated)
+	CRUD_SIM_COMMANDS  command; // The command
+	int32_t            len;     // The length (or expected result)
+	int32_t            off;     // The offset
+	char              *text;    // The text to write (WRITE/WRITEAT, len bytes)
+} CrudSimulationCommand;
+
+// These are the ways a trace payload is stored
+typedef enum {
+	CRUD_TRACE_NONE    = 0, // No payload
+	CRUD_TRACE_LITERAL = 1, // The bytes themselves
+	CRUD_TRACE_RUNS    = 2, // (byte, count) pairs, until the length is reached
+	CRUD_TRACE_MAXVAL  = 3, // Max value
+} CRUD_TRACE_PAYLOAD_TYPES;
+
+// This is the header of a binary trace (host byte order, see order)
+typedef struct {
+	char     magic[8]; // CRUD_TRACE_MAGIC (not terminated)
+	uint32_t order;    // CRUD_TRACE_ORDER
+	uint32_t files;    // The number of file names
+	uint32_t records;  // The number of records
+	uint32_t unused;   // Unused (0)
+	uint64_t names;    // The offset of the file names (each terminated)
+	uint64_t ops;      // The offset of the records
+	uint64_t payloads; // The offset of the payloads
+	uint64_t size;     // The size of the trace
+} CrudTraceHeader;
+
+// This is a record of a binary trace, a command
+typedef struct {
+	uint8_t  command; // The command (CRUD_SIM_COMMANDS)
+	uint8_t  payload; // How the payload is stored (CRUD_TRACE_PAYLOAD_TYPES)
+	uint16_t unused;  // Unused (0)
+	uint32_t file;    // The file (index into the names)
+	int32_t  len;     // The length (or expected result)
+	int32_t  off;     // The offset
+	uint32_t data;    // The payload (offset into the payloads)
+} CrudTraceRecord;
+
+// This is a binary trace attached for replay
+typedef struct {
+	CrudTraceHeader *header;   // The header (the start of the trace)
+	CrudTraceRecord *records;  // The records
+	char           **names;    // The file names (pointing into the trace)
+	unsigned char   *payloads; // The payloads
+	uint64_t         plength;  // The size of the payloads
+} CrudTrace;
+
+// This is a binary trace being built (see crud_trace_begin)
+typedef struct CrudTraceBuilder CrudTraceBuilder;
+
+//
+// Text workload interface
+
+int crud_trace_parse( char *line, char *eol, char *end, CrudSimulationCommand *cmd );
+	// Parse a text workload line in place (terminating the name, putting
+	// back the line breaks in the text)
+
+void crud_trace_translate( char *text, int32_t len );
+	// Turn the '*'s standing in for line breaks back into newlines
+
+//
+// Binary trace interface
+
+int crud_trace_convert( char *wload, char *tname );
+	// Convert a text workload into a binary trace
+
+CrudTraceBuilder *crud_trace_begin( void );
+	// Start building a binary trace (NULL if failure)
+
+int crud_trace_add( CrudTraceBuilder *tb, CrudSimulationCommand *cmd );
+	// Add a command to a trace being built (the name and payload are copied)
+
+int crud_trace_end( CrudTraceBuilder *tb, char *tname );
+	// Write out a trace being built (unless tname is NULL) and release it
+
+int crud_trace_attach( CrudTrace *trace, void *map, size_t size );
+	// Check a (mapped) binary trace and get it ready for replay, -1 if it
+	// is not one
+
+int crud_trace_command( CrudTrace *trace, uint32_t rec, CrudSimulationCommand *cmd, char *buf );
+	// Get a command of an attached trace (runs are expanded into buf, which
+	// holds CRUD_MAX_OBJECT_SIZE bytes)
+
+void crud_trace_detach( CrudTrace *trace );
+	// Release what attaching allocated (not the trace itself)
+
+//
+// Unit Testing
+
+int crud_trace_unit_test( void );
+	// Convert a random workload and check the trace replays it
+
+#endif
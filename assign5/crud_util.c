@@ -9,9 +9,43 @@
 //
 
 // Includes
+#include <time.h>
 
 // Project includes
 #include <crud_driver.h>
+#include <crud_codec.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_CODEC_TEST_ITERATIONS 10000
+#define CRUD_CODEC_TEST_BATCH 37 // Odd, so the batch tails are exercised
+
+//
+// Global data
+
+// The request and flag labels (for logging, the flags by combination)
+const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL] = {
+	"CRUD_INIT",
+	"CRUD_FORMAT",
+	"CRUD_CREATE",
+	"CRUD_READ",
+	"CRUD_UPDATE",
+	"CRUD_DELETE",
+	"CRUD_CLOSE",
+	"CRUD_UNKNOWN",
+	"CRUD_INVALIDATE"
+};
+const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX] = {
+	"CRUD_NULL_FLAG",
+	"CRUD_PRIORITY_OBJECT",
+	"CRUD_IF_CHANGED",
+	"CRUD_PRIORITY_OBJECT|CRUD_IF_CHANGED",
+	"CRUD_IF_VERSION",
+	"CRUD_PRIORITY_OBJECT|CRUD_IF_VERSION",
+	"CRUD_IF_CHANGED|CRUD_IF_VERSION",
+	"CRUD_PRIORITY_OBJECT|CRUD_IF_CHANGED|CRUD_IF_VERSION"
+};
 
 // Functions
 
@@ -32,15 +66,7 @@ CrudRequest construct_crud_request(CrudOID oid, CRUD_REQUEST_TYPES req,
 		uint32_t length, uint8_t flags, uint8_t res) {
 
 	// Build up the request fields
-	CrudRequest request = 0;
-	request = ((uint64_t) oid) << 32;
-	request |= req << 28;
-	request |= length << 4;
-	request |= flags << 1;
-	request |= res;
-
-	// Return successfully
-	return (request);
+	return (crud_codec_encode(oid, req, length, flags, res));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -61,14 +87,194 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 		uint8_t *res) {
 
 	// Pull out the fields
-	uint32_t bottom;
-	*oid = request >> 32;
-	bottom = (uint32_t) request & 0xffffffff;
-	*req = bottom >> 28;
-	*length = (bottom << 4) >> 8;
-	*flags = (bottom & 0xe) >> 1;
-	*res = (bottom & 1);
+	*oid = crud_codec_oid(request);
+	*req = crud_codec_req(request);
+	*length = crud_codec_length(request);
+	*flags = crud_codec_flags(request);
+	*res = crud_codec_result(request);
 
 	// Return successfully
 	return (0);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pack_crud_header
+// Description  : Put the request/response fields in the wire format of a
+//                protocol version (see crud_driver.h).  Version 1 only holds
+//                32-bit OIDs and 24-bit lengths.
+//
+// Inputs       : hdr - the fields
+//                format - the protocol version (and CRUD_PROTOCOL_VERSIONS)
+//                wire - the words to fill (see size_crud_header)
+// Outputs      : none
+
+void pack_crud_header(CrudHeader *hdr, int format, uint64_t *wire) {
+
+	// Local variables
+	int words = 1;
+
+	// Version 1 is the single word, version 2 moves the OID and length out
+	if ((format & CRUD_PROTOCOL_VERSION_MASK) < CRUD_PROTOCOL_V2) {
+		wire[0] = crud_codec_encode((uint32_t)hdr->oid, hdr->req, (uint32_t)hdr->length,
+				hdr->flags, hdr->res);
+	} else {
+		wire[0] = crud_codec_encode(0, hdr->req, 0, hdr->flags, hdr->res);
+		wire[words++] = hdr->oid;
+		wire[words++] = hdr->length;
+	}
+
+	// The object version (if agreed) comes last
+	if (format & CRUD_PROTOCOL_VERSIONS) {
+		wire[words++] = hdr->objver;
+	}
+	crud_codec_swap_batch(wire, words);
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unpack_crud_header
+// Description  : Extract the request/response fields from the wire format
+//                of a protocol version (see crud_driver.h)
+//
+// Inputs       : wire - the words received (see size_crud_header)
+//                format - the protocol version (and CRUD_PROTOCOL_VERSIONS)
+//                hdr - the place to put the fields
+// Outputs      : none
+
+void unpack_crud_header(uint64_t *wire, int format, CrudHeader *hdr) {
+
+	// Local variables
+	int words = 1;
+
+	// The first word has everything in version 1
+	crud_codec_decode_batch(wire, hdr, 1);
+	if ((format & CRUD_PROTOCOL_VERSION_MASK) >= CRUD_PROTOCOL_V2) {
+		hdr->oid = crud_codec_swap(wire[words++]);
+		hdr->length = crud_codec_swap(wire[words++]);
+	}
+	hdr->objver = (format & CRUD_PROTOCOL_VERSIONS) ? crud_codec_swap(wire[words]) : 0;
+	return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : size_crud_header
+// Description  : Work out the size of the wire header of a protocol version
+//                (1 or 3 words, plus the object version if agreed)
+//
+// Inputs       : format - the protocol version (and CRUD_PROTOCOL_VERSIONS)
+// Outputs      : the size in bytes
+
+uint32_t size_crud_header(int format) {
+	return ((((format & CRUD_PROTOCOL_VERSION_MASK) >= CRUD_PROTOCOL_V2) ? 3 : 1) +
+			((format & CRUD_PROTOCOL_VERSIONS) ? 1 : 0)) * sizeof(uint64_t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : first_crud_version
+// Description  : Pick the first object version for a store being started.
+//                Versions count up from the time (in nsecs), so a version
+//                handed out by an earlier run is not handed out again.
+//
+// Inputs       : none
+// Outputs      : the first version (never 0)
+
+uint64_t first_crud_version(void) {
+
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_codec_unit_test
+// Description  : Check the header codec (crud_codec.h) against a reference
+//                encoding built a field at a time, single and batched, and
+//                the whole headers of each wire format.
+//
+// Inputs       : none
+// Outputs      : 0 if successful test, -1 if failure
+
+int crud_codec_unit_test(void) {
+
+	// Local variables
+	CrudHeader hdrs[CRUD_CODEC_TEST_BATCH], back[CRUD_CODEC_TEST_BATCH];
+	uint64_t wire[CRUD_CODEC_TEST_BATCH], ref[CRUD_CODEC_TEST_BATCH];
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint64_t last;
+	uint8_t flags, res;
+	int i, j, format;
+
+	for (i = 0; i < CRUD_CODEC_TEST_ITERATIONS; i++) {
+
+		// Random fields, the reference is shifted together by hand
+		for (j = 0; j < CRUD_CODEC_TEST_BATCH; j++) {
+			hdrs[j].oid = getRandomValue(0, 0xffffffff);
+			hdrs[j].req = getRandomValue(CRUD_INIT, CRUD_MAXVAL - 1);
+			hdrs[j].length = getRandomValue(0, 0xffffff);
+			hdrs[j].flags = getRandomValue(0, 7);
+			hdrs[j].res = getRandomValue(0, 1);
+			ref[j] = (hdrs[j].oid << 32) | ((uint64_t)hdrs[j].req << 28) |
+					(hdrs[j].length << 4) | ((uint64_t)hdrs[j].flags << 1) | hdrs[j].res;
+
+			// Single header encode and decode
+			if (construct_crud_request((CrudOID)hdrs[j].oid, hdrs[j].req,
+					(uint32_t)hdrs[j].length, hdrs[j].flags, hdrs[j].res) != ref[j]) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD codec: encode mismatch [0x%lx]", ref[j]);
+				return (-1);
+			}
+			deconstruct_crud_request(ref[j], &oid, &req, &length, &flags, &res);
+			if ((oid != hdrs[j].oid) || (req != hdrs[j].req) || (length != hdrs[j].length) ||
+					(flags != hdrs[j].flags) || (res != hdrs[j].res)) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD codec: decode mismatch [0x%lx]", ref[j]);
+				return (-1);
+			}
+			if (crud_codec_length(crud_codec_set_length(ref[j], 0)) ||
+					(crud_codec_set_length(ref[j], 0) != (ref[j] & ~(0xffffffULL << 4)))) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD codec: set length mismatch [0x%lx]", ref[j]);
+				return (-1);
+			}
+		}
+
+		// Batches, of every length up to the maximum over the iterations
+		j = 1 + (i % CRUD_CODEC_TEST_BATCH);
+		crud_codec_encode_batch(hdrs, wire, j);
+		crud_codec_decode_batch(wire, back, j);
+		while (j-- > 0) {
+			if ((wire[j] != htonll64(ref[j])) || (back[j].oid != hdrs[j].oid) ||
+					(back[j].req != hdrs[j].req) || (back[j].length != hdrs[j].length) ||
+					(back[j].flags != hdrs[j].flags) || (back[j].res != hdrs[j].res)) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD codec: batch mismatch at %d [0x%lx]", j, ref[j]);
+				return (-1);
+			}
+		}
+
+		// Whole headers in each wire format, the last word is the version (if any)
+		hdrs[0].objver = ((uint64_t)getRandomValue(0, 0xffffffff) << 32) | i;
+		for (j = 0; j < 4; j++) {
+			format = ((j & 1) ? CRUD_PROTOCOL_V2 : CRUD_PROTOCOL_V1) | ((j & 2) ? CRUD_PROTOCOL_VERSIONS : 0);
+			last = (j & 2) ? hdrs[0].objver : ((j & 1) ? hdrs[0].length : ref[0]);
+			pack_crud_header(&hdrs[0], format, wire);
+			unpack_crud_header(wire, format, &back[0]);
+			if ((wire[size_crud_header(format) / sizeof(uint64_t) - 1] != htonll64(last)) ||
+					(back[0].oid != hdrs[0].oid) || (back[0].req != hdrs[0].req) ||
+					(back[0].length != hdrs[0].length) || (back[0].flags != hdrs[0].flags) ||
+					(back[0].res != hdrs[0].res) || (back[0].objver != ((j & 2) ? hdrs[0].objver : 0))) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD codec: header mismatch in format 0x%x [0x%lx]", format, ref[0]);
+				return (-1);
+			}
+		}
+	}
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "CRUD codec unit test completed successfully.");
+	return (0);
+}